@@ -0,0 +1,655 @@
+#define _GNU_SOURCE
+
+#include "../src/cli.h"
+#include "../src/codec.h"
+#include "../src/console.h"
+#include "../src/game.h"
+#include "../src/histogram.h"
+#include "../src/protocol.h"
+#include "../src/reactor.h"
+#include "../src/socket.h"
+#include "../src/timer.h"
+#include <arpa/inet.h>
+#include <stdio.h>
+#include <sys/resource.h>
+#include <time.h>
+
+// Drives the server with a number of connections that play games one after
+// another without a terminal. Each connection authenticates, asks for a match
+// and, as the guesser, guesses at a fixed rate while the chooser answers each
+// wrong guess with a hint. Once the word is guessed both players reconnect.
+//
+// The latency of a guess is from sending it to its answer. A game only has a
+// single guess in flight, so an answer that's late delays the guesses after
+// it too. The corrected latencies count the guesses that would have been sent
+// meanwhile, like HdrHistogram does, so a stall isn't hidden by the guesses
+// it held back.
+//
+// With `--slow`, that many more pairs of connections play a game of their own
+// where the guesser hardly reads and the chooser floods it with hints. The
+// server has to hold back and drop the slow readers without the other games
+// slowing down, which `--max-p99-us` checks. A pair starts over once its slow
+// reader is dropped.
+//
+// With `--idle`, that many more connections never send the password. The
+// server times them out and they connect again, so there are always about
+// that many half-open handshakes alongside the games.
+
+#define HOST inet_addr("127.0.0.1")
+/// Milliseconds before a connection that failed or was turned away is opened
+/// again.
+#define RETRY_DELAY 10
+/// Milliseconds between the reads of a slow reader.
+#define SLOW_READ_INTERVAL 100
+/// Bytes that a slow reader takes in each read.
+#define SLOW_READ_BYTES 64
+/// The kernel buffer that a slow reader receives into, so the server's queue
+/// for it fills up soon.
+#define SLOW_RCVBUF_SIZE 4096
+/// Milliseconds between the bursts of hints of a flooder.
+#define FLOOD_INTERVAL 10
+/// Hints in each burst of a flooder.
+#define FLOOD_HINTS 64
+
+/// What a connection does.
+typedef enum {
+    /// It plays games with the other players.
+    conn_player,
+    /// It picks its slow reader from the lobby and floods it with hints.
+    conn_flooder,
+    /// It waits in the lobby for its flooder and then hardly reads.
+    conn_slow,
+    /// It never sends the password.
+    conn_idle,
+} conn_role;
+
+/// Where a connection is.
+typedef enum {
+    /// It's waiting to be opened again.
+    conn_closed,
+    /// It's connected and waits to be asked for the password.
+    conn_awaiting_passwd,
+    /// It sent the password and waits for its id.
+    conn_awaiting_uid,
+    /// It asked for a match.
+    conn_matching,
+    /// It's in a game.
+    conn_playing,
+    /// It's in the lobby until the other connection of its pair is there too.
+    conn_waiting,
+    /// It's a slow reader in a game. A timer reads it instead of the event
+    /// loop.
+    conn_reading_slowly,
+} conn_state;
+
+/// A connection of the load generator.
+typedef struct {
+    /// The game it's in.
+    ge_game game;
+    /// Bytes received from the server.
+    pl_inbuf in;
+    /// Messages waiting to be sent to the server.
+    pl_outbuf out;
+    /// Sends the next guess or burst of hints, reads a slow reader or opens
+    /// the connection again.
+    tw_timer timer;
+    /// The other connection of a flooder or a slow reader.
+    void *partner;
+    /// User id.
+    size_t uid;
+    /// When the guess in flight was sent in nanoseconds of `now_ns`. Zero means
+    /// none is in flight.
+    long sent_at;
+    /// Wrong guesses it has made in the game.
+    unsigned int guesses;
+    /// Socket's file descripter.
+    int fd;
+    /// Wire format negotiated with the server.
+    pl_version version;
+    /// Where it is.
+    conn_state state;
+    /// What its socket is waited for.
+    unsigned int interest;
+    /// What it does.
+    conn_role role;
+    /// Whether it's the guesser of its game.
+    bool guesser;
+    /// Struct padding.
+    char _padding[7];
+} conn;
+
+/// What the load generator counted.
+typedef struct {
+    /// Connections that were authenticated.
+    unsigned long connects;
+    /// Messages that the players sent and received.
+    unsigned long messages;
+    /// Games whose word was guessed.
+    unsigned long games;
+    /// Connections that failed or were told to exit.
+    unsigned long errors;
+    /// Slow readers that the server dropped, which it may.
+    unsigned long dropped;
+    /// Idle connections that the server timed out, which it should.
+    unsigned long timed_out;
+    /// Nanoseconds from each guess to its answer.
+    hg_histogram raw;
+    /// The same, along with the guesses that stalls held back.
+    hg_histogram corrected;
+} totals;
+
+/// Cli arguments of the application.
+static cli_args args;
+/// Every connection.
+static conn *conns;
+/// Event loop.
+static rx_reactor rx;
+/// Timers of the connections, in milliseconds of `now_ms`.
+static tw_wheel timers;
+/// Storage of the connections' input buffers.
+static pl_pool inpool = (pl_pool){.free = NULL, .size = PL_INBUF_SIZE};
+/// Storage of the connections' output buffers.
+static pl_pool outpool = (pl_pool){.free = NULL, .size = PL_OUTBUF_SIZE};
+/// Connections without an input buffer of their own read into this one.
+static char scratch[PL_INBUF_SIZE];
+/// Nanoseconds between the guesses of a game.
+static long period;
+/// What's been counted.
+static totals counted;
+
+/// @brief Gives the time of a monotonic clock.
+/// @return Nanoseconds.
+static long now_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+/// @brief Gives the time of a monotonic clock.
+/// @return Milliseconds.
+static long now_ms(void) { return now_ns() / 1000000; }
+
+/// @brief Records the latency of a guess. If it's longer than the period, the
+/// guesses that would have been sent meanwhile are recorded too, each with
+/// the latency it would have seen.
+/// @param latency Nanoseconds.
+static void record_latency(long latency) {
+    hg_record(&counted.raw, (uint64_t)latency);
+    hg_record(&counted.corrected, (uint64_t)latency);
+    for (long missed = latency - period; missed >= period; missed -= period)
+        hg_record(&counted.corrected, (uint64_t)missed);
+}
+
+/// @brief Closes a connection and opens it again after a while.
+/// @param c The connection.
+/// @param delay Milliseconds before it's opened again.
+static void close_conn(conn *c, long delay) {
+    rx_remove(&rx, c->fd);
+    close(c->fd);
+    pl_inbuf_release(&c->in, &inpool, scratch);
+    pl_outbuf_release(&c->out, &outpool);
+    c->state = conn_closed;
+    tw_schedule_in(&timers, &c->timer, delay);
+}
+
+/// @brief Counts a connection that failed and opens it again after a while.
+/// The first failure is printed.
+/// @param c The connection.
+/// @param why What happened.
+static void fail_conn(conn *c, const char *why) {
+    if (counted.errors == 0) fprintf(stderr, "A connection failed: %s\n", why);
+    counted.errors += 1;
+    close_conn(c, RETRY_DELAY);
+}
+
+/// @brief Connects a connection. The server asks for the password once it's
+/// accepted.
+/// @param c The connection.
+static void open_conn(conn *c) {
+    conn_role role = c->role;
+    void *partner = c->partner;
+    sockaddr_in tcp_addr;
+    sockaddr_un unix_addr;
+    sockaddr *addr =
+        args.unix_socket ? st_unix_sockaddr(&unix_addr, args.unix_socket_file)
+                         : st_tcp_sockaddr(&tcp_addr, HOST, args.port);
+    socklen_t addr_len =
+        args.unix_socket ? sizeof(sockaddr_un) : sizeof(sockaddr_in);
+
+    *c = (conn){
+        .in = pl_inbuf_init(NULL, 0),
+        .out = pl_outbuf_init(NULL, 0),
+        .partner = partner,
+        .uid = 0,
+        .sent_at = 0,
+        .guesses = 0,
+        .fd = st_new(args.unix_socket),
+        // The password request is always in the legacy format.
+        .version = pl_version_legacy,
+        .state = conn_awaiting_passwd,
+        .interest = rx_read,
+        .role = role,
+        .guesser = false,
+    };
+    if (c->fd < 0 ||
+        st_set_profile(c->fd, args.profile, !args.unix_socket) < 0) {
+        fail_conn(c, strerror(errno));
+        return;
+    }
+    if (role == conn_slow) {
+        setsockopt(c->fd, SOL_SOCKET, SO_RCVBUF, &(int){SLOW_RCVBUF_SIZE},
+                   sizeof(int));
+    }
+
+    // Closing it resets it so the ports don't pile up in `TIME_WAIT`.
+    if (!args.unix_socket) {
+        setsockopt(c->fd, SOL_SOCKET, SO_LINGER,
+                   &(struct linger){.l_onoff = 1, .l_linger = 0},
+                   sizeof(struct linger));
+    }
+
+    if (st_connect(c->fd, addr, addr_len) < 0 && errno != EINPROGRESS) {
+        // A full backlog isn't the server's fault.
+        if (errno == EAGAIN) close_conn(c, RETRY_DELAY);
+        else fail_conn(c, strerror(errno));
+        return;
+    }
+    if (rx_add(&rx, c->fd, c, rx_read) < 0) fail_conn(c, strerror(errno));
+}
+
+/// @brief Sends what's queued for the server as far as the socket accepts it.
+/// The rest is sent once it's writable.
+/// @param c The connection.
+static void flush_conn(conn *c) {
+    ssize_t left = pl_outbuf_flush(&c->out, &outpool, c->fd);
+    unsigned int interest = left > 0 ? rx_read | rx_write : rx_read;
+
+    if (left < 0) {
+        fail_conn(c, strerror(errno));
+        return;
+    }
+    if (interest == c->interest) return;
+
+    c->interest = interest;
+    if (rx_want(&rx, c->fd, c, interest) < 0) fail_conn(c, strerror(errno));
+}
+
+/// @brief Sends a message to the server.
+/// @param c The connection.
+/// @param kind Message kind.
+/// @param bytes Message raw bytes.
+/// @param len The number of `bytes`.
+static void send_conn(conn *c, pl_message_kind kind, const char *bytes,
+                      size_t len) {
+    if (pl_msg_queue(&c->out, &outpool, c->version, bytes,
+                     (pl_message){
+                         .id = c->uid,
+                         .kind = kind,
+                         .raw_bytes_len = len,
+                     }) < 0) {
+        fail_conn(c, "the server doesn't take what's sent to it");
+        return;
+    }
+
+    if (c->role == conn_player) counted.messages += 1;
+    flush_conn(c);
+}
+
+/// @brief Makes a flooder pick its slow reader from the lobby.
+/// @param c The flooder.
+static void pick_slow_reader(conn *c) {
+    conn *slow = c->partner;
+    ge_game game = {.guesser = slow->uid, .chooser = c->uid, .finished = false};
+
+    snprintf(game.word, sizeof(game.word), "w%zu", c->uid);
+    c->state = conn_matching;
+    send_conn(c, mk_select_opponent, (const char *)&game, sizeof(ge_game));
+}
+
+/// @brief Sends a burst of hints to the slow reader of a flooder. They aren't
+/// counted as messages so the games' throughput stays comparable.
+/// @param c The flooder.
+static void flood(conn *c) {
+    for (int i = 0; i < FLOOD_HINTS; i++) {
+        // The server may read it slower than it sends.
+        if (pl_msg_queue(&c->out, &outpool, c->version,
+                         (const char *)&c->game,
+                         (pl_message){
+                             .id = c->uid,
+                             .kind = mk_hint,
+                             .raw_bytes_len = sizeof(ge_game),
+                         }) < 0)
+            break;
+    }
+    flush_conn(c);
+    if (c->state == conn_playing)
+        tw_schedule_in(&timers, &c->timer, FLOOD_INTERVAL);
+}
+
+/// @brief Takes a few bytes of what the server has sent to a slow reader and
+/// throws them away. Once the server has dropped it, the pair starts over.
+/// @param c The slow reader.
+static void read_slowly(conn *c) {
+    pollfd shut = {.fd = c->fd, .events = POLLRDHUP, .revents = 0};
+    conn *flooder = c->partner;
+    ssize_t read_len = 0;
+
+    if (poll(&shut, 1, 0) == 0)
+        read_len = read(c->fd, scratch, SLOW_READ_BYTES);
+
+    // A hint of a guesser goes nowhere. Once the server has dropped the
+    // reader, it resets the connection, which the next poll sees even if what
+    // the server sent before hasn't been read yet.
+    if ((read_len > 0 || (read_len < 0 && errno == EAGAIN)) &&
+        pl_msg_queue(&c->out, &outpool, c->version, (const char *)&c->game,
+                     (pl_message){
+                         .id = c->uid,
+                         .kind = mk_hint,
+                         .raw_bytes_len = sizeof(ge_game),
+                     }) == 0 &&
+        pl_outbuf_flush(&c->out, &outpool, c->fd) >= 0) {
+        tw_schedule_in(&timers, &c->timer, SLOW_READ_INTERVAL);
+        return;
+    }
+
+    counted.dropped += 1;
+    close_conn(c, RETRY_DELAY);
+    if (flooder->state != conn_closed) close_conn(flooder, RETRY_DELAY);
+}
+
+/// @brief Sends the next guess of a guesser. It's the right one once the
+/// wrong ones are through.
+/// @param c The connection.
+static void guess(conn *c) {
+    ge_game game = c->game;
+
+    if (c->guesses < args.guesses)
+        snprintf(game.word, sizeof(game.word), "x%u", c->guesses);
+    else snprintf(game.word, sizeof(game.word), "w%zu", game.chooser);
+
+    c->sent_at = now_ns();
+    send_conn(c, mk_guess, (const char *)&game, sizeof(ge_game));
+}
+
+/// @brief Schedules the next guess of a guesser a period after the last one
+/// was sent. It's sent right away if that's passed already.
+/// @param c The connection.
+static void schedule_guess(conn *c) {
+    long wait = c->sent_at + period - now_ns();
+
+    if (wait <= 0) guess(c);
+    else tw_schedule_in(&timers, &c->timer, (wait + 999999) / 1000000);
+}
+
+/// @brief Handles a message from the server.
+/// @param c The connection.
+/// @param m The message.
+static void handle_msg(conn *c, const pl_frame *m) {
+    char payload[PL_RAW_BYTES_SIZE];
+    size_t pass_len = strlen(args.pass);
+
+    if (c->role == conn_player) counted.messages += 1;
+
+    switch (m->kind) {
+    case mk_enter_passwd:
+        if (c->state != conn_awaiting_passwd || c->role == conn_idle) break;
+        if (m->raw_bytes_len == 1 && args.version >= pl_version_compact &&
+            m->raw_bytes[0] >= (char)pl_version_compact)
+            c->version = pl_version_compact;
+
+        // Compact passwords are prefixed with the version byte.
+        payload[0] = (char)c->version;
+        memcpy(payload + (c->version == pl_version_compact ? 1 : 0), args.pass,
+               pass_len);
+        c->state = conn_awaiting_uid;
+        send_conn(c, mk_enter_passwd, payload,
+                  pass_len + (c->version == pl_version_compact ? 1 : 0));
+        break;
+
+    // The server turns away a connection whose password didn't arrive in
+    // time, and an idle one connects again right away.
+    case mk_wrong_passwd:
+        if (c->role == conn_idle) {
+            counted.timed_out += 1;
+            close_conn(c, 0);
+            break;
+        }
+        fail_conn(c, "the password is wrong");
+        break;
+
+    case mk_assign_uid:
+        if (c->state != conn_awaiting_uid) break;
+        c->uid = m->id;
+
+        // A pair waits in the lobby for each other.
+        if (c->role != conn_player) {
+            conn *partner = c->partner;
+
+            c->state = conn_waiting;
+            if (partner->state == conn_waiting)
+                pick_slow_reader(c->role == conn_flooder ? c : partner);
+            break;
+        }
+        c->state = conn_matching;
+        counted.connects += 1;
+
+        // The word is the one the guesser guesses if this one chooses.
+        c->game = (ge_game){.chooser = c->uid, .finished = false};
+        snprintf(c->game.word, sizeof(c->game.word), "w%zu", c->uid);
+        send_conn(c, mk_find_match, (const char *)&c->game, sizeof(ge_game));
+        break;
+
+    case mk_select_opponent:
+        // The event loop stops waiting for a slow reader that's been picked.
+        if (c->role == conn_slow && c->state == conn_waiting) {
+            c->game = cd_load(cd_view(m->raw_bytes));
+            c->state = conn_reading_slowly;
+            rx_remove(&rx, c->fd);
+            tw_schedule_in(&timers, &c->timer, SLOW_READ_INTERVAL);
+            break;
+        }
+        if (c->state != conn_matching) break;
+        c->game = cd_load(cd_view(m->raw_bytes));
+        if (c->role == conn_flooder) {
+            c->state = conn_playing;
+            flood(c);
+            break;
+        }
+        c->guesser = c->game.guesser == c->uid;
+        c->state = conn_playing;
+        if (c->guesser) guess(c);
+        break;
+
+    // The wrong guesses are all different, so they're only taken as repeated
+    // if their hashes collide.
+    case mk_repeated_guess:
+    case mk_wrong_guess:
+        if (c->state != conn_playing) break;
+        if (!c->guesser) {
+            send_conn(c, mk_hint, (const char *)&c->game, sizeof(ge_game));
+            break;
+        }
+        record_latency(now_ns() - c->sent_at);
+        c->guesses += 1;
+        schedule_guess(c);
+        break;
+
+    case mk_correct_guess:
+        if (c->state != conn_playing) break;
+        if (c->guesser) {
+            record_latency(now_ns() - c->sent_at);
+            counted.games += 1;
+        }
+        send_conn(c, mk_exit, "", 0);
+        if (c->state != conn_closed) close_conn(c, 0);
+        break;
+
+    case mk_exit:
+        fail_conn(c, "the server told it to exit");
+        break;
+
+    default:
+        break;
+    }
+}
+
+/// @brief Reads and handles what the server has sent until there's nothing
+/// left.
+/// @param c The connection.
+static void read_conn(conn *c) {
+    pl_frame frame;
+    ssize_t read_len;
+    size_t room;
+    int decoded;
+
+    while (c->state != conn_closed) {
+        if (c->in.data == NULL) c->in = pl_inbuf_init(scratch, PL_INBUF_SIZE);
+        room = c->in.cap - (c->in.end - c->in.start);
+        read_len = pl_inbuf_fill(&c->in, c->fd);
+        // An idle connection connects again right after it's closed.
+        if (c->role == conn_idle &&
+            (read_len == 0 || (read_len < 0 && errno != EAGAIN))) {
+            counted.timed_out += 1;
+            close_conn(c, 0);
+            return;
+        }
+        if (read_len == 0 || (read_len < 0 && errno != EAGAIN)) {
+            fail_conn(c, read_len == 0 ? "the server closed it"
+                                       : strerror(errno));
+            return;
+        }
+
+        while (c->state != conn_closed &&
+               (decoded = pl_frame_decode(&c->in, &c->version, &frame)) != 0) {
+            if (decoded < 0 || !cd_check(&frame)) {
+                fail_conn(c, "the server sent a malformed message");
+                return;
+            }
+            handle_msg(c, &frame);
+        }
+        if (c->state == conn_closed) return;
+        if (c->state == conn_reading_slowly) {
+            pl_inbuf_release(&c->in, &inpool, scratch);
+            return;
+        }
+        if (pl_inbuf_settle(&c->in, &inpool, scratch) < 0) {
+            fail_conn(c, "allocating an input buffer failed");
+            return;
+        }
+
+        // A read that didn't fill the buffer took everything there was.
+        if (read_len < 0 || (size_t)read_len < room) return;
+    }
+}
+
+/// @brief Handles the timers that have expired.
+static void expire_timers(void) {
+    tw_timer *t;
+
+    while ((t = tw_expire(&timers, now_ms())) != NULL) {
+        conn *c = (conn *)(void *)((char *)t - offsetof(conn, timer));
+
+        if (c->state == conn_closed) open_conn(c);
+        else if (c->state == conn_reading_slowly) read_slowly(c);
+        else if (c->state == conn_playing && c->role == conn_flooder) flood(c);
+        else if (c->state == conn_playing && c->guesser) guess(c);
+    }
+}
+
+/// @brief Prints a latency histogram.
+/// @param name What it is.
+/// @param h The histogram.
+static void print_latency(const char *name, const hg_histogram *h) {
+    printf("%-22s p50 %8.3f ms, p99 %8.3f ms, p99.9 %8.3f ms, max %8.3f ms\n",
+           name, (double)hg_percentile(h, 0.5) / 1e6,
+           (double)hg_percentile(h, 0.99) / 1e6,
+           (double)hg_percentile(h, 0.999) / 1e6, (double)h->max / 1e6);
+}
+
+int main(int argc, char *argv[]) {
+    rx_event events[RX_MAX_EVENTS];
+    struct rlimit files;
+    size_t total;
+    long start, end;
+    double elapsed;
+    bool passed;
+
+    args = parse_cli_args(argc, argv);
+    period = 1000000000L / (long)args.rate;
+    // The io_uring backend is the server's own.
+    rx = rx_init(args.backend == rx_backend_uring ? rx_backend_epoll
+                                                  : args.backend);
+    success_or_die(rx.epfd == -2 ? -1 : 0, "Failed to setup epoll");
+
+    // Every connection is a file descripter.
+    total = (size_t)args.connections + 2 * (size_t)args.slow + args.idle;
+    if (getrlimit(RLIMIT_NOFILE, &files) == 0 &&
+        files.rlim_cur < (rlim_t)total + 64) {
+        files.rlim_cur = files.rlim_max;
+        setrlimit(RLIMIT_NOFILE, &files);
+    }
+
+    if ((conns = calloc(total, sizeof(conn))) == NULL)
+        die("Failed to allocate the connections.\n");
+    // The pairs of `--slow` and then the idle ones come after the players.
+    for (size_t i = args.connections; i < total - args.idle; i += 2) {
+        conns[i] = (conn){.role = conn_flooder, .partner = &conns[i + 1]};
+        conns[i + 1] = (conn){.role = conn_slow, .partner = &conns[i]};
+    }
+    for (size_t i = total - args.idle; i < total; i++) conns[i].role = conn_idle;
+
+    start = now_ns();
+    end = start + (long)args.duration * 1000000000L;
+    tw_init(&timers, now_ms());
+    for (size_t i = 0; i < total; i++) open_conn(&conns[i]);
+
+    while (now_ns() < end) {
+        long wait = (end - now_ns() + 999999) / 1000000;
+        long next = tw_next(&timers);
+        int n_events;
+
+        if (next != TW_NEVER && next - now_ms() < wait) wait = next - now_ms();
+        if (wait < 0) wait = 0;
+
+        n_events = success_or_die(rx_wait(&rx, events, (int)wait),
+                                  "Failed to wait for events");
+        expire_timers();
+
+        for (int i = 0; i < n_events; i++) {
+            conn *c = events[i].data;
+
+            if (c->state == conn_closed || c->state == conn_reading_slowly)
+                continue;
+            if ((events[i].events & rx_write) != 0) {
+                flush_conn(c);
+                if (c->state == conn_closed) continue;
+            }
+            if ((events[i].events & rx_read) != 0) read_conn(c);
+        }
+    }
+    elapsed = (double)(now_ns() - start) / 1e9;
+
+    printf("%lu games over %.1f s with %u connections.\n", counted.games,
+           elapsed, args.connections);
+    printf("%.1f connections/s, %.1f messages/s, %lu guesses, %lu errors\n",
+           (double)counted.connects / elapsed,
+           (double)counted.messages / elapsed,
+           (unsigned long)counted.raw.count, counted.errors);
+    if (args.slow > 0) {
+        printf("%u slow readers, which the server dropped %lu times.\n",
+               args.slow, counted.dropped);
+    }
+    if (args.idle > 0) {
+        printf("%u idle connections, which the server timed out %lu times.\n",
+               args.idle, counted.timed_out);
+    }
+    print_latency("guess latency", &counted.raw);
+    print_latency("corrected for stalls", &counted.corrected);
+
+    passed = counted.errors == 0 && counted.games > 0 &&
+             (args.max_p99_us == 0 || hg_percentile(&counted.corrected, 0.99) <=
+                                          (uint64_t)args.max_p99_us * 1000);
+    if (!passed) printf("Failed.\n");
+
+    return passed ? EXIT_SUCCESS : EXIT_FAILURE;
+}
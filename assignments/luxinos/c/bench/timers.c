@@ -0,0 +1,90 @@
+#define _GNU_SOURCE
+
+#include "../src/timer.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+/// How many times each timer is rescheduled.
+#define RESCHEDULES 16
+
+/// @brief Gives the time of a monotonic clock.
+/// @return Seconds.
+static double now_s(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (double)ts.tv_sec + (double)ts.tv_nsec / 1e9;
+}
+
+/// @brief Gives the next number of a xorshift generator.
+/// @param state Generator state.
+/// @return The number.
+static unsigned long next_rand(unsigned long *state) {
+    *state ^= *state << 13;
+    *state ^= *state >> 7;
+    *state ^= *state << 17;
+    return *state;
+}
+
+/// @brief Churns a number of timers the way the server does: each of them is
+/// started, rescheduled as its connection is active, cancelled or left to
+/// expire while the wheel turns.
+/// @param n The number of timers.
+/// @param span Milliseconds that the timers are scheduled within.
+static void churn(size_t n, long span) {
+    tw_wheel w;
+    tw_timer *timers = calloc(n, sizeof(tw_timer));
+    unsigned long state = 88172645463325252UL;
+    size_t ops = 0, expired = 0, drained = 0;
+    double start, schedule_s, expire_s;
+    long tick = 0;
+
+    if (timers == NULL) {
+        fprintf(stderr, "Failed to allocate the timers.\n");
+        exit(EXIT_FAILURE);
+    }
+    tw_init(&w, 0);
+
+    start = now_s();
+    for (int round = 0; round < RESCHEDULES; round++) {
+        for (size_t i = 0; i < n; i++) {
+            unsigned long r = next_rand(&state);
+
+            // Every eighth one is cancelled, like a connection that goes
+            // away, and the rest are pushed back.
+            if (r % 8 == 0) tw_cancel(&w, &timers[i]);
+            else tw_schedule_in(&w, &timers[i], (long)(r % (unsigned long)span));
+            ops += 1;
+        }
+        // The wheel moves on a little between rounds.
+        tick += 1;
+        while (tw_expire(&w, tick) != NULL) expired += 1;
+    }
+    schedule_s = now_s() - start;
+
+    start = now_s();
+    while (w.len > 0) {
+        tick = tw_next(&w);
+        while (tw_expire(&w, tick) != NULL) drained += 1;
+    }
+    expire_s = now_s() - start;
+
+    printf("%8zu timers within %6ld ms: %6.1f M schedules/s, %6.1f M "
+           "expiries/s (%zu expired early)\n",
+           n, span, (double)ops / schedule_s / 1e6,
+           (double)drained / expire_s / 1e6, expired);
+
+    free(timers);
+}
+
+int main(void) {
+    size_t counts[] = {1024, 65536, 262144, 1048576};
+    long spans[] = {1000, 60000, 3600000};
+
+    for (size_t i = 0; i < sizeof(counts) / sizeof(counts[0]); i++) {
+        for (size_t j = 0; j < sizeof(spans) / sizeof(spans[0]); j++)
+            churn(counts[i], spans[j]);
+    }
+
+    return EXIT_SUCCESS;
+}
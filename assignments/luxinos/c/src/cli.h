@@ -1,6 +1,8 @@
 #pragma once
 
 #include "console.h"
+#include "protocol.h"
+#include "reactor.h"
 #include <netinet/in.h>
 #include <stdbool.h>
 #include <stddef.h>
@@ -9,16 +11,97 @@
 typedef struct {
     /// Entered password.
     const char *pass;
+    /// Path to the unix socket file.
+    const char *unix_socket_file;
+    /// Path to the unix socket file that the server's metrics are read from.
+    /// `NULL` means there's none.
+    const char *admin_socket_file;
+    /// Path to the file that the server journals the games to. `NULL` means
+    /// there's none.
+    const char *journal_file;
+    /// The newest wire format to use.
+    pl_version version;
+    /// Event loop backend of the server.
+    rx_backend backend;
+    /// Socket options of the connections.
+    st_profile profile;
+    /// The number of the server's threads.
+    unsigned int shards;
+    /// Seconds that a user may be idle in the lobby for. Zero means forever.
+    unsigned int idle_timeout;
+    /// Seconds that a guesser has for each guess. Zero means forever.
+    unsigned int turn_timeout;
+    /// Seconds that a user may not take anything that's sent to it for. Zero
+    /// means forever.
+    unsigned int stall_timeout;
+    /// The number of connections of the load generator.
+    unsigned int connections;
+    /// Guesses per second of each game of the load generator.
+    unsigned int rate;
+    /// Wrong guesses before the right one in each game of the load generator.
+    unsigned int guesses;
+    /// Seconds that the load generator runs for.
+    unsigned int duration;
+    /// Microseconds of p99 guess latency that the load generator fails above.
+    /// Zero means none.
+    unsigned int max_p99_us;
+    /// The number of slow readers of the load generator. Each is flooded by a
+    /// connection of its own.
+    unsigned int slow;
+    /// The number of connections of the load generator that never send the
+    /// password.
+    unsigned int idle;
+    /// File descripter of the unix socket that the server that restarted
+    /// itself hands its connections over through. `-1` means it's started
+    /// afresh.
+    int handover_fd;
     /// TCP port.
     in_port_t port;
     /// Whether to use unix socket.
     bool unix_socket;
-    /// Struct padding.
-    char _padding[5];
-    /// Path to the unix socket file.
-    const char *unix_socket_file;
+    /// Whether the client asks the server for a match instead of picking an
+    /// opponent.
+    bool match;
 } cli_args;
 
+/// The most threads the server runs.
+#define CLI_MAX_SHARDS 64
+
+/// @brief Gives the value of a `--name=value` option.
+/// @param arg The argument.
+/// @param name Option name including the dashes and the equal sign.
+/// @return The value or `NULL` if `arg` is another option.
+static const char *cli_option_value(const char *arg, const char *name) {
+    size_t name_len = strlen(name);
+
+    if (strncmp(arg, name, name_len) != 0) return NULL;
+    return arg + name_len;
+}
+
+/// @brief Parses the value of a numeric option.
+/// @param value The value.
+/// @param min The least valid number.
+/// @param max The most valid number.
+/// @param error What to die with if it's not valid.
+/// @return The number.
+static unsigned int cli_number(const char *value, int min, int max,
+                               const char *error) {
+    int number = atoi(value);
+
+    if (number < min || number > max) die(error);
+
+    return (unsigned int)number;
+}
+
+/// @brief Parses the value of a timeout option.
+/// @param value The value.
+/// @return Seconds.
+static unsigned int cli_timeout(const char *value) {
+    return cli_number(value, 0, 86400,
+                      "Invalid timeout. You pass a number of seconds up to a "
+                      "day or `0` for none.\n");
+}
+
 /// @brief Parses cli arguments.
 /// @param argc Arguments count.
 /// @param argv Arguments array.
@@ -28,27 +111,153 @@ static cli_args parse_cli_args(int argc, char *argv[]) {
     cli_args args =
         (cli_args){.port = 8080,
                    .unix_socket = false,
+                   .match = false,
+                   .version = pl_version_compact,
+                   .backend = rx_backend_epoll,
+                   .profile = st_profile_default,
+                   .shards = 1,
+                   .idle_timeout = 600,
+                   .turn_timeout = 300,
+                   .stall_timeout = 30,
+                   .connections = 1000,
+                   .rate = 10,
+                   .guesses = 8,
+                   .duration = 10,
+                   .max_p99_us = 0,
+                   .slow = 0,
+                   .idle = 0,
+                   .handover_fd = -1,
                    .pass = "password12345",
-                   .unix_socket_file = "/tmp/guessing-game-unix-socket"};
+                   .unix_socket_file = "/tmp/guessing-game-unix-socket",
+                   .admin_socket_file = NULL,
+                   .journal_file = NULL};
+    // Arguments that aren't options.
+    char *pos[3];
+    int pos_len = 0;
+    const char *value;
 
-    if (argc > 4) {
-        die("Invalid number of arguments. You should pass either either one or "
-            "two or three.\n");
+    for (int i = 1; i < argc; i++) {
+        if (strncmp(argv[i], "--", 2) != 0) {
+            if (pos_len == 3) {
+                die("Invalid number of arguments. You should pass either "
+                    "either one or two or three.\n");
+            }
+            pos[pos_len++] = argv[i];
+        } else if ((value = cli_option_value(argv[i], "--protocol="))) {
+            if (strcmp(value, "legacy") == 0) {
+                args.version = pl_version_legacy;
+            } else if (strcmp(value, "compact") == 0) {
+                args.version = pl_version_compact;
+            } else {
+                die("Invalid `--protocol`. You pass either `legacy` or "
+                    "`compact`.\n");
+            }
+        } else if ((value = cli_option_value(argv[i], "--backend="))) {
+            if (strcmp(value, "poll") == 0) {
+                args.backend = rx_backend_poll;
+            } else if (strcmp(value, "epoll") == 0) {
+                args.backend = rx_backend_epoll;
+            } else if (strcmp(value, "uring") == 0) {
+                args.backend = rx_backend_uring;
+            } else {
+                die("Invalid `--backend`. You pass either `poll`, `epoll` or "
+                    "`uring`.\n");
+            }
+        } else if ((value = cli_option_value(argv[i], "--socket-profile="))) {
+            if (strcmp(value, "default") == 0) {
+                args.profile = st_profile_default;
+            } else if (strcmp(value, "latency") == 0) {
+                args.profile = st_profile_latency;
+            } else if (strcmp(value, "throughput") == 0) {
+                args.profile = st_profile_throughput;
+            } else {
+                die("Invalid `--socket-profile`. You pass either `default`, "
+                    "`latency` or `throughput`.\n");
+            }
+        } else if ((value = cli_option_value(argv[i], "--shards="))) {
+            int shards = atoi(value);
+
+            if (shards < 1 || shards > CLI_MAX_SHARDS) {
+                die("Invalid `--shards`. You pass a number from 1 to 64.\n");
+            }
+            args.shards = (unsigned int)shards;
+        } else if ((value = cli_option_value(argv[i], "--idle-timeout="))) {
+            args.idle_timeout = cli_timeout(value);
+        } else if ((value = cli_option_value(argv[i], "--turn-timeout="))) {
+            args.turn_timeout = cli_timeout(value);
+        } else if ((value = cli_option_value(argv[i], "--stall-timeout="))) {
+            args.stall_timeout = cli_timeout(value);
+        } else if ((value = cli_option_value(argv[i], "--admin-socket="))) {
+            if (strlen(value) == 0 || strlen(value) >= 108) {
+                die("Invalid `--admin-socket`. You pass a path of a unix "
+                    "socket file that's less than 108 characters.\n");
+            }
+            args.admin_socket_file = value;
+        } else if ((value = cli_option_value(argv[i], "--journal="))) {
+            if (strlen(value) == 0)
+                die("Invalid `--journal`. You pass a path of a file.\n");
+            args.journal_file = value;
+        } else if ((value = cli_option_value(argv[i], "--connections="))) {
+            args.connections = cli_number(
+                value, 1, 1000000,
+                "Invalid `--connections`. You pass a number from 1 to "
+                "1000000.\n");
+        } else if ((value = cli_option_value(argv[i], "--rate="))) {
+            args.rate = cli_number(value, 1, 1000,
+                                   "Invalid `--rate`. You pass a number of "
+                                   "guesses per second from 1 to 1000.\n");
+        } else if ((value = cli_option_value(argv[i], "--guesses="))) {
+            args.guesses = cli_number(value, 0, 1000,
+                                      "Invalid `--guesses`. You pass a number "
+                                      "from 0 to 1000.\n");
+        } else if ((value = cli_option_value(argv[i], "--duration="))) {
+            args.duration = cli_number(value, 1, 86400,
+                                       "Invalid `--duration`. You pass a "
+                                       "number of seconds up to a day.\n");
+        } else if ((value = cli_option_value(argv[i], "--max-p99-us="))) {
+            args.max_p99_us = cli_number(
+                value, 0, 60000000,
+                "Invalid `--max-p99-us`. You pass a number of microseconds up "
+                "to a minute or `0` for none.\n");
+        } else if ((value = cli_option_value(argv[i], "--slow="))) {
+            args.slow = cli_number(value, 0, 100000,
+                                   "Invalid `--slow`. You pass a number from 0 "
+                                   "to 100000.\n");
+        } else if ((value = cli_option_value(argv[i], "--idle="))) {
+            args.idle = cli_number(value, 0, 100000,
+                                   "Invalid `--idle`. You pass a number from 0 "
+                                   "to 100000.\n");
+        } else if ((value = cli_option_value(argv[i], "--handover="))) {
+            args.handover_fd = (int)cli_number(
+                value, 0, 65535,
+                "Invalid `--handover`. It's passed by the server when it "
+                "restarts itself.\n");
+        } else if (strcmp(argv[i], "--match") == 0) {
+            args.match = true;
+        } else {
+            die("Unknown option. The options are `--protocol`, `--backend`, "
+                "`--socket-profile`, `--shards`, `--idle-timeout`, "
+                "`--turn-timeout`, `--stall-timeout`, `--admin-socket`, "
+                "`--journal`, `--match`, `--connections`, `--rate`, "
+                "`--guesses`, `--duration`, `--max-p99-us`, `--slow` and "
+                "`--idle`.\n");
+        }
     }
-    if (argc < 2) {
+
+    if (pos_len < 1) {
         die("Invalid number of arguments. You should the password as the first "
             "argument.\n");
     }
 
     // Password.
-    args.pass = argv[1];
+    args.pass = pos[0];
 
     // If we got any arguments after password.
-    if (argc >= 3) {
+    if (pos_len >= 2) {
         // TCP or Unix.
-        if (strcmp(argv[2], "unix") == 0) {
+        if (strcmp(pos[1], "unix") == 0) {
             args.unix_socket = true;
-        } else if (strcmp(argv[2], "tcp") == 0) {
+        } else if (strcmp(pos[1], "tcp") == 0) {
             args.unix_socket = false;
         } else {
             die("The second argument is invalid. You pass either `tcp` or "
@@ -56,15 +265,15 @@ static cli_args parse_cli_args(int argc, char *argv[]) {
         }
 
         // TCP port or unix socket file path.
-        if (argc == 4) {
-            size_t len = strlen(argv[3]);
+        if (pos_len == 3) {
+            size_t len = strlen(pos[2]);
             if (len >= 108) {
                 die("The third argument is invalid. It shouldn't be more than "
                     "108 characters.\n");
             }
 
             if (!args.unix_socket) {
-                int parsed_port = atoi(argv[3]);
+                int parsed_port = atoi(pos[2]);
                 if (parsed_port < 1) {
                     die("The third argument is invalid. Can't parse it as a "
                         "number for using it as the tcp port.\n");
@@ -72,7 +281,7 @@ static cli_args parse_cli_args(int argc, char *argv[]) {
 
                 args.port = (in_port_t)parsed_port;
             } else {
-                args.unix_socket_file = argv[3];
+                args.unix_socket_file = pos[2];
             }
         }
     }
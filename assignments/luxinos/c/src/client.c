@@ -1,6 +1,7 @@
 #define _GNU_SOURCE
 
 #include "cli.h"
+#include "codec.h"
 #include "console.h"
 #include "game.h"
 #include "protocol.h"
@@ -19,12 +20,39 @@ static int socketfd;
 /// User ID assigned by the server.
 static size_t uid = 0;
 
+/// Wire format negotiated with the server.
+static pl_version version = pl_version_legacy;
+
+/// Storage of the input buffer.
+static char inbuf_data[PL_INBUF_SIZE];
+
+/// Bytes received from the server.
+static pl_inbuf inbuf =
+    (pl_inbuf){.data = inbuf_data, .cap = PL_INBUF_SIZE, .start = 0, .end = 0};
+
+/// Storage of the output buffer. A message is sent before the next one is
+/// queued so it only needs one buffer.
+static pl_pool outpool = (pl_pool){.free = NULL, .size = PL_MSG_MAX_SIZE};
+
+/// Messages waiting to be sent to the server.
+static pl_outbuf outbuf =
+    (pl_outbuf){.data = NULL, .cap = 0, .start = 0, .end = 0};
+
 /// If the client is in a game.
 static bool is_in_game = false;
 
+/// If the client has asked the server for a match.
+static bool is_matching = false;
+
 /// Determines if the client is a guesser.
 static bool is_guesser;
 
+/// Opponents that the server has announced, in no particular order.
+static size_t opps[PL_RAW_BYTES_SIZE / sizeof(size_t)];
+
+/// The number of `opps`.
+static size_t opps_count = 0;
+
 /// Details of the current game.
 static ge_game current_game =
     (ge_game){.id = 0, .chooser = 0, .guesser = 0, .finished = false};
@@ -38,7 +66,7 @@ static void zero_current_game(void) {
 static void __attribute((noreturn))
 sigint_handler(int sig_num __attribute__((unused))) {
     // Informs the server that the client is quitting.
-    pl_poll_msg_write(socketfd, "",
+    pl_poll_msg_write(socketfd, &outbuf, &outpool, version, "",
                       (pl_message){
                           .id = uid,
                           .kind = mk_exit,
@@ -57,35 +85,58 @@ sigint_handler(int sig_num __attribute__((unused))) {
 
 /// @brief Tries authenticating with credentials.
 /// @param pass Password.
-static void authenticate(const char *pass) {
-    // Waits for the server to ask for credentials.
-    pl_message *m = pl_poll_msg_read(socketfd, PL_NO_TIMEOUT);
+/// @param newest The newest wire format to use.
+static void authenticate(const char *pass, pl_version newest) {
+    // Compact passwords are prefixed with the version byte.
+    char payload[PL_RAW_BYTES_SIZE];
+    size_t pass_len = strlen(pass);
+    size_t prefix_len;
+    pl_frame frame;
+
+    // Waits for the server to ask for credentials. The request is always in
+    // the legacy format and offers the newest format the server supports.
+    pl_frame *m =
+        pl_poll_msg_read(socketfd, &inbuf, &version, &frame, PL_NO_TIMEOUT);
     if (!m || m->kind != mk_enter_passwd) {
         die("Failed to read while authenticating with credentials!\n");
     }
+    if (m->raw_bytes_len == 1 && newest >= pl_version_compact &&
+        m->raw_bytes[0] >= (char)pl_version_compact) {
+        version = pl_version_compact;
+    }
+
+    prefix_len = version == pl_version_compact ? 1 : 0;
+    if (pass_len + prefix_len > sizeof(payload)) die("Password is too long!\n");
+    payload[0] = (char)version;
+    memcpy(payload + prefix_len, pass, pass_len);
 
     // Send the credentials to the server.
     success_or_die(
-        (int)pl_poll_msg_write(socketfd, pass,
-                               (pl_message){.id = uid,
-                                            .kind = mk_enter_passwd,
-                                            .raw_bytes_len = strlen(pass)},
-                               PL_NO_TIMEOUT),
+        pl_poll_msg_write(
+            socketfd, &outbuf, &outpool, version, payload,
+            (pl_message){.id = uid,
+                         .kind = mk_enter_passwd,
+                         .raw_bytes_len = pass_len + prefix_len},
+            PL_NO_TIMEOUT),
         "Failed to authenticate with credentials");
 
     // Asks the server for the authentication result.
-    m = pl_poll_msg_read(socketfd, PL_NO_TIMEOUT);
+    m = pl_poll_msg_read(socketfd, &inbuf, &version, &frame, PL_NO_TIMEOUT);
+    if (!m) die("Failed to read while authenticating with credentials!\n");
     if (m->kind != mk_assign_uid) die("Unauthorized!\n");
 
     uid = m->id;
 }
 
-/// @brief Performs a poll againts stdin and the network socket.
+/// @brief Performs a poll againts stdin and the network socket. Bytes that are
+/// already buffered count as a network message.
 /// @return File descripter of the finished one.
 static int stdin_vs_socket_poll(void) {
     // Stdin vs Socket poll
     pollfd pollfds[2];
 
+    if (inbuf.start < inbuf.end) return socketfd;
+
     bzero(&pollfds, sizeof(pollfds));
 
     // stdin
@@ -109,8 +160,9 @@ static int stdin_vs_socket_poll(void) {
 /// @brief Sends a game message to the server.
 /// @param kind Message kind.
 /// @return Message write result.
-static ssize_t send_game_msg(pl_message_kind kind) {
-    return pl_poll_msg_write(socketfd, (char *)&current_game,
+static int send_game_msg(pl_message_kind kind) {
+    return pl_poll_msg_write(socketfd, &outbuf, &outpool, version,
+                             (char *)&current_game,
                              (pl_message){
                                  .id = uid,
                                  .kind = kind,
@@ -119,11 +171,43 @@ static ssize_t send_game_msg(pl_message_kind kind) {
                              PL_NO_TIMEOUT);
 }
 
+/// @brief Applies an announcement of the server to `opps`. The ones that don't
+/// fit are left out.
+/// @param m The announcement.
+static void update_opponents(const pl_frame *m) {
+    // Copied since the bytes aren't aligned.
+    size_t ids[PL_RAW_BYTES_SIZE / sizeof(size_t)];
+    size_t ids_count = m->raw_bytes_len / sizeof(size_t);
+
+    memcpy(ids, m->raw_bytes, ids_count * sizeof(size_t));
+
+    // A full list replaces the current one.
+    if (m->kind == mk_show_opponents) opps_count = 0;
+
+    for (size_t i = 0; i < ids_count; i++) {
+        size_t j = 0;
+
+        // We can't let the user choose itself as its opponent.
+        if (ids[i] == uid) continue;
+
+        while (j < opps_count && opps[j] != ids[i]) j++;
+
+        if (m->kind == mk_opponents_left) {
+            if (j == opps_count) continue;
+            // The last one takes its place.
+            opps_count -= 1;
+            opps[j] = opps[opps_count];
+        } else if (j == opps_count &&
+                   opps_count < sizeof(opps) / sizeof(size_t)) {
+            opps[opps_count] = ids[i];
+            opps_count += 1;
+        }
+    }
+}
+
 /// @brief Asks the user to select an opponent and checks if the client actually
 /// exists.
-/// @param opps Opps array.
-/// @param opps_count Opps array length.
-static void select_opponent(size_t *opps, size_t opps_count) {
+static void select_opponent(void) {
     zero_current_game();
 
     for (;;) {
@@ -163,28 +247,51 @@ int main(int argc, char *argv[]) {
 
     socketfd =
         success_or_die(st_client_setup(HOST, args.port, args.unix_socket_file,
-                                       args.unix_socket),
+                                       args.unix_socket, args.profile),
                        "Failed to setup a client socket");
 
-    authenticate(args.pass);
+    authenticate(args.pass, args.version);
 
     if (args.unix_socket) {
         printf("Connected to `%s` unix socket file.\n", args.unix_socket_file);
     } else printf("Connected to the %d port.\n", args.port);
 
-    printf("Initially, we have to wait until enough opponents connect to the "
-           "server...\n\n");
+    if (args.match) {
+        zero_current_game();
+        current_game.chooser = uid;
+
+        printf("Enter a word for your opponent to guess in case you're the "
+               "one who chooses. It should be at least 2 characters and 55 "
+               "characters at most.\n");
+
+        read_stdin(current_game.word, sizeof(current_game.word));
+        if (strlen(current_game.word) < 2)
+            die("Should be at least 2 characters.\n");
+
+        // The server pairs us with the next one who asks.
+        send_game_msg(mk_find_match);
+        is_matching = true;
+
+        printf("Waiting for a match...\n\n");
+    } else {
+        printf("Initially, we have to wait until enough opponents connect to "
+               "the server...\n\n");
+    }
 
     for (;;) {
         int poll_fd;
-        pl_message *m;
+        pl_frame frame;
+        pl_frame *m;
 
         if (is_in_game) {
             // Waits until it receives stdin or network message.
             poll_fd = stdin_vs_socket_poll();
 
             // It's a network message.
-            if (poll_fd == socketfd) m = pl_msg_read(socketfd);
+            if (poll_fd == socketfd) {
+                m = pl_poll_msg_read(socketfd, &inbuf, &version, &frame,
+                                     PL_NO_TIMEOUT);
+            }
             // It's stdin.
             else {
                 zero_current_game();
@@ -209,26 +316,27 @@ int main(int argc, char *argv[]) {
                 continue;
             }
         } else {
-            m = pl_poll_msg_read(socketfd, PL_NO_TIMEOUT);
+            m = pl_poll_msg_read(socketfd, &inbuf, &version, &frame,
+                                 PL_NO_TIMEOUT);
         }
 
+        if (!m) die("Lost the connection to the server!\n");
+        if (!cd_check(m)) die("The server sent a malformed message!\n");
+
         switch (m->kind) {
-        case mk_show_opponents: {
-            // Casting to `size_t` is for escaping the alignment check of the
-            // compiler. It's handled by the protocol's design.
-            size_t *opps = (size_t *)((size_t)m->raw_bytes);
-            size_t opps_count = m->raw_bytes_len / sizeof(size_t);
+        case mk_show_opponents:
+        case mk_opponents_joined:
+        case mk_opponents_left: {
+            update_opponents(m);
 
-            // The message is ignored if a game is in process.
-            if (is_in_game) continue;
+            // The message is ignored if a game is in process, we're waiting
+            // for a match or nobody is there to pick.
+            if (is_in_game || is_matching || opps_count == 0) continue;
 
             printf("We got enough opponents to start. Here's a list of them to "
                    "pick.\n");
 
             for (size_t i = 0; i < opps_count; i++) {
-                // We can't let the user choose itself as its opponent.
-                if (opps[i] == uid) continue;
-
                 printf("Client number %zu\n", opps[i]);
             }
 
@@ -241,7 +349,7 @@ int main(int argc, char *argv[]) {
             if (poll_fd == socketfd) continue;
 
             // Asks the user to select an opponent.
-            select_opponent(opps, opps_count);
+            select_opponent();
 
             printf("Enter a word to ask the opponent to guess. It should be "
                    "at least 2 characters and 55 characters at most.\n");
@@ -256,8 +364,7 @@ int main(int argc, char *argv[]) {
 
         case mk_select_opponent: {
             is_in_game = true;
-            // Same reason as before.
-            current_game = *(ge_game *)((size_t)m->raw_bytes);
+            current_game = cd_load(cd_view(m->raw_bytes));
 
             if (current_game.chooser == uid) {
                 is_guesser = false;
@@ -274,14 +381,19 @@ int main(int argc, char *argv[]) {
             if (is_guesser) {
                 printf("Wrong guess!\n");
             } else {
-                ge_game *g = ge_game_from_msg(m);
-                printf("Opponent guessed wrong: %s\n", g->word);
+                printf("Opponent guessed wrong: %s\n",
+                       cd_word(cd_view(m->raw_bytes)));
             }
         } break;
 
+        case mk_repeated_guess:
+            printf("You guessed %s already!\n",
+                   cd_word(cd_view(m->raw_bytes)));
+            break;
+
         case mk_hint: {
-            ge_game g = *ge_game_from_msg(m);
-            printf("Your opponent gave you a hint: %s\n", g.word);
+            printf("Your opponent gave you a hint: %s\n",
+                   cd_word(cd_view(m->raw_bytes)));
         } break;
 
         case mk_correct_guess:
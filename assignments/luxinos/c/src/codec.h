@@ -0,0 +1,189 @@
+/// This declares what the payload of each message kind is and reads and writes
+/// them in place. A received payload is checked once against its declaration
+/// right after the message is decoded, so the rest of the code reads its fields
+/// through a view into the input buffer instead of copying it into a struct.
+/// Payloads are written field by field right into the output buffer too.
+///
+/// A game payload is laid out like `ge_game` on the hosts that it's built for,
+/// which is how the clients have always sent it.
+
+#pragma once
+
+#include "game.h"
+#include "protocol.h"
+#include <stdbool.h>
+#include <stddef.h>
+#include <string.h>
+
+/// The size of a game payload.
+#define CD_GAME_SIZE 80
+
+/// What the payload of a message kind is.
+typedef enum {
+    /// Any bytes, e.g. a password.
+    cd_payload_bytes = 0,
+    /// Nothing.
+    cd_payload_empty,
+    /// A game. Its word is null-terminated within its field.
+    cd_payload_game,
+    /// User ids.
+    cd_payload_ids,
+} cd_payload;
+
+/// A field of a game payload.
+typedef enum {
+    /// Game's id.
+    cd_field_id,
+    /// Guesser's id.
+    cd_field_guesser,
+    /// Chooser's id.
+    cd_field_chooser,
+    /// Whether the game has been finished.
+    cd_field_finished,
+    /// Word to guess.
+    cd_field_word,
+    cd_fields_len,
+} cd_field;
+
+/// Where a field of a game payload is.
+typedef struct {
+    /// Offset in the payload.
+    size_t offset;
+    /// Size in bytes.
+    size_t size;
+} cd_span;
+
+/// A game payload that was checked. It points into the bytes it was decoded
+/// from, which aren't aligned.
+typedef struct {
+    /// The payload.
+    const char *bytes;
+} cd_game_view;
+
+/// The payload of each message kind.
+static const cd_payload cd_payloads[PL_KINDS] = {
+    [mk_exit] = cd_payload_bytes,
+    [mk_enter_passwd] = cd_payload_bytes,
+    [mk_wrong_passwd] = cd_payload_bytes,
+    [mk_assign_uid] = cd_payload_empty,
+    [mk_show_opponents] = cd_payload_ids,
+    [mk_select_opponent] = cd_payload_game,
+    [mk_ask_opponent] = cd_payload_game,
+    [mk_guess] = cd_payload_game,
+    [mk_wrong_guess] = cd_payload_game,
+    [mk_hint] = cd_payload_game,
+    [mk_correct_guess] = cd_payload_empty,
+    [mk_opponents_joined] = cd_payload_ids,
+    [mk_opponents_left] = cd_payload_ids,
+    [mk_find_match] = cd_payload_game,
+    [mk_repeated_guess] = cd_payload_game,
+};
+
+/// The layout of a game payload by `cd_field`.
+static const cd_span cd_game_layout[cd_fields_len] = {
+    [cd_field_id] = {0, sizeof(size_t)},
+    [cd_field_guesser] = {8, sizeof(size_t)},
+    [cd_field_chooser] = {16, sizeof(size_t)},
+    [cd_field_finished] = {24, 1},
+    [cd_field_word] = {25, 55},
+};
+
+_Static_assert(sizeof(ge_game) == CD_GAME_SIZE, "game payload size");
+_Static_assert(offsetof(ge_game, guesser) == 8, "guesser offset");
+_Static_assert(offsetof(ge_game, chooser) == 16, "chooser offset");
+_Static_assert(offsetof(ge_game, finished) == 24, "finished offset");
+_Static_assert(offsetof(ge_game, word) == 25, "word offset");
+
+/// @brief Checks that a received payload is what its kind declares. Kinds
+/// that aren't known are left to whoever handles them.
+/// @param m A received message.
+/// @return Whether it's valid.
+static bool cd_check(const pl_frame *m) {
+    const cd_span *word = &cd_game_layout[cd_field_word];
+
+    if ((unsigned int)m->kind >= PL_KINDS) return true;
+
+    switch (cd_payloads[m->kind]) {
+    case cd_payload_empty:
+        return m->raw_bytes_len == 0;
+    case cd_payload_ids:
+        return m->raw_bytes_len % sizeof(size_t) == 0;
+    case cd_payload_game:
+        return m->raw_bytes_len == CD_GAME_SIZE &&
+               memchr(m->raw_bytes + word->offset, '\0', word->size) != NULL;
+    case cd_payload_bytes:
+    default:
+        return true;
+    }
+}
+
+/// @brief Views a game payload.
+/// @param bytes A game payload that was checked with `cd_check`.
+/// @return The view.
+static cd_game_view cd_view(const char *bytes) {
+    return (cd_game_view){bytes};
+}
+
+/// @brief Reads a number field of a game payload.
+/// @param game The payload.
+/// @param field Any field except the word.
+/// @return The field value.
+static size_t cd_get(cd_game_view game, cd_field field) {
+    const cd_span *span = &cd_game_layout[field];
+    size_t value = 0;
+
+    if (span->size == 1) return (unsigned char)game.bytes[span->offset];
+    memcpy(&value, game.bytes + span->offset, sizeof(size_t));
+
+    return value;
+}
+
+/// @brief Reads the word of a game payload.
+/// @param game The payload.
+/// @return The null-terminated word. It's not aligned.
+static const char *cd_word(cd_game_view game) {
+    return game.bytes + cd_game_layout[cd_field_word].offset;
+}
+
+/// @brief Copies a game payload out, e.g. to keep it after its message.
+/// @param game The payload.
+/// @return A `game` struct.
+static ge_game cd_load(cd_game_view game) {
+    ge_game copy;
+
+    memcpy(&copy, game.bytes, CD_GAME_SIZE);
+    copy.finished = cd_get(game, cd_field_finished) != 0;
+
+    return copy;
+}
+
+/// @brief Writes a number field of a game payload.
+/// @param dst The payload.
+/// @param field Any field except the word.
+/// @param value The field value.
+static void cd_put(char *dst, cd_field field, size_t value) {
+    const cd_span *span = &cd_game_layout[field];
+
+    if (span->size == 1)
+        dst[span->offset] = (char)value;
+    else
+        memcpy(dst + span->offset, &value, sizeof(size_t));
+}
+
+/// @brief Writes a game payload.
+/// @param dst `CD_GAME_SIZE` bytes.
+/// @param game Its id, players and whether it's finished.
+/// @param word A null-terminated word, which is cut to fit.
+static void cd_put_game(char *dst, const ge_game *game, const char *word) {
+    const cd_span *span = &cd_game_layout[cd_field_word];
+    size_t len = strnlen(word, span->size - 1);
+
+    cd_put(dst, cd_field_id, game->id);
+    cd_put(dst, cd_field_guesser, game->guesser);
+    cd_put(dst, cd_field_chooser, game->chooser);
+    cd_put(dst, cd_field_finished, game->finished);
+    memcpy(dst + span->offset, word, len);
+    // The rest of the field goes on the wire too and the buffer may hold what
+    // was queued for another connection before.
+    bzero(dst + span->offset + len, span->size - len);
+}
@@ -2,6 +2,13 @@
 
 #include "protocol.h"
 #include <stddef.h>
+#include <stdint.h>
+#include <stdlib.h>
+
+/// The initial capacity of a set of guesses.
+#define GE_GUESSES_MIN 8
+/// The most guesses a game keeps track of. The ones after them are all new.
+#define GE_GUESSES_MAX 4096
 
 /// A game.
 typedef struct {
@@ -17,8 +24,122 @@ typedef struct {
     char word[55];
 } ge_game;
 
-/// @brief Gives a `game` pointer from a `message` struct.
-/// @return A `game` struct.
-static ge_game *ge_game_from_msg(pl_message *msg) {
-    return (ge_game *)((size_t)msg->raw_bytes);
+/// A normalized word's length and hash. Words that differ in either aren't
+/// compared byte by byte.
+typedef struct {
+    /// FNV-1a hash of the normalized bytes.
+    uint64_t hash;
+    /// The number of normalized bytes.
+    size_t len;
+} ge_key;
+
+/// The hashes of the guesses of a game. It's an open-addressing set where zero
+/// means an empty slot, so a hash of zero is stored as one.
+typedef struct {
+    /// `cap` hashes or `NULL` until the first one is added.
+    uint64_t *hashes;
+    /// The number of hashes.
+    size_t len;
+    /// The number of slots, a power of two.
+    size_t cap;
+} ge_guesses;
+
+/// @brief Whether a character is whitespace that surrounds a word.
+/// @param c The character.
+/// @return Whether it is.
+static bool ge_is_space(char c) {
+    return c == ' ' || c == '\t' || c == '\n' || c == '\r';
+}
+
+/// @brief Normalizes a word so guesses don't differ in the surrounding
+/// whitespace or the case of ASCII letters.
+/// @param word A null-terminated word.
+/// @param dst Where to write the null-terminated normalized word. It fits
+/// `word` and may be it.
+/// @return The key of the normalized word.
+static ge_key ge_normalize(const char *word, char *dst) {
+    size_t start = 0, end = strlen(word);
+    uint64_t hash = 14695981039346656037UL;
+
+    while (start < end && ge_is_space(word[start])) start++;
+    while (end > start && ge_is_space(word[end - 1])) end--;
+
+    for (size_t i = start; i < end; i++) {
+        char c = word[i];
+
+        if (c >= 'A' && c <= 'Z') c = (char)(c - 'A' + 'a');
+        dst[i - start] = c;
+        hash = (hash ^ (unsigned char)c) * 1099511628211UL;
+    }
+    dst[end - start] = '\0';
+
+    return (ge_key){.hash = hash, .len = end - start};
+}
+
+/// @brief Whether two normalized words are the same. Most different ones are
+/// told apart by their keys.
+/// @param a A normalized word.
+/// @param a_key Its key.
+/// @param b Another normalized word.
+/// @param b_key Its key.
+/// @return Whether they're the same.
+static bool ge_same(const char *a, ge_key a_key, const char *b, ge_key b_key) {
+    return a_key.hash == b_key.hash && a_key.len == b_key.len &&
+           memcmp(a, b, a_key.len) == 0;
+}
+
+/// @brief Doubles the slots of a set of guesses.
+/// @param set The guesses.
+/// @return `0` or `-1` if allocating failed.
+static int ge_guesses_grow(ge_guesses *set) {
+    size_t cap = set->cap == 0 ? GE_GUESSES_MIN : set->cap * 2;
+    uint64_t *hashes = calloc(cap, sizeof(uint64_t));
+
+    if (hashes == NULL) return -1;
+    for (size_t j = 0; j < set->cap; j++) {
+        size_t i = set->hashes[j] & (cap - 1);
+
+        if (set->hashes[j] == 0) continue;
+        while (hashes[i] != 0) i = (i + 1) & (cap - 1);
+        hashes[i] = set->hashes[j];
+    }
+
+    free(set->hashes);
+    set->hashes = hashes;
+    set->cap = cap;
+
+    return 0;
+}
+
+/// @brief Adds a guess to the guesses of a game. Guesses with the same hash
+/// are taken as the same.
+/// @param set The guesses.
+/// @param key The key of the normalized guess.
+/// @return Whether it's new. Once the set is full or can't grow, the guesses
+/// that it doesn't have are new but aren't added.
+static bool ge_guesses_add(ge_guesses *set, ge_key key) {
+    uint64_t hash = key.hash == 0 ? 1 : key.hash;
+    size_t i;
+
+    // It's kept at most three quarters full so probing ends early.
+    if (set->len * 4 >= set->cap * 3 && set->cap < GE_GUESSES_MAX &&
+        ge_guesses_grow(set) < 0 && set->cap == 0)
+        return true;
+
+    for (i = hash & (set->cap - 1); set->hashes[i] != 0;
+         i = (i + 1) & (set->cap - 1)) {
+        if (set->hashes[i] == hash) return false;
+    }
+    if (set->len * 4 >= set->cap * 3) return true;
+    set->hashes[i] = hash;
+    set->len += 1;
+
+    return true;
+}
+
+/// @brief Frees the guesses of a game.
+/// @param set The guesses.
+static void ge_guesses_free(ge_guesses *set) {
+    free(set->hashes);
+    *set = (ge_guesses){.hashes = NULL, .len = 0, .cap = 0};
 }
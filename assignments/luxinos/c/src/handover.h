@@ -0,0 +1,252 @@
+/// This hands a running server over to a new process of it, e.g. to upgrade
+/// its binary without dropping its connections. The new process is exec'd with
+/// one end of a unix socket and says hello on it. The old one stops its event
+/// loops once it has checked that the new one can read its snapshot, and sends
+/// the listening and client sockets with `SCM_RIGHTS` and a snapshot of what
+/// its shards know about them. The new one goes on from there, so the clients
+/// only see a pause.
+///
+/// The snapshot is in the memory layout of the structs that were saved, since
+/// both processes run on the same host. A process only resumes from one with
+/// the same `HO_VERSION`, which changes along with those structs.
+
+#pragma once
+
+#include "socket.h"
+#include <errno.h>
+#include <limits.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+/// Version of the snapshot format.
+#define HO_VERSION 2
+
+/// What the processes tell each other first. The new process says hello with
+/// `len` and `fds` of zero.
+typedef struct {
+    /// `LXHO`.
+    char magic[4];
+    /// `HO_VERSION`.
+    uint32_t version;
+    /// Microseconds of a monotonic clock when the old process stopped serving.
+    uint64_t paused_at;
+    /// The number of bytes of the snapshot.
+    uint64_t len;
+    /// The number of file descripters.
+    uint32_t fds;
+    /// The number of shards, which the snapshot is made of.
+    uint32_t shards;
+} ho_header;
+
+/// A snapshot that's being written. It grows as needed.
+typedef struct {
+    /// Storage.
+    char *data;
+    /// The number of bytes.
+    size_t len;
+    /// Storage size.
+    size_t cap;
+} ho_buffer;
+
+/// A snapshot that's being read.
+typedef struct {
+    /// The bytes.
+    const char *data;
+    /// The number of bytes.
+    size_t len;
+    /// Offset of the next byte to read.
+    size_t at;
+} ho_reader;
+
+/// @brief Makes a header.
+/// @param paused_at When the old process stopped serving.
+/// @param len The number of bytes of the snapshot.
+/// @param fds The number of file descripters.
+/// @param shards The number of shards.
+/// @return The header.
+static ho_header ho_make_header(uint64_t paused_at, size_t len, size_t fds,
+                                size_t shards) {
+    return (ho_header){
+        .magic = {'L', 'X', 'H', 'O'},
+        .version = HO_VERSION,
+        .paused_at = paused_at,
+        .len = len,
+        .fds = (uint32_t)fds,
+        .shards = (uint32_t)shards,
+    };
+}
+
+/// @brief Checks that a header is of this version and number of shards.
+/// @param h The header.
+/// @param shards The number of shards.
+/// @return Whether it is.
+static bool ho_check_header(const ho_header *h, size_t shards) {
+    return memcmp(h->magic, "LXHO", 4) == 0 && h->version == HO_VERSION &&
+           h->shards == shards;
+}
+
+/// @brief Appends bytes to a snapshot.
+/// @param b The snapshot.
+/// @param bytes The bytes.
+/// @param len The number of bytes.
+/// @return `0` or `-1` if allocating failed.
+static int ho_put(ho_buffer *b, const void *bytes, size_t len) {
+    if (b->len + len > b->cap) {
+        size_t cap = b->cap == 0 ? 4096 : b->cap;
+        char *data;
+
+        while (cap < b->len + len) cap *= 2;
+        if ((data = realloc(b->data, cap)) == NULL) return -1;
+        b->data = data;
+        b->cap = cap;
+    }
+
+    if (len > 0) memcpy(b->data + b->len, bytes, len);
+    b->len += len;
+
+    return 0;
+}
+
+/// @brief Reads bytes of a snapshot.
+/// @param r The snapshot.
+/// @param dst Where to copy them.
+/// @param len The number of bytes.
+/// @return Whether there were that many.
+static bool ho_take(ho_reader *r, void *dst, size_t len) {
+    if (r->len - r->at < len) return false;
+
+    if (len > 0) memcpy(dst, r->data + r->at, len);
+    r->at += len;
+
+    return true;
+}
+
+/// @brief Points at bytes of a snapshot without copying them.
+/// @param r The snapshot.
+/// @param len The number of bytes.
+/// @return The bytes or `NULL` if there weren't that many.
+static const char *ho_skip(ho_reader *r, size_t len) {
+    const char *bytes = r->data + r->at;
+
+    if (r->len - r->at < len) return NULL;
+    r->at += len;
+
+    return bytes;
+}
+
+/// @brief Writes all the bytes to a blocking file descripter.
+/// @param fd File descripter.
+/// @param bytes The bytes.
+/// @param len The number of bytes.
+/// @return `0` or `-1` in case of an error.
+static int ho_write(int fd, const void *bytes, size_t len) {
+    const char *at = bytes;
+    ssize_t written;
+
+    while (len > 0) {
+        if ((written = send(fd, at, len, MSG_NOSIGNAL)) < 0) {
+            if (errno == EINTR) continue;
+            return -1;
+        }
+        at += written;
+        len -= (size_t)written;
+    }
+
+    return 0;
+}
+
+/// @brief Reads exactly so many bytes from a blocking file descripter.
+/// @param fd File descripter.
+/// @param dst Where to store them.
+/// @param len The number of bytes.
+/// @return `0` or `-1` in case of an error. It's `EPIPE` if the other end
+/// closed it first.
+static int ho_read(int fd, void *dst, size_t len) {
+    char *at = dst;
+    ssize_t read_len;
+
+    while (len > 0) {
+        if ((read_len = read(fd, at, len)) < 0) {
+            if (errno == EINTR) continue;
+            return -1;
+        }
+        if (read_len == 0) {
+            errno = EPIPE;
+            return -1;
+        }
+        at += read_len;
+        len -= (size_t)read_len;
+    }
+
+    return 0;
+}
+
+/// @brief Finds the file of a program like `execvp` does, so that the child of
+/// a process with threads doesn't have to search `PATH` before `exec`.
+/// @param name The program, e.g. `argv[0]`.
+/// @param path Where the path is stored. `PATH_MAX` bytes.
+/// @return `0` or `-1` with `errno` set to `ENOENT` if it's not found.
+static int ho_find_program(const char *name, char *path) {
+    const char *dirs = getenv("PATH");
+    const char *end;
+    int len;
+
+    if (strchr(name, '/') != NULL) {
+        if (snprintf(path, PATH_MAX, "%s", name) >= PATH_MAX) {
+            errno = ENAMETOOLONG;
+            return -1;
+        }
+        return 0;
+    }
+
+    if (dirs == NULL) dirs = "/bin:/usr/bin";
+    for (;; dirs = end + 1) {
+        end = strchrnul(dirs, ':');
+        // An empty directory is the current one.
+        len = snprintf(path, PATH_MAX, "%.*s%s%s", (int)(end - dirs), dirs,
+                       end > dirs ? "/" : "", name);
+        if (len < PATH_MAX && access(path, X_OK) == 0) return 0;
+        if (*end == '\0') break;
+    }
+
+    errno = ENOENT;
+    return -1;
+}
+
+/// @brief Sends a snapshot and its file descripters to the new process.
+/// @param fd The unix socket.
+/// @param h The header.
+/// @param fds The file descripters, `h->fds` of them.
+/// @param snapshot The snapshot, `h->len` bytes.
+/// @return `0` or `-1` in case of an error.
+static int ho_send(int fd, const ho_header *h, const int *fds,
+                   const char *snapshot) {
+    if (ho_write(fd, h, sizeof(ho_header)) < 0 ||
+        st_send_fds(fd, fds, h->fds) < 0)
+        return -1;
+
+    return ho_write(fd, snapshot, h->len);
+}
+
+/// @brief Receives a snapshot and its file descripters from the old process.
+/// @param fd The unix socket.
+/// @param h Where to store the header.
+/// @param fds Where to store the file descripters, which are allocated.
+/// @param snapshot Where to store the snapshot, which is allocated.
+/// @return `0` or `-1` in case of an error.
+static int ho_receive(int fd, ho_header *h, int **fds, char **snapshot) {
+    if (ho_read(fd, h, sizeof(ho_header)) < 0) return -1;
+
+    *fds = malloc((h->fds == 0 ? 1 : h->fds) * sizeof(int));
+    *snapshot = malloc(h->len == 0 ? 1 : h->len);
+    if (*fds == NULL || *snapshot == NULL) {
+        errno = ENOMEM;
+        return -1;
+    }
+
+    if (st_recv_fds(fd, *fds, h->fds) < 0) return -1;
+    return ho_read(fd, *snapshot, h->len);
+}
@@ -0,0 +1,113 @@
+/// This is a histogram of non-negative values such as latencies. Each power of
+/// two is split into `HG_SUBS` buckets, so it covers any 64-bit value in a
+/// few kilobytes and the percentiles it gives are off by an eighth at most.
+///
+/// A single thread records into a histogram, with relaxed atomic stores that
+/// cost as much as plain ones, so other threads can merge it at any time
+/// without locks. A merged copy may be a value or so behind.
+
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+/// Bits of the sub-bucket index.
+#define HG_SUB_BITS 3
+/// The number of buckets of each power of two.
+#define HG_SUBS (1 << HG_SUB_BITS)
+/// The number of buckets.
+#define HG_BUCKETS (64 * HG_SUBS)
+
+/// A histogram. It should be zeroed before it's first used.
+typedef struct {
+    /// The number of values in each bucket.
+    uint64_t counts[HG_BUCKETS];
+    /// The number of values.
+    uint64_t count;
+    /// The sum of the values.
+    uint64_t sum;
+    /// The largest value.
+    uint64_t max;
+} hg_histogram;
+
+/// @brief Gives the bucket of a value. The values below `HG_SUBS` have one
+/// each.
+/// @param value The value.
+/// @return Index of the bucket.
+static size_t hg_bucket(uint64_t value) {
+    unsigned int exp;
+
+    if (value < HG_SUBS) return (size_t)value;
+
+    exp = 63 - (unsigned int)__builtin_clzll(value);
+    return (exp - HG_SUB_BITS + 1) * HG_SUBS +
+           ((value >> (exp - HG_SUB_BITS)) & (HG_SUBS - 1));
+}
+
+/// @brief Gives the largest value of a bucket.
+/// @param bucket Index of the bucket.
+/// @return The value.
+static uint64_t hg_bucket_max(size_t bucket) {
+    unsigned int exp;
+
+    if (bucket < HG_SUBS) return bucket;
+
+    exp = (unsigned int)(bucket / HG_SUBS) + HG_SUB_BITS - 1;
+    return ((uint64_t)1 << exp) +
+           ((uint64_t)(bucket % HG_SUBS + 1) << (exp - HG_SUB_BITS)) - 1;
+}
+
+/// @brief Adds to a number that only this thread changes while others may
+/// read it.
+/// @param number The number.
+/// @param n How much to add.
+static void hg_add(uint64_t *number, uint64_t n) {
+    __atomic_store_n(number, __atomic_load_n(number, __ATOMIC_RELAXED) + n,
+                     __ATOMIC_RELAXED);
+}
+
+/// @brief Adds a value.
+/// @param h The histogram.
+/// @param value The value.
+static void hg_record(hg_histogram *h, uint64_t value) {
+    hg_add(&h->counts[hg_bucket(value)], 1);
+    hg_add(&h->count, 1);
+    hg_add(&h->sum, value);
+    if (value > h->max) __atomic_store_n(&h->max, value, __ATOMIC_RELAXED);
+}
+
+/// @brief Adds the values of a histogram that another thread may be recording
+/// into.
+/// @param into A histogram of this thread.
+/// @param from The other histogram.
+static void hg_merge(hg_histogram *into, const hg_histogram *from) {
+    uint64_t max = __atomic_load_n(&from->max, __ATOMIC_RELAXED);
+
+    for (size_t i = 0; i < HG_BUCKETS; i++)
+        into->counts[i] += __atomic_load_n(&from->counts[i], __ATOMIC_RELAXED);
+    into->count += __atomic_load_n(&from->count, __ATOMIC_RELAXED);
+    into->sum += __atomic_load_n(&from->sum, __ATOMIC_RELAXED);
+    if (max > into->max) into->max = max;
+}
+
+/// @brief Gives a percentile.
+/// @param h The histogram.
+/// @param fraction The share of the values that are at most the percentile,
+/// from `0` to `1`.
+/// @return The largest value of the bucket that the percentile is in, but not
+/// more than the largest value. Zero if there are no values.
+static uint64_t hg_percentile(const hg_histogram *h, double fraction) {
+    // The rank of the percentile, counting from one.
+    uint64_t rank = (uint64_t)(fraction * (double)h->count + 0.5);
+    uint64_t seen = 0;
+
+    if (rank == 0) rank = 1;
+
+    for (size_t i = 0; i < HG_BUCKETS && h->count > 0; i++) {
+        seen += h->counts[i];
+        if (seen < rank) continue;
+        return hg_bucket_max(i) < h->max ? hg_bucket_max(i) : h->max;
+    }
+
+    return h->max;
+}
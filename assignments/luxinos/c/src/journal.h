@@ -0,0 +1,334 @@
+/// This is an append-only journal of what happened to the games. Each shard
+/// collects its records in its own batch and writes the whole batch at the end
+/// of the file while it holds the journal's lock, so the batches of the shards
+/// aren't interleaved even if one takes more than one write. A thread of the journal makes them durable with group
+/// commits: it waits a moment after a batch is written so a single `fdatasync`
+/// covers every batch that the shards wrote meanwhile. A record is durable a
+/// few milliseconds after it happened.
+///
+/// The file is little-endian: a header of the magic `LXJR`, a `u16` version, a
+/// `u16` record size and a `u64` time it was created at, then fixed-size
+/// records, so it can be mapped and scanned as an array. A record is the `u64`
+/// time it happened at and game id, the `u32` number of guesses and
+/// milliseconds the game took, the `u8` event and padding. A batch that fails
+/// to be written is cut off and kept for the next write. A crash may leave a
+/// part of a record at the end, which is cut off when the journal is opened
+/// again.
+
+#pragma once
+
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+
+/// Version of the journal format.
+#define JR_VERSION 1
+/// The size of the header.
+#define JR_HEADER_SIZE 16
+/// The size of a record.
+#define JR_RECORD_SIZE 32
+#ifndef JR_COMMIT_DELAY_US
+/// Microseconds that a sync waits for more batches to share it. The default
+/// value is 2000.
+#define JR_COMMIT_DELAY_US 2000
+#endif
+
+/// What happened to a game.
+typedef enum {
+    /// It was started. Its players aren't in it yet.
+    jr_started = 1,
+    /// It ended after its word was guessed.
+    jr_finished,
+    /// It ended without a correct guess, including when it was called off.
+    jr_abandoned,
+    /// Its chooser gave a hint.
+    jr_hinted,
+} jr_event;
+
+/// A record of the journal.
+typedef struct {
+    /// Microseconds since the epoch.
+    uint64_t at;
+    /// Game id. The ids are only unique while the server runs.
+    uint64_t game;
+    /// Guesses of an ended game, including the repeated ones.
+    uint32_t guesses;
+    /// Milliseconds that an ended game took.
+    uint32_t duration_ms;
+    /// What happened.
+    jr_event event;
+    /// Struct padding.
+    char _padding[4];
+} jr_record;
+
+/// Records of a shard that haven't been written yet.
+typedef struct {
+    /// Encoded records.
+    char *data;
+    /// The number of bytes.
+    size_t len;
+    /// Storage size.
+    size_t cap;
+} jr_batch;
+
+/// A journal that any thread appends batches to.
+typedef struct {
+    /// Guards the counters, `size`, `stopped` and writing to the file.
+    pthread_mutex_t lock;
+    /// Signaled when a batch is written or the journal is stopped.
+    pthread_cond_t written_cond;
+    /// The number of batches written.
+    uint64_t written;
+    /// The number of batches that are durable.
+    uint64_t synced;
+    /// The number of `fdatasync` calls.
+    uint64_t syncs;
+    /// The size of the file. It ends with a whole record.
+    off_t size;
+    /// The file.
+    int fd;
+    /// Whether the thread should sync what's left and return.
+    bool stopped;
+    /// Struct padding.
+    char _padding[3];
+} jr_journal;
+
+/// @brief Writes a little-endian number.
+/// @param dst Where to write it.
+/// @param value The number.
+/// @param size Its size in bytes.
+static void jr_put(char *dst, uint64_t value, size_t size) {
+    for (size_t i = 0; i < size; i++) dst[i] = (char)(value >> (8 * i));
+}
+
+/// @brief Reads a little-endian number.
+/// @param src Where to read it from.
+/// @param size Its size in bytes.
+/// @return The number.
+static uint64_t jr_get(const char *src, size_t size) {
+    uint64_t value = 0;
+
+    for (size_t i = 0; i < size; i++)
+        value |= (uint64_t)(unsigned char)src[i] << (8 * i);
+
+    return value;
+}
+
+/// @brief Encodes the header of a new journal.
+/// @param dst `JR_HEADER_SIZE` bytes.
+/// @param created_at Microseconds since the epoch.
+static void jr_encode_header(char *dst, uint64_t created_at) {
+    memcpy(dst, "LXJR", 4);
+    jr_put(dst + 4, JR_VERSION, 2);
+    jr_put(dst + 6, JR_RECORD_SIZE, 2);
+    jr_put(dst + 8, created_at, 8);
+}
+
+/// @brief Checks the header of a journal.
+/// @param src The start of the journal.
+/// @param len The length of the journal.
+/// @return Whether it's a journal of this version.
+static bool jr_check_header(const char *src, size_t len) {
+    return len >= JR_HEADER_SIZE && memcmp(src, "LXJR", 4) == 0 &&
+           jr_get(src + 4, 2) == JR_VERSION &&
+           jr_get(src + 6, 2) == JR_RECORD_SIZE;
+}
+
+/// @brief Encodes a record.
+/// @param dst `JR_RECORD_SIZE` bytes.
+/// @param r The record.
+static void jr_encode(char *dst, const jr_record *r) {
+    bzero(dst, JR_RECORD_SIZE);
+    jr_put(dst, r->at, 8);
+    jr_put(dst + 8, r->game, 8);
+    jr_put(dst + 16, r->guesses, 4);
+    jr_put(dst + 20, r->duration_ms, 4);
+    jr_put(dst + 24, (uint64_t)r->event, 1);
+}
+
+/// @brief Decodes a record.
+/// @param src `JR_RECORD_SIZE` bytes.
+/// @return The record. Its event may be anything.
+static jr_record jr_decode(const char *src) {
+    return (jr_record){
+        .at = jr_get(src, 8),
+        .game = jr_get(src + 8, 8),
+        .guesses = (uint32_t)jr_get(src + 16, 4),
+        .duration_ms = (uint32_t)jr_get(src + 20, 4),
+        .event = (jr_event)jr_get(src + 24, 1),
+    };
+}
+
+/// @brief Writes the header of a new journal or checks the one of an existing
+/// journal and cuts off a part of a record at its end.
+/// @param fd The file.
+/// @param now Microseconds since the epoch.
+/// @param size Where the size of the file is stored.
+/// @return `0` or `-1` with `errno` set. It's `EINVAL` if the file isn't a
+/// journal of this version.
+static int jr_prepare(int fd, uint64_t now, off_t *size) {
+    char header[JR_HEADER_SIZE];
+    struct stat st;
+    size_t tail;
+
+    if (fstat(fd, &st) < 0) return -1;
+
+    if (st.st_size == 0) {
+        jr_encode_header(header, now);
+        if (pwrite(fd, header, JR_HEADER_SIZE, 0) != JR_HEADER_SIZE) return -1;
+        *size = JR_HEADER_SIZE;
+        return fdatasync(fd);
+    }
+
+    if (pread(fd, header, JR_HEADER_SIZE, 0) != JR_HEADER_SIZE ||
+        !jr_check_header(header, JR_HEADER_SIZE)) {
+        errno = EINVAL;
+        return -1;
+    }
+    tail = (size_t)(st.st_size - JR_HEADER_SIZE) % JR_RECORD_SIZE;
+    *size = st.st_size - (off_t)tail;
+    if (tail > 0) return ftruncate(fd, *size);
+
+    return 0;
+}
+
+/// @brief Opens a journal to append to, making it if it doesn't exist.
+/// @param j The journal. It shouldn't be moved afterwards.
+/// @param path Path to the file.
+/// @param now Microseconds since the epoch.
+/// @return `0` or `-1` with `errno` set. It's `EINVAL` if the file isn't a
+/// journal of this version.
+static int jr_open(jr_journal *j, const char *path, uint64_t now) {
+    int fd, error;
+    off_t size;
+
+    // The batches are written at `size` with `pwrite`, which appends anyway
+    // if the file is opened with `O_APPEND`.
+    if ((fd = open(path, O_RDWR | O_CREAT | O_CLOEXEC, 0644)) < 0) return -1;
+    if (jr_prepare(fd, now, &size) < 0) {
+        error = errno;
+        close(fd);
+        errno = error;
+        return -1;
+    }
+
+    *j = (jr_journal){
+        .written = 0,
+        .synced = 0,
+        .syncs = 0,
+        .size = size,
+        .fd = fd,
+        .stopped = false,
+    };
+    pthread_mutex_init(&j->lock, NULL);
+    pthread_cond_init(&j->written_cond, NULL);
+
+    return 0;
+}
+
+/// @brief Adds a record to a batch.
+/// @param b The batch.
+/// @param r The record.
+/// @return `0` or `-1` if allocating failed, in which case it's left out.
+static int jr_append(jr_batch *b, const jr_record *r) {
+    if (b->len + JR_RECORD_SIZE > b->cap) {
+        size_t cap = b->cap == 0 ? 64 * JR_RECORD_SIZE : b->cap * 2;
+        char *data = realloc(b->data, cap);
+
+        if (data == NULL) return -1;
+        b->data = data;
+        b->cap = cap;
+    }
+
+    jr_encode(b->data + b->len, r);
+    b->len += JR_RECORD_SIZE;
+
+    return 0;
+}
+
+/// @brief Appends a batch to a journal and empties it. The thread of the
+/// journal makes it durable later.
+/// @param j The journal.
+/// @param b The batch.
+/// @return `0` or `-1` with `errno` set if writing failed, in which case the
+/// batch is kept for the next write.
+static int jr_write(jr_journal *j, jr_batch *b) {
+    size_t at = 0;
+    ssize_t written;
+    int error;
+
+    if (b->len == 0) return 0;
+
+    pthread_mutex_lock(&j->lock);
+    while (at < b->len) {
+        written = pwrite(j->fd, b->data + at, b->len - at, j->size + (off_t)at);
+        if (written >= 0) {
+            at += (size_t)written;
+        } else if (errno != EINTR) {
+            // The part that was written is cut off. It's overwritten by the
+            // next batch even if that fails too.
+            error = errno;
+            ftruncate(j->fd, j->size);
+            pthread_mutex_unlock(&j->lock);
+            errno = error;
+            return -1;
+        }
+    }
+    j->size += (off_t)b->len;
+    j->written += 1;
+    pthread_cond_signal(&j->written_cond);
+    pthread_mutex_unlock(&j->lock);
+    b->len = 0;
+
+    return 0;
+}
+
+/// @brief Makes the written batches durable until the journal is stopped. Once
+/// a batch is written, it waits `JR_COMMIT_DELAY_US` for more so they share a
+/// sync.
+/// @param arg The journal.
+/// @return `NULL`.
+static void *jr_run(void *arg) {
+    jr_journal *j = arg;
+    struct timespec delay = {.tv_sec = 0, .tv_nsec = JR_COMMIT_DELAY_US * 1000};
+    uint64_t target;
+
+    pthread_mutex_lock(&j->lock);
+    for (;;) {
+        while (j->synced == j->written && !j->stopped)
+            pthread_cond_wait(&j->written_cond, &j->lock);
+        if (j->synced == j->written) break;
+
+        if (!j->stopped) {
+            pthread_mutex_unlock(&j->lock);
+            nanosleep(&delay, NULL);
+            pthread_mutex_lock(&j->lock);
+        }
+        target = j->written;
+        pthread_mutex_unlock(&j->lock);
+        fdatasync(j->fd);
+        pthread_mutex_lock(&j->lock);
+        j->synced = target;
+        j->syncs += 1;
+    }
+    pthread_mutex_unlock(&j->lock);
+
+    return NULL;
+}
+
+/// @brief Stops the thread of a journal once it has synced what's written.
+/// @param j The journal.
+static void jr_stop(jr_journal *j) {
+    pthread_mutex_lock(&j->lock);
+    j->stopped = true;
+    pthread_cond_signal(&j->written_cond);
+    pthread_mutex_unlock(&j->lock);
+}
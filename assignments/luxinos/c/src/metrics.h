@@ -0,0 +1,283 @@
+/// These are the metrics of a server shard. Each shard records into its own
+/// with the single-writer stores of `histogram.h`, so another thread can take
+/// a snapshot of every shard at any time without locks or pausing them.
+///
+/// A snapshot is rendered either as Prometheus text or as compact binary. The
+/// binary one is little-endian: the magic `LXMT`, a `u16` version and the
+/// `u16` numbers of counters, message kinds and histograms. Then come the
+/// `u64` counters, the messages received and sent by kind and each histogram
+/// as its `u64` count, sum and max, a `u16` number of buckets that have values
+/// and a `u16` index and `u64` count of each of them.
+
+#pragma once
+
+#include "histogram.h"
+#include "protocol.h"
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+
+/// The number of message kinds.
+#define MT_KINDS PL_KINDS
+/// Version of the binary snapshot.
+#define MT_VERSION 1
+/// The number of histograms.
+#define MT_HISTOGRAMS (MT_KINDS + 2)
+/// The most bytes of a binary snapshot.
+#define MT_SNAPSHOT_MAX                                                        \
+    (12 + (mt_counters_len + 2 * MT_KINDS) * 8 +                               \
+     MT_HISTOGRAMS * (26 + HG_BUCKETS * 10))
+
+/// A counter or a gauge.
+typedef enum {
+    /// Connections that were accepted.
+    mt_accepted,
+    /// Users that sent the right password.
+    mt_authenticated,
+    /// Connections that were closed, including the rejected ones.
+    mt_disconnected,
+    /// Bytes received from the users.
+    mt_bytes_in,
+    /// Bytes sent to the users.
+    mt_bytes_out,
+    /// Games that were started.
+    mt_games_started,
+    /// Games whose word was guessed.
+    mt_games_finished,
+    /// Games that ended without a correct guess, including the ones that were
+    /// called off.
+    mt_games_abandoned,
+    /// Users that are connected, as a gauge.
+    mt_users,
+    /// Games that haven't ended, as a gauge.
+    mt_games,
+    mt_counters_len,
+} mt_counter;
+
+/// The metrics of a shard.
+typedef struct {
+    /// By `mt_counter`.
+    uint64_t counters[mt_counters_len];
+    /// Messages received from the users, by kind.
+    uint64_t received[MT_KINDS];
+    /// Messages queued to the users, by kind.
+    uint64_t sent[MT_KINDS];
+    /// Nanoseconds that handling the messages of each kind took.
+    hg_histogram handling[MT_KINDS];
+    /// Bytes that were queued for a user whenever it was flushed.
+    hg_histogram queue_depth;
+    /// Microseconds that the users waited to be matched.
+    hg_histogram match_waits;
+} mt_metrics;
+
+/// Name, type and help of each `mt_counter` in Prometheus text.
+static const char *const mt_counter_texts[mt_counters_len][3] = {
+    {"connections_accepted_total", "counter",
+     "Connections that were accepted."},
+    {"users_authenticated_total", "counter",
+     "Users that sent the right password."},
+    {"connections_closed_total", "counter",
+     "Connections that were closed, including the rejected ones."},
+    {"received_bytes_total", "counter", "Bytes received from the users."},
+    {"sent_bytes_total", "counter", "Bytes sent to the users."},
+    {"games_started_total", "counter", "Games that were started."},
+    {"games_finished_total", "counter", "Games whose word was guessed."},
+    {"games_abandoned_total", "counter",
+     "Games that ended without a correct guess."},
+    {"users", "gauge", "Users that are connected."},
+    {"games", "gauge", "Games that haven't ended."},
+};
+
+/// Label of each message kind.
+static const char *const mt_kind_names[MT_KINDS] = {
+    "exit",           "enter_passwd",    "wrong_passwd",  "assign_uid",
+    "show_opponents", "select_opponent", "ask_opponent",  "guess",
+    "wrong_guess",    "hint",            "correct_guess", "opponents_joined",
+    "opponents_left", "find_match",      "repeated_guess",
+};
+
+/// Percentiles that the histograms are summarized with in Prometheus text.
+static const double mt_quantiles[] = {0.5, 0.9, 0.99, 0.999};
+
+/// @brief Adds to a counter of this shard.
+/// @param m The metrics of this shard.
+/// @param counter The counter.
+/// @param n How much to add.
+static void mt_count(mt_metrics *m, mt_counter counter, uint64_t n) {
+    hg_add(&m->counters[counter], n);
+}
+
+/// @brief Sets a gauge of this shard.
+/// @param m The metrics of this shard.
+/// @param gauge The gauge.
+/// @param value Its value.
+static void mt_set(mt_metrics *m, mt_counter gauge, uint64_t value) {
+    __atomic_store_n(&m->counters[gauge], value, __ATOMIC_RELAXED);
+}
+
+/// @brief Counts a message that was queued to a user.
+/// @param m The metrics of this shard.
+/// @param kind Message kind.
+static void mt_sent(mt_metrics *m, pl_message_kind kind) {
+    if ((unsigned int)kind < MT_KINDS) hg_add(&m->sent[kind], 1);
+}
+
+/// @brief Counts a message that was received from a user and handled.
+/// @param m The metrics of this shard.
+/// @param kind Message kind. It might be anything.
+/// @param ns Nanoseconds that handling it took.
+static void mt_handled(mt_metrics *m, pl_message_kind kind, uint64_t ns) {
+    if ((unsigned int)kind >= MT_KINDS) return;
+    hg_add(&m->received[kind], 1);
+    hg_record(&m->handling[kind], ns);
+}
+
+/// @brief Adds the metrics of a shard, which it may be recording meanwhile.
+/// @param into The sum, which is zeroed at first.
+/// @param from The metrics of a shard.
+static void mt_merge(mt_metrics *into, const mt_metrics *from) {
+    for (size_t i = 0; i < mt_counters_len; i++) {
+        into->counters[i] +=
+            __atomic_load_n(&from->counters[i], __ATOMIC_RELAXED);
+    }
+    for (size_t i = 0; i < MT_KINDS; i++) {
+        into->received[i] +=
+            __atomic_load_n(&from->received[i], __ATOMIC_RELAXED);
+        into->sent[i] += __atomic_load_n(&from->sent[i], __ATOMIC_RELAXED);
+        hg_merge(&into->handling[i], &from->handling[i]);
+    }
+    hg_merge(&into->queue_depth, &from->queue_depth);
+    hg_merge(&into->match_waits, &from->match_waits);
+}
+
+/// @brief Writes a little-endian number.
+/// @param dst Where to write it.
+/// @param value The number.
+/// @param size Its size in bytes.
+/// @return What comes after it.
+static char *mt_put(char *dst, uint64_t value, size_t size) {
+    for (size_t i = 0; i < size; i++) dst[i] = (char)(value >> (8 * i));
+    return dst + size;
+}
+
+/// @brief Writes a histogram of a binary snapshot.
+/// @param dst Where to write it.
+/// @param h The histogram.
+/// @return What comes after it.
+static char *mt_put_histogram(char *dst, const hg_histogram *h) {
+    char *n_buckets;
+    uint64_t n = 0;
+
+    dst = mt_put(dst, h->count, 8);
+    dst = mt_put(dst, h->sum, 8);
+    dst = mt_put(dst, h->max, 8);
+    n_buckets = dst;
+    dst += 2;
+    for (size_t i = 0; i < HG_BUCKETS; i++) {
+        if (h->counts[i] == 0) continue;
+        dst = mt_put(dst, i, 2);
+        dst = mt_put(dst, h->counts[i], 8);
+        n += 1;
+    }
+    mt_put(n_buckets, n, 2);
+
+    return dst;
+}
+
+/// @brief Encodes a snapshot in binary.
+/// @param m The snapshot.
+/// @param dst Where to write it. It should fit `MT_SNAPSHOT_MAX` bytes.
+/// @return The number of bytes.
+static size_t mt_encode(const mt_metrics *m, char *dst) {
+    char *end = dst;
+
+    memcpy(end, "LXMT", 4);
+    end = mt_put(end + 4, MT_VERSION, 2);
+    end = mt_put(end, mt_counters_len, 2);
+    end = mt_put(end, MT_KINDS, 2);
+    end = mt_put(end, MT_HISTOGRAMS, 2);
+    for (size_t i = 0; i < mt_counters_len; i++)
+        end = mt_put(end, m->counters[i], 8);
+    for (size_t i = 0; i < MT_KINDS; i++) end = mt_put(end, m->received[i], 8);
+    for (size_t i = 0; i < MT_KINDS; i++) end = mt_put(end, m->sent[i], 8);
+    for (size_t i = 0; i < MT_KINDS; i++)
+        end = mt_put_histogram(end, &m->handling[i]);
+    end = mt_put_histogram(end, &m->queue_depth);
+    end = mt_put_histogram(end, &m->match_waits);
+
+    return (size_t)(end - dst);
+}
+
+/// @brief Renders a histogram as a Prometheus summary.
+/// @param out Where to render it.
+/// @param name Metric name without the prefix.
+/// @param label The label of the series or an empty string.
+/// @param h The histogram.
+/// @param unit What a value of the histogram is in the unit of the metric.
+static void mt_render_summary(FILE *out, const char *name, const char *label,
+                              const hg_histogram *h, double unit) {
+    const char *comma = label[0] == '\0' ? "" : ",";
+    char labels[64];
+
+    for (size_t i = 0; i < sizeof(mt_quantiles) / sizeof(double); i++) {
+        fprintf(out, "luxinos_%s{%s%squantile=\"%g\"} %g\n", name, label,
+                comma, mt_quantiles[i],
+                (double)hg_percentile(h, mt_quantiles[i]) * unit);
+    }
+
+    labels[0] = '\0';
+    if (label[0] != '\0') snprintf(labels, sizeof(labels), "{%s}", label);
+    fprintf(out, "luxinos_%s_sum%s %g\n", name, labels, (double)h->sum * unit);
+    fprintf(out, "luxinos_%s_count%s %lu\n", name, labels,
+            (unsigned long)h->count);
+}
+
+/// @brief Renders a snapshot as Prometheus text.
+/// @param m The snapshot.
+/// @param out Where to render it.
+static void mt_render(const mt_metrics *m, FILE *out) {
+    char label[64];
+
+    for (size_t i = 0; i < mt_counters_len; i++) {
+        const char *const *text = mt_counter_texts[i];
+
+        fprintf(out, "# HELP luxinos_%s %s\n# TYPE luxinos_%s %s\n", text[0],
+                text[2], text[0], text[1]);
+        fprintf(out, "luxinos_%s %lu\n", text[0],
+                (unsigned long)m->counters[i]);
+    }
+
+    fprintf(out, "# HELP luxinos_messages_received_total Messages received "
+                 "from the users.\n"
+                 "# TYPE luxinos_messages_received_total counter\n");
+    for (size_t i = 0; i < MT_KINDS; i++) {
+        fprintf(out, "luxinos_messages_received_total{kind=\"%s\"} %lu\n",
+                mt_kind_names[i], (unsigned long)m->received[i]);
+    }
+    fprintf(out, "# HELP luxinos_messages_sent_total Messages queued to the "
+                 "users.\n"
+                 "# TYPE luxinos_messages_sent_total counter\n");
+    for (size_t i = 0; i < MT_KINDS; i++) {
+        fprintf(out, "luxinos_messages_sent_total{kind=\"%s\"} %lu\n",
+                mt_kind_names[i], (unsigned long)m->sent[i]);
+    }
+
+    fprintf(out, "# HELP luxinos_message_handling_seconds How long handling a "
+                 "message took.\n"
+                 "# TYPE luxinos_message_handling_seconds summary\n");
+    for (size_t i = 0; i < MT_KINDS; i++) {
+        if (m->handling[i].count == 0) continue;
+        snprintf(label, sizeof(label), "kind=\"%s\"", mt_kind_names[i]);
+        mt_render_summary(out, "message_handling_seconds", label,
+                          &m->handling[i], 1e-9);
+    }
+
+    fprintf(out, "# HELP luxinos_outbound_queue_bytes Bytes that were queued "
+                 "for a user whenever it was flushed.\n"
+                 "# TYPE luxinos_outbound_queue_bytes summary\n");
+    mt_render_summary(out, "outbound_queue_bytes", "", &m->queue_depth, 1);
+    fprintf(out, "# HELP luxinos_match_wait_seconds How long the users waited "
+                 "to be matched.\n"
+                 "# TYPE luxinos_match_wait_seconds summary\n");
+    mt_render_summary(out, "match_wait_seconds", "", &m->match_waits, 1e-6);
+}
@@ -7,6 +7,7 @@
 #include "socket.h"
 #include <poll.h>
 #include <stddef.h>
+#include <stdlib.h>
 #include <string.h>
 
 /// Message kind.
@@ -33,8 +34,36 @@ typedef enum {
     mk_hint,
     /// Announces that the guess is correct.
     mk_correct_guess,
+    /// Adds opponents to the ones shown before.
+    mk_opponents_joined,
+    /// Removes opponents from the ones shown before.
+    mk_opponents_left,
+    /// Asks to be matched with the next user that asks. It carries a game
+    /// with the word that the other one guesses if this one waited longer.
+    /// The match is announced like a selected opponent.
+    mk_find_match,
+    /// Tells the one that guessed that the word was guessed before. The other
+    /// player isn't told again.
+    mk_repeated_guess,
 } pl_message_kind;
 
+/// The number of message kinds.
+#define PL_KINDS (mk_repeated_guess + 1)
+
+/// Wire format of the messages. The server offers the newest version it
+/// supports in the payload of its `mk_enter_passwd` request, which is always
+/// sent in the legacy format so any client can read it, and the client answers
+/// in the version it picked.
+typedef enum {
+    /// Not negotiated yet. Reading detects the version from the first byte.
+    pl_version_unknown = 0,
+    /// Every message is a whole `pl_message` struct.
+    pl_version_legacy,
+    /// A compact frame carries only `raw_bytes_len` payload bytes. The payload
+    /// of the password message starts with the version byte.
+    pl_version_compact,
+} pl_version;
+
 #ifndef PL_RAW_BYTES_SIZE
 /// This is a buffer size used for network communication. The default value is
 /// 1024.
@@ -54,73 +83,545 @@ typedef struct {
     char raw_bytes[PL_RAW_BYTES_SIZE + 4];
 } pl_message;
 
-/// A global buffer used for reading and writing messages.
-static pl_message pl_msg_buf;
+/// Compact frame memory layout:
+/// [<u8 kind><u16 little-endian body length>][<varint id><payload>]
+#define PL_FRAME_HEADER_SIZE 3
+/// The longest LEB128 varint of a `size_t`.
+#define PL_VARINT_MAX_SIZE 10
+/// The longest compact frame.
+#define PL_FRAME_MAX_SIZE                                                      \
+    (PL_FRAME_HEADER_SIZE + PL_VARINT_MAX_SIZE + PL_RAW_BYTES_SIZE)
+
+/// The longest message of any version.
+#define PL_MSG_MAX_SIZE sizeof(pl_message)
+
+/// A received message. It's a view into the input buffer it was decoded from.
+typedef struct {
+    /// Assigned id. Zero means no id is assigned yet.
+    size_t id;
+    /// The length of bytes in `raw_bytes`.
+    size_t raw_bytes_len;
+    /// Raw bytes. They aren't null-terminated nor aligned.
+    const char *raw_bytes;
+    /// Message kind.
+    pl_message_kind kind;
+    /// Struct padding.
+    char _padding[4];
+} pl_frame;
+
+#ifndef PL_INBUF_SIZE
+/// The default size of connection input buffers which is 16384.
+#define PL_INBUF_SIZE 16384
+#endif
+
+/// Buffers the bytes read from a connection until they form complete messages.
+/// Messages are decoded in place and the bytes of an incomplete one are kept
+/// for the next read. A connection that isn't in the middle of a message can
+/// go without storage.
+typedef struct {
+    /// Buffer storage.
+    char *data;
+    /// Storage size.
+    size_t cap;
+    /// Offset of the first byte that's not decoded yet.
+    size_t start;
+    /// Offset after the last read byte.
+    size_t end;
+} pl_inbuf;
+
+#ifndef PL_OUTBUF_SIZE
+/// The default size of connection output buffers which is 65536.
+#define PL_OUTBUF_SIZE 65536
+#endif
+
+/// Connections stop being read while more bytes than this are queued for
+/// them.
+#define PL_OUTBUF_HIGH_WATER (PL_OUTBUF_SIZE / 2)
+
+/// Queues the messages to send to a connection until its socket accepts them.
+/// Its storage comes from a pool and goes back once everything is sent.
+typedef struct {
+    /// Buffer storage.
+    char *data;
+    /// Storage size.
+    size_t cap;
+    /// Offset of the first byte that's not sent yet.
+    size_t start;
+    /// Offset after the last queued byte.
+    size_t end;
+} pl_outbuf;
+
+/// Hands out buffers of the same size and takes them back for reuse, so
+/// connections only hold one while they need it.
+typedef struct {
+    /// Buffers that were given back, linked through their first bytes.
+    char *free;
+    /// Buffer size.
+    size_t size;
+} pl_pool;
 
 /// No timeout.
 #define PL_NO_TIMEOUT -1
 /// The default value for network communication timeout which is 5000.
 #define PL_DEFAULT_TIMEOUT 5000
 
-/// @brief Writes the message to the socket according to the protocol.
-/// Note that you need to pass the raw bytes through an argument
-/// and no need to fill the `raw_bytes` field in `pl_message` manually.
-/// @param fd Socket's file descripter.
-/// @param bytes Message raw bytes.
+/// @brief Writes `value` as a LEB128 varint.
+/// @param dst At least `PL_VARINT_MAX_SIZE` bytes.
+/// @param value The value.
+/// @return The number of bytes written.
+static size_t pl_varint_encode(char *dst, size_t value) {
+    size_t len = 0;
+
+    while (value >= 0x80) {
+        dst[len++] = (char)(value | 0x80);
+        value >>= 7;
+    }
+    dst[len++] = (char)value;
+
+    return len;
+}
+
+/// @brief Reads a LEB128 varint.
+/// @param src Encoded bytes.
+/// @param len Number of available bytes.
+/// @param value Where the value is stored.
+/// @return The number of bytes read or zero if the varint is incomplete or
+/// too long.
+static size_t pl_varint_decode(const char *src, size_t len, size_t *value) {
+    size_t i;
+
+    *value = 0;
+    for (i = 0; i < len && i < PL_VARINT_MAX_SIZE; i++) {
+        *value |= (size_t)((unsigned char)src[i] & 0x7f) << (7 * i);
+        if (((unsigned char)src[i] & 0x80) == 0) return i + 1;
+    }
+
+    return 0;
+}
+
+/// @brief Encodes a compact frame.
+/// @param dst At least `PL_FRAME_MAX_SIZE` bytes.
+/// @param bytes Message raw bytes or `NULL` to leave the payload to the caller.
 /// @param m A message struct.
-/// @return The `st_write` result.
-static ssize_t pl_msg_write(int fd, const char *bytes, pl_message m) {
-    bzero(&pl_msg_buf, sizeof(pl_message));
+/// @return The frame length.
+static size_t pl_frame_encode(char *dst, const char *bytes, pl_message m) {
+    size_t body_len = pl_varint_encode(dst + PL_FRAME_HEADER_SIZE, m.id);
 
-    // Fills the `pl_msg_buf`.
-    pl_msg_buf.id = m.id;
-    pl_msg_buf.kind = m.kind;
-    pl_msg_buf.raw_bytes_len = m.raw_bytes_len;
+    if (bytes != NULL && m.raw_bytes_len > 0)
+        memcpy(dst + PL_FRAME_HEADER_SIZE + body_len, bytes, m.raw_bytes_len);
+    body_len += m.raw_bytes_len;
 
-    // Copy the bytes if we got any.
-    if (pl_msg_buf.raw_bytes_len > 0)
-        memcpy(&pl_msg_buf.raw_bytes, bytes, m.raw_bytes_len);
+    // Explicit little-endian so the frame doesn't depend on the host.
+    dst[0] = (char)m.kind;
+    dst[1] = (char)(body_len & 0xff);
+    dst[2] = (char)(body_len >> 8);
 
-    return st_write(fd, &pl_msg_buf, sizeof(pl_message));
+    return PL_FRAME_HEADER_SIZE + body_len;
 }
 
-/// @brief Writes the message to the socket according to the protocol and waits
-/// until the socket is ready to write if it's not. Note that you need to pass
-/// the raw bytes through an argument and no need to fill the `raw_bytes` field
-/// in `pl_message` manually.
-/// @param fd Socket's file descripter.
-/// @param bytes Message raw bytes.
+/// @brief Encodes a legacy message.
+/// @param dst At least `sizeof(pl_message)` bytes.
+/// @param bytes Message raw bytes or `NULL` to leave the payload to the caller.
 /// @param m A message struct.
-/// @return The `st_write` result.
-static ssize_t pl_poll_msg_write(int fd, const char *bytes, pl_message m,
-                                 int timeout) {
-    if (st_single_poll(fd, pk_write, timeout) <= 0) return -1;
-    return pl_msg_write(fd, bytes, m);
+/// @return The message length.
+static size_t pl_legacy_encode(char *dst, const char *bytes, pl_message m) {
+    memcpy(dst + offsetof(pl_message, id), &m.id, sizeof(size_t));
+    memcpy(dst + offsetof(pl_message, raw_bytes_len), &m.raw_bytes_len,
+           sizeof(size_t));
+    memcpy(dst + offsetof(pl_message, kind), &m.kind, sizeof(pl_message_kind));
+    if (bytes != NULL && m.raw_bytes_len > 0)
+        memcpy(dst + offsetof(pl_message, raw_bytes), bytes, m.raw_bytes_len);
+
+    // The unused bytes go on the wire too and the buffer may hold what was
+    // queued for another connection before.
+    bzero(dst + offsetof(pl_message, raw_bytes) + m.raw_bytes_len,
+          sizeof(pl_message) - offsetof(pl_message, raw_bytes) -
+              m.raw_bytes_len);
+
+    return sizeof(pl_message);
+}
+
+/// @brief Encodes a message in the given wire format.
+/// @param dst At least `PL_MSG_MAX_SIZE` bytes.
+/// @param version Wire format.
+/// @param bytes Message raw bytes or `NULL` to leave the payload to the caller.
+/// @param m A message struct.
+/// @return The encoded length.
+static size_t pl_msg_encode(char *dst, pl_version version, const char *bytes,
+                            pl_message m) {
+    return version == pl_version_compact ? pl_frame_encode(dst, bytes, m)
+                                         : pl_legacy_encode(dst, bytes, m);
+}
+
+/// @brief Initiates a buffer pool.
+/// @param size Buffer size.
+/// @return An empty `pl_pool`.
+static pl_pool pl_pool_init(size_t size) {
+    return (pl_pool){.free = NULL, .size = size};
+}
+
+/// @brief Takes a buffer from the pool. A new one is allocated if none has
+/// been given back.
+/// @param pool The pool.
+/// @return A buffer of `pool->size` bytes or `NULL` if allocating failed.
+static char *pl_pool_get(pl_pool *pool) {
+    char *buf = pool->free;
+
+    if (buf == NULL) return malloc(pool->size);
+    memcpy(&pool->free, buf, sizeof(char *));
+
+    return buf;
+}
+
+/// @brief Gives a buffer back to the pool.
+/// @param pool The pool.
+/// @param buf A buffer of the pool.
+static void pl_pool_put(pl_pool *pool, char *buf) {
+    memcpy(buf, &pool->free, sizeof(char *));
+    pool->free = buf;
+}
+
+/// @brief Initiates an input buffer.
+/// @param data Buffer storage or `NULL` to have none for now.
+/// @param cap Storage size. It should fit `PL_MSG_MAX_SIZE` bytes at least.
+/// @return An empty `pl_inbuf`.
+static pl_inbuf pl_inbuf_init(char *data, size_t cap) {
+    return (pl_inbuf){.data = data, .cap = cap, .start = 0, .end = 0};
+}
+
+/// @brief Moves the incomplete frame left over from the last read, if any, to
+/// the front of the input buffer.
+/// @param in Input buffer.
+static void pl_inbuf_compact(pl_inbuf *in) {
+    if (in->start == 0) return;
+
+    memmove(in->data, in->data + in->start, in->end - in->start);
+    in->end -= in->start;
+    in->start = 0;
+}
+
+/// @brief Reads as many bytes as fit into the input buffer with a single
+/// `read`. The incomplete frame left over from the last read, if any, is moved
+/// to the front first.
+/// @param in Input buffer.
+/// @param fd File descripter.
+/// @return The `st_read` result.
+static ssize_t pl_inbuf_fill(pl_inbuf *in, int fd) {
+    ssize_t read_len;
+
+    pl_inbuf_compact(in);
+    read_len = st_read(fd, in->data + in->end, in->cap - in->end);
+    if (read_len > 0) in->end += (size_t)read_len;
+
+    return read_len;
+}
+
+/// @brief Appends bytes that were received somewhere else, e.g. by
+/// `io_uring`. The incomplete frame left over from the last read, if any, is
+/// moved to the front first.
+/// @param in Input buffer.
+/// @param bytes Received bytes.
+/// @param len The number of bytes.
+/// @return `0` or `-1` with `errno` set to `ENOBUFS` if they don't fit.
+static int pl_inbuf_push(pl_inbuf *in, const char *bytes, size_t len) {
+    pl_inbuf_compact(in);
+    if (in->cap - in->end < len) {
+        errno = ENOBUFS;
+        return -1;
+    }
+
+    memcpy(in->data + in->end, bytes, len);
+    in->end += len;
+
+    return 0;
+}
+
+/// @brief Gives the input buffer's storage back to the pool and drops what's
+/// buffered.
+/// @param in Input buffer.
+/// @param pool Pool of `PL_INBUF_SIZE`-byte buffers.
+/// @param scratch The buffer that's read into if a connection has none.
+static void pl_inbuf_release(pl_inbuf *in, pl_pool *pool, const char *scratch) {
+    if (in->data != NULL && in->data != scratch) pl_pool_put(pool, in->data);
+    *in = pl_inbuf_init(NULL, 0);
 }
 
-/// @brief Reads the message to socket buffer according to the protocol.
-/// Note that you need to pass the raw bytes through an argument
-/// and no need to fill the `raw_bytes` field in `pl_message` manually.
+/// @brief Gives up the storage that the input buffer doesn't need after its
+/// messages are decoded. A connection that read into the shared `scratch`
+/// buffer moves the bytes of an incomplete message to a buffer of the pool,
+/// and an emptied buffer goes back to the pool.
+/// @param in Input buffer.
+/// @param pool Pool of `PL_INBUF_SIZE`-byte buffers.
+/// @param scratch The buffer that's read into if a connection has none.
+/// @return `0` or `-1` if allocating failed.
+static int pl_inbuf_settle(pl_inbuf *in, pl_pool *pool, const char *scratch) {
+    size_t len = in->end - in->start;
+    char *own;
+
+    if (len == 0) {
+        pl_inbuf_release(in, pool, scratch);
+        return 0;
+    }
+    if (in->data != scratch) return 0;
+
+    if ((own = pl_pool_get(pool)) == NULL) return -1;
+    memcpy(own, in->data + in->start, len);
+    *in = (pl_inbuf){.data = own, .cap = pool->size, .start = 0, .end = len};
+
+    return 0;
+}
+
+/// @brief Decodes the next complete message of the input buffer in place.
+/// @param in Input buffer.
+/// @param version Wire format. It's detected and stored if it's
+/// `pl_version_unknown`.
+/// @param frame Where the view is stored. It's valid until the next
+/// `pl_inbuf_fill`.
+/// @return `1` if a message was decoded, `0` if it's incomplete and `-1` if
+/// it's malformed.
+static int pl_frame_decode(pl_inbuf *in, pl_version *version,
+                           pl_frame *frame) {
+    const char *src = in->data + in->start;
+    size_t len = in->end - in->start;
+    size_t body_len, id_len;
+
+    if (len == 0) return 0;
+
+    // Only the password message can be the first one. A legacy message starts
+    // with the lowest byte of the id, which is still zero, and a compact one
+    // with its kind.
+    if (*version == pl_version_unknown) {
+        *version = src[0] == 0 ? pl_version_legacy : pl_version_compact;
+    }
+
+    if (*version == pl_version_legacy) {
+        if (len < sizeof(pl_message)) return 0;
+
+        // The buffer isn't aligned for the fields.
+        memcpy(&frame->id, src + offsetof(pl_message, id), sizeof(size_t));
+        memcpy(&frame->raw_bytes_len, src + offsetof(pl_message, raw_bytes_len),
+               sizeof(size_t));
+        memcpy(&frame->kind, src + offsetof(pl_message, kind),
+               sizeof(pl_message_kind));
+        frame->raw_bytes = src + offsetof(pl_message, raw_bytes);
+        if (frame->raw_bytes_len > PL_RAW_BYTES_SIZE) return -1;
+
+        in->start += sizeof(pl_message);
+        return 1;
+    }
+
+    if (len < PL_FRAME_HEADER_SIZE) return 0;
+    body_len = (size_t)(unsigned char)src[1] |
+               (size_t)(unsigned char)src[2] << 8;
+    if (body_len > PL_FRAME_MAX_SIZE - PL_FRAME_HEADER_SIZE) return -1;
+    if (len < PL_FRAME_HEADER_SIZE + body_len) return 0;
+
+    id_len = pl_varint_decode(src + PL_FRAME_HEADER_SIZE, body_len, &frame->id);
+    if (id_len == 0 || body_len - id_len > PL_RAW_BYTES_SIZE) return -1;
+
+    frame->kind = (pl_message_kind)(unsigned char)src[0];
+    frame->raw_bytes = src + PL_FRAME_HEADER_SIZE + id_len;
+    frame->raw_bytes_len = body_len - id_len;
+
+    in->start += PL_FRAME_HEADER_SIZE + body_len;
+    return 1;
+}
+
+/// @brief Gives the next message of the input buffer and reads the socket
+/// until one is complete if there's none.
 /// @param fd File descripter.
-/// @return A pointer to the corresponding `pl_message`.
-static pl_message *pl_msg_read(int fd) {
-    // Since we work with null-terminated strings we're making sure the buffer
-    // is zeroed out. Yes, there are other ways with better performance but we
-    // stick to simplicity here.
-    bzero(&pl_msg_buf, sizeof(pl_message));
+/// @param in Input buffer.
+/// @param version Wire format. It's detected and stored if it's
+/// `pl_version_unknown`.
+/// @param frame Where the view is stored. It's valid until the next read.
+/// @param timeout Waiting timeout for each read.
+/// @return `frame` or `NULL` with `errno` set to `ETIMEDOUT` if nothing
+/// arrived in time, `ECONNRESET` if the connection closed or `EBADMSG` if the
+/// message is malformed.
+static pl_frame *pl_poll_msg_read(int fd, pl_inbuf *in, pl_version *version,
+                                  pl_frame *frame, int timeout) {
+    int decoded, polled;
+    ssize_t read_len;
+
+    while ((decoded = pl_frame_decode(in, version, frame)) == 0) {
+        if ((polled = st_single_poll(fd, pk_read, timeout)) <= 0) {
+            if (polled == 0) errno = ETIMEDOUT;
+            return NULL;
+        }
+
+        read_len = pl_inbuf_fill(in, fd);
+        if (read_len == 0) errno = ECONNRESET;
+        if (read_len == 0 || (read_len < 0 && errno != EAGAIN)) return NULL;
+    }
+
+    if (decoded < 0) {
+        errno = EBADMSG;
+        return NULL;
+    }
+
+    return frame;
+}
+
+/// @brief Initiates an output buffer.
+/// @param data Buffer storage or `NULL` to take it from a pool later.
+/// @param cap Storage size. It should fit `PL_MSG_MAX_SIZE` bytes at least.
+/// @return An empty `pl_outbuf`.
+static pl_outbuf pl_outbuf_init(char *data, size_t cap) {
+    return (pl_outbuf){.data = data, .cap = cap, .start = 0, .end = 0};
+}
+
+/// @brief Gives the output buffer's storage back to the pool and drops what's
+/// queued.
+/// @param out Output buffer.
+/// @param pool Pool of the output buffer's storage.
+static void pl_outbuf_release(pl_outbuf *out, pl_pool *pool) {
+    if (out->data != NULL) pl_pool_put(pool, out->data);
+    *out = pl_outbuf_init(NULL, 0);
+}
+
+/// @brief Gives the number of queued bytes.
+/// @param out Output buffer.
+/// @return Queued bytes.
+static size_t pl_outbuf_len(const pl_outbuf *out) {
+    return out->end - out->start;
+}
+
+/// @brief Makes room for `len` bytes at the end of the output buffer.
+/// @param out Output buffer.
+/// @param pool Pool of the output buffer's storage.
+/// @param len The number of bytes.
+/// @return Where the bytes go or `NULL` with `errno` set to `ENOBUFS` if they
+/// don't fit.
+static char *pl_outbuf_reserve(pl_outbuf *out, pl_pool *pool, size_t len) {
+    if (out->data == NULL) {
+        if ((out->data = pl_pool_get(pool)) == NULL) {
+            errno = ENOBUFS;
+            return NULL;
+        }
+        out->cap = pool->size;
+    }
 
-    if (st_read(fd, &pl_msg_buf, sizeof(pl_message)) < 0) return NULL;
+    // The sent bytes at the front make room when the end is reached.
+    if (out->cap - out->end < len) {
+        memmove(out->data, out->data + out->start, out->end - out->start);
+        out->end -= out->start;
+        out->start = 0;
+    }
+    if (out->cap - out->end < len) {
+        errno = ENOBUFS;
+        return NULL;
+    }
 
-    return (pl_message *)&pl_msg_buf;
+    return out->data + out->end;
 }
 
-/// @brief Reads the message to socket buffer according to the protocol and
-/// waits until the socket is ready to read if it's not. Note that you need to
-/// pass the raw bytes through an argument and no need to fill the `raw_bytes`
-/// field in `pl_message` manually.
+/// @brief Encodes the header of a message at the end of the output buffer and
+/// leaves room for its payload, so the caller can write it in place.
+/// @param out Output buffer.
+/// @param pool Pool of the output buffer's storage.
+/// @param version Wire format.
+/// @param m A message struct.
+/// @return Where the `raw_bytes_len` payload bytes go or `NULL` with `errno`
+/// set to `ENOBUFS` if the message doesn't fit.
+static char *pl_msg_reserve(pl_outbuf *out, pl_pool *pool, pl_version version,
+                            pl_message m) {
+    size_t max_len = version == pl_version_compact
+                         ? PL_FRAME_HEADER_SIZE + PL_VARINT_MAX_SIZE +
+                               m.raw_bytes_len
+                         : sizeof(pl_message);
+    size_t len;
+    char *dst;
+
+    if (m.raw_bytes_len > PL_RAW_BYTES_SIZE) {
+        errno = EMSGSIZE;
+        return NULL;
+    }
+    if ((dst = pl_outbuf_reserve(out, pool, max_len)) == NULL) return NULL;
+
+    len = pl_msg_encode(dst, version, NULL, m);
+    out->end += len;
+
+    return version == pl_version_compact
+               ? dst + len - m.raw_bytes_len
+               : dst + offsetof(pl_message, raw_bytes);
+}
+
+/// @brief Encodes the message at the end of the output buffer.
+/// @param out Output buffer.
+/// @param pool Pool of the output buffer's storage.
+/// @param version Wire format.
+/// @param bytes Message raw bytes.
+/// @param m A message struct.
+/// @return `0` or `-1` with `errno` set to `ENOBUFS` if it doesn't fit.
+static int pl_msg_queue(pl_outbuf *out, pl_pool *pool, pl_version version,
+                        const char *bytes, pl_message m) {
+    char *dst = pl_msg_reserve(out, pool, version, m);
+
+    if (dst == NULL) return -1;
+    if (m.raw_bytes_len > 0) memcpy(dst, bytes, m.raw_bytes_len);
+
+    return 0;
+}
+
+/// @brief Queues messages that are already encoded, e.g. the same message for
+/// many connections.
+/// @param out Output buffer.
+/// @param pool Pool of the output buffer's storage.
+/// @param bytes Encoded messages.
+/// @param len The length of `bytes`.
+/// @return `0` or `-1` with `errno` set to `ENOBUFS` if they don't fit.
+static int pl_encoded_queue(pl_outbuf *out, pl_pool *pool, const char *bytes,
+                            size_t len) {
+    char *dst;
+
+    if ((dst = pl_outbuf_reserve(out, pool, len)) == NULL) return -1;
+    memcpy(dst, bytes, len);
+    out->end += len;
+
+    return 0;
+}
+
+/// @brief Sends the queued bytes with a single `send`. What the socket doesn't
+/// accept stays queued and the storage goes back to the pool once everything
+/// is sent.
+/// @param out Output buffer.
+/// @param pool Pool of the output buffer's storage.
 /// @param fd File descripter.
-/// @return A pointer to the corresponding `pl_message`.
-static pl_message *pl_poll_msg_read(int fd, int timeout) {
-    if (st_single_poll(fd, pk_read, timeout) <= 0) return NULL;
-    return pl_msg_read(fd);
+/// @return The number of bytes still queued or `-1` if the send failed.
+static ssize_t pl_outbuf_flush(pl_outbuf *out, pl_pool *pool, int fd) {
+    ssize_t sent;
+
+    if (out->start < out->end) {
+        sent = st_send(fd, out->data + out->start, out->end - out->start);
+        if (sent < 0 && errno != EAGAIN) return -1;
+        if (sent > 0) out->start += (size_t)sent;
+    }
+    if (out->start == out->end) pl_outbuf_release(out, pool);
+
+    return (ssize_t)(out->end - out->start);
+}
+
+/// @brief Queues the message and sends the whole queue, waiting until the
+/// socket is ready to write if it's not. Note that you need to pass the raw
+/// bytes through an argument and no need to fill the `raw_bytes` field in
+/// `pl_message` manually.
+/// @param fd Socket's file descripter.
+/// @param out Output buffer.
+/// @param pool Pool of the output buffer's storage.
+/// @param version Wire format.
+/// @param bytes Message raw bytes.
+/// @param m A message struct.
+/// @param timeout Waiting timeout for each write.
+/// @return `0` or `-1` if it failed or timed out.
+static int pl_poll_msg_write(int fd, pl_outbuf *out, pl_pool *pool,
+                             pl_version version, const char *bytes,
+                             pl_message m, int timeout) {
+    ssize_t left;
+
+    if (pl_msg_queue(out, pool, version, bytes, m) < 0) return -1;
+    while ((left = pl_outbuf_flush(out, pool, fd)) > 0) {
+        if (st_single_poll(fd, pk_write, timeout) <= 0) return -1;
+    }
+
+    return (int)left;
 }
@@ -0,0 +1,268 @@
+/// This is an event loop interface on top of either `poll` or `epoll`. File
+/// descripters are registered once and waiting only gives the ones that are
+/// ready.
+///
+/// The `epoll` backend is edge-triggered so an event is only given when the
+/// file descripter becomes ready again and it should be read until `EAGAIN`.
+/// The `poll` backend gives an event as long as the file descripter is ready
+/// for what's wanted.
+
+#pragma once
+
+#include "socket.h"
+#include <stdint.h>
+#include <stdlib.h>
+#include <sys/epoll.h>
+
+/// Reactor backend.
+typedef enum {
+    /// `poll` over every registered file descripter.
+    rx_backend_poll,
+    /// Edge-triggered `epoll`.
+    rx_backend_epoll,
+    /// `io_uring`, which completes the I/O instead of telling readiness. The
+    /// server drives it with `uring.h` and the reactor isn't used.
+    rx_backend_uring,
+} rx_backend;
+
+/// What a file descripter is ready for. Errors and hangups count as reading
+/// since reading is what reports them.
+typedef enum {
+    rx_read = 1,
+    rx_write = 2,
+} rx_interest;
+
+/// The most events a single wait gives.
+#define RX_MAX_EVENTS 256
+
+/// A ready file descripter.
+typedef struct {
+    /// What it was registered with.
+    void *data;
+    /// `rx_interest` flags.
+    unsigned int events;
+    /// Struct padding.
+    char _padding[4];
+} rx_event;
+
+/// An event loop.
+typedef struct {
+    /// The `epoll` instance or `-1` on the `poll` backend.
+    int epfd;
+    /// Backend.
+    rx_backend backend;
+    /// Registered pollfds of the `poll` backend.
+    pollfd *pfds;
+    /// What each pollfd was registered with.
+    void **datas;
+    /// The number of registered pollfds.
+    size_t len;
+    /// Capacity of `pfds` and `datas`.
+    size_t cap;
+    /// The pollfd of each file descripter plus one. Zero means none.
+    size_t *slots;
+    /// Capacity of `slots`.
+    size_t slots_cap;
+} rx_reactor;
+
+/// @brief Gives the `poll` events of an interest.
+/// @param interest `rx_interest` flags.
+/// @return `poll` events.
+static short rx_poll_events(unsigned int interest) {
+    short events = 0;
+
+    if ((interest & rx_read) != 0) events |= POLLIN;
+    if ((interest & rx_write) != 0) events |= POLLOUT;
+
+    return events;
+}
+
+/// @brief Initiates a reactor.
+/// @param backend Backend.
+/// @return A `rx_reactor` or one with `epfd` set to `-2` if creating the
+/// `epoll` instance failed.
+static rx_reactor rx_init(rx_backend backend) {
+    rx_reactor rx = (rx_reactor){
+        .epfd = -1,
+        .backend = backend,
+        .pfds = NULL,
+        .datas = NULL,
+        .len = 0,
+        .cap = 0,
+        .slots = NULL,
+        .slots_cap = 0,
+    };
+
+    if (backend == rx_backend_epoll && (rx.epfd = epoll_create1(0)) < 0)
+        rx.epfd = -2;
+
+    return rx;
+}
+
+/// @brief Grows the `poll` backend's storage so `fd` and one more pollfd fit.
+/// @param rx The reactor.
+/// @param fd File descripter.
+/// @return `0` or `-1` if allocating failed.
+static int rx_poll_reserve(rx_reactor *rx, int fd) {
+    size_t fd_index = (size_t)fd;
+
+    if (rx->len == rx->cap) {
+        size_t cap = rx->cap == 0 ? 64 : rx->cap * 2;
+        pollfd *pfds = realloc(rx->pfds, cap * sizeof(pollfd));
+        void **datas;
+
+        if (pfds == NULL) return -1;
+        rx->pfds = pfds;
+        if ((datas = realloc(rx->datas, cap * sizeof(void *))) == NULL)
+            return -1;
+        rx->datas = datas;
+        rx->cap = cap;
+    }
+
+    if (fd_index >= rx->slots_cap) {
+        size_t cap = rx->slots_cap == 0 ? 64 : rx->slots_cap;
+        size_t *slots;
+
+        while (cap <= fd_index) cap *= 2;
+        if ((slots = realloc(rx->slots, cap * sizeof(size_t))) == NULL)
+            return -1;
+        bzero(slots + rx->slots_cap, (cap - rx->slots_cap) * sizeof(size_t));
+        rx->slots = slots;
+        rx->slots_cap = cap;
+    }
+
+    return 0;
+}
+
+/// @brief Gives the `epoll` events of an interest. Reading is always waited
+/// for since an edge that isn't waited for is lost.
+/// @param interest `rx_interest` flags.
+/// @return `epoll` events.
+static uint32_t rx_epoll_events(unsigned int interest) {
+    uint32_t events = EPOLLIN | EPOLLRDHUP | EPOLLET;
+
+    if ((interest & rx_write) != 0) events |= EPOLLOUT;
+
+    return events;
+}
+
+/// @brief Registers a file descripter.
+/// @param rx The reactor.
+/// @param fd File descripter.
+/// @param data What its events come with.
+/// @param interest `rx_interest` flags.
+/// @return `0` or `-1` if it failed.
+static int rx_add(rx_reactor *rx, int fd, void *data, unsigned int interest) {
+    if (rx->backend == rx_backend_epoll) {
+        struct epoll_event ev;
+
+        ev.events = rx_epoll_events(interest);
+        ev.data.ptr = data;
+        return epoll_ctl(rx->epfd, EPOLL_CTL_ADD, fd, &ev);
+    }
+
+    if (rx_poll_reserve(rx, fd) < 0) return -1;
+
+    rx->pfds[rx->len] = (pollfd){
+        .fd = fd,
+        .events = rx_poll_events(interest),
+        .revents = 0,
+    };
+    rx->datas[rx->len] = data;
+    rx->len += 1;
+    rx->slots[fd] = rx->len;
+
+    return 0;
+}
+
+/// @brief Changes what a registered file descripter is waited for. It costs a
+/// syscall on the `epoll` backend so it should only be called on a change.
+/// @param rx The reactor.
+/// @param fd File descripter.
+/// @param data What its events come with.
+/// @param interest `rx_interest` flags.
+/// @return `0` or `-1` if it failed.
+static int rx_want(rx_reactor *rx, int fd, void *data, unsigned int interest) {
+    if (rx->backend == rx_backend_epoll) {
+        struct epoll_event ev;
+
+        ev.events = rx_epoll_events(interest);
+        ev.data.ptr = data;
+        return epoll_ctl(rx->epfd, EPOLL_CTL_MOD, fd, &ev);
+    }
+
+    rx->pfds[rx->slots[fd] - 1].events = rx_poll_events(interest);
+
+    return 0;
+}
+
+/// @brief Unregisters a file descripter. It should be called before closing
+/// it.
+/// @param rx The reactor.
+/// @param fd File descripter.
+static void rx_remove(rx_reactor *rx, int fd) {
+    size_t slot;
+
+    if (rx->backend == rx_backend_epoll) {
+        epoll_ctl(rx->epfd, EPOLL_CTL_DEL, fd, NULL);
+        return;
+    }
+
+    if ((size_t)fd >= rx->slots_cap || (slot = rx->slots[fd]) == 0) return;
+
+    // The last pollfd takes its place.
+    rx->len -= 1;
+    rx->pfds[slot - 1] = rx->pfds[rx->len];
+    rx->datas[slot - 1] = rx->datas[rx->len];
+    rx->slots[rx->pfds[slot - 1].fd] = slot;
+    rx->slots[fd] = 0;
+}
+
+/// @brief Waits until a registered file descripter is ready.
+/// @param rx The reactor.
+/// @param events At least `RX_MAX_EVENTS` events.
+/// @param timeout Waiting timeout.
+/// @return The number of ready file descripters or `-1` if waiting failed. A
+/// wait that a signal interrupted, e.g. when the process is stopped and
+/// continued, gives none.
+static int rx_wait(rx_reactor *rx, rx_event *events, int timeout) {
+    int ready, n = 0;
+
+    if (rx->backend == rx_backend_epoll) {
+        struct epoll_event evs[RX_MAX_EVENTS];
+
+        ready = epoll_wait(rx->epfd, evs, RX_MAX_EVENTS, timeout);
+        if (ready < 0 && errno == EINTR) return 0;
+        for (int i = 0; i < ready; i++) {
+            uint32_t read_events = EPOLLIN | EPOLLRDHUP | EPOLLHUP | EPOLLERR;
+
+            events[i].data = evs[i].data.ptr;
+            events[i].events = 0;
+            if ((evs[i].events & read_events) != 0) events[i].events |= rx_read;
+            if ((evs[i].events & EPOLLOUT) != 0) events[i].events |= rx_write;
+        }
+
+        return ready;
+    }
+
+    if ((ready = poll(rx->pfds, rx->len, timeout)) < 0 && errno == EINTR)
+        return 0;
+    if (ready <= 0) return ready;
+
+    // Whatever doesn't fit is given by the next wait since the file descripter
+    // is still ready.
+    for (size_t i = 0; i < rx->len && n < ready && n < RX_MAX_EVENTS; i++) {
+        short revents = rx->pfds[i].revents;
+
+        if (revents == 0) continue;
+
+        events[n].data = rx->datas[i];
+        events[n].events = 0;
+        if ((revents & (POLLIN | POLLHUP | POLLERR)) != 0)
+            events[n].events |= rx_read;
+        if ((revents & POLLOUT) != 0) events[n].events |= rx_write;
+        n += 1;
+    }
+
+    return n;
+}
@@ -0,0 +1,149 @@
+#define _GNU_SOURCE
+
+#include "console.h"
+#include "histogram.h"
+#include "journal.h"
+#include <stdio.h>
+#include <sys/mman.h>
+#include <time.h>
+
+/// Statistics that are rebuilt from a journal.
+typedef struct {
+    /// Guesses of each finished game.
+    hg_histogram guesses;
+    /// Milliseconds that each finished game took.
+    hg_histogram durations;
+    /// The number of records.
+    uint64_t records;
+    /// Games that were started.
+    uint64_t started;
+    /// Games whose word was guessed.
+    uint64_t finished;
+    /// Games that ended without a correct guess.
+    uint64_t abandoned;
+    /// Hints that were given.
+    uint64_t hints;
+    /// Records of events that this version doesn't know.
+    uint64_t unknown;
+    /// When the first and the last record happened, in microseconds since the
+    /// epoch.
+    uint64_t first_at;
+    /// See `first_at`.
+    uint64_t last_at;
+} replay_stats;
+
+/// What the journal adds up to.
+static replay_stats stats;
+
+/// @brief Gives the time of a monotonic clock in nanoseconds.
+/// @return Nanoseconds.
+static long now_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+/// @brief Adds the records of a journal to `stats`.
+/// @param records The first record.
+/// @param len The number of records.
+static void replay(const char *records, size_t len) {
+    for (size_t i = 0; i < len; i++) {
+        jr_record r = jr_decode(records + i * JR_RECORD_SIZE);
+
+        if (stats.records++ == 0) stats.first_at = r.at;
+        stats.last_at = r.at;
+
+        switch (r.event) {
+        case jr_started:
+            stats.started += 1;
+            break;
+        case jr_finished:
+            stats.finished += 1;
+            hg_record(&stats.guesses, r.guesses);
+            hg_record(&stats.durations, r.duration_ms);
+            break;
+        case jr_abandoned:
+            stats.abandoned += 1;
+            break;
+        case jr_hinted:
+            stats.hints += 1;
+            break;
+        default:
+            stats.unknown += 1;
+            break;
+        }
+    }
+}
+
+int main(int argc, char *argv[]) {
+    struct stat st;
+    const char *journal;
+    size_t len, tail;
+    long started, took;
+    uint64_t ended;
+    int fd;
+
+    if (argc != 2) {
+        die("Invalid number of arguments. You pass the path of a journal "
+            "file.\n");
+    }
+
+    fd = success_or_die(open(argv[1], O_RDONLY | O_CLOEXEC),
+                        "Failed to open the journal");
+    success_or_die(fstat(fd, &st), "Failed to open the journal");
+    len = (size_t)st.st_size;
+    if (len < JR_HEADER_SIZE) die("The file isn't a journal.\n");
+
+    // The records are read in order, once.
+    journal = mmap(NULL, len, PROT_READ, MAP_PRIVATE, fd, 0);
+    if (journal == MAP_FAILED) die("Failed to map the journal.\n");
+    madvise((void *)(uintptr_t)journal, len, MADV_SEQUENTIAL);
+    if (!jr_check_header(journal, len))
+        die("The file isn't a journal of this version.\n");
+
+    started = now_ns();
+    tail = (len - JR_HEADER_SIZE) % JR_RECORD_SIZE;
+    replay(journal + JR_HEADER_SIZE, (len - JR_HEADER_SIZE) / JR_RECORD_SIZE);
+    took = now_ns() - started;
+
+    ended = stats.finished + stats.abandoned;
+    printf("Replayed %lu records of %zu bytes in %.3f ms (%.0f MB/s).\n",
+           (unsigned long)stats.records, len, (double)took / 1e6,
+           (double)len / ((double)took / 1e9) / 1e6);
+    if (tail > 0)
+        printf("The last %zu bytes are a part of a record, which the server "
+               "cuts off when it opens the journal again.\n",
+               tail);
+    if (stats.records > 0) {
+        printf("The records span %.3f seconds.\n",
+               (double)(stats.last_at - stats.first_at) / 1e6);
+    }
+    printf("Games: %lu started, %lu finished, %lu abandoned and %lu not "
+           "ended.\n",
+           (unsigned long)stats.started, (unsigned long)stats.finished,
+           (unsigned long)stats.abandoned,
+           (unsigned long)(stats.started > ended ? stats.started - ended : 0));
+    printf("Hints: %lu.\n", (unsigned long)stats.hints);
+    if (stats.finished > 0) {
+        printf("Finished games took %.2f guesses on average, %lu at the "
+               "median, %lu at p99 and %lu at most.\n",
+               (double)stats.guesses.sum / (double)stats.finished,
+               (unsigned long)hg_percentile(&stats.guesses, 0.5),
+               (unsigned long)hg_percentile(&stats.guesses, 0.99),
+               (unsigned long)stats.guesses.max);
+        printf("They lasted %lu ms at the median, %lu ms at p99 and %lu ms "
+               "at most.\n",
+               (unsigned long)hg_percentile(&stats.durations, 0.5),
+               (unsigned long)hg_percentile(&stats.durations, 0.99),
+               (unsigned long)stats.durations.max);
+    }
+    if (stats.unknown > 0) {
+        printf("%lu records are of events that this version doesn't know.\n",
+               (unsigned long)stats.unknown);
+    }
+
+    munmap((void *)(uintptr_t)journal, len);
+    close(fd);
+
+    return 0;
+}
@@ -1,25 +1,175 @@
 #define _GNU_SOURCE
 
 #include "cli.h"
+#include "codec.h"
 #include "console.h"
 #include "game.h"
+#include "handover.h"
+#include "histogram.h"
+#include "journal.h"
+#include "metrics.h"
 #include "protocol.h"
+#include "reactor.h"
+#include "shard.h"
 #include "socket.h"
+#include "table.h"
+#include "timer.h"
+#include "uring.h"
+#include <pthread.h>
 #include <signal.h>
 #include <stddef.h>
 #include <stdio.h>
-
-#define MAX_CLIENTS 10
+#include <sys/wait.h>
+#include <time.h>
+
+#ifndef MAX_CLIENTS
+/// The most users each shard serves at once. Nothing is sized by it.
+#define MAX_CLIENTS 262144
+#endif
+/// The low bits of a user or game id that tell its slot. The rest is the
+/// generation of the slot so the ids of a reused slot are new, while the ids
+/// of the slots that haven't been reused stay small.
+#define ID_SLOT_BITS 24
+/// The slot bits of an id.
+#define ID_SLOT_MASK (((size_t)1 << ID_SLOT_BITS) - 1)
 #define HOST INADDR_ANY
+/// The most opponent ids in a single announcement.
+#define LOBBY_CHUNK (PL_RAW_BYTES_SIZE / sizeof(size_t))
+/// The most reads of a user in a row so one that keeps sending doesn't hold
+/// up the others.
+#define READ_BUDGET 2
+/// Changes of the lobby are announced at most once in this many milliseconds
+/// so the ones in between go out together.
+#define ANNOUNCE_INTERVAL 100
+/// Records are written to the journal at most once in this many milliseconds
+/// by each shard, unless they add up to `JOURNAL_BATCH_BYTES`.
+#define JOURNAL_INTERVAL 1
+/// The most bytes of records that a shard holds back from the journal.
+#define JOURNAL_BATCH_BYTES 65536
+/// Submission queue entries of the io_uring backend.
+#define URING_ENTRIES 1024
+/// The number of provided buffers that the io_uring backend receives into.
+#define URING_BUFS 1024
+/// Size of each provided buffer. Along with an incomplete message it fits
+/// into an input buffer.
+#define URING_BUF_SIZE 4096
+/// Milliseconds that a new connection has to send the password.
+#define HANDSHAKE_TIMEOUT PL_DEFAULT_TIMEOUT
+/// The shard that matches the users that ask for a match, so every pair is
+/// made by a single thread.
+#define MATCH_SHARD 0
+/// Milliseconds between the reports of how long users waited for a match.
+#define REPORT_INTERVAL 60000
+/// Milliseconds that a new process of the server has to say hello when the
+/// server restarts itself.
+#define HANDOVER_HELLO_TIMEOUT 5000
+/// Milliseconds that the io_uring requests in flight have to complete when the
+/// server restarts itself. The users whose requests don't are disconnected.
+#define HANDOVER_DRAIN_TIMEOUT 1000
+/// File descripter that a new process of the server gets the unix socket of the
+/// handover as.
+#define HANDOVER_FD 3
+
+// Every thread is a shard with its own users, games and event loop, which
+// live in thread-local variables. Shards only talk to each other through their
+// mailboxes.
+
+/// A thread of the server.
+typedef struct {
+    /// Mails from the other shards.
+    sh_mailbox mailbox;
+    /// The thread.
+    pthread_t thread;
+    /// What the shard records about itself. Any thread may read it.
+    mt_metrics *metrics;
+    /// What the shard hands over when the server restarts itself.
+    ho_buffer saved;
+    /// The sockets of the users in `saved`, as `int`s.
+    ho_buffer saved_fds;
+    /// What the shard goes on from if the server was restarted.
+    ho_reader restore;
+    /// The sockets of the users in `restore`.
+    const int *restore_fds;
+    /// Listening socket. Unix sockets are shared by every shard.
+    int serverfd;
+    /// Struct padding.
+    char _padding[4];
+} shard;
 
-// Ensures the server descripter is in a global variable so
-// it can be accessed by signal handlers for closing it.
-/// Server's file descripter.
-static int serverfd;
-
-// Same thing for cli arguments.
 /// Cli arguments of the application.
 static cli_args args;
+/// Every shard.
+static shard *sr_shards;
+/// The number of shards.
+static size_t sr_shards_len;
+/// The admin socket that the metrics are read from, if any.
+static int sr_admin_fd = -1;
+/// The thread that serves the admin socket.
+static pthread_t sr_admin;
+/// Whether the admin thread has been stopped.
+static bool sr_admin_stopped = false;
+/// The journal of the games, if `args.journal_file` is set.
+static jr_journal sr_journal;
+/// The thread that makes the journal durable.
+static pthread_t sr_journal_thread;
+/// Microseconds of `now_us` when the server that restarted stopped serving.
+static uint64_t sr_paused_at;
+/// The number of shards that are still going on from the snapshot of the
+/// server that restarted.
+static size_t sr_restoring;
+/// The users and games that the shards went on with.
+static size_t sr_restored[2];
+/// The snapshot that the shards go on from and its sockets. They're freed once
+/// every shard has.
+static char *sr_snapshot;
+/// See `sr_snapshot`.
+static int *sr_snapshot_fds;
+
+/// Index of this thread's shard.
+static _Thread_local size_t sr_shard;
+/// Server's file descripter.
+static _Thread_local int serverfd;
+/// Whether the shard hasn't been stopped.
+static _Thread_local bool sr_running = true;
+/// Shards that were mailed since they were last woken up, by index.
+static _Thread_local bool *sr_wakes;
+/// The metrics of this shard.
+static _Thread_local mt_metrics *sr_metrics;
+/// Journal records that haven't been written yet.
+static _Thread_local jr_batch sr_batch;
+/// Milliseconds of `now_ms` when the journal was last written to.
+static _Thread_local long sr_journaled_at = 0;
+/// Whether the shard is waiting for its io_uring requests to complete before
+/// it's handed over. It neither reads nor sends meanwhile.
+static _Thread_local bool sr_handing_over = false;
+/// Milliseconds of `now_ms` when the shard is handed over anyway.
+static _Thread_local long sr_handover_deadline;
+
+/// What a timer is for.
+typedef enum {
+    /// The password of a user hasn't arrived in time.
+    timer_handshake,
+    /// A user has been idle in the lobby for too long.
+    timer_idle,
+    /// A user hasn't taken anything that's sent to it for too long.
+    timer_stall,
+    /// The guesser of a game hasn't guessed in time.
+    timer_turn,
+    /// It's time to report how long users waited for a match.
+    timer_report,
+} timer_kind;
+
+/// Where a user is in its session.
+typedef enum {
+    /// It's connected and the password hasn't arrived yet.
+    state_awaiting_passwd,
+    /// It's authenticated and available as an opponent.
+    state_in_lobby,
+    /// It's waiting to be matched with the next user that asks.
+    state_in_queue,
+    /// It's been chosen or chosen an opponent.
+    state_in_game,
+} user_state;
 
 /// A user.
 typedef struct {
@@ -27,372 +177,2938 @@ typedef struct {
     size_t id;
     /// User's socket file descripter.
     int fd;
-    /// Whether the user has finished its game and quitted.
+    /// Wire format negotiated with the user.
+    pl_version version;
+    /// Bytes received from the user.
+    pl_inbuf in;
+    /// Messages waiting to be sent to the user.
+    pl_outbuf out;
+    /// Messages that an io_uring send has in flight. Its storage is only given
+    /// back once the send completes, even if the user has quitted.
+    pl_outbuf sending;
+    /// The number of the user's requests that another shard hasn't answered
+    /// yet.
+    size_t forwarded;
+    /// Id plus one of the game the user is in. Zero means none. The game
+    /// might be on another shard and it might have finished since.
+    size_t game;
+    /// The other player of `game`.
+    size_t opponent;
+    /// Disconnects the user if its password or, in the lobby, any message
+    /// doesn't arrive in time.
+    tw_timer session;
+    /// Disconnects the user if what's queued for it doesn't go out in time.
+    tw_timer stall;
+    /// What the user's socket is waited for.
+    unsigned int interest;
+    /// Id plus one of the first provided buffer that the io_uring backend
+    /// holds back for the user while too much is queued for it. Zero means
+    /// none.
+    unsigned int held_first;
+    /// Id plus one of the last held provided buffer.
+    unsigned int held_last;
+    /// Where the user is in its session.
+    user_state state;
+    /// Whether the user has finished its game and quitted. Its slot is freed
+    /// once nothing refers to it anymore.
     bool finished_game;
+    /// Whether the user is in `sr_flushes`.
+    bool flush_pending;
+    /// Whether the user's socket may have bytes that haven't been read.
+    bool readable;
+    /// Whether the user is in `sr_resumes`.
+    bool resume_pending;
+    /// Whether an io_uring receive of the user hasn't given its last
+    /// completion.
+    bool receiving;
+    /// Whether the user's io_uring receive is being cancelled.
+    bool cancelling;
+    /// Whether the user chose the word of `game` and it hasn't been guessed.
+    bool chooser;
     /// Padding.
-    char _padding[3];
+    char _padding[1];
 } user;
-/// Connected users.
+
+_Static_assert((size_t)MAX_CLIENTS * CLI_MAX_SHARDS <= ID_SLOT_MASK + 1,
+               "The ids don't have room for the users of every shard.");
+
+/// A game of this shard.
 typedef struct {
-    user users[MAX_CLIENTS];
-    size_t len;
-} users;
+    /// What the players are told, along with the word.
+    ge_game game;
+    /// Ends the game if the guesser doesn't guess in time.
+    tw_timer turn;
+    /// The player that picked the other one from the lobby. It's told about
+    /// the game once the other one is in it. Zero if the game is a match.
+    size_t requester;
+    /// The key of the word, which is normalized.
+    ge_key word_key;
+    /// The wrong guesses so far, so the repeated ones aren't announced again.
+    ge_guesses guesses;
+    /// Milliseconds of `now_ms` when it started.
+    long started_at;
+    /// The number of guesses, including the repeated ones.
+    uint32_t guess_count;
+    /// Whether the word has been guessed.
+    bool guessed;
+    /// Struct padding.
+    char _padding[3];
+} hosted_game;
 
-/// Processed/processing games.
+/// Users of this shard.
 typedef struct {
-    ge_game games[MAX_CLIENTS];
+    user **users;
     size_t len;
-} games;
+    size_t cap;
+} user_list;
 
-/// Pollfd instances to wait on.
+/// A set of user ids of every shard.
 typedef struct {
-    pollfd pfds[MAX_CLIENTS + 1];
+    size_t *ids;
     size_t len;
-} pollfds;
-
-/// Server games.
-static games sr_games = (games){.len = 0};
-/// Server users.
-static users sr_users = (users){.len = 0};
-/// Server poll fds.
-static pollfds sr_pfds = (pollfds){.len = 0};
-
-// Closes the connection and exits when the SIGINT signal is received.
-static void __attribute((noreturn))
-sigint_handler(int sig_num __attribute__((unused))) {
-    for (size_t i = 0; i < sr_users.len; i++) {
-        user u = sr_users.users[i];
+    size_t cap;
+} user_ids;
+
+/// Where a user of any shard is in the lobby. Users whose ids have the same
+/// slot bits share it.
+typedef struct {
+    /// The user it's about.
+    size_t id;
+    /// Position in `sr_lobby` plus one. Zero means it's not available as an
+    /// opponent.
+    size_t slot;
+    /// Whether the user joined the lobby after the last announcement.
+    bool is_new;
+    /// Struct padding.
+    char _padding[7];
+} lobby_entry;
+
+/// A user as it's handed over to a new process of the server. Its socket is
+/// the next one of its shard and what's buffered for it comes after it, the
+/// received bytes first.
+typedef struct {
+    /// Slot of the user.
+    size_t slot;
+    /// See `user`.
+    size_t forwarded;
+    /// See `user`.
+    size_t game;
+    /// See `user`.
+    size_t opponent;
+    /// The tick that its session timer expires at or `TW_NEVER`.
+    long session_at;
+    /// The tick that its stall timer expires at or `TW_NEVER`.
+    long stall_at;
+    /// The number of received bytes that haven't been handled.
+    size_t in_len;
+    /// The number of bytes that haven't been sent.
+    size_t out_len;
+    /// What its session timer is for.
+    unsigned int session_kind;
+    /// See `user`.
+    pl_version version;
+    /// See `user`.
+    user_state state;
+    /// See `user`.
+    bool chooser;
+    /// Struct padding.
+    char _padding[3];
+} saved_user;
+
+/// A game as it's handed over to a new process of the server. The hashes of
+/// its guesses come after it.
+typedef struct {
+    /// See `hosted_game`.
+    ge_game game;
+    /// See `hosted_game`.
+    size_t requester;
+    /// The tick that its turn timer expires at or `TW_NEVER`.
+    long turn_at;
+    /// See `hosted_game`.
+    long started_at;
+    /// The number of hashes of its guesses.
+    size_t guesses_len;
+    /// See `hosted_game`.
+    uint32_t guess_count;
+    /// See `hosted_game`.
+    bool guessed;
+    /// Struct padding.
+    char _padding[3];
+} saved_game;
+
+/// Games that haven't finished, in `hosted_game` slots.
+static _Thread_local tb_table sr_games;
+/// Server users, in `user` slots.
+static _Thread_local tb_table sr_users;
+/// Server event loop. The listening socket is registered without a user and
+/// the mailbox with its shard.
+static _Thread_local rx_reactor sr_rx;
+/// The ring of the io_uring backend.
+static _Thread_local ur_ring sr_ring;
+/// Whether new connections are accepted. They aren't while the limit is
+/// reached.
+static _Thread_local bool sr_accepting = false;
+/// Whether the io_uring backend has an accept that hasn't given its last
+/// completion.
+static _Thread_local bool sr_accept_armed = false;
+/// The provided buffer held back after each one plus one, indexed by buffer
+/// id. Zero means none.
+static _Thread_local unsigned int sr_held_next[URING_BUFS];
+/// The number of received bytes in each held provided buffer.
+static _Thread_local size_t sr_held_len[URING_BUFS];
+/// Storage of the users' input buffers.
+static _Thread_local pl_pool sr_inpool =
+    (pl_pool){.free = NULL, .size = PL_INBUF_SIZE};
+/// Storage of the users' output buffers.
+static _Thread_local pl_pool sr_outpool =
+    (pl_pool){.free = NULL, .size = PL_OUTBUF_SIZE};
+/// Users without an input buffer of their own read into this one.
+static _Thread_local char sr_scratch[PL_INBUF_SIZE];
+/// The buffer that the bytes being handled are in if the user has no input
+/// buffer of its own. It's `sr_scratch` unless they're in a provided buffer of
+/// the io_uring backend.
+static _Thread_local char *sr_shared;
+/// Users of every shard that are available as opponents, in no particular
+/// order. The ones of the other shards come from their announcements.
+static _Thread_local user_ids sr_lobby;
+/// Where each user is in `sr_lobby`, indexed by the slot bits of its id.
+static _Thread_local lobby_entry *sr_lobby_entries;
+/// The number of `sr_lobby_entries`.
+static _Thread_local size_t sr_lobby_entries_len;
+/// Users that joined the lobby after the last announcement.
+static _Thread_local user_ids sr_joined;
+/// Users that left the lobby after the last announcement.
+static _Thread_local user_ids sr_left;
+/// Users with messages queued since the last flush.
+static _Thread_local user_list sr_flushes;
+/// Users that weren't read while too much was queued for them and have room
+/// now.
+static _Thread_local user_list sr_resumes;
+/// Users that quitted and whose slots haven't been freed yet.
+static _Thread_local user_list sr_quits;
+/// Timers of the users and games, in milliseconds of `now_ms`.
+static _Thread_local tw_wheel sr_timers;
+/// The request of the user that waits to be matched, on `MATCH_SHARD`. Its
+/// chooser is the user and its id is when it asked, in microseconds of
+/// `now_us`. Nobody waits if the chooser is zero.
+static _Thread_local ge_game sr_waiting;
+/// Reports how long the users waited to be matched while they're being
+/// matched.
+static _Thread_local tw_timer sr_report;
+
+/// What a mail between shards is for.
+typedef enum {
+    /// Users of the sender joined the lobby. The ids are in the bytes.
+    mail_joined,
+    /// Users of the sender left the lobby. The ids are in the bytes.
+    mail_left,
+    /// The user is in a game now so it's not available anymore, unless it
+    /// wasn't available already. The game without the word is in the bytes and
+    /// the message kind is what started it.
+    mail_enter_game,
+    /// The user said whether it's in a game that it was picked for. The game id
+    /// is in the bytes and the message kind is `mk_select_opponent` if it is.
+    mail_entered,
+    /// A message to the user.
+    mail_deliver,
+    /// A guess in a game of the shard. The game is in the bytes.
+    mail_guess,
+    /// The word of the user's game has been guessed.
+    mail_guessed,
+    /// The user quitted so its game of the shard is over. The game id is in
+    /// the bytes.
+    mail_quit,
+    /// The user's game timed out so it's told to exit and disconnected.
+    mail_evict,
+    /// The user asks to be matched. Its request is in the bytes, like
+    /// `sr_waiting`.
+    mail_find_match,
+    /// The user that asked to be matched quitted.
+    mail_leave_queue,
+    /// The user's match was called off since its opponent couldn't join. The
+    /// game id is in the bytes.
+    mail_call_off,
+    /// Everything that a request of the user caused to be sent to it has been
+    /// mailed.
+    mail_answered,
+    /// The server is shutting down.
+    mail_stop,
+    /// The server is restarting itself, so the shard is handed over.
+    mail_handover,
+} mail_kind;
+
+/// What an io_uring completion is for. It's in the upper half of the user data
+/// and the index of the user in the lower half.
+typedef enum {
+    uring_accept = 1,
+    uring_recv,
+    uring_send,
+    uring_cancel,
+    uring_mail,
+} uring_op;
+
+static void quit_user(user *u);
+static void receive_held(user *u);
+static void lobby_leave(size_t id);
+static void end_game(hosted_game *hosted);
+
+/// @brief Adds a user to a list, which grows as needed.
+/// @param list The list.
+/// @param u The user.
+static void push_user(user_list *list, user *u) {
+    if (list->len == list->cap) {
+        size_t cap = list->cap == 0 ? 64 : list->cap * 2;
+        user **users = realloc(list->users, cap * sizeof(user *));
+
+        if (users == NULL) die("Failed to allocate a list of users.\n");
+        list->users = users;
+        list->cap = cap;
+    }
+
+    list->users[list->len] = u;
+    list->len += 1;
+}
+
+/// @brief Adds an id to a set, which grows as needed.
+/// @param set The set.
+/// @param id User id.
+static void push_id(user_ids *set, size_t id) {
+    if (set->len == set->cap) {
+        size_t cap = set->cap == 0 ? 64 : set->cap * 2;
+        size_t *ids = realloc(set->ids, cap * sizeof(size_t));
+
+        if (ids == NULL) die("Failed to allocate a set of ids.\n");
+        set->ids = ids;
+        set->cap = cap;
+    }
+
+    set->ids[set->len] = id;
+    set->len += 1;
+}
+
+/// @brief Makes a handle of a slot of this shard. The slots of the shards are
+/// interleaved so the handles are unique.
+/// @param t The table of the slot.
+/// @param slot The slot.
+/// @return The handle. It's the id of a game and the id of a user minus one.
+static size_t make_handle(const tb_table *t, size_t slot) {
+    return tb_generation(t, slot) << ID_SLOT_BITS |
+           (slot * sr_shards_len + sr_shard);
+}
+
+/// @brief Gives the shard of a handle.
+/// @param handle The handle.
+/// @return Index of the shard.
+static size_t handle_shard(size_t handle) {
+    return (handle & ID_SLOT_MASK) % sr_shards_len;
+}
+
+/// @brief Gives the slot of a handle on its shard.
+/// @param handle The handle.
+/// @return The slot.
+static size_t handle_slot(size_t handle) {
+    return (handle & ID_SLOT_MASK) / sr_shards_len;
+}
+
+/// @brief Finds what a handle refers to on this shard.
+/// @param t The table of the handle.
+/// @param handle The handle.
+/// @return A pointer to its slot or `NULL` if it's of another shard or the
+/// slot has been freed since.
+static void *handle_at(const tb_table *t, size_t handle) {
+    size_t slot = handle_slot(handle);
+
+    if (handle_shard(handle) != sr_shard || !tb_live(t, slot) ||
+        make_handle(t, slot) != handle)
+        return NULL;
+
+    return tb_at(t, slot);
+}
+
+/// @brief Gives the shard of a user.
+/// @param id User id.
+/// @return Index of the shard.
+static size_t user_shard(size_t id) { return handle_shard(id - 1); }
+
+/// @brief Finds a user of this shard.
+/// @param id User id.
+/// @return The user or `NULL` if there's no such user on this shard.
+static user *local_user(size_t id) {
+    return id == 0 ? NULL : handle_at(&sr_users, id - 1);
+}
+
+/// @brief Gives the shard of a game. It's the one of the user that started
+/// it.
+/// @param id Game id.
+/// @return Index of the shard.
+static size_t game_shard(size_t id) { return handle_shard(id); }
+
+/// @brief Finds a game of this shard.
+/// @param id Game id.
+/// @return The game or `NULL` if there's no such game on this shard.
+static hosted_game *local_game(size_t id) { return handle_at(&sr_games, id); }
+
+/// @brief Posts a mail to a shard. It's woken up at the end of the iteration.
+/// @param to Index of the shard.
+/// @param kind Mail kind.
+/// @param id The user it's about.
+/// @param msg_kind Kind of the message it carries, if any.
+/// @param bytes Payload.
+/// @param len The number of `bytes`. At most `SH_MAIL_BYTES`.
+static void post_mail(size_t to, mail_kind kind, size_t id,
+                      pl_message_kind msg_kind, const char *bytes,
+                      size_t len) {
+    sh_mail *mail = malloc(sizeof(sh_mail));
+
+    if (mail == NULL) die("Failed to allocate a mail.\n");
+    mail->id = id;
+    mail->len = len;
+    mail->kind = kind;
+    mail->msg_kind = msg_kind;
+    if (len > 0) memcpy(mail->bytes, bytes, len);
+
+    sh_mailbox_post(&sr_shards[to].mailbox, mail);
+    sr_wakes[to] = true;
+}
+
+/// @brief Wakes up the shards that were mailed in this iteration, once each.
+static void wake_shards(void) {
+    for (size_t i = 0; i < sr_shards_len; i++) {
+        if (!sr_wakes[i]) continue;
+        sr_wakes[i] = false;
+        sh_mailbox_wake(&sr_shards[i].mailbox);
+    }
+}
+
+/// @brief Queues a message to a user whose payload the caller writes in place.
+/// The user is disconnected if it can't keep up and its queue is full.
+/// @param u The user.
+/// @param m A message struct.
+/// @return Where the payload goes or `NULL` if it isn't sent.
+static char *reserve_msg(user *u, pl_message m) {
+    char *payload;
+
+    if (u->finished_game) return NULL;
+
+    if ((payload = pl_msg_reserve(&u->out, &sr_outpool, u->version, m)) ==
+        NULL) {
+        printf("User %zu can't keep up.\n", u->id);
+        quit_user(u);
+        return NULL;
+    }
+    mt_sent(sr_metrics, m.kind);
+
+    if (!u->flush_pending) {
+        u->flush_pending = true;
+        push_user(&sr_flushes, u);
+    }
+
+    return payload;
+}
+
+/// @brief Queues a message to a user. The user is disconnected if it can't
+/// keep up and its queue is full.
+/// @param u The user.
+/// @param bytes Message raw bytes.
+/// @param m A message struct.
+static void send_msg(user *u, const char *bytes, pl_message m) {
+    char *payload = reserve_msg(u, m);
+
+    if (payload != NULL && m.raw_bytes_len > 0)
+        memcpy(payload, bytes, m.raw_bytes_len);
+}
+
+/// @brief Queues an encoded message to a user. The user is disconnected if it
+/// can't keep up and its queue is full.
+/// @param u The user.
+/// @param kind Message kind.
+/// @param bytes The encoded message.
+/// @param len The length of `bytes`.
+static void send_encoded(user *u, pl_message_kind kind, const char *bytes,
+                         size_t len) {
+    if (u->finished_game) return;
+
+    if (pl_encoded_queue(&u->out, &sr_outpool, bytes, len) < 0) {
+        printf("User %zu can't keep up.\n", u->id);
+        quit_user(u);
+        return;
+    }
+    mt_sent(sr_metrics, kind);
+
+    if (!u->flush_pending) {
+        u->flush_pending = true;
+        push_user(&sr_flushes, u);
+    }
+}
+
+/// @brief Gives the user data of an io_uring request.
+/// @param op What it's for.
+/// @param u The user or `NULL`.
+/// @return User data.
+static uint64_t uring_data(uring_op op, const user *u) {
+    size_t index = u == NULL ? 0 : handle_slot(u->id - 1);
+
+    return (uint64_t)op << 32 | index;
+}
 
-        if (u.finished_game) continue;
-        // Sends the exit message to each clients.
-        pl_msg_write(u.fd, "exit",
+/// @brief Gives the number of bytes that haven't been sent to a user yet.
+/// @param u The user.
+/// @return Queued bytes.
+static size_t queued_len(const user *u) {
+    return pl_outbuf_len(&u->out) + pl_outbuf_len(&u->sending);
+}
+
+/// @brief Gives the number of bytes that are or may be queued for a user. The
+/// answers of another shard are counted as the largest message, since the user
+/// shouldn't be read faster than they can be sent to it either.
+/// @param u The user.
+/// @return Pending bytes.
+static size_t pending_len(const user *u) {
+    return queued_len(u) + u->forwarded * PL_MSG_MAX_SIZE;
+}
+
+/// @brief Arms or cancels a user's multishot receive on the io_uring backend.
+/// Another one is only armed after the last one has given its last
+/// completion.
+/// @param u The user.
+/// @param interest `rx_interest` flags. Writing doesn't need to be waited for.
+/// @return `0` or `-1` if it failed.
+static int uring_want(user *u, unsigned int interest) {
+    if ((interest & rx_read) != 0 && !u->receiving) {
+        u->receiving = true;
+        return ur_prep_multishot_recv(&sr_ring, u->fd,
+                                      uring_data(uring_recv, u));
+    }
+
+    if ((interest & rx_read) == 0 && u->receiving && !u->cancelling) {
+        u->cancelling = true;
+        return ur_prep_cancel(&sr_ring, uring_data(uring_recv, u),
+                              uring_data(uring_cancel, u));
+    }
+
+    return 0;
+}
+
+/// @brief Tells the event loop what a user's socket is waited for. A user
+/// isn't read while more than `PL_OUTBUF_HIGH_WATER` bytes are queued for it
+/// and its socket is only waited on for writing while something is queued.
+/// @param u The user.
+/// @return `0` or `-1` if it failed.
+static int update_interest(user *u) {
+    unsigned int interest = 0;
+
+    // A shard that's being handed over leaves the rest to the new process.
+    if (pending_len(u) < PL_OUTBUF_HIGH_WATER && !sr_handing_over)
+        interest |= rx_read;
+    if (queued_len(u) > 0) interest |= rx_write;
+    if (sr_rx.backend == rx_backend_uring) return uring_want(u, interest);
+    if (interest == u->interest) return 0;
+
+    u->interest = interest;
+    return rx_want(&sr_rx, u->fd, u, interest);
+}
+
+/// @brief Makes a user be read again in the next iteration without waiting for
+/// its socket.
+/// @param u The user.
+static void resume_user(user *u) {
+    if (u->resume_pending) return;
+
+    u->resume_pending = true;
+    push_user(&sr_resumes, u);
+}
+
+/// @brief Hands what's queued for a user to an io_uring send unless one is in
+/// flight already. What's queued meanwhile goes with the next one so the bytes
+/// stay in order.
+/// @param u The user.
+/// @return `0` or `-1` if it failed.
+static int uring_send_user(user *u) {
+    if (u->sending.data != NULL || pl_outbuf_len(&u->out) == 0 ||
+        sr_handing_over)
+        return 0;
+
+    u->sending = u->out;
+    u->out = pl_outbuf_init(NULL, 0);
+
+    return ur_prep_send(&sr_ring, u->fd, u->sending.data + u->sending.start,
+                        pl_outbuf_len(&u->sending), uring_data(uring_send, u));
+}
+
+/// @brief Holds a provided buffer back for a user until there's room for what
+/// it causes to be sent.
+/// @param u The user.
+/// @param bid Buffer id.
+/// @param len The number of received bytes.
+static void hold_buf(user *u, unsigned int bid, size_t len) {
+    sr_held_next[bid] = 0;
+    sr_held_len[bid] = len;
+    if (u->held_last != 0) sr_held_next[u->held_last - 1] = bid + 1;
+    else u->held_first = bid + 1;
+    u->held_last = bid + 1;
+}
+
+/// @brief Takes the first provided buffer that's held back for a user.
+/// @param u The user. It should have one.
+/// @return Buffer id.
+static unsigned int unhold_buf(user *u) {
+    unsigned int bid = u->held_first - 1;
+
+    u->held_first = sr_held_next[bid];
+    if (u->held_first == 0) u->held_last = 0;
+
+    return bid;
+}
+
+/// @brief Gives a user `--stall-timeout` seconds to take what's queued for it
+/// since it last took something.
+/// @param u The user.
+/// @param progressed Whether some of it has just been sent.
+static void watch_stall(user *u, bool progressed) {
+    if (queued_len(u) == 0 || args.stall_timeout == 0) {
+        tw_cancel(&sr_timers, &u->stall);
+    } else if (progressed || !tw_pending(&u->stall)) {
+        u->stall.kind = timer_stall;
+        tw_schedule_in(&sr_timers, &u->stall, args.stall_timeout * 1000L);
+    }
+}
+
+/// @brief Sends what's queued for a user as far as its socket accepts it
+/// without blocking.
+/// @param u The user.
+/// @return The number of bytes still queued or `-1` if the send failed.
+static ssize_t send_queued(user *u) {
+    size_t queued = pl_outbuf_len(&u->out);
+    ssize_t left = pl_outbuf_flush(&u->out, &sr_outpool, u->fd);
+
+    if (left >= 0) mt_count(sr_metrics, mt_bytes_out, queued - (size_t)left);
+
+    return left;
+}
+
+/// @brief Sends what's queued for a user as far as its socket accepts it. If
+/// it wasn't read because too much was queued, it's read again once there's
+/// room. The io_uring backend only queues the send and it goes to the kernel
+/// along with the others.
+/// @param u The user.
+static void flush_user(user *u) {
+    size_t queued = pl_outbuf_len(&u->out);
+    ssize_t flushed;
+
+    hg_record(&sr_metrics->queue_depth, queued_len(u));
+    // The io_uring backend hears about progress when its sends complete.
+    flushed = sr_rx.backend == rx_backend_uring ? uring_send_user(u)
+                                                : send_queued(u);
+
+    if (flushed < 0 || update_interest(u) < 0) {
+        quit_user(u);
+        return;
+    }
+    watch_stall(u, sr_rx.backend != rx_backend_uring &&
+                       (size_t)flushed < queued);
+
+    if (u->readable && pending_len(u) < PL_OUTBUF_HIGH_WATER) resume_user(u);
+}
+
+/// @brief Sends what's been queued since the last flush. What the sockets
+/// don't accept is sent once they're writable again.
+static void flush_users(void) {
+    for (size_t i = 0; i < sr_flushes.len; i++) {
+        user *u = sr_flushes.users[i];
+
+        u->flush_pending = false;
+        if (u->finished_game) continue;
+        flush_user(u);
+    }
+
+    sr_flushes.len = 0;
+}
+
+/// @brief Prints how long the users waited to be matched so far.
+static void report_match_waits(void) {
+    const hg_histogram *h = &sr_metrics->match_waits;
+
+    printf("Matched %lu users. They waited %.2f ms at the median, %.2f ms at "
+           "p99, %.2f ms at p99.9 and %.2f ms at most.\n",
+           (unsigned long)h->count, (double)hg_percentile(h, 0.5) / 1e3,
+           (double)hg_percentile(h, 0.99) / 1e3,
+           (double)hg_percentile(h, 0.999) / 1e3, (double)h->max / 1e3);
+}
+
+/// @brief Says goodbye to the users of this shard and closes their
+/// connections. The thread ends after this iteration.
+static void stop_shard(void) {
+    for (size_t i = 0; i < sr_users.len; i++) {
+        user *u;
+
+        if (!tb_live(&sr_users, i)) continue;
+        u = tb_at(&sr_users, i);
+        if (u->finished_game) continue;
+        // Sends the exit message to each clients, after what's queued, as far
+        // as their sockets accept it without blocking.
+        pl_msg_queue(&u->out, &sr_outpool, u->version, "exit",
                      (pl_message){
-                         .id = u.id,
+                         .id = u->id,
                          .kind = mk_exit,
                          .raw_bytes_len = 4,
                      });
+        // An io_uring send in flight would be interleaved.
+        if (u->sending.data == NULL) send_queued(u);
 
         // Close the socket connection.
-        close(u.fd);
+        close(u->fd);
     }
 
-    // Closes the server socket.
-    close(serverfd);
+    // The games that are left are called off so the journal ends them too.
+    for (size_t i = 0; i < sr_games.len; i++) {
+        if (tb_live(&sr_games, i)) end_game(tb_at(&sr_games, i));
+    }
 
-    if (args.unix_socket) {
-        // Unlinks the socket domain path.
-        unlink(args.unix_socket_file);
+    if (sr_metrics->match_waits.count > 0) report_match_waits();
+
+    sr_running = false;
+}
+
+/// @brief Gives the time of a monotonic clock.
+/// @return Milliseconds.
+static long now_ms(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+
+/// @brief Gives the time of a monotonic clock in microseconds. It's the same
+/// on every shard.
+/// @return Microseconds.
+static long now_us(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+/// @brief Gives the time of the wall clock.
+/// @return Microseconds since the epoch.
+static uint64_t wall_us(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_REALTIME, &ts);
+    return (uint64_t)ts.tv_sec * 1000000 + (uint64_t)ts.tv_nsec / 1000;
+}
+
+/// @brief Records what happened to a game in this iteration's batch of the
+/// journal, if there's one.
+/// @param event What happened.
+/// @param game_id Game id.
+/// @param guesses Guesses of an ended game.
+/// @param duration_ms Milliseconds that an ended game took.
+static void journal_game(jr_event event, size_t game_id, uint32_t guesses,
+                         long duration_ms) {
+    jr_record r;
+
+    if (args.journal_file == NULL) return;
+
+    r = (jr_record){
+        .at = wall_us(),
+        .game = game_id,
+        .guesses = guesses,
+        .duration_ms = (uint32_t)duration_ms,
+        .event = event,
+    };
+    if (jr_append(&sr_batch, &r) < 0)
+        printf("Failed to journal game %zu.\n", game_id);
+}
+
+/// @brief Gives the time of a monotonic clock in nanoseconds.
+/// @return Nanoseconds.
+static long now_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+/// @brief Finishes a game. Its slot is reused so its id goes stale.
+/// @param hosted The game.
+static void end_game(hosted_game *hosted) {
+    if (!hosted->guessed) mt_count(sr_metrics, mt_games_abandoned, 1);
+    journal_game(hosted->guessed ? jr_finished : jr_abandoned, hosted->game.id,
+                 hosted->guess_count, now_ms() - hosted->started_at);
+    hosted->game.finished = true;
+    tw_cancel(&sr_timers, &hosted->turn);
+    ge_guesses_free(&hosted->guesses);
+    tb_free(&sr_games, handle_slot(hosted->game.id));
+}
+
+/// @brief Gives a game's guesser `--turn-timeout` seconds for the next guess.
+/// @param hosted The game.
+static void watch_turn(hosted_game *hosted) {
+    if (args.turn_timeout == 0) return;
+    hosted->turn.kind = timer_turn;
+    tw_schedule_in(&sr_timers, &hosted->turn, args.turn_timeout * 1000L);
+}
+
+/// @brief Gives a user in the lobby or the queue `--idle-timeout` seconds for
+/// its next message.
+/// @param u The user.
+static void watch_idle(user *u) {
+    if (args.idle_timeout == 0) {
+        tw_cancel(&sr_timers, &u->session);
+        return;
     }
+    u->session.kind = timer_idle;
+    tw_schedule_in(&sr_timers, &u->session, args.idle_timeout * 1000L);
+}
 
-    printf("\nConnection closed.\n");
-    fflush(stdout);
+/// @brief Gives a waiting timeout that doesn't go past a deadline.
+/// @param timeout Waiting timeout.
+/// @param deadline Milliseconds of `now_ms`.
+/// @return Whichever is sooner.
+static int wake_by(int timeout, long deadline) {
+    long wait = deadline - now_ms();
 
-    exit(EXIT_SUCCESS);
+    if (wait < 0) wait = 0;
+    if (timeout != PL_NO_TIMEOUT && timeout < wait) return timeout;
+
+    return (int)wait;
 }
 
-/// @brief Finds a game based on the id.
-/// @param id User's id.
-/// @return A pointer to the `game` struct.
-static ge_game *find_game(size_t id) {
-    for (size_t i = 0; i < sr_games.len; i++) {
-        if (sr_games.games[i].finished) continue;
+/// @brief Checks if the lobby has changed since the last announcement.
+static bool lobby_changed(void) { return sr_joined.len > 0 || sr_left.len > 0; }
+
+/// @brief Gives the lobby entry of a user of any shard. The entries grow as
+/// needed.
+/// @param id User id.
+/// @return The entry. It's someone else's if its id isn't `id`.
+static lobby_entry *lobby_entry_of(size_t id) {
+    size_t index = (id - 1) & ID_SLOT_MASK;
+
+    if (index >= sr_lobby_entries_len) {
+        size_t len = sr_lobby_entries_len == 0 ? 64 : sr_lobby_entries_len;
+        lobby_entry *entries;
+
+        while (len <= index) len *= 2;
+        entries = realloc(sr_lobby_entries, len * sizeof(lobby_entry));
+        if (entries == NULL) die("Failed to allocate the lobby.\n");
+        bzero(entries + sr_lobby_entries_len,
+              (len - sr_lobby_entries_len) * sizeof(lobby_entry));
+        sr_lobby_entries = entries;
+        sr_lobby_entries_len = len;
+    }
 
-        if (sr_games.games[i].guesser == id ||
-            sr_games.games[i].chooser == id) {
-            return &sr_games.games[i];
-        }
+    return &sr_lobby_entries[index];
+}
+
+/// @brief Checks if a user of any shard is available as an opponent.
+/// @param id User id.
+/// @return `true` if it is.
+static bool in_lobby(size_t id) {
+    lobby_entry *entry = lobby_entry_of(id);
+
+    return entry->id == id && entry->slot != 0;
+}
+
+/// @brief Makes a user available as an opponent. The others hear about it
+/// with the next announcement.
+/// @param id User id.
+static void lobby_join(size_t id) {
+    lobby_entry *entry = lobby_entry_of(id);
+
+    // The former user of the slot is gone if a new one is here.
+    if (entry->slot != 0) lobby_leave(entry->id);
+
+    push_id(&sr_lobby, id);
+    entry->id = id;
+    entry->slot = sr_lobby.len;
+    entry->is_new = true;
+
+    push_id(&sr_joined, id);
+}
+
+/// @brief Makes a user unavailable as an opponent. The others hear about it
+/// with the next announcement.
+/// @param id User id.
+static void lobby_leave(size_t id) {
+    lobby_entry *entry = lobby_entry_of(id);
+    size_t last_id;
+
+    if (entry->id != id || entry->slot == 0) return;
+
+    // The last user of the lobby takes its place.
+    sr_lobby.len -= 1;
+    last_id = sr_lobby.ids[sr_lobby.len];
+    sr_lobby.ids[entry->slot - 1] = last_id;
+    lobby_entry_of(last_id)->slot = entry->slot;
+    entry->slot = 0;
+
+    // Nobody has heard about the new ones yet.
+    if (!entry->is_new) push_id(&sr_left, id);
+    entry->is_new = false;
+}
+
+/// @brief Takes a user of this shard out of the lobby or the queue and into a
+/// game.
+/// @param u The user.
+/// @param game The game as the shard of the game made it.
+static void join_game(user *u, cd_game_view game) {
+    u->state = state_in_game;
+    u->game = cd_get(game, cd_field_id) + 1;
+    u->chooser = cd_get(game, cd_field_chooser) == u->id;
+    u->opponent = cd_get(game, u->chooser ? cd_field_guesser : cd_field_chooser);
+    tw_cancel(&sr_timers, &u->session);
+    lobby_leave(u->id);
+}
+
+/// @brief Takes a user of this shard out of a game that was called off before
+/// it began. It's available as an opponent again.
+/// @param u The user.
+static void leave_game(user *u) {
+    u->state = state_in_lobby;
+    u->game = 0;
+    u->opponent = 0;
+    u->chooser = false;
+    lobby_join(u->id);
+    watch_idle(u);
+}
+
+/// @brief Calls off a match for a player of any shard because its opponent
+/// couldn't join. It's been told about the game already, so it's told to exit
+/// and it's available again.
+/// @param id The player.
+/// @param game_id Game id.
+static void call_off_match(size_t id, size_t game_id) {
+    user *u;
+
+    if (id != 0 && user_shard(id) != sr_shard) {
+        post_mail(user_shard(id), mail_call_off, id, mk_exit,
+                  (const char *)&game_id, sizeof(size_t));
+        return;
     }
 
-    return NULL;
+    // It's not in the game if it was called off before it joined.
+    if ((u = local_user(id)) == NULL || u->finished_game ||
+        u->game != game_id + 1)
+        return;
+
+    leave_game(u);
+    send_msg(u, "exit",
+             (pl_message){
+                 .id = id,
+                 .kind = mk_exit,
+                 .raw_bytes_len = 4,
+             });
 }
 
-/// @brief Checks if a user is already in a game.
-/// @param id User's id.
-static bool is_in_game(size_t id) { return find_game(id) != NULL; }
+/// @brief Goes on with a game of this shard once a player that was picked for
+/// it said whether it's in it. The one that picked it is told about the game
+/// if it is. The game is called off otherwise, the one that picked it is
+/// available again and the other player of a match is told so.
+/// @param game_id Game id.
+/// @param id The player.
+/// @param entered Whether the player is in the game.
+static void game_answered(size_t game_id, size_t id, bool entered) {
+    // It's over already if a player quitted meanwhile.
+    hosted_game *hosted = local_game(game_id);
+    char *payload;
+    size_t other;
+    user *u;
+
+    if (hosted == NULL) return;
+    u = local_user(hosted->requester);
+
+    if (!entered) {
+        // The other player of a match has been told about the game already.
+        other = hosted->requester != 0 ? 0
+                : hosted->game.guesser == id ? hosted->game.chooser
+                                             : hosted->game.guesser;
+        end_game(hosted);
+        if (other != 0) call_off_match(other, game_id);
+        else if (u != NULL && !u->finished_game && u->game == game_id + 1)
+            leave_game(u);
+        return;
+    }
 
-/// @brief Checks if a user finished its game.
-/// @param id User's id.
-static bool is_finished(size_t id) {
-    // User ids start from 1 (id - 1).
-    return sr_users.users[id - 1].finished_game;
+    if (u == NULL) return;
+    payload = reserve_msg(u, (pl_message){
+                                 .id = u->id,
+                                 .kind = mk_select_opponent,
+                                 .raw_bytes_len = CD_GAME_SIZE,
+                             });
+    if (payload != NULL) cd_put_game(payload, &hosted->game, "");
 }
 
-/// @brief Announces the opponents to all clients.
-static void announce_opponents(void) {
-    size_t n_opps = 0;
-    size_t opps[MAX_CLIENTS];
-    bzero(&opps, sizeof(opps));
+/// @brief Tells the shard of a game whether a player is in it.
+/// @param game_id Game id.
+/// @param id The player.
+/// @param entered Whether it is.
+static void answer_game(size_t game_id, size_t id, bool entered) {
+    if (game_shard(game_id) != sr_shard) {
+        post_mail(game_shard(game_id), mail_entered, id,
+                  entered ? mk_select_opponent : mk_exit,
+                  (const char *)&game_id, sizeof(size_t));
+        return;
+    }
 
-    // Finds available users.
-    for (size_t i = 0; i < sr_users.len; i++) {
-        size_t user_id = sr_users.users[i].id;
-        // Should check if the opponent is not currently in a game.
-        if (!is_in_game(user_id) && !is_finished(user_id)) {
-            opps[n_opps] = user_id;
-            n_opps += 1;
-        }
+    game_answered(game_id, id, entered);
+}
+
+/// @brief Puts a user of any shard into a game and tells it about the game.
+/// Only its own shard changes its availability and tells the others, so a
+/// user that's taken already isn't put into another game and the game is
+/// called off.
+/// @param id User id.
+/// @param game The game without the word.
+/// @param via `mk_select_opponent` if the user was picked from the lobby or
+/// `mk_find_match` if it was matched.
+static void enter_game(size_t id, cd_game_view game, pl_message_kind via) {
+    user_state from = via == mk_find_match ? state_in_queue : state_in_lobby;
+    size_t game_id = cd_get(game, cd_field_id);
+    user *u;
+
+    if (id != 0 && user_shard(id) != sr_shard) {
+        post_mail(user_shard(id), mail_enter_game, id, via, game.bytes,
+                  CD_GAME_SIZE);
+        return;
+    }
+
+    if ((u = local_user(id)) == NULL || u->finished_game || u->state != from) {
+        answer_game(game_id, id, false);
+        return;
     }
 
-    // If this becomes true it means only the current user is ready to start a
-    // game.
-    if (n_opps <= 1) return;
+    join_game(u, game);
+    send_msg(u, game.bytes,
+             (pl_message){
+                 .id = id,
+                 .kind = mk_select_opponent,
+                 .raw_bytes_len = CD_GAME_SIZE,
+             });
+    // The players of a match are told right away.
+    if (via == mk_select_opponent) answer_game(game_id, id, true);
+}
+
+/// @brief Starts a game on this shard. Its players aren't in it yet.
+/// @param request The players and the word.
+/// @return The game or `NULL` if allocating it failed.
+static hosted_game *start_game(const ge_game *request) {
+    hosted_game *hosted;
+    size_t slot;
+
+    if ((slot = tb_alloc(&sr_games)) == TB_NONE) return NULL;
+    hosted = tb_at(&sr_games, slot);
+    *hosted = (hosted_game){
+        .game = *request,
+        .requester = 0,
+        .guesses = {.hashes = NULL, .len = 0, .cap = 0},
+        .started_at = now_ms(),
+        .guess_count = 0,
+        .guessed = false,
+    };
+    hosted->word_key = ge_normalize(hosted->game.word, hosted->game.word);
+    mt_count(sr_metrics, mt_games_started, 1);
+
+    // Assigns an ID to it. The ids of the shards are interleaved like the
+    // user ids.
+    hosted->game.id = make_handle(&sr_games, slot);
+    hosted->game.finished = false;
+    watch_turn(hosted);
+    journal_game(jr_started, hosted->game.id, 0, 0);
+
+    return hosted;
+}
+
+/// @brief Matches a user with the one that waits, who chooses the word, or
+/// makes it wait. It only runs on `MATCH_SHARD`.
+/// @param request The request of the user, like `sr_waiting`.
+static void match_user(const ge_game *request) {
+    long now = now_us();
+    char game_without_word[CD_GAME_SIZE];
+    hosted_game *hosted;
+    size_t game_id;
+    ge_game game;
+
+    if (sr_waiting.chooser == 0 || sr_waiting.chooser == request->chooser) {
+        sr_waiting = *request;
+        return;
+    }
 
-    // Loops through those users and announce the opponents.
-    for (size_t i = 0; i < n_opps; i++) {
-        // User ids start from 1 (opps[i] - 1).
-        pl_poll_msg_write(sr_users.users[opps[i] - 1].fd, (char *)opps,
-                          (pl_message){
-                              .id = opps[i],
-                              .kind = mk_show_opponents,
-                              .raw_bytes_len = sizeof(size_t) * n_opps,
-                          },
-                          PL_DEFAULT_TIMEOUT);
+    hg_record(&sr_metrics->match_waits, (uint64_t)(now - (long)sr_waiting.id));
+    hg_record(&sr_metrics->match_waits, (uint64_t)(now - (long)request->id));
+    if (!tw_pending(&sr_report)) {
+        sr_report.kind = timer_report;
+        tw_schedule_in(&sr_timers, &sr_report, REPORT_INTERVAL);
     }
+
+    game = sr_waiting;
+    game.guesser = request->chooser;
+    sr_waiting.chooser = 0;
+    if ((hosted = start_game(&game)) == NULL) return;
+
+    game_id = hosted->game.id;
+    cd_put_game(game_without_word, &hosted->game, "");
+    enter_game(game.chooser, cd_view(game_without_word), mk_find_match);
+    // The chooser has quitted if it's called off already, so the user waits
+    // instead.
+    if (local_game(game_id) == NULL) sr_waiting = *request;
+    else enter_game(game.guesser, cd_view(game_without_word), mk_find_match);
 }
 
-/// @brief Regenerates the pollfds to handle new users.
-/// @param limit_reached Whether the limitation for accepting new users has
-/// reached.
-static void poll_new_users(bool limit_reached) {
-    bzero(sr_pfds.pfds, sizeof(sr_pfds.pfds));
-
-    if (!limit_reached) {
-        sr_pfds.len = 1;
-        sr_pfds.pfds[0] = (pollfd){
-            .revents = 0,
-            .fd = serverfd,
-            .events = POLLIN,
-        };
-    } else sr_pfds.len = 0;
+/// @brief Takes a user of any shard out of the queue.
+/// @param id User id.
+static void leave_queue(size_t id) {
+    if (sr_shard != MATCH_SHARD) {
+        post_mail(MATCH_SHARD, mail_leave_queue, id, mk_exit, NULL, 0);
+    } else if (sr_waiting.chooser == id) {
+        sr_waiting.chooser = 0;
+    }
+}
 
-    for (size_t i = 0; i < sr_users.len; i++) {
-        if (sr_users.users[i].finished_game) continue;
+/// @brief Finishes a game because one of its players quitted. The game might
+/// be on another shard.
+/// @param id The user that quitted.
+/// @param game_id Game id.
+static void quit_game(size_t id, size_t game_id) {
+    hosted_game *hosted;
 
-        sr_pfds.pfds[sr_pfds.len] = (pollfd){
-            .revents = 0,
-            .events = POLLIN,
-            .fd = sr_users.users[i].fd,
-        };
-        sr_pfds.len += 1;
+    if (game_shard(game_id) != sr_shard) {
+        post_mail(game_shard(game_id), mail_quit, id, mk_exit,
+                  (const char *)&game_id, sizeof(size_t));
+        return;
     }
+
+    // It's not found if it has finished already.
+    hosted = local_game(game_id);
+    if (hosted != NULL &&
+        (hosted->game.guesser == id || hosted->game.chooser == id))
+        end_game(hosted);
 }
 
-/// @brief Authenticates a new client.
-/// @param fd File descripter.
-static void authenticate(int fd, const char *pass) {
-    size_t user_id;
-    pl_message *read;
+/// @brief Sends a list of opponents to the users of the lobby. The message is
+/// the same for everyone so it's encoded once per wire format.
+/// @param kind Message kind.
+/// @param ids The opponents. At most `LOBBY_CHUNK` of them.
+/// @param len The number of `ids`.
+/// @param to_new Whether it's for the users that joined after the last
+/// announcement or for the others.
+static void broadcast_opponents(pl_message_kind kind, const size_t *ids,
+                                size_t len, bool to_new) {
+    // Indexed by `pl_version`.
+    char encoded[3][PL_MSG_MAX_SIZE];
+    size_t encoded_len[3] = {0, 0, 0};
+    pl_message m = (pl_message){
+        .id = 0,
+        .kind = kind,
+        .raw_bytes_len = sizeof(size_t) * len,
+    };
 
-    // Asking the new clinet to enter the password.
-    pl_poll_msg_write(fd, "",
-                      (pl_message){
-                          .id = 0,
-                          .kind = mk_enter_passwd,
-                      },
-                      PL_DEFAULT_TIMEOUT);
-
-    // Wait for it to answer.
-    read = pl_poll_msg_read(fd, PL_DEFAULT_TIMEOUT);
-    if (!read || read->raw_bytes_len != strlen(pass) ||
-        strncmp(pass, read->raw_bytes, strlen(pass)) != 0) {
-        // Terminate it if the password is wrong.
-        pl_poll_msg_write(fd, "",
-                          (pl_message){
-                              .id = 0,
-                              .kind = mk_wrong_passwd,
-                          },
-                          PL_DEFAULT_TIMEOUT);
+    // Backwards since a user that can't keep up takes itself out of the lobby
+    // and the last user takes its place.
+    for (size_t i = sr_lobby.len; i > 0; i--) {
+        size_t id = sr_lobby.ids[i - 1];
+        // The users of the other shards hear it from their own.
+        user *u = local_user(id);
+
+        if (u == NULL || lobby_entry_of(id)->is_new != to_new) continue;
+
+        if (encoded_len[u->version] == 0) {
+            encoded_len[u->version] = pl_msg_encode(
+                encoded[u->version], u->version, (const char *)ids, m);
+        }
+        send_encoded(u, kind, encoded[u->version], encoded_len[u->version]);
+    }
+}
+
+/// @brief Tells the other shards which of this shard's users joined or left
+/// the lobby.
+/// @param kind `mail_joined` or `mail_left`.
+/// @param ids Users of every shard.
+/// @param len The number of `ids`.
+static void publish_lobby(mail_kind kind, const size_t *ids, size_t len) {
+    size_t batch[SH_MAIL_BYTES / sizeof(size_t)];
+    size_t batch_len = 0;
+
+    if (sr_shards_len == 1) return;
+
+    for (size_t i = 0; i <= len; i++) {
+        if (i < len && user_shard(ids[i]) == sr_shard)
+            batch[batch_len++] = ids[i];
+        if (batch_len == 0 ||
+            (batch_len < SH_MAIL_BYTES / sizeof(size_t) && i < len))
+            continue;
+
+        for (size_t to = 0; to < sr_shards_len; to++) {
+            if (to == sr_shard) continue;
+            post_mail(to, kind, 0, mk_exit, (const char *)batch,
+                      batch_len * sizeof(size_t));
+        }
+        batch_len = 0;
+    }
+}
+
+/// @brief Announces the changes of the lobby since the last announcement.
+/// The users that were already there get what changed and the new ones get
+/// the opponents that are available now.
+static void announce_opponents(void) {
+    size_t n_joined = 0;
+
+    // Some of the new ones might have left already.
+    for (size_t i = 0; i < sr_joined.len; i++) {
+        if (!in_lobby(sr_joined.ids[i])) continue;
+        sr_joined.ids[n_joined] = sr_joined.ids[i];
+        n_joined += 1;
+    }
+
+    for (size_t i = 0; i < n_joined; i += LOBBY_CHUNK) {
+        broadcast_opponents(mk_opponents_joined, sr_joined.ids + i,
+                            n_joined - i < LOBBY_CHUNK ? n_joined - i
+                                                       : LOBBY_CHUNK,
+                            false);
+    }
+
+    // Users that can't keep up leave while this goes on.
+    for (size_t i = 0; i < sr_left.len; i += LOBBY_CHUNK) {
+        broadcast_opponents(mk_opponents_left, sr_left.ids + i,
+                            sr_left.len - i < LOBBY_CHUNK ? sr_left.len - i
+                                                          : LOBBY_CHUNK,
+                            false);
+    }
+
+    // A single message is enough to pick an opponent from. If this is false it
+    // means only the new user is ready to start a game.
+    if (n_joined > 0 && sr_lobby.len > 1) {
+        broadcast_opponents(mk_show_opponents, sr_lobby.ids,
+                            sr_lobby.len < LOBBY_CHUNK ? sr_lobby.len
+                                                       : LOBBY_CHUNK,
+                            true);
+    }
+
+    // Leaving goes first since a slot that's left may have been taken again.
+    publish_lobby(mail_left, sr_left.ids, sr_left.len);
+    publish_lobby(mail_joined, sr_joined.ids, n_joined);
+
+    for (size_t i = 0; i < n_joined; i++) {
+        lobby_entry_of(sr_joined.ids[i])->is_new = false;
+    }
+    sr_joined.len = 0;
+    sr_left.len = 0;
+}
+
+/// @brief Welcomes a new connection. It's asked for the password, which is
+/// read along with what the others send, and it has `HANDSHAKE_TIMEOUT`
+/// milliseconds to send it.
+/// @param fd File descripter.
+static void welcome_user(int fd) {
+    size_t slot;
+    user *u;
+    // Offers the newest wire format in the legacy one so older clients can read
+    // it too.
+    char offered = (char)args.version;
+
+    if ((slot = tb_alloc(&sr_users)) == TB_NONE) {
         close(fd);
         return;
     }
-
-    // New user
-    user_id = sr_users.len + 1;
-    sr_users.users[sr_users.len] = (user){
+    u = tb_at(&sr_users, slot);
+    // The io_uring backend arms its receive when the password request is
+    // flushed.
+    if (sr_rx.backend != rx_backend_uring &&
+        rx_add(&sr_rx, fd, u, rx_read) < 0) {
+        tb_free(&sr_users, slot);
+        close(fd);
+        return;
+    }
+    *u = (user){
         .fd = fd,
-        .id = user_id,
+        .id = make_handle(&sr_users, slot) + 1,
+        // It's detected from the password message.
+        .version = pl_version_unknown,
+        .in = pl_inbuf_init(NULL, 0),
+        .out = pl_outbuf_init(NULL, 0),
+        .sending = pl_outbuf_init(NULL, 0),
+        .forwarded = 0,
+        .game = 0,
+        .opponent = 0,
+        .session = (tw_timer){.kind = timer_handshake},
+        .stall = (tw_timer){.kind = timer_stall},
+        .interest = rx_read,
+        .held_first = 0,
+        .held_last = 0,
+        .state = state_awaiting_passwd,
         .finished_game = false,
+        .flush_pending = false,
+        .readable = false,
+        .resume_pending = false,
+        .receiving = false,
+        .cancelling = false,
+        .chooser = false,
     };
-    sr_users.len += 1;
-
-    // Assign a user id to the client.
-    pl_poll_msg_write(fd, "",
-                      (pl_message){
-                          .id = user_id,
-                          .kind = mk_assign_uid,
-                      },
-                      PL_DEFAULT_TIMEOUT);
+    tw_schedule_in(&sr_timers, &u->session, HANDSHAKE_TIMEOUT);
+    mt_count(sr_metrics, mt_accepted, 1);
 
-    printf("A new user (id = %lu) authenticated.\n", user_id);
+    // Asking the new clinet to enter the password.
+    send_msg(u, &offered,
+             (pl_message){
+                 .id = 0,
+                 .kind = mk_enter_passwd,
+                 .raw_bytes_len = 1,
+             });
+}
 
-    poll_new_users(false);
+/// @brief Says goodbye to a user and disconnects it.
+/// @param u The user.
+/// @param bytes Message raw bytes.
+/// @param m The goodbye message.
+static void dismiss_user(user *u, const char *bytes, pl_message m) {
+    send_msg(u, bytes, m);
+    if (u->finished_game) return;
+
+    // Sends it as far as the socket accepts it without blocking. An io_uring
+    // send in flight would be interleaved.
+    if (u->sending.data == NULL) send_queued(u);
+    quit_user(u);
+}
 
-    announce_opponents();
+/// @brief Disconnects a user that hasn't authenticated. It's told the password
+/// is wrong in the format it was asked in, if it was asked at all.
+/// @param u The user.
+static void reject_user(user *u) {
+    dismiss_user(u, "",
+                 (pl_message){
+                     .id = 0,
+                     .kind = mk_wrong_passwd,
+                 });
 }
 
-/// @brief Sends a game message to both clients of a game.
-/// @param game Game instance.
-/// @param kind Message kind.
-/// @param bytes Message bytes.
-/// @param len Message bytes' length.
-static void send_game_msg(const ge_game *game, pl_message_kind kind,
-                          const char *bytes, size_t len) {
-    // User ids start from 1 (game->X - 1).
-    int guesser_fd = sr_users.users[game->guesser - 1].fd;
-    int chooser_fd = sr_users.users[game->chooser - 1].fd;
-
-    // Writing to both clients of a game.
-    pl_poll_msg_write(guesser_fd, bytes,
-                      (pl_message){
-                          .id = game->guesser,
-                          .kind = kind,
-                          .raw_bytes_len = len,
-                      },
-                      PL_DEFAULT_TIMEOUT);
-    pl_poll_msg_write(chooser_fd, bytes,
-                      (pl_message){
-                          .id = game->chooser,
-                          .kind = kind,
-                          .raw_bytes_len = len,
-                      },
-                      PL_DEFAULT_TIMEOUT);
+/// @brief Tells a user of any shard to exit and disconnects it.
+/// @param id User id.
+static void evict_user(size_t id) {
+    user *u;
+
+    if (id != 0 && user_shard(id) != sr_shard) {
+        post_mail(user_shard(id), mail_evict, id, mk_exit, NULL, 0);
+    } else if ((u = local_user(id)) != NULL) {
+        dismiss_user(u, "exit",
+                     (pl_message){
+                         .id = id,
+                         .kind = mk_exit,
+                         .raw_bytes_len = 4,
+                     });
+    }
 }
 
-int main(int argc, char *argv[]) {
-    args = parse_cli_args(argc, argv);
+/// @brief Checks the password of a new user. It's available as an opponent if
+/// the password is right and it's disconnected otherwise.
+/// @param u The user.
+/// @param m The first message of the user.
+static void check_passwd(user *u, const pl_frame *m) {
+    // Compact passwords are prefixed with the version byte.
+    size_t prefix_len = u->version == pl_version_compact ? 1 : 0;
+    size_t pass_len = strlen(args.pass);
+
+    if (u->version > args.version || m->raw_bytes_len != pass_len + prefix_len ||
+        (prefix_len == 1 && m->raw_bytes[0] != (char)u->version) ||
+        strncmp(args.pass, m->raw_bytes + prefix_len, pass_len) != 0) {
+        // Terminate it if the password is wrong.
+        reject_user(u);
+        return;
+    }
 
-    // Handles the SIGINT (i.e Crtl+C) signal.
-    signal(SIGINT, sigint_handler);
+    u->state = state_in_lobby;
+    watch_idle(u);
+    mt_count(sr_metrics, mt_authenticated, 1);
 
-    // Makes sure to zero out everything before start.
-    bzero(sr_games.games, sizeof(sr_games.games));
-    bzero(sr_users.users, sizeof(sr_users.users));
+    // Assign a user id to the client.
+    send_msg(u, "",
+             (pl_message){
+                 .id = u->id,
+                 .kind = mk_assign_uid,
+             });
 
-    serverfd =
-        success_or_die(st_server_setup(HOST, args.port, args.unix_socket_file,
-                                       MAX_CLIENTS, args.unix_socket),
-                       "Failed to setup a server socket");
+    printf("A new user (id = %lu) authenticated.\n", u->id);
 
-    poll_new_users(false);
+    lobby_join(u->id);
+}
 
-    if (args.unix_socket) {
-        printf("Listening on `%s` unix socket file...\n",
-               args.unix_socket_file);
-    } else printf("Listening on the %d port...\n", args.port);
+/// @brief Gives the user that a timer is embedded in.
+/// @param t The timer.
+/// @param offset Offset of the timer in `user`.
+/// @return The user.
+static user *timer_user(tw_timer *t, size_t offset) {
+    return (user *)(void *)((char *)t - offset);
+}
 
-    for (;;) {
-        success_or_die(poll(sr_pfds.pfds, sr_pfds.len, PL_NO_TIMEOUT),
-                       "Faild to poll");
+/// @brief Gives the game whose turn timer a timer is.
+/// @param t The timer.
+/// @return The game.
+static hosted_game *timer_game(tw_timer *t) {
+    return (hosted_game *)(void *)((char *)t - offsetof(hosted_game, turn));
+}
 
-        // Listening socket.
-        if (sr_users.len < MAX_CLIENTS &&
-            sr_pfds.pfds[0].revents == sr_pfds.pfds[0].events) {
-            for (;;) {
-                int fd;
-
-                if (sr_users.len < MAX_CLIENTS) {
-                    if ((fd = st_accept(sr_pfds.pfds[0].fd)) > 0) {
-                        authenticate(fd, args.pass);
-                    } else break;
-                } else {
-                    printf("Server cannot accept more users. Limit has been "
-                           "reached!\n");
-
-                    // Stop accepting new connections.
-                    poll_new_users(true);
-                    break;
-                }
-            }
+/// @brief Handles the timers that have expired.
+static void expire_timers(void) {
+    long now = now_ms();
+    tw_timer *t;
+
+    while ((t = tw_expire(&sr_timers, now)) != NULL) {
+        switch ((timer_kind)t->kind) {
+        case timer_handshake:
+            reject_user(timer_user(t, offsetof(user, session)));
+            break;
+        case timer_idle: {
+            user *u = timer_user(t, offsetof(user, session));
+
+            printf("User %zu was idle for too long.\n", u->id);
+            evict_user(u->id);
+        } break;
+        case timer_stall: {
+            user *u = timer_user(t, offsetof(user, stall));
+
+            printf("User %zu hasn't read for too long.\n", u->id);
+            quit_user(u);
+        } break;
+        case timer_report:
+            report_match_waits();
+            break;
+        case timer_turn: {
+            hosted_game *hosted = timer_game(t);
+            ge_game game = hosted->game;
+
+            printf("Game %zu timed out.\n", game.id);
+            end_game(hosted);
+            evict_user(game.guesser);
+            evict_user(game.chooser);
+        } break;
+        default:
+            break;
         }
+    }
+}
 
-        // Starts from 1 since the first element is the listening socket.
-        for (size_t i = 1; i < sr_pfds.len; i++) {
-            pl_message *m;
-            // File descripter of this pollfd.
-            int fd = sr_pfds.pfds[i].fd;
-
-            // This pollfd did not succeed.
-            if (sr_pfds.pfds[i].revents != sr_pfds.pfds[i].events) continue;
-
-            m = pl_msg_read(fd);
-            if (m) switch (m->kind) {
-                case mk_select_opponent: {
-                    // Game instance without the secret guess word.
-                    ge_game game_without_word;
-
-                    // Stores the game.
-                    ge_game *game = &sr_games.games[sr_games.len];
-                    *game = *ge_game_from_msg(m);
-                    // Assigns an ID to it.
-                    game->id = sr_games.len;
-                    // Increaments the length.
-                    sr_games.len += 1;
-
-                    // Unauthorized action.
-                    if ((game->chooser != m->id && game->guesser != m->id) ||
-                        game->finished)
-                        continue;
-
-                    // The exact data should be in `game_without_word` but
-                    // without the secret word.
-                    game_without_word = *game;
-                    bzero(game_without_word.word,
-                          sizeof(game_without_word.word));
-
-                    // Announces that the selection succeeded.
-                    send_game_msg(game, mk_select_opponent,
-                                  (char *)&game_without_word, sizeof(ge_game));
-
-                } break;
-
-                case mk_guess: {
-                    ge_game game = *ge_game_from_msg(m);
-                    ge_game game_in_proc = sr_games.games[game.id];
-
-                    if (strcmp(game.word, game_in_proc.word) != 0) {
-                        send_game_msg(&game, mk_wrong_guess, (char *)&game,
-                                      sizeof(ge_game));
-                    } else {
-                        send_game_msg(&game, mk_correct_guess, NULL, 0);
-                    }
-                } break;
-
-                case mk_hint: {
-                    ge_game game = *ge_game_from_msg(m);
-                    // Sends the hint to the guesser.
-                    // User ids start from 1 (game.guesser - 1).
-                    pl_poll_msg_write(sr_users.users[game.guesser - 1].fd,
-                                      (char *)&game,
-                                      (pl_message){
-                                          .id = game.guesser,
-                                          .kind = mk_hint,
-                                          .raw_bytes_len = sizeof(ge_game),
-                                      },
-                                      PL_DEFAULT_TIMEOUT);
-                } break;
-
-                case mk_exit: {
-                    ge_game *user_game;
-
-                    printf("User %zu quitted.\n", m->id);
-
-                    // Close the socket connection.
-                    // User ids start from 1 (m->id - 1).
-                    close(sr_users.users[m->id - 1].fd);
-
-                    // Keep track of deleted users.
-                    // User ids start from 1 (m->id - 1).
-                    sr_users.users[m->id - 1].finished_game = true;
-
-                    // Set the game to finished if the user has played one.
-                    if ((user_game = find_game(m->id))) {
-                        user_game->finished = true;
-                    }
-                } break;
-
-                default:
-                    break;
-                }
-        }
+/// @brief Tells a player of any shard that the word of its game has been
+/// guessed. Its chooser doesn't hint anymore once it's told.
+/// @param id User id.
+static void tell_guessed(size_t id) {
+    user *u;
+
+    if (id != 0 && user_shard(id) != sr_shard) {
+        post_mail(user_shard(id), mail_guessed, id, mk_correct_guess, NULL, 0);
+    } else if ((u = local_user(id)) != NULL) {
+        u->chooser = false;
+        reserve_msg(u, (pl_message){.id = id, .kind = mk_correct_guess});
     }
 }
+
+/// @brief Sends a game message to a user of any shard. The payload is written
+/// right into the output buffer of a user of this shard.
+/// @param id User id.
+/// @param kind Message kind.
+/// @param game The game.
+/// @param word The word that goes with it.
+static void send_game_to(size_t id, pl_message_kind kind, const ge_game *game,
+                         const char *word) {
+    char bytes[CD_GAME_SIZE];
+    char *payload;
+    user *u;
+
+    if (id != 0 && user_shard(id) != sr_shard) {
+        cd_put_game(bytes, game, word);
+        post_mail(user_shard(id), mail_deliver, id, kind, bytes, CD_GAME_SIZE);
+    } else if ((u = local_user(id)) != NULL &&
+               (payload = reserve_msg(u, (pl_message){
+                                             .id = id,
+                                             .kind = kind,
+                                             .raw_bytes_len = CD_GAME_SIZE,
+                                         })) != NULL) {
+        cd_put_game(payload, game, word);
+    }
+}
+
+/// @brief Makes a user quit and closes its connection.
+/// @param u The user.
+static void quit_user(user *u) {
+    if (u->state != state_awaiting_passwd)
+        printf("User %zu quitted.\n", u->id);
+
+    // Close the socket connection. The io_uring requests of the socket keep it
+    // open until they complete and shutting it down completes them.
+    if (sr_rx.backend == rx_backend_uring) shutdown(u->fd, SHUT_RDWR);
+    else rx_remove(&sr_rx, u->fd);
+    close(u->fd);
+
+    // Keep track of deleted users.
+    u->finished_game = true;
+    mt_count(sr_metrics, mt_disconnected, 1);
+    tw_cancel(&sr_timers, &u->session);
+    tw_cancel(&sr_timers, &u->stall);
+    push_user(&sr_quits, u);
+    lobby_leave(u->id);
+    if (u->state == state_in_queue) leave_queue(u->id);
+
+    // Its buffers go back to the pools.
+    pl_inbuf_release(&u->in, &sr_inpool, sr_shared);
+    pl_outbuf_release(&u->out, &sr_outpool);
+    while (u->held_first != 0) ur_buf_recycle(&sr_ring, unhold_buf(u));
+
+    // Set the game to finished if the user has played one.
+    if (u->game != 0) quit_game(u->id, u->game - 1);
+}
+
+/// @brief Checks a guess in a game of this shard and tells both players. A
+/// wrong guess that was made before is only told to the one that made it.
+/// @param guess The game with the guessed word. It may be in the input buffer
+/// of the user that guessed.
+/// @param from The user that guessed. Its shard is told once it's answered.
+static void check_guess(cd_game_view guess, size_t from) {
+    // A game that has finished isn't found even if its slot is reused.
+    size_t game_id = cd_get(guess, cd_field_id);
+    hosted_game *hosted = local_game(game_id);
+    const ge_game *game = hosted == NULL ? NULL : &hosted->game;
+    char word[sizeof(game->word)];
+    ge_key key;
+    size_t other;
+
+    if (game != NULL && (game->guesser == from || game->chooser == from)) {
+        // The players are the ones of the game, not the ones of the guess.
+        // The one that guessed is told last since its input buffer goes away
+        // if it can't keep up.
+        other = from == game->guesser ? game->chooser : game->guesser;
+        key = ge_normalize(cd_word(guess), word);
+        hosted->guess_count += 1;
+
+        if (ge_same(word, key, game->word, hosted->word_key)) {
+            tell_guessed(game->guesser);
+            tell_guessed(game->chooser);
+            tw_cancel(&sr_timers, &hosted->turn);
+            if (!hosted->guessed) mt_count(sr_metrics, mt_games_finished, 1);
+            hosted->guessed = true;
+        } else if (!ge_guesses_add(&hosted->guesses, key)) {
+            // It doesn't start a turn either, so repeating a guess doesn't
+            // keep the game going.
+            send_game_to(from, mk_repeated_guess, game, cd_word(guess));
+        } else {
+            send_game_to(other, mk_wrong_guess, game, cd_word(guess));
+            send_game_to(from, mk_wrong_guess, game, cd_word(guess));
+            // Only a guess of the guesser starts its next turn, unless a
+            // player quitted meanwhile.
+            if (from == game->guesser && local_game(game_id) != NULL)
+                watch_turn(hosted);
+        }
+    }
+
+    // The mails of a shard are taken in order, so this comes after the
+    // answers.
+    if (user_shard(from) != sr_shard)
+        post_mail(user_shard(from), mail_answered, from, mk_exit, NULL, 0);
+}
+
+/// @brief Handles a message of a user.
+/// @param u The user.
+/// @param m The message.
+static void handle_msg(user *u, const pl_frame *m) {
+    // The first message is the password.
+    if (u->state == state_awaiting_passwd) {
+        check_passwd(u, m);
+        return;
+    }
+    if (u->state == state_in_lobby || u->state == state_in_queue)
+        watch_idle(u);
+
+    switch (m->kind) {
+    case mk_select_opponent: {
+        ge_game request = cd_load(cd_view(m->raw_bytes));
+        size_t opponent =
+            request.chooser == u->id ? request.guesser : request.chooser;
+        // Game payload without the secret guess word.
+        char game_without_word[CD_GAME_SIZE];
+        hosted_game *hosted;
+
+        // Unauthorized action, or the user isn't available itself.
+        if ((request.chooser != u->id && request.guesser != u->id) ||
+            opponent == u->id || request.finished ||
+            u->state != state_in_lobby)
+            return;
+
+        // Stores the game.
+        if ((hosted = start_game(&request)) == NULL) return;
+        hosted->requester = u->id;
+
+        // The exact data should be in `game_without_word` but without the
+        // secret word.
+        cd_put_game(game_without_word, &hosted->game, "");
+        join_game(u, cd_view(game_without_word));
+
+        // The user is told once the opponent is in the game too.
+        enter_game(opponent, cd_view(game_without_word), mk_select_opponent);
+    } break;
+
+    case mk_find_match: {
+        ge_game request = cd_load(cd_view(m->raw_bytes));
+
+        if (u->state != state_in_lobby) return;
+        u->state = state_in_queue;
+        lobby_leave(u->id);
+
+        request.id = (size_t)now_us();
+        request.chooser = u->id;
+        request.guesser = 0;
+        request.finished = false;
+        if (sr_shard != MATCH_SHARD) {
+            post_mail(MATCH_SHARD, mail_find_match, u->id, mk_find_match,
+                      (const char *)&request, sizeof(ge_game));
+        } else {
+            match_user(&request);
+        }
+    } break;
+
+    case mk_guess: {
+        cd_game_view game = cd_view(m->raw_bytes);
+        size_t game_id = cd_get(game, cd_field_id);
+
+        // Users only guess in the game they're in.
+        if (u->game == 0 || game_id != u->game - 1) return;
+
+        // The word is on the shard of the game.
+        if (game_shard(game_id) != sr_shard) {
+            u->forwarded += 1;
+            post_mail(game_shard(game_id), mail_guess, u->id, mk_guess,
+                      game.bytes, CD_GAME_SIZE);
+        } else {
+            check_guess(game, u->id);
+        }
+    } break;
+
+    case mk_hint: {
+        ge_game game = {
+            .id = u->game - 1,
+            .guesser = u->opponent,
+            .chooser = u->id,
+            .finished = false,
+        };
+
+        // Only the chooser hints the guesser of its game until the word is
+        // guessed. The hint carries the game as the server knows it,
+        // whatever the chooser put in.
+        if (u->state != state_in_game || !u->chooser) return;
+        journal_game(jr_hinted, game.id, 0, 0);
+        send_game_to(game.guesser, mk_hint, &game,
+                     cd_word(cd_view(m->raw_bytes)));
+    } break;
+
+    case mk_exit:
+        quit_user(u);
+        break;
+
+    default:
+        break;
+    }
+}
+
+/// @brief Handles every complete message that's buffered for a user.
+/// @param u The user.
+static void handle_msgs(user *u) {
+    pl_frame frame;
+    int decoded;
+    long started;
+
+    while (!u->finished_game &&
+           (decoded = pl_frame_decode(&u->in, &u->version, &frame)) != 0) {
+        // A payload that isn't what its kind declares is malformed too.
+        if (decoded < 0 || !cd_check(&frame)) {
+            if (u->state == state_awaiting_passwd) reject_user(u);
+            else quit_user(u);
+            return;
+        }
+        started = now_ns();
+        handle_msg(u, &frame);
+        mt_handled(sr_metrics, frame.kind, (uint64_t)(now_ns() - started));
+    }
+}
+
+/// @brief Reads and handles what a user has sent. Edge-triggered sockets are
+/// read until there's nothing left and the others once per event. Reading
+/// stops early while too much is queued for the user. The io_uring backend
+/// receives with its completions so only what it held back is handled.
+/// @param u The user.
+static void read_user(user *u) {
+    ssize_t read_len;
+    size_t room;
+    int budget = READ_BUDGET;
+
+    if (sr_rx.backend == rx_backend_uring) {
+        receive_held(u);
+        return;
+    }
+
+    while (u->readable && !u->finished_game &&
+           pending_len(u) < PL_OUTBUF_HIGH_WATER) {
+        // The rest is read after the others had their turn.
+        if (budget-- == 0) {
+            resume_user(u);
+            return;
+        }
+
+        // Users that aren't in the middle of a message read into the shared
+        // scratch buffer.
+        if (u->in.data == NULL)
+            u->in = pl_inbuf_init(sr_scratch, PL_INBUF_SIZE);
+        room = u->in.cap - (u->in.end - u->in.start);
+        read_len = pl_inbuf_fill(&u->in, u->fd);
+        if (read_len == 0 || (read_len < 0 && errno != EAGAIN)) {
+            quit_user(u);
+            return;
+        }
+        if (read_len > 0) mt_count(sr_metrics, mt_bytes_in, (size_t)read_len);
+        // A read that didn't fill the buffer took everything there was and
+        // what arrives after it comes with a new edge.
+        if (read_len < 0 || (size_t)read_len < room ||
+            sr_rx.backend != rx_backend_epoll)
+            u->readable = false;
+
+        handle_msgs(u);
+        if (pl_inbuf_settle(&u->in, &sr_inpool, sr_scratch) < 0) {
+            quit_user(u);
+            return;
+        }
+    }
+}
+
+/// @brief Reads the users that have room again.
+static void resume_users(void) {
+    size_t len = sr_resumes.len;
+
+    // Each of them is added again at most once while they're read, in a place
+    // that has been read already.
+    sr_resumes.len = 0;
+    for (size_t i = 0; i < len; i++) {
+        sr_resumes.users[i]->resume_pending = false;
+        read_user(sr_resumes.users[i]);
+    }
+}
+
+/// @brief Accepts new connections until there's none left or the limit is
+/// reached.
+static void accept_users(void) {
+    int fd;
+
+    while (sr_users.live < MAX_CLIENTS) {
+        if ((fd = st_accept(serverfd)) < 0) return;
+        welcome_user(fd);
+    }
+
+    printf("Server cannot accept more users. Limit has been reached!\n");
+
+    // Stop accepting new connections until some users quit.
+    sr_accepting = false;
+    rx_remove(&sr_rx, serverfd);
+}
+
+/// @brief Arms a multishot accept of the io_uring backend.
+/// @return `0` or `-1` if it failed.
+static int uring_arm_accept(void) {
+    sr_accept_armed = true;
+    return ur_prep_multishot_accept(&sr_ring, serverfd,
+                                    uring_data(uring_accept, NULL));
+}
+
+/// @brief Arms a multishot poll of the io_uring backend for the mailbox.
+/// @return `0` or `-1` if it failed.
+static int uring_watch_mailbox(void) {
+    return ur_prep_multishot_poll(&sr_ring, sr_shards[sr_shard].mailbox.efd,
+                                  uring_data(uring_mail, NULL));
+}
+
+/// @brief Authenticates a connection that the io_uring backend accepted.
+/// Accepting stops once the limit is reached.
+/// @param cqe The completion.
+static void uring_accepted(const struct io_uring_cqe *cqe) {
+    if (cqe->res >= 0) {
+        // It was accepted before the accept was cancelled.
+        if (sr_users.live == MAX_CLIENTS) close(cqe->res);
+        else welcome_user(cqe->res);
+    }
+
+    if ((cqe->flags & IORING_CQE_F_MORE) == 0) sr_accept_armed = false;
+
+    if (sr_users.live == MAX_CLIENTS) {
+        if (!sr_accepting) return;
+        printf("Server cannot accept more users. Limit has been reached!\n");
+
+        // Stop accepting new connections until some users quit.
+        sr_accepting = false;
+        if (sr_accept_armed) {
+            ur_prep_cancel(&sr_ring, uring_data(uring_accept, NULL),
+                           uring_data(uring_cancel, NULL));
+        }
+        return;
+    }
+
+    if (!sr_accept_armed && sr_accepting)
+        success_or_die(uring_arm_accept(), "Failed to accept");
+}
+
+/// @brief Frees the slots of the users that quitted once nothing refers to
+/// them anymore. The requests of the io_uring backend have to complete first.
+/// New connections are accepted again if there's room now.
+static void release_users(void) {
+    size_t n_kept = 0;
+
+    for (size_t i = 0; i < sr_quits.len; i++) {
+        user *u = sr_quits.users[i];
+
+        if (u->receiving || u->sending.data != NULL || u->flush_pending ||
+            u->resume_pending) {
+            sr_quits.users[n_kept] = u;
+            n_kept += 1;
+            continue;
+        }
+        tb_free(&sr_users, handle_slot(u->id - 1));
+    }
+    sr_quits.len = n_kept;
+
+    if (sr_accepting || sr_users.live == MAX_CLIENTS || sr_handing_over)
+        return;
+
+    sr_accepting = true;
+    if (sr_rx.backend != rx_backend_uring) {
+        success_or_die(rx_add(&sr_rx, serverfd, NULL, rx_read),
+                       "Failed to watch the server socket");
+    } else if (!sr_accept_armed) {
+        success_or_die(uring_arm_accept(), "Failed to accept");
+    }
+}
+
+/// @brief Handles bytes that the io_uring backend received for a user. If the
+/// user isn't in the middle of a message they're decoded right in the
+/// provided buffer.
+/// @param u The user.
+/// @param bytes Received bytes.
+/// @param len The number of bytes.
+static void receive_user(user *u, char *bytes, size_t len) {
+    if (u->in.data == NULL) {
+        u->in = pl_inbuf_init(bytes, len);
+        u->in.end = len;
+    } else if (pl_inbuf_push(&u->in, bytes, len) < 0) {
+        quit_user(u);
+        return;
+    }
+
+    sr_shared = bytes;
+    handle_msgs(u);
+    if (!u->finished_game &&
+        pl_inbuf_settle(&u->in, &sr_inpool, sr_shared) < 0)
+        quit_user(u);
+    sr_shared = sr_scratch;
+}
+
+/// @brief Handles what a user sent that the io_uring backend held back, as
+/// long as there's room for what it causes to be sent.
+/// @param u The user.
+static void receive_held(user *u) {
+    unsigned int bid;
+
+    // What came after the password is in its input buffer.
+    u->readable = false;
+    handle_msgs(u);
+    if (!u->finished_game &&
+        pl_inbuf_settle(&u->in, &sr_inpool, sr_scratch) < 0)
+        quit_user(u);
+
+    while (u->held_first != 0 && !u->finished_game &&
+           pending_len(u) < PL_OUTBUF_HIGH_WATER) {
+        bid = unhold_buf(u);
+        receive_user(u, ur_buf(&sr_ring, bid), sr_held_len[bid]);
+        ur_buf_recycle(&sr_ring, bid);
+    }
+
+    if (u->held_first != 0) u->readable = true;
+}
+
+/// @brief Handles a completion of a user's multishot receive. The receive is
+/// armed again if it stopped because the provided buffers ran out.
+/// @param u The user.
+/// @param cqe The completion.
+static void uring_received(user *u, const struct io_uring_cqe *cqe) {
+    if ((cqe->flags & IORING_CQE_F_BUFFER) != 0) {
+        unsigned int bid = cqe->flags >> IORING_CQE_BUFFER_SHIFT;
+
+        if (cqe->res > 0) mt_count(sr_metrics, mt_bytes_in, (size_t)cqe->res);
+        if (u->finished_game || cqe->res <= 0) {
+            ur_buf_recycle(&sr_ring, bid);
+        } else if (u->held_first != 0 ||
+                   pending_len(u) >= PL_OUTBUF_HIGH_WATER) {
+            // The receive is cancelled but what it already received comes
+            // in order once there's room.
+            hold_buf(u, bid, (size_t)cqe->res);
+            u->readable = true;
+            if (update_interest(u) < 0) quit_user(u);
+        } else {
+            receive_user(u, ur_buf(&sr_ring, bid), (size_t)cqe->res);
+            ur_buf_recycle(&sr_ring, bid);
+        }
+    }
+
+    if ((cqe->flags & IORING_CQE_F_MORE) != 0) return;
+    u->receiving = false;
+    u->cancelling = false;
+    if (u->finished_game) return;
+
+    // The connection is closed or it failed.
+    if (cqe->res == 0 ||
+        (cqe->res < 0 && cqe->res != -ENOBUFS && cqe->res != -ECANCELED)) {
+        quit_user(u);
+        return;
+    }
+
+    if (update_interest(u) < 0) quit_user(u);
+}
+
+/// @brief Handles a completion of a user's send. The user's storage goes back
+/// to the pool and what's been queued meanwhile is sent.
+/// @param u The user.
+/// @param res The number of sent bytes or a negative `errno`.
+static void uring_sent(user *u, int res) {
+    if (res > 0) {
+        u->sending.start += (size_t)res;
+        mt_count(sr_metrics, mt_bytes_out, (size_t)res);
+    }
+
+    if (res <= 0 || u->finished_game) {
+        pl_outbuf_release(&u->sending, &sr_outpool);
+        if (!u->finished_game) quit_user(u);
+        return;
+    }
+    watch_stall(u, true);
+
+    // It was interrupted.
+    if (pl_outbuf_len(&u->sending) > 0) {
+        if (ur_prep_send(&sr_ring, u->fd, u->sending.data + u->sending.start,
+                         pl_outbuf_len(&u->sending),
+                         uring_data(uring_send, u)) < 0)
+            quit_user(u);
+        return;
+    }
+
+    pl_outbuf_release(&u->sending, &sr_outpool);
+    flush_user(u);
+}
+
+/// @brief Starts handing this shard over to a new process of the server. It
+/// stops accepting, reading and sending, and it's saved once its io_uring
+/// requests have completed.
+static void hand_over(void) {
+    sr_handing_over = true;
+    sr_handover_deadline = now_ms() + HANDOVER_DRAIN_TIMEOUT;
+
+    // The connections that haven't been accepted yet are the new process's.
+    if (sr_rx.backend != rx_backend_uring) {
+        if (sr_accepting) rx_remove(&sr_rx, serverfd);
+    } else if (sr_accept_armed) {
+        ur_prep_cancel(&sr_ring, uring_data(uring_accept, NULL),
+                       uring_data(uring_cancel, NULL));
+    }
+    sr_accepting = false;
+
+    if (sr_rx.backend != rx_backend_uring) return;
+
+    // What the receives got before they're cancelled is handled as usual.
+    for (size_t i = 0; i < sr_users.len; i++) {
+        user *u;
+
+        if (!tb_live(&sr_users, i)) continue;
+        u = tb_at(&sr_users, i);
+        if (!u->finished_game && update_interest(u) < 0) quit_user(u);
+    }
+}
+
+/// @brief Checks if a shard that's being handed over can be saved. The users
+/// whose io_uring requests haven't completed by the deadline are told to exit
+/// and disconnected.
+/// @return Whether it can.
+static bool handover_drained(void) {
+    bool late = now_ms() >= sr_handover_deadline;
+
+    if (sr_rx.backend != rx_backend_uring) return true;
+    if (sr_accept_armed && !late) return false;
+
+    for (size_t i = 0; i < sr_users.len; i++) {
+        user *u;
+
+        if (!tb_live(&sr_users, i)) continue;
+        u = tb_at(&sr_users, i);
+        if (u->finished_game || (!u->receiving && u->sending.data == NULL))
+            continue;
+        if (!late) return false;
+
+        printf("User %zu couldn't be handed over in time.\n", u->id);
+        // It only goes out if no send is in flight, which it would be
+        // interleaved with.
+        dismiss_user(u, "exit",
+                     (pl_message){
+                         .id = u->id,
+                         .kind = mk_exit,
+                         .raw_bytes_len = 4,
+                     });
+    }
+
+    return true;
+}
+
+/// @brief Handles the mails posted to this shard.
+static void read_mail(void) {
+    sh_mailbox *mb = &sr_shards[sr_shard].mailbox;
+    sh_mail *mail;
+
+    sh_mailbox_clear(mb);
+
+    while ((mail = sh_mailbox_take(mb)) != NULL) {
+        const size_t *ids = (const size_t *)(void *)mail->bytes;
+        size_t n_ids = mail->len / sizeof(size_t);
+        size_t game_id;
+        ge_game game;
+        user *u = local_user(mail->id);
+
+        switch ((mail_kind)mail->kind) {
+        case mail_joined:
+            for (size_t i = 0; i < n_ids; i++) lobby_join(ids[i]);
+            break;
+        case mail_left:
+            for (size_t i = 0; i < n_ids; i++) lobby_leave(ids[i]);
+            break;
+        case mail_enter_game:
+            enter_game(mail->id, cd_view(mail->bytes), mail->msg_kind);
+            break;
+        case mail_entered:
+            memcpy(&game_id, mail->bytes, sizeof(size_t));
+            game_answered(game_id, mail->id,
+                          mail->msg_kind == mk_select_opponent);
+            break;
+        case mail_find_match:
+            game = cd_load(cd_view(mail->bytes));
+            match_user(&game);
+            break;
+        case mail_leave_queue:
+            leave_queue(mail->id);
+            break;
+        case mail_call_off:
+            memcpy(&game_id, mail->bytes, sizeof(size_t));
+            call_off_match(mail->id, game_id);
+            break;
+        case mail_deliver:
+            if (u == NULL) break;
+            send_msg(u, mail->bytes,
+                     (pl_message){
+                         .id = mail->id,
+                         .kind = mail->msg_kind,
+                         .raw_bytes_len = mail->len,
+                     });
+            break;
+        case mail_guess:
+            check_guess(cd_view(mail->bytes), mail->id);
+            break;
+        case mail_guessed:
+            tell_guessed(mail->id);
+            break;
+        case mail_answered:
+            if (u == NULL || u->finished_game) break;
+            u->forwarded -= 1;
+            if (update_interest(u) < 0) quit_user(u);
+            else if (u->readable && pending_len(u) < PL_OUTBUF_HIGH_WATER)
+                resume_user(u);
+            break;
+        case mail_quit:
+            memcpy(&game_id, mail->bytes, sizeof(size_t));
+            quit_game(mail->id, game_id);
+            break;
+        case mail_evict:
+            evict_user(mail->id);
+            break;
+        case mail_stop:
+            stop_shard();
+            break;
+        case mail_handover:
+            hand_over();
+            break;
+        default:
+            break;
+        }
+
+        free(mail);
+    }
+}
+
+/// @brief Waits for the events of the reactor and handles them.
+/// @param timeout Waiting timeout.
+static void wait_events(int timeout) {
+    rx_event events[RX_MAX_EVENTS];
+    int n_events = success_or_die(rx_wait(&sr_rx, events, timeout),
+                                  "Faild to wait for events");
+
+    // Timers go first since they're as late as the wait was long.
+    expire_timers();
+
+    for (int i = 0; i < n_events; i++) {
+        // User of this event.
+        user *u = events[i].data;
+
+        // Listening socket.
+        if (u == NULL) {
+            accept_users();
+            continue;
+        }
+
+        // Mailbox.
+        if (events[i].data == &sr_shards[sr_shard]) {
+            read_mail();
+            continue;
+        }
+
+        if (u->finished_game) continue;
+
+        // Sends what's been waiting for the socket to become writable.
+        if ((events[i].events & rx_write) != 0) {
+            flush_user(u);
+            if (u->finished_game) continue;
+        }
+
+        if ((events[i].events & rx_read) != 0) {
+            u->readable = true;
+            read_user(u);
+        }
+    }
+}
+
+/// @brief Submits what the io_uring backend has queued since the last
+/// iteration, waits for completions and handles them. It's a single
+/// `io_uring_enter` unless the submission queue filled up.
+/// @param timeout Waiting timeout.
+static void wait_completions(int timeout) {
+    struct io_uring_cqe *next;
+
+    success_or_die(ur_submit_and_wait(&sr_ring, 1, timeout),
+                   "Faild to wait for completions");
+    expire_timers();
+
+    while ((next = ur_peek_cqe(&sr_ring)) != NULL) {
+        // Handling it may queue requests, so it's copied to free its entry.
+        struct io_uring_cqe cqe = *next;
+        size_t slot = cqe.user_data & 0xffffffff;
+
+        ur_cqe_seen(&sr_ring);
+        switch ((uring_op)(cqe.user_data >> 32)) {
+        case uring_accept:
+            uring_accepted(&cqe);
+            break;
+        case uring_recv:
+            uring_received(tb_at(&sr_users, slot), &cqe);
+            break;
+        case uring_send:
+            uring_sent(tb_at(&sr_users, slot), cqe.res);
+            break;
+        case uring_mail:
+            read_mail();
+            if ((cqe.flags & IORING_CQE_F_MORE) == 0 && sr_running)
+                success_or_die(uring_watch_mailbox(), "Failed to watch mails");
+            break;
+        case uring_cancel:
+        default:
+            break;
+        }
+    }
+}
+
+/// @brief Appends the batched records to the journal, at most once in
+/// `JOURNAL_INTERVAL` milliseconds unless it's forced or the batch is large.
+/// @param force Whether to write it anyway.
+static void journal_batch(bool force) {
+    long now;
+
+    if (args.journal_file == NULL || sr_batch.len == 0) return;
+    now = now_ms();
+    if (!force && now - sr_journaled_at < JOURNAL_INTERVAL &&
+        sr_batch.len < JOURNAL_BATCH_BYTES)
+        return;
+
+    sr_journaled_at = now;
+    if (jr_write(&sr_journal, &sr_batch) < 0)
+        printf("Failed to write the journal: %s\n", strerror(errno));
+}
+
+/// @brief Appends bytes to a snapshot of the server.
+/// @param b The snapshot.
+/// @param bytes The bytes.
+/// @param len The number of bytes.
+static void save(ho_buffer *b, const void *bytes, size_t len) {
+    if (ho_put(b, bytes, len) < 0) die("Failed to allocate the snapshot.\n");
+}
+
+/// @brief Appends a number to a snapshot of the server.
+/// @param b The snapshot.
+/// @param value The number.
+static void save_size(ho_buffer *b, size_t value) {
+    save(b, &value, sizeof(size_t));
+}
+
+/// @brief Reads bytes of the snapshot of the server that restarted.
+/// @param r The snapshot.
+/// @param dst Where to copy them.
+/// @param len The number of bytes.
+static void restore(ho_reader *r, void *dst, size_t len) {
+    if (!ho_take(r, dst, len)) die("The snapshot is malformed.\n");
+}
+
+/// @brief Reads a number of the snapshot of the server that restarted.
+/// @param r The snapshot.
+/// @return The number.
+static size_t restore_size(ho_reader *r) {
+    size_t value;
+
+    restore(r, &value, sizeof(size_t));
+
+    return value;
+}
+
+/// @brief Gives the number of bytes that a user sent and that haven't been
+/// handled yet, including the ones that the io_uring backend holds back.
+/// @param u The user.
+/// @return Received bytes.
+static size_t received_len(const user *u) {
+    size_t len = u->in.end - u->in.start;
+
+    for (unsigned int next = u->held_first; next != 0;
+         next = sr_held_next[next - 1])
+        len += sr_held_len[next - 1];
+
+    return len;
+}
+
+/// @brief Saves a user of this shard and its socket.
+/// @param b The snapshot of the shard.
+/// @param fds The sockets of the shard.
+/// @param u The user.
+static void save_user(ho_buffer *b, ho_buffer *fds, const user *u) {
+    saved_user saved = (saved_user){
+        .slot = handle_slot(u->id - 1),
+        .forwarded = u->forwarded,
+        .game = u->game,
+        .opponent = u->opponent,
+        .session_at = tw_pending(&u->session) ? u->session.expires : TW_NEVER,
+        .stall_at = tw_pending(&u->stall) ? u->stall.expires : TW_NEVER,
+        .in_len = received_len(u),
+        .out_len = pl_outbuf_len(&u->out),
+        .session_kind = u->session.kind,
+        .version = u->version,
+        .state = u->state,
+        .chooser = u->chooser,
+    };
+
+    save(b, &saved, sizeof(saved_user));
+    if (u->in.data != NULL)
+        save(b, u->in.data + u->in.start, u->in.end - u->in.start);
+    for (unsigned int next = u->held_first; next != 0;
+         next = sr_held_next[next - 1])
+        save(b, ur_buf(&sr_ring, next - 1), sr_held_len[next - 1]);
+    if (u->out.data != NULL) save(b, u->out.data + u->out.start, saved.out_len);
+    save(fds, &u->fd, sizeof(int));
+}
+
+/// @brief Saves a game of this shard.
+/// @param b The snapshot of the shard.
+/// @param hosted The game.
+static void save_game(ho_buffer *b, const hosted_game *hosted) {
+    saved_game saved = (saved_game){
+        .game = hosted->game,
+        .requester = hosted->requester,
+        .turn_at = tw_pending(&hosted->turn) ? hosted->turn.expires : TW_NEVER,
+        .started_at = hosted->started_at,
+        .guesses_len = hosted->guesses.len,
+        .guess_count = hosted->guess_count,
+        .guessed = hosted->guessed,
+    };
+
+    save(b, &saved, sizeof(saved_game));
+    for (size_t i = 0; i < hosted->guesses.cap; i++) {
+        if (hosted->guesses.hashes[i] != 0)
+            save(b, &hosted->guesses.hashes[i], sizeof(uint64_t));
+    }
+}
+
+/// @brief Saves what this shard knows so a new process of the server goes on
+/// from there. The sockets are left open and the games aren't ended.
+static void save_shard(void) {
+    ho_buffer *b = &sr_shards[sr_shard].saved;
+    ho_buffer *fds = &sr_shards[sr_shard].saved_fds;
+    size_t n_users = 0;
+
+    // A user whose held bytes don't fit into an input buffer can't be handed
+    // over. The users are counted meanwhile.
+    for (size_t i = 0; i < sr_users.len; i++) {
+        user *u;
+
+        if (!tb_live(&sr_users, i)) continue;
+        u = tb_at(&sr_users, i);
+        if (!u->finished_game && received_len(u) > PL_INBUF_SIZE) {
+            printf("User %zu couldn't be handed over with what it sent.\n",
+                   u->id);
+            quit_user(u);
+        }
+        if (!u->finished_game) n_users += 1;
+    }
+
+    // Each slot is its generation and whether it's in use in the lowest bit.
+    // The users that quitted are freed on the way.
+    save_size(b, sr_users.len);
+    for (size_t i = 0; i < sr_users.len; i++) {
+        bool live = tb_live(&sr_users, i) &&
+                    !((user *)tb_at(&sr_users, i))->finished_game;
+        size_t generation = tb_generation(&sr_users, i);
+
+        if (tb_live(&sr_users, i) && !live) generation += 1;
+        save_size(b, generation << 1 | (size_t)live);
+    }
+    save_size(b, sr_games.len);
+    for (size_t i = 0; i < sr_games.len; i++)
+        save_size(b, tb_generation(&sr_games, i) << 1 |
+                         (size_t)tb_live(&sr_games, i));
+
+    save_size(b, n_users);
+    for (size_t i = 0; i < sr_users.len; i++) {
+        user *u;
+
+        if (!tb_live(&sr_users, i)) continue;
+        u = tb_at(&sr_users, i);
+        if (!u->finished_game) save_user(b, fds, u);
+    }
+    save_size(b, sr_games.live);
+    for (size_t i = 0; i < sr_games.len; i++) {
+        if (tb_live(&sr_games, i)) save_game(b, tb_at(&sr_games, i));
+    }
+
+    save_size(b, sr_lobby.len);
+    for (size_t i = 0; i < sr_lobby.len; i++)
+        save(b, lobby_entry_of(sr_lobby.ids[i]), sizeof(lobby_entry));
+    save_size(b, sr_joined.len);
+    save(b, sr_joined.ids, sr_joined.len * sizeof(size_t));
+    save_size(b, sr_left.len);
+    save(b, sr_left.ids, sr_left.len * sizeof(size_t));
+    save(b, &sr_waiting, sizeof(ge_game));
+}
+
+/// @brief Goes on with a user of the server that restarted.
+/// @param r The snapshot of this shard.
+/// @param fd The user's socket.
+static void restore_user(ho_reader *r, int fd) {
+    saved_user saved;
+    const char *bytes;
+    user *u;
+
+    restore(r, &saved, sizeof(saved_user));
+    if (!tb_live(&sr_users, saved.slot)) die("The snapshot is malformed.\n");
+    u = tb_at(&sr_users, saved.slot);
+    *u = (user){
+        .fd = fd,
+        .id = make_handle(&sr_users, saved.slot) + 1,
+        .version = saved.version,
+        .in = pl_inbuf_init(NULL, 0),
+        .out = pl_outbuf_init(NULL, 0),
+        .sending = pl_outbuf_init(NULL, 0),
+        .forwarded = saved.forwarded,
+        .game = saved.game,
+        .opponent = saved.opponent,
+        .session = (tw_timer){.kind = saved.session_kind},
+        .stall = (tw_timer){.kind = timer_stall},
+        .interest = rx_read,
+        .held_first = 0,
+        .held_last = 0,
+        .state = saved.state,
+        .finished_game = false,
+        .flush_pending = false,
+        .readable = false,
+        .resume_pending = false,
+        .receiving = false,
+        .cancelling = false,
+        .chooser = saved.chooser,
+    };
+    if (saved.session_at != TW_NEVER)
+        tw_schedule(&sr_timers, &u->session, saved.session_at);
+    if (saved.stall_at != TW_NEVER)
+        tw_schedule(&sr_timers, &u->stall, saved.stall_at);
+
+    // What it sent before is handled before what it sends now.
+    if (saved.in_len > 0) {
+        if ((bytes = ho_skip(r, saved.in_len)) == NULL)
+            die("The snapshot is malformed.\n");
+        u->in = pl_inbuf_init(pl_pool_get(&sr_inpool), PL_INBUF_SIZE);
+        if (u->in.data == NULL || pl_inbuf_push(&u->in, bytes, saved.in_len) < 0)
+            die("Failed to allocate an input buffer.\n");
+        u->readable = true;
+        resume_user(u);
+    }
+    if (saved.out_len > 0) {
+        if ((bytes = ho_skip(r, saved.out_len)) == NULL)
+            die("The snapshot is malformed.\n");
+        if (pl_encoded_queue(&u->out, &sr_outpool, bytes, saved.out_len) < 0)
+            die("Failed to allocate an output buffer.\n");
+        u->flush_pending = true;
+        push_user(&sr_flushes, u);
+    }
+
+    // The io_uring backend arms its receive along with the rest.
+    if ((sr_rx.backend != rx_backend_uring &&
+         rx_add(&sr_rx, fd, u, rx_read) < 0) ||
+        update_interest(u) < 0)
+        quit_user(u);
+}
+
+/// @brief Goes on with a game of the server that restarted.
+/// @param r The snapshot of this shard.
+static void restore_game(ho_reader *r) {
+    saved_game saved;
+    hosted_game *hosted;
+    uint64_t hash;
+
+    restore(r, &saved, sizeof(saved_game));
+    if (handle_shard(saved.game.id) != sr_shard ||
+        !tb_live(&sr_games, handle_slot(saved.game.id)))
+        die("The snapshot is malformed.\n");
+    hosted = tb_at(&sr_games, handle_slot(saved.game.id));
+    *hosted = (hosted_game){
+        .game = saved.game,
+        .turn = (tw_timer){.kind = timer_turn},
+        .requester = saved.requester,
+        .guesses = {.hashes = NULL, .len = 0, .cap = 0},
+        .started_at = saved.started_at,
+        .guess_count = saved.guess_count,
+        .guessed = saved.guessed,
+    };
+    // The word was normalized when the game started.
+    hosted->word_key = ge_normalize(hosted->game.word, hosted->game.word);
+    for (size_t i = 0; i < saved.guesses_len; i++) {
+        restore(r, &hash, sizeof(uint64_t));
+        ge_guesses_add(&hosted->guesses, (ge_key){.hash = hash, .len = 0});
+    }
+    if (saved.turn_at != TW_NEVER)
+        tw_schedule(&sr_timers, &hosted->turn, saved.turn_at);
+}
+
+/// @brief Goes on from where this shard was in the server that restarted. The
+/// slots keep their generations so the ids stay the same.
+static void restore_shard(void) {
+    ho_reader *r = &sr_shards[sr_shard].restore;
+    const int *fds = sr_shards[sr_shard].restore_fds;
+    lobby_entry entry;
+    size_t len, slot;
+
+    len = restore_size(r);
+    for (size_t i = 0; i < len; i++) {
+        slot = restore_size(r);
+        if (tb_push(&sr_users, slot >> 1, (slot & 1) != 0) == TB_NONE)
+            die("Failed to allocate the users.\n");
+    }
+    len = restore_size(r);
+    for (size_t i = 0; i < len; i++) {
+        slot = restore_size(r);
+        if (tb_push(&sr_games, slot >> 1, (slot & 1) != 0) == TB_NONE)
+            die("Failed to allocate the games.\n");
+    }
+
+    len = restore_size(r);
+    for (size_t i = 0; i < len; i++) restore_user(r, fds[i]);
+    __atomic_add_fetch(&sr_restored[0], len, __ATOMIC_RELAXED);
+    len = restore_size(r);
+    for (size_t i = 0; i < len; i++) restore_game(r);
+    __atomic_add_fetch(&sr_restored[1], len, __ATOMIC_RELAXED);
+
+    len = restore_size(r);
+    for (size_t i = 0; i < len; i++) {
+        restore(r, &entry, sizeof(lobby_entry));
+        push_id(&sr_lobby, entry.id);
+        *lobby_entry_of(entry.id) = entry;
+    }
+    len = restore_size(r);
+    for (size_t i = 0; i < len; i++) push_id(&sr_joined, restore_size(r));
+    len = restore_size(r);
+    for (size_t i = 0; i < len; i++) push_id(&sr_left, restore_size(r));
+    restore(r, &sr_waiting, sizeof(ge_game));
+
+    // What was queued before goes out right away.
+    flush_users();
+}
+
+/// @brief Runs a shard until it's stopped.
+/// @param arg The shard.
+/// @return `NULL`.
+static void *run_shard(void *arg) {
+    // When the lobby was last announced.
+    long last_announce = 0;
+
+    sr_shard = (size_t)((shard *)arg - sr_shards);
+    serverfd = sr_shards[sr_shard].serverfd;
+    sr_metrics = sr_shards[sr_shard].metrics;
+    sr_shared = sr_scratch;
+    sr_users = tb_init(sizeof(user));
+    sr_games = tb_init(sizeof(hosted_game));
+    tw_init(&sr_timers, now_ms());
+
+    if ((sr_wakes = calloc(sr_shards_len, sizeof(bool))) == NULL)
+        die("Failed to allocate the shards.\n");
+
+    sr_rx = rx_init(args.backend);
+    success_or_die(sr_rx.epfd == -2 ? -1 : 0, "Failed to setup epoll");
+    if (args.backend == rx_backend_uring) {
+        success_or_die(
+            ur_init(&sr_ring, URING_ENTRIES, URING_BUFS, URING_BUF_SIZE),
+            "Failed to setup io_uring");
+        success_or_die(uring_arm_accept(), "Failed to watch the server socket");
+        success_or_die(uring_watch_mailbox(), "Failed to watch mails");
+        sr_accepting = true;
+    } else {
+        success_or_die(rx_add(&sr_rx, serverfd, NULL, rx_read),
+                       "Failed to watch the server socket");
+        sr_accepting = true;
+        success_or_die(rx_add(&sr_rx, sr_shards[sr_shard].mailbox.efd,
+                              &sr_shards[sr_shard], rx_read),
+                       "Failed to watch mails");
+    }
+
+    if (sr_shards[sr_shard].restore.data != NULL) {
+        restore_shard();
+        // The last shard to go on ends the pause.
+        if (__atomic_sub_fetch(&sr_restoring, 1, __ATOMIC_ACQ_REL) == 0) {
+            printf("Went on with %zu users and %zu games after a pause of "
+                   "%.2f ms.\n",
+                   sr_restored[0], sr_restored[1],
+                   (double)((uint64_t)now_us() - sr_paused_at) / 1e3);
+            fflush(stdout);
+            free(sr_snapshot);
+            free(sr_snapshot_fds);
+        }
+    }
+
+    while (sr_running) {
+        int timeout = PL_NO_TIMEOUT;
+
+        // Wakes up for the next announcement if there's something to announce.
+        if (lobby_changed())
+            timeout = wake_by(timeout, last_announce + ANNOUNCE_INTERVAL);
+        // And for the next timer.
+        if (sr_timers.len > 0) timeout = wake_by(timeout, tw_next(&sr_timers));
+        // Users that have room again are read without waiting.
+        if (sr_resumes.len > 0) timeout = 0;
+        // And for the batch of the journal.
+        if (sr_batch.len > 0)
+            timeout = wake_by(timeout, sr_journaled_at + JOURNAL_INTERVAL);
+
+        if (sr_rx.backend == rx_backend_uring) wait_completions(timeout);
+        else wait_events(timeout);
+        if (!sr_running) break;
+
+        resume_users();
+
+        if (lobby_changed() && now_ms() - last_announce >= ANNOUNCE_INTERVAL) {
+            announce_opponents();
+            last_announce = now_ms();
+        }
+
+        // Every user gets what was queued for it in this iteration with a
+        // single send. The io_uring backend submits them with the next wait.
+        flush_users();
+        // Every shard that was mailed is woken up once.
+        wake_shards();
+        release_users();
+
+        mt_set(sr_metrics, mt_users, sr_users.live);
+        mt_set(sr_metrics, mt_games, sr_games.live);
+        // The records of the games go to the journal in batches.
+        journal_batch(false);
+
+        if (sr_handing_over && handover_drained()) {
+            save_shard();
+            sr_running = false;
+        }
+    }
+
+    // The games that were ended by stopping it too.
+    journal_batch(true);
+    free(sr_batch.data);
+
+    return NULL;
+}
+
+/// @brief Sends a snapshot of the metrics of every shard to a connection of
+/// the admin socket. It's in binary if the connection asks for `binary` first
+/// and in Prometheus text otherwise.
+/// @param fd The connection. It blocks for a second at most.
+/// @param sum Where the snapshot is taken.
+/// @param encoded Room for a binary snapshot.
+static void serve_metrics(int fd, mt_metrics *sum, char *encoded) {
+    timeval second = (timeval){.tv_sec = 1, .tv_usec = 0};
+    char request[16];
+    char *text = NULL;
+    size_t len = 0;
+    ssize_t read_len, sent;
+    FILE *out;
+
+    setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &second, sizeof(timeval));
+    setsockopt(fd, SOL_SOCKET, SO_SNDTIMEO, &second, sizeof(timeval));
+    read_len = st_read(fd, request, sizeof(request) - 1);
+    request[read_len < 0 ? 0 : read_len] = '\0';
+
+    bzero(sum, sizeof(mt_metrics));
+    for (size_t i = 0; i < sr_shards_len; i++)
+        mt_merge(sum, sr_shards[i].metrics);
+
+    if (strncmp(request, "binary", 6) == 0) {
+        len = mt_encode(sum, encoded);
+    } else if ((out = open_memstream(&text, &len)) != NULL) {
+        mt_render(sum, out);
+        fclose(out);
+        encoded = text;
+    }
+
+    for (size_t at = 0; at < len; at += (size_t)sent) {
+        if ((sent = st_send(fd, encoded + at, len - at)) <= 0) break;
+    }
+
+    free(text);
+    close(fd);
+}
+
+/// @brief Serves the admin socket until it's shut down. The shards aren't
+/// paused meanwhile.
+/// @param arg Unused.
+/// @return `NULL`.
+static void *run_admin(void *arg) {
+    mt_metrics *sum = malloc(sizeof(mt_metrics));
+    char *encoded = malloc(MT_SNAPSHOT_MAX);
+    int fd;
+
+    (void)arg;
+    if (sum == NULL || encoded == NULL)
+        die("Failed to allocate the metrics.\n");
+
+    while (!__atomic_load_n(&sr_admin_stopped, __ATOMIC_ACQUIRE)) {
+        if (st_single_poll(sr_admin_fd, pk_read, -1) < 0 && errno != EINTR)
+            break;
+        if ((fd = accept4(sr_admin_fd, NULL, NULL, SOCK_CLOEXEC)) >= 0)
+            serve_metrics(fd, sum, encoded);
+    }
+
+    free(encoded);
+    free(sum);
+    return NULL;
+}
+
+/// @brief Mails every shard.
+/// @param kind `mail_stop` or `mail_handover`.
+static void mail_shards(mail_kind kind) {
+    for (size_t i = 0; i < sr_shards_len; i++) {
+        sh_mail *mail = calloc(1, sizeof(sh_mail));
+
+        if (mail == NULL) die("Failed to allocate a mail.\n");
+        mail->kind = kind;
+        sh_mailbox_post(&sr_shards[i].mailbox, mail);
+        sh_mailbox_wake(&sr_shards[i].mailbox);
+    }
+}
+
+/// @brief Stops the admin thread and removes its socket.
+static void stop_admin(void) {
+    if (sr_admin_fd < 0) return;
+
+    // Shutting the admin socket down wakes its thread up.
+    __atomic_store_n(&sr_admin_stopped, true, __ATOMIC_RELEASE);
+    shutdown(sr_admin_fd, SHUT_RDWR);
+    pthread_join(sr_admin, NULL);
+    close(sr_admin_fd);
+    unlink(args.admin_socket_file);
+}
+
+/// @brief Stops the journal thread and closes the journal.
+static void stop_journal(void) {
+    if (args.journal_file == NULL) return;
+
+    // The journal thread syncs what the shards wrote before it returns.
+    jr_stop(&sr_journal);
+    pthread_join(sr_journal_thread, NULL);
+    close(sr_journal.fd);
+    printf("\nJournaled %lu batches with %lu syncs.",
+           (unsigned long)sr_journal.written, (unsigned long)sr_journal.syncs);
+}
+
+/// @brief Saves the mails that a shard hadn't taken when it was handed over.
+/// @param b The snapshot.
+/// @param mb The mailbox of the shard, whose thread has ended.
+static void save_mails(ho_buffer *b, sh_mailbox *mb) {
+    size_t at = b->len, len = 0;
+    sh_mail *mail;
+
+    save_size(b, 0);
+    while ((mail = sh_mailbox_take(mb)) != NULL) {
+        save(b, mail, sizeof(sh_mail));
+        free(mail);
+        len += 1;
+    }
+    memcpy(b->data + at, &len, sizeof(size_t));
+}
+
+/// @brief Posts the mails that a shard of the server that restarted hadn't
+/// taken.
+/// @param r The snapshot.
+/// @param mb The mailbox of the shard.
+static void restore_mails(ho_reader *r, sh_mailbox *mb) {
+    size_t len = restore_size(r);
+    sh_mail *mail;
+
+    for (size_t i = 0; i < len; i++) {
+        if ((mail = malloc(sizeof(sh_mail))) == NULL)
+            die("Failed to allocate a mail.\n");
+        restore(r, mail, sizeof(sh_mail));
+        sh_mailbox_post(mb, mail);
+    }
+    if (len > 0) sh_mailbox_wake(mb);
+}
+
+/// @brief Restarts the server without dropping its connections. A new process
+/// of it is exec'd with the same arguments and the shards are handed over to
+/// it once it says hello. The connections that haven't been accepted yet wait
+/// for the new process.
+/// @param argc Arguments count.
+/// @param argv The arguments of the server.
+/// @return `-1` with `errno` set if the new process didn't say hello, in which
+/// case the server goes on. It exits otherwise.
+static int restart_server(int argc, char *argv[]) {
+    char **new_argv = calloc((size_t)argc + 2, sizeof(char *));
+    char option[32], path[PATH_MAX];
+    ho_buffer snapshot = {.data = NULL, .len = 0, .cap = 0};
+    ho_buffer fds = {.data = NULL, .len = 0, .cap = 0};
+    ho_header header;
+    size_t n_args = 0;
+    int pair[2], polled, error = 0;
+    pid_t pid;
+
+    if (new_argv == NULL) die("Failed to allocate the arguments.\n");
+    for (int i = 0; i < argc; i++) {
+        if (cli_option_value(argv[i], "--handover=") == NULL)
+            new_argv[n_args++] = argv[i];
+    }
+    snprintf(option, sizeof(option), "--handover=%d", HANDOVER_FD);
+    new_argv[n_args] = option;
+
+    // It's found before `fork` since searching `PATH` isn't async-signal-safe.
+    if (ho_find_program(new_argv[0], path) < 0 ||
+        socketpair(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0, pair) < 0) {
+        free(new_argv);
+        return -1;
+    }
+    fflush(stdout);
+    if ((pid = fork()) < 0) {
+        error = errno;
+        close(pair[0]);
+        close(pair[1]);
+        free(new_argv);
+        errno = error;
+        return -1;
+    }
+
+    if (pid == 0) {
+        // Only async-signal-safe calls are made before `exec`. The new process
+        // only gets the standard streams and its end of the unix socket.
+        if (pair[1] == HANDOVER_FD) fcntl(HANDOVER_FD, F_SETFD, 0);
+        else dup2(pair[1], HANDOVER_FD);
+        close_range(HANDOVER_FD + 1, ~0U, 0);
+        execve(path, new_argv, environ);
+        _exit(127);
+    }
+    close(pair[1]);
+    free(new_argv);
+
+    // The clients aren't paused until the new process is ready and can read
+    // the snapshot.
+    polled = st_single_poll(pair[0], pk_read, HANDOVER_HELLO_TIMEOUT);
+    if (polled <= 0) error = polled == 0 ? ETIMEDOUT : errno;
+    else if (ho_read(pair[0], &header, sizeof(ho_header)) < 0) error = errno;
+    else if (!ho_check_header(&header, sr_shards_len)) error = EPROTO;
+    if (error != 0) {
+        kill(pid, SIGKILL);
+        waitpid(pid, NULL, 0);
+        close(pair[0]);
+        errno = error;
+        return -1;
+    }
+
+    sr_paused_at = (uint64_t)now_us();
+    mail_shards(mail_handover);
+    for (size_t i = 0; i < sr_shards_len; i++)
+        pthread_join(sr_shards[i].thread, NULL);
+    // The new process takes their sockets over.
+    stop_admin();
+    stop_journal();
+
+    // The listening sockets go first and the ones of the users of each shard
+    // after them.
+    for (size_t i = 0; i < sr_shards_len; i++)
+        save(&fds, &sr_shards[i].serverfd, sizeof(int));
+    for (size_t i = 0; i < sr_shards_len; i++) {
+        shard *sh = &sr_shards[i];
+
+        save_size(&snapshot, sh->saved.len);
+        save_size(&snapshot, sh->saved_fds.len / sizeof(int));
+        save(&snapshot, sh->saved.data, sh->saved.len);
+        save(&fds, sh->saved_fds.data, sh->saved_fds.len);
+        save_mails(&snapshot, &sh->mailbox);
+    }
+
+    header = ho_make_header(sr_paused_at, snapshot.len, fds.len / sizeof(int),
+                            sr_shards_len);
+    if (ho_send(pair[0], &header, (const int *)(void *)fds.data,
+                snapshot.data) < 0) {
+        perror("Failed to hand the connections over");
+        exit(EXIT_FAILURE);
+    }
+    printf("\nHanded %zu connections over to process %d.\n",
+           fds.len / sizeof(int) - sr_shards_len, (int)pid);
+    fflush(stdout);
+
+    // The unix socket file is the new process's now.
+    exit(EXIT_SUCCESS);
+}
+
+/// @brief Takes the connections over from the server that restarted itself.
+/// Each shard goes on from its part of the snapshot once it's started.
+static void resume_server(void) {
+    int fd = args.handover_fd;
+    ho_header header = ho_make_header(0, 0, 0, sr_shards_len);
+    ho_reader r;
+    size_t fd_at = sr_shards_len, len, n_fds;
+
+    // Saying hello tells the old process that this one is ready.
+    success_or_die(ho_write(fd, &header, sizeof(ho_header)),
+                   "Failed to take the connections over");
+    success_or_die(ho_receive(fd, &header, &sr_snapshot_fds, &sr_snapshot),
+                   "Failed to take the connections over");
+    close(fd);
+    if (!ho_check_header(&header, sr_shards_len) ||
+        header.fds < sr_shards_len)
+        die("The snapshot is malformed.\n");
+
+    sr_paused_at = header.paused_at;
+    sr_restoring = sr_shards_len;
+    r = (ho_reader){.data = sr_snapshot, .len = header.len, .at = 0};
+    for (size_t i = 0; i < sr_shards_len; i++) {
+        // The shards share the unix socket like they did.
+        sr_shards[i].serverfd =
+            args.unix_socket ? sr_snapshot_fds[0] : sr_snapshot_fds[i];
+        if (args.unix_socket && i > 0) close(sr_snapshot_fds[i]);
+
+        len = restore_size(&r);
+        n_fds = restore_size(&r);
+        sr_shards[i].restore = (ho_reader){
+            .data = ho_skip(&r, len),
+            .len = len,
+            .at = 0,
+        };
+        if (sr_shards[i].restore.data == NULL || n_fds > header.fds - fd_at)
+            die("The snapshot is malformed.\n");
+        sr_shards[i].restore_fds = sr_snapshot_fds + fd_at;
+        fd_at += n_fds;
+        restore_mails(&r, &sr_shards[i].mailbox);
+    }
+}
+
+int main(int argc, char *argv[]) {
+    sigset_t signals;
+    int sig_num;
+
+    args = parse_cli_args(argc, argv);
+    sr_shards_len = args.shards;
+
+    // SIGINT (i.e Crtl+C) and SIGUSR2, which restarts the server, are waited
+    // for by the main thread, so the shards are started with them blocked.
+    sigemptyset(&signals);
+    sigaddset(&signals, SIGINT);
+    sigaddset(&signals, SIGUSR2);
+    pthread_sigmask(SIG_BLOCK, &signals, NULL);
+
+    if ((sr_shards = calloc(sr_shards_len, sizeof(shard))) == NULL)
+        die("Failed to allocate the shards.\n");
+
+    for (size_t i = 0; i < sr_shards_len; i++) {
+        success_or_die(sh_mailbox_init(&sr_shards[i].mailbox),
+                       "Failed to setup a mailbox");
+        if ((sr_shards[i].metrics = calloc(1, sizeof(mt_metrics))) == NULL)
+            die("Failed to allocate the metrics.\n");
+    }
+
+    // The server that restarted hands its sockets over.
+    if (args.handover_fd >= 0) resume_server();
+
+    for (size_t i = 0; i < sr_shards_len && args.handover_fd < 0; i++) {
+        // Every shard has its own TCP socket on the same port and the kernel
+        // spreads the connections between them. Unix sockets can't be shared
+        // like that, so the shards accept from the same one.
+        if (args.unix_socket && i > 0) {
+            sr_shards[i].serverfd = sr_shards[0].serverfd;
+            continue;
+        }
+        sr_shards[i].serverfd = success_or_die(
+            st_server_setup(HOST, args.port, args.unix_socket_file,
+                            SOMAXCONN, args.unix_socket, sr_shards_len > 1,
+                            args.profile),
+            "Failed to setup a server socket");
+    }
+
+    if (args.unix_socket) {
+        printf("Listening on `%s` unix socket file...\n",
+               args.unix_socket_file);
+    } else printf("Listening on the %d port...\n", args.port);
+
+    if (args.journal_file != NULL) {
+        success_or_die(jr_open(&sr_journal, args.journal_file, wall_us()),
+                       "Failed to open the journal");
+        if (pthread_create(&sr_journal_thread, NULL, jr_run, &sr_journal) != 0)
+            die("Failed to start the journal thread.\n");
+        printf("Games are journaled to `%s`.\n", args.journal_file);
+    }
+
+    if (args.admin_socket_file != NULL) {
+        sr_admin_fd = success_or_die(
+            st_server_setup(HOST, 0, args.admin_socket_file, 16, true, false,
+                            st_profile_default),
+            "Failed to setup the admin socket");
+        if (pthread_create(&sr_admin, NULL, run_admin, NULL) != 0)
+            die("Failed to start the admin thread.\n");
+        printf("Metrics are on `%s` unix socket file.\n",
+               args.admin_socket_file);
+    }
+    fflush(stdout);
+
+    for (size_t i = 0; i < sr_shards_len; i++) {
+        if (pthread_create(&sr_shards[i].thread, NULL, run_shard,
+                           &sr_shards[i]) != 0)
+            die("Failed to start a shard.\n");
+    }
+
+    // It only returns if restarting failed.
+    while (sigwait(&signals, &sig_num) == 0 && sig_num == SIGUSR2) {
+        restart_server(argc, argv);
+        perror("Failed to restart");
+    }
+
+    // Each shard closes the connections of its users.
+    mail_shards(mail_stop);
+    for (size_t i = 0; i < sr_shards_len; i++) {
+        pthread_join(sr_shards[i].thread, NULL);
+        // Closes the server socket.
+        if (!args.unix_socket || i == 0) close(sr_shards[i].serverfd);
+    }
+
+    if (args.unix_socket) {
+        // Unlinks the socket domain path.
+        unlink(args.unix_socket_file);
+    }
+
+    stop_admin();
+    stop_journal();
+
+    printf("\nConnection closed.\n");
+    fflush(stdout);
+
+    exit(EXIT_SUCCESS);
+}
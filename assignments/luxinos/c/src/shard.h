@@ -0,0 +1,125 @@
+/// This is a mailbox for the threads of a sharded server. Any thread can post
+/// mails to a shard without locks and the shard takes them in its own event
+/// loop, where its `eventfd` wakes it up.
+///
+/// The queue is an intrusive multi-producer single-consumer linked list.
+/// Posting is a single atomic exchange and the mails of each poster are taken
+/// in the order they were posted.
+
+#pragma once
+
+#include "game.h"
+#include "protocol.h"
+#include <stdint.h>
+#include <stdlib.h>
+#include <sys/eventfd.h>
+#include <unistd.h>
+
+/// The most bytes a mail carries.
+#define SH_MAIL_BYTES sizeof(ge_game)
+
+/// A mail between shards. What its fields mean depends on its kind.
+typedef struct sh_mail {
+    /// The mail posted after this one.
+    struct sh_mail *next;
+    /// The user it's about.
+    size_t id;
+    /// The number of `bytes`.
+    size_t len;
+    /// Mail kind.
+    unsigned int kind;
+    /// Kind of the message it carries, if any.
+    pl_message_kind msg_kind;
+    /// Payload.
+    char bytes[SH_MAIL_BYTES];
+} sh_mail;
+
+/// Mails posted to a shard.
+typedef struct {
+    /// The last posted mail. Posters swap themselves in here.
+    sh_mail *head;
+    /// Keeps `head` out of the cache line that the shard writes to.
+    char _padding0[56];
+    /// The next mail to take, or the stub.
+    sh_mail *tail;
+    /// Readable while there are mails that may not have been taken.
+    int efd;
+    /// Struct padding.
+    char _padding1[4];
+    /// Stays in the queue so it's never empty.
+    sh_mail stub;
+} sh_mailbox;
+
+/// @brief Initiates a mailbox. It shouldn't be moved afterwards.
+/// @param mb The mailbox.
+/// @return `0` or `-1` if creating the `eventfd` failed.
+static int sh_mailbox_init(sh_mailbox *mb) {
+    bzero(mb, sizeof(sh_mailbox));
+    mb->head = &mb->stub;
+    mb->tail = &mb->stub;
+    mb->efd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+
+    return mb->efd < 0 ? -1 : 0;
+}
+
+/// @brief Adds a mail to the queue. It should be followed by `sh_mailbox_wake`
+/// sooner or later.
+/// @param mb The mailbox.
+/// @param mail The mail. The shard owns it afterwards.
+static void sh_mailbox_post(sh_mailbox *mb, sh_mail *mail) {
+    sh_mail *prev;
+
+    __atomic_store_n(&mail->next, NULL, __ATOMIC_RELAXED);
+    prev = __atomic_exchange_n(&mb->head, mail, __ATOMIC_ACQ_REL);
+    // Until this store, the mails after `prev` can't be taken.
+    __atomic_store_n(&prev->next, mail, __ATOMIC_RELEASE);
+}
+
+/// @brief Wakes up the shard for the mails posted so far.
+/// @param mb The mailbox.
+static void sh_mailbox_wake(sh_mailbox *mb) {
+    uint64_t one = 1;
+
+    // It only fails if the counter is about to overflow, which also wakes.
+    if (write(mb->efd, &one, sizeof(one)) < 0) return;
+}
+
+/// @brief Resets the wakeup. It's done before taking the mails so a wakeup for
+/// a later mail isn't lost.
+/// @param mb The mailbox.
+static void sh_mailbox_clear(sh_mailbox *mb) {
+    uint64_t count;
+
+    if (read(mb->efd, &count, sizeof(count)) < 0) return;
+}
+
+/// @brief Takes the next mail. Only the shard that owns the mailbox may call
+/// it.
+/// @param mb The mailbox.
+/// @return The mail, which should be freed, or `NULL` if there's none. A mail
+/// that's still being posted is taken after the next wakeup.
+static sh_mail *sh_mailbox_take(sh_mailbox *mb) {
+    sh_mail *tail = mb->tail;
+    sh_mail *next = __atomic_load_n(&tail->next, __ATOMIC_ACQUIRE);
+
+    if (tail == &mb->stub) {
+        if (next == NULL) return NULL;
+        mb->tail = next;
+        tail = next;
+        next = __atomic_load_n(&tail->next, __ATOMIC_ACQUIRE);
+    }
+
+    if (next != NULL) {
+        mb->tail = next;
+        return tail;
+    }
+
+    // The last mail is only taken with the stub behind it.
+    if (tail != __atomic_load_n(&mb->head, __ATOMIC_ACQUIRE)) return NULL;
+    sh_mailbox_post(mb, &mb->stub);
+    if ((next = __atomic_load_n(&tail->next, __ATOMIC_ACQUIRE)) == NULL)
+        return NULL;
+    mb->tail = next;
+
+    return tail;
+}
@@ -7,6 +7,7 @@
 #include <errno.h>
 #include <fcntl.h>
 #include <netinet/in.h>
+#include <netinet/tcp.h>
 #include <poll.h>
 #include <stdbool.h>
 #include <string.h>
@@ -30,6 +31,30 @@ typedef struct pollfd pollfd;
     name = expr;                                                               \
     if (name < 0) return -1
 
+/// The size of the kernel buffers of a socket with the latency profile. Less
+/// waits in them.
+#define ST_LATENCY_BUF_SIZE (32 * 1024)
+/// The size of the kernel buffers of a socket with the throughput profile.
+#define ST_THROUGHPUT_BUF_SIZE (1024 * 1024)
+/// Microseconds that a read of a socket with the latency profile busy-polls the
+/// device for.
+#define ST_BUSY_POLL_US 50
+/// The most file descripters that a single message of a unix socket carries,
+/// which is `SCM_MAX_FD` of the kernel.
+#define ST_MAX_FDS 253
+
+/// Socket options that trade latency and throughput.
+typedef enum {
+    /// Kernel defaults.
+    st_profile_default = 0,
+    /// Small frames go out right away, reads busy-poll and the buffers are
+    /// small.
+    st_profile_latency,
+    /// The buffers are large and small frames are held back until they fill a
+    /// segment or what was sent before them is acknowledged.
+    st_profile_throughput,
+} st_profile;
+
 /// Poll kind.
 typedef enum {
     pk_read,
@@ -109,6 +134,42 @@ static int st_new(bool unix_socket) {
     return fd;
 }
 
+/// @brief Sets the options of a profile. The sockets that a listening socket
+/// accepts inherit them. It should be set before connecting or listening so
+/// the TCP window is scaled to the buffers.
+/// @param fd Socket's file descripter.
+/// @param profile The profile.
+/// @param tcp Whether it's a TCP socket. Unix sockets only get the buffers.
+/// @return `0` or `-1` in case of an error.
+static int st_set_profile(int fd, st_profile profile, bool tcp) {
+    int size = profile == st_profile_latency ? ST_LATENCY_BUF_SIZE
+                                             : ST_THROUGHPUT_BUF_SIZE;
+    int nodelay = profile == st_profile_latency;
+    int res;
+
+    if (profile == st_profile_default) return 0;
+
+    ret_on_err(res,
+               setsockopt(fd, SOL_SOCKET, SO_SNDBUF, &size, sizeof(int)));
+    ret_on_err(res,
+               setsockopt(fd, SOL_SOCKET, SO_RCVBUF, &size, sizeof(int)));
+    if (!tcp) return 0;
+
+    // Nagle's algorithm is what holds back small frames. Corking them as well
+    // would hold the last frame of a burst for up to 200 ms, so the batching
+    // is left to it and to sending all that's queued for a connection at once.
+    ret_on_err(res, setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &nodelay,
+                               sizeof(int)));
+    if (profile != st_profile_latency) return 0;
+
+    // Busy-polling longer than `net.core.busy_read` needs `CAP_NET_ADMIN`, so
+    // it's left out without it.
+    setsockopt(fd, SOL_SOCKET, SO_BUSY_POLL, &(int){ST_BUSY_POLL_US},
+               sizeof(int));
+
+    return 0;
+}
+
 /// @brief Binds and listens on a socket.
 /// @param saddr A pointer to the `sockaddr_in` struct.
 /// @param fd Socket's file descripter
@@ -140,13 +201,18 @@ static int st_connect(int fd, sockaddr *saddr, socklen_t slen) {
 /// @param port TCP port which is ignored if `use_unix` is true.
 /// @param unsock_path Path to the unix socket file which is ignored if
 /// `use_unix` is false.
-/// @param max_conns Maximum connections.
+/// @param conn_queue_cap Connection queue capacity. It's how many connections
+/// wait to be accepted, not how many are served.
 /// @param use_unix Wheter to use unix domain socket instead of tcp.
+/// @param reuse_port Whether other tcp sockets can listen on the same port too,
+/// in which case the kernel spreads the connections between them.
+/// @param profile Options of the accepted sockets.
 /// @return Server's file descripter or `-1` in case of an error.
 static int st_server_setup(in_addr_t addr, in_port_t port,
-                           const char *unsock_path, int max_conns,
-                           bool use_unix) {
-    int fd, serv_res;
+                           const char *unsock_path, int conn_queue_cap,
+                           bool use_unix, bool reuse_port,
+                           st_profile profile) {
+    int fd, serv_res, reuse_res, profile_res;
     sockaddr *serveraddr;
     socklen_t serveraddr_len;
     sockaddr_in tcp_serveraddr;
@@ -158,7 +224,14 @@ static int st_server_setup(in_addr_t addr, in_port_t port,
 
     ret_on_err(fd, st_new(use_unix));
 
-    ret_on_err(serv_res, st_serve(fd, serveraddr, serveraddr_len, max_conns));
+    if (reuse_port && !use_unix) {
+        ret_on_err(reuse_res, setsockopt(fd, SOL_SOCKET, SO_REUSEPORT,
+                                         &(int){1}, sizeof(int)));
+    }
+    ret_on_err(profile_res, st_set_profile(fd, profile, !use_unix));
+
+    ret_on_err(serv_res,
+               st_serve(fd, serveraddr, serveraddr_len, conn_queue_cap));
 
     return fd;
 }
@@ -169,10 +242,12 @@ static int st_server_setup(in_addr_t addr, in_port_t port,
 /// @param unsock_path Path to the unix socket file which is ignored if
 /// `use_unix` is false.
 /// @param use_unix Wheter to use unix domain socket instead of tcp.
+/// @param profile Socket options.
 /// @return Client's file descripter or `-1` in case of an error.
 static int st_client_setup(in_addr_t addr, in_port_t port,
-                           const char *unsock_path, bool use_unix) {
-    int fd, poll_res, socket_error;
+                           const char *unsock_path, bool use_unix,
+                           st_profile profile) {
+    int fd, poll_res, profile_res, socket_error;
     sockaddr *serveraddr;
     socklen_t serveraddr_len;
     sockaddr_in tcp_serveraddr;
@@ -183,6 +258,7 @@ static int st_client_setup(in_addr_t addr, in_port_t port,
     serveraddr_len = use_unix ? sizeof(sockaddr_un) : sizeof(sockaddr_in);
 
     ret_on_err(fd, st_new(use_unix));
+    ret_on_err(profile_res, st_set_profile(fd, profile, !use_unix));
 
     st_connect(fd, serveraddr, serveraddr_len);
 
@@ -198,10 +274,11 @@ static int st_client_setup(in_addr_t addr, in_port_t port,
     return fd;
 }
 
-/// @brief Accepts new connections.
+/// @brief Accepts new connections. Unlike the sockets made by `accept`, they
+/// don't block.
 /// @param fd Socket's file descripter.
 /// @return Client's file descripter.
-static int st_accept(int fd) { return accept(fd, NULL, NULL); }
+static int st_accept(int fd) { return accept4(fd, NULL, NULL, SOCK_NONBLOCK); }
 
 /// @brief Reads from the socket.
 /// @param fd Corresponding file descripter.
@@ -220,3 +297,100 @@ static ssize_t st_read(int fd, void *buf, size_t buflen) {
 static ssize_t st_write(int fd, void *buf, size_t buflen) {
     return write(fd, buf, buflen);
 }
+
+/// @brief Sends to the socket without raising `SIGPIPE` if the peer is gone.
+/// @param fd Corresponding file descripter.
+/// @param buf A buffer.
+/// @param buflen Buffer's length.
+/// @return Send's result.
+static ssize_t st_send(int fd, const void *buf, size_t buflen) {
+    return send(fd, buf, buflen, MSG_NOSIGNAL);
+}
+
+/// @brief Sends file descripters over a blocking unix socket. They're sent in
+/// messages of a byte and `ST_MAX_FDS` descripters at most, so the other end
+/// takes them with `st_recv_fds`.
+/// @param fd Socket's file descripter.
+/// @param fds File descripters. The other end gets its own ones of the same
+/// files.
+/// @param len The number of `fds`.
+/// @return `0` or `-1` in case of an error.
+static int st_send_fds(int fd, const int *fds, size_t len) {
+    union {
+        char bytes[CMSG_SPACE(ST_MAX_FDS * sizeof(int))];
+        struct cmsghdr align;
+    } control;
+    char byte = 0;
+    struct iovec iov = {.iov_base = &byte, .iov_len = 1};
+    struct msghdr msg;
+    struct cmsghdr *cmsg;
+    size_t n;
+
+    for (size_t at = 0; at < len; at += n) {
+        n = len - at < ST_MAX_FDS ? len - at : ST_MAX_FDS;
+        msg = (struct msghdr){
+            .msg_iov = &iov,
+            .msg_iovlen = 1,
+            .msg_control = control.bytes,
+            .msg_controllen = CMSG_SPACE(n * sizeof(int)),
+        };
+        cmsg = CMSG_FIRSTHDR(&msg);
+        cmsg->cmsg_level = SOL_SOCKET;
+        cmsg->cmsg_type = SCM_RIGHTS;
+        cmsg->cmsg_len = CMSG_LEN(n * sizeof(int));
+        memcpy(CMSG_DATA(cmsg), fds + at, n * sizeof(int));
+
+        while (sendmsg(fd, &msg, MSG_NOSIGNAL) < 0) {
+            if (errno != EINTR) return -1;
+        }
+    }
+
+    return 0;
+}
+
+/// @brief Receives the file descripters that `st_send_fds` sent. They're
+/// closed on `exec`.
+/// @param fd Socket's file descripter.
+/// @param fds Where to store them.
+/// @param len The number of `fds` that were sent.
+/// @return `0` or `-1` in case of an error. It's `EPROTO` if they weren't sent
+/// like that.
+static int st_recv_fds(int fd, int *fds, size_t len) {
+    union {
+        char bytes[CMSG_SPACE(ST_MAX_FDS * sizeof(int))];
+        struct cmsghdr align;
+    } control;
+    char byte;
+    struct iovec iov = {.iov_base = &byte, .iov_len = 1};
+    struct msghdr msg;
+    struct cmsghdr *cmsg;
+    ssize_t res;
+    size_t n;
+
+    for (size_t at = 0; at < len; at += n) {
+        msg = (struct msghdr){
+            .msg_iov = &iov,
+            .msg_iovlen = 1,
+            .msg_control = control.bytes,
+            .msg_controllen = sizeof(control.bytes),
+        };
+        while ((res = recvmsg(fd, &msg, MSG_CMSG_CLOEXEC)) < 0) {
+            if (errno != EINTR) return -1;
+        }
+
+        cmsg = CMSG_FIRSTHDR(&msg);
+        if (res == 0 || (msg.msg_flags & MSG_CTRUNC) != 0 || cmsg == NULL ||
+            cmsg->cmsg_level != SOL_SOCKET || cmsg->cmsg_type != SCM_RIGHTS) {
+            errno = EPROTO;
+            return -1;
+        }
+        n = (cmsg->cmsg_len - CMSG_LEN(0)) / sizeof(int);
+        if (n == 0 || n > len - at) {
+            errno = EPROTO;
+            return -1;
+        }
+        memcpy(fds + at, CMSG_DATA(cmsg), n * sizeof(int));
+    }
+
+    return 0;
+}
@@ -0,0 +1,183 @@
+/// This is a table of slots that are reused once they're freed. Each slot has
+/// a generation that changes when it's freed, so a handle that's made of a
+/// slot and its generation can tell that the slot has been reused.
+///
+/// Slots live in chunks that never move, so pointers to them stay valid while
+/// the table grows. Memory follows the most slots that were in use at once.
+
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+
+/// The number of slots in a chunk.
+#define TB_CHUNK 1024
+/// What `tb_alloc` gives if it fails.
+#define TB_NONE SIZE_MAX
+
+/// Bookkeeping of a slot.
+typedef struct {
+    /// It changes whenever the slot is freed.
+    size_t generation;
+    /// The next free slot plus one while the slot is free. Zero means it's the
+    /// last one.
+    size_t next_free;
+    /// Whether the slot is in use.
+    bool live;
+    /// Struct padding.
+    char _padding[7];
+} tb_meta;
+
+/// A table of slots.
+typedef struct {
+    /// Chunks of `TB_CHUNK` slots.
+    char **chunks;
+    /// Bookkeeping of the slots of each chunk.
+    tb_meta **metas;
+    /// The number of chunks.
+    size_t chunks_len;
+    /// Slot size.
+    size_t size;
+    /// The number of slots that have been used so far, free or not.
+    size_t len;
+    /// The number of slots in use.
+    size_t live;
+    /// The first free slot plus one. Zero means none.
+    size_t free;
+} tb_table;
+
+/// @brief Initiates an empty table. Nothing is allocated until a slot is.
+/// @param size Slot size.
+/// @return A `tb_table`.
+static tb_table tb_init(size_t size) {
+    return (tb_table){
+        .chunks = NULL,
+        .metas = NULL,
+        .chunks_len = 0,
+        .size = size,
+        .len = 0,
+        .live = 0,
+        .free = 0,
+    };
+}
+
+/// @brief Gives a slot.
+/// @param t The table.
+/// @param slot A slot less than `len`.
+/// @return A pointer to the slot.
+static void *tb_at(const tb_table *t, size_t slot) {
+    return t->chunks[slot / TB_CHUNK] + (slot % TB_CHUNK) * t->size;
+}
+
+/// @brief Gives the bookkeeping of a slot.
+/// @param t The table.
+/// @param slot A slot less than `len`.
+/// @return A pointer to its `tb_meta`.
+static tb_meta *tb_meta_at(const tb_table *t, size_t slot) {
+    return &t->metas[slot / TB_CHUNK][slot % TB_CHUNK];
+}
+
+/// @brief Checks if a slot is in use.
+/// @param t The table.
+/// @param slot Any slot.
+/// @return `true` if it is.
+static bool tb_live(const tb_table *t, size_t slot) {
+    return slot < t->len && tb_meta_at(t, slot)->live;
+}
+
+/// @brief Gives the generation of a slot.
+/// @param t The table.
+/// @param slot A slot less than `len`.
+/// @return Generation.
+static size_t tb_generation(const tb_table *t, size_t slot) {
+    return tb_meta_at(t, slot)->generation;
+}
+
+/// @brief Adds a chunk of slots.
+/// @param t The table.
+/// @return `0` or `-1` if allocating it failed.
+static int tb_grow(tb_table *t) {
+    size_t n = t->chunks_len + 1;
+    char **chunks = realloc(t->chunks, n * sizeof(char *));
+    tb_meta **metas;
+
+    if (chunks == NULL) return -1;
+    t->chunks = chunks;
+    if ((metas = realloc(t->metas, n * sizeof(tb_meta *))) == NULL) return -1;
+    t->metas = metas;
+
+    if ((t->chunks[t->chunks_len] = malloc(TB_CHUNK * t->size)) == NULL)
+        return -1;
+    if ((t->metas[t->chunks_len] = calloc(TB_CHUNK, sizeof(tb_meta))) ==
+        NULL) {
+        free(t->chunks[t->chunks_len]);
+        return -1;
+    }
+    t->chunks_len = n;
+
+    return 0;
+}
+
+/// @brief Takes a slot. The most recently freed one is reused first, since
+/// it's most likely in the cache.
+/// @param t The table.
+/// @return The slot or `TB_NONE` if allocating a chunk failed.
+static size_t tb_alloc(tb_table *t) {
+    size_t slot;
+
+    if (t->free != 0) {
+        slot = t->free - 1;
+        t->free = tb_meta_at(t, slot)->next_free;
+    } else {
+        if (t->len == t->chunks_len * TB_CHUNK && tb_grow(t) < 0)
+            return TB_NONE;
+        slot = t->len;
+        t->len += 1;
+    }
+
+    tb_meta_at(t, slot)->live = true;
+    t->live += 1;
+
+    return slot;
+}
+
+/// @brief Gives a slot back. Its handles go stale.
+/// @param t The table.
+/// @param slot A slot in use.
+static void tb_free(tb_table *t, size_t slot) {
+    tb_meta *meta = tb_meta_at(t, slot);
+
+    meta->live = false;
+    meta->generation += 1;
+    meta->next_free = t->free;
+    t->free = slot + 1;
+    t->live -= 1;
+}
+
+/// @brief Appends a slot with its generation, e.g. to rebuild a table slot by
+/// slot in another process. The handles of the slots are the same as they were
+/// there.
+/// @param t The table.
+/// @param generation Generation of the slot.
+/// @param live Whether it's in use. It's free otherwise.
+/// @return The slot or `TB_NONE` if allocating a chunk failed.
+static size_t tb_push(tb_table *t, size_t generation, bool live) {
+    size_t slot = t->len;
+    tb_meta *meta;
+
+    if (t->len == t->chunks_len * TB_CHUNK && tb_grow(t) < 0) return TB_NONE;
+    t->len += 1;
+
+    meta = tb_meta_at(t, slot);
+    meta->generation = generation;
+    meta->live = live;
+    if (live) {
+        t->live += 1;
+    } else {
+        meta->next_free = t->free;
+        t->free = slot + 1;
+    }
+
+    return slot;
+}
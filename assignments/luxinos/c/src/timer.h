@@ -0,0 +1,220 @@
+/// This is a hierarchical timer wheel. Timers are embedded in what they're
+/// about, so starting, cancelling and rescheduling one never allocates and
+/// takes constant time.
+///
+/// The first level has a slot for each of the next `TW_SLOTS` ticks and each
+/// slot of a level above spans a whole turn of the level below it. When the
+/// wheel turns to a slot of a level above, its timers move down to where they
+/// belong now, so a timer moves at most `TW_LEVELS` times before it expires.
+/// Stretches of the wheel without timers are skipped at once.
+
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+
+/// Bits of the slot index on each level.
+#define TW_SLOT_BITS 6
+/// The number of slots of each level.
+#define TW_SLOTS (1 << TW_SLOT_BITS)
+/// The slot bits of a tick.
+#define TW_SLOT_MASK (TW_SLOTS - 1)
+/// The number of levels. Timers that are further away than the wheel spans
+/// wait in the top level until they're close enough.
+#define TW_LEVELS 4
+/// What `tw_next` gives if there are no timers.
+#define TW_NEVER -1
+
+/// A timer. It should be zeroed before it's first scheduled.
+typedef struct tw_timer {
+    /// The next timer in its slot.
+    struct tw_timer *next;
+    /// What points to the timer in its slot. `NULL` means it's not scheduled.
+    struct tw_timer **pprev;
+    /// The tick it expires at.
+    long expires;
+    /// The level of its slot.
+    unsigned int level;
+    /// What it's for. The wheel doesn't use it.
+    unsigned int kind;
+} tw_timer;
+
+/// A timer wheel.
+typedef struct {
+    /// Scheduled timers, by level and slot.
+    tw_timer *slots[TW_LEVELS][TW_SLOTS];
+    /// The number of timers on each level.
+    size_t lens[TW_LEVELS];
+    /// The number of timers.
+    size_t len;
+    /// The tick the wheel is at.
+    long now;
+} tw_wheel;
+
+/// @brief Initiates an empty wheel.
+/// @param w The wheel.
+/// @param now The current tick.
+static void tw_init(tw_wheel *w, long now) {
+    *w = (tw_wheel){.now = now};
+}
+
+/// @brief Checks if a timer is scheduled.
+/// @param t The timer.
+/// @return `true` if it is.
+static bool tw_pending(const tw_timer *t) { return t->pprev != NULL; }
+
+/// @brief Gives the number of ticks that a slot of a level spans.
+/// @param level The level.
+/// @return Ticks.
+static long tw_span(unsigned int level) {
+    return 1L << (TW_SLOT_BITS * level);
+}
+
+/// @brief Puts a timer into the slot where it belongs from the wheel's tick.
+/// @param w The wheel.
+/// @param t A timer that isn't in a slot.
+static void tw_link(tw_wheel *w, tw_timer *t) {
+    long delta = t->expires - w->now;
+    // Timers that have expired already go into the slot of the wheel's tick.
+    long at = delta < 0 ? w->now : t->expires;
+    unsigned int level = 0;
+    tw_timer **slot;
+
+    while (level < TW_LEVELS - 1 && delta >= tw_span(level + 1)) level += 1;
+    // The top level goes around once at most.
+    if (delta >= tw_span(TW_LEVELS)) at = w->now + tw_span(TW_LEVELS) - 1;
+
+    slot = &w->slots[level][(at >> (TW_SLOT_BITS * level)) & TW_SLOT_MASK];
+    t->next = *slot;
+    if (t->next != NULL) t->next->pprev = &t->next;
+    t->pprev = slot;
+    *slot = t;
+    t->level = level;
+    w->lens[level] += 1;
+    w->len += 1;
+}
+
+/// @brief Takes a timer out of its slot.
+/// @param w The wheel.
+/// @param t A scheduled timer.
+static void tw_unlink(tw_wheel *w, tw_timer *t) {
+    *t->pprev = t->next;
+    if (t->next != NULL) t->next->pprev = t->pprev;
+    t->next = NULL;
+    t->pprev = NULL;
+    w->lens[t->level] -= 1;
+    w->len -= 1;
+}
+
+/// @brief Schedules a timer. It's rescheduled if it's scheduled already.
+/// @param w The wheel.
+/// @param t The timer.
+/// @param expires The tick it expires at.
+static void tw_schedule(tw_wheel *w, tw_timer *t, long expires) {
+    if (tw_pending(t)) tw_unlink(w, t);
+    t->expires = expires;
+    tw_link(w, t);
+}
+
+/// @brief Schedules a timer some ticks after the wheel's tick.
+/// @param w The wheel.
+/// @param t The timer.
+/// @param ticks Ticks from now.
+static void tw_schedule_in(tw_wheel *w, tw_timer *t, long ticks) {
+    tw_schedule(w, t, w->now + ticks);
+}
+
+/// @brief Cancels a timer. It's fine if it isn't scheduled.
+/// @param w The wheel.
+/// @param t The timer.
+static void tw_cancel(tw_wheel *w, tw_timer *t) {
+    if (tw_pending(t)) tw_unlink(w, t);
+}
+
+/// @brief Gives the lowest level from a level on that has timers.
+/// @param w The wheel.
+/// @param from The first level to look at.
+/// @return The level or `TW_LEVELS` if none of them has timers.
+static unsigned int tw_lowest(const tw_wheel *w, unsigned int from) {
+    unsigned int level = from;
+
+    while (level < TW_LEVELS && w->lens[level] == 0) level += 1;
+
+    return level;
+}
+
+/// @brief Gives the tick that the timers of a level move down at next.
+/// @param w The wheel.
+/// @param level A level above the first one.
+/// @return The tick.
+static long tw_boundary(const tw_wheel *w, unsigned int level) {
+    return (w->now | (tw_span(level) - 1)) + 1;
+}
+
+/// @brief Moves the timers of the slots that the wheel's tick has just turned
+/// to down to where they belong now.
+/// @param w The wheel.
+static void tw_cascade(tw_wheel *w) {
+    for (unsigned int level = 1; level < TW_LEVELS; level++) {
+        long index;
+        tw_timer *t;
+
+        if ((w->now & (tw_span(level) - 1)) != 0) return;
+
+        index = (w->now >> (TW_SLOT_BITS * level)) & TW_SLOT_MASK;
+        while ((t = w->slots[level][index]) != NULL) {
+            tw_unlink(w, t);
+            tw_link(w, t);
+        }
+    }
+}
+
+/// @brief Turns the wheel up to a tick and takes a timer that has expired by
+/// then. It should be called until it gives `NULL`, which leaves the wheel at
+/// `now`. Handling a timer may schedule and cancel others.
+/// @param w The wheel.
+/// @param now The current tick.
+/// @return An expired timer, which isn't scheduled anymore, or `NULL`.
+static tw_timer *tw_expire(tw_wheel *w, long now) {
+    for (;;) {
+        tw_timer *t = w->slots[0][w->now & TW_SLOT_MASK];
+        long next;
+
+        if (t != NULL) {
+            tw_unlink(w, t);
+            return t;
+        }
+        if (w->now >= now) return NULL;
+
+        // Nothing happens before the next slot of the lowest level that has
+        // timers.
+        if (w->len == 0) next = now + 1;
+        else if (w->lens[0] > 0) next = w->now + 1;
+        else next = tw_boundary(w, tw_lowest(w, 1));
+        if (next > now) {
+            w->now = now;
+            return NULL;
+        }
+        w->now = next;
+        tw_cascade(w);
+    }
+}
+
+/// @brief Gives the tick that the wheel should be turned at next. It's when
+/// the first timer expires or when the timers of a level above move down,
+/// whichever is sooner.
+/// @param w The wheel.
+/// @return The tick or `TW_NEVER` if there are no timers.
+static long tw_next(const tw_wheel *w) {
+    unsigned int level = tw_lowest(w, 1);
+    long next = level < TW_LEVELS ? tw_boundary(w, level) : TW_NEVER;
+
+    if (w->len == 0) return TW_NEVER;
+
+    // The timers of the first level expire within a turn of it.
+    for (long tick = w->now; w->lens[0] > 0 && tick != next; tick++) {
+        if (w->slots[0][tick & TW_SLOT_MASK] != NULL) return tick;
+    }
+
+    return next;
+}
@@ -0,0 +1,348 @@
+/// This is a minimal io_uring interface on top of the raw syscalls. Requests
+/// are queued with the `ur_prep_` functions and go to the kernel with the next
+/// `ur_submit_and_wait`, so a whole batch costs a single `io_uring_enter`.
+///
+/// Received bytes land in a provided buffer ring that's registered once. Each
+/// buffer should be given back with `ur_buf_recycle` once its bytes are
+/// consumed.
+
+#pragma once
+
+#include <errno.h>
+#include <linux/io_uring.h>
+#include <linux/time_types.h>
+#include <poll.h>
+#include <stdint.h>
+#include <string.h>
+#include <strings.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+/// A ring and its provided buffers.
+typedef struct {
+    /// The ring's file descripter.
+    int fd;
+    /// Entries of the submission queue.
+    unsigned int sq_entries;
+    /// The kernel's head of the submission queue.
+    unsigned int *sq_head;
+    /// The tail of the submission queue that the kernel sees.
+    unsigned int *sq_tail;
+    /// Indexes of the submitted entries.
+    unsigned int *sq_array;
+    /// Submission queue entries.
+    struct io_uring_sqe *sqes;
+    /// The tail including the entries that aren't submitted yet.
+    unsigned int sq_local_tail;
+    /// Entries of the completion queue.
+    unsigned int cq_entries;
+    /// The head of the completion queue.
+    unsigned int *cq_head;
+    /// The kernel's tail of the completion queue.
+    unsigned int *cq_tail;
+    /// Completion queue entries.
+    struct io_uring_cqe *cqes;
+    /// The provided buffer ring.
+    struct io_uring_buf_ring *br;
+    /// Storage of the provided buffers.
+    char *bufs;
+    /// The number of provided buffers.
+    unsigned int buf_count;
+    /// Size of each provided buffer.
+    unsigned int buf_size;
+    /// The tail of the provided buffer ring that's not published yet.
+    unsigned short br_tail;
+    /// Struct padding.
+    char _padding[6];
+} ur_ring;
+
+/// The provided buffer group of received bytes.
+#define UR_BUF_GROUP 0
+
+/// @brief Gives a pointer at an offset of a mapping.
+/// @param base The mapping.
+/// @param offset Offset in bytes.
+/// @return The pointer.
+static void *ur_offset(void *base, unsigned int offset) {
+    return (char *)base + offset;
+}
+
+/// @brief Sets up a ring with a provided buffer ring. It's meant to be used by
+/// a single thread which lets the kernel defer its work until the next wait.
+/// @param ring The ring.
+/// @param entries Submission queue entries. A power of two.
+/// @param buf_count The number of provided buffers. A power of two.
+/// @param buf_size Size of each provided buffer.
+/// @return `0` or `-1` if it failed.
+static int ur_init(ur_ring *ring, unsigned int entries, unsigned int buf_count,
+                   unsigned int buf_size) {
+    struct io_uring_params p;
+    struct io_uring_buf_reg reg;
+    size_t sq_size, cq_size, br_size;
+    void *sq_ptr, *cq_ptr, *br_ptr;
+
+    bzero(ring, sizeof(ur_ring));
+    bzero(&p, sizeof(p));
+    p.flags = IORING_SETUP_CQSIZE | IORING_SETUP_SINGLE_ISSUER |
+              IORING_SETUP_DEFER_TASKRUN;
+    // Multishot requests complete many times so the completion queue is
+    // bigger.
+    p.cq_entries = entries * 4;
+
+    ring->fd = (int)syscall(SYS_io_uring_setup, entries, &p);
+    if (ring->fd < 0) return -1;
+    if ((p.features & IORING_FEAT_SINGLE_MMAP) == 0 ||
+        (p.features & IORING_FEAT_EXT_ARG) == 0) {
+        errno = ENOSYS;
+        return -1;
+    }
+
+    // Both queues share one mapping.
+    sq_size = p.sq_off.array + p.sq_entries * sizeof(unsigned int);
+    cq_size = p.cq_off.cqes + p.cq_entries * sizeof(struct io_uring_cqe);
+    sq_ptr = mmap(NULL, sq_size > cq_size ? sq_size : cq_size,
+                  PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ring->fd,
+                  IORING_OFF_SQ_RING);
+    if (sq_ptr == MAP_FAILED) return -1;
+    cq_ptr = sq_ptr;
+
+    ring->sqes = mmap(NULL, p.sq_entries * sizeof(struct io_uring_sqe),
+                      PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+                      ring->fd, IORING_OFF_SQES);
+    if (ring->sqes == MAP_FAILED) return -1;
+
+    ring->sq_entries = p.sq_entries;
+    ring->sq_head = ur_offset(sq_ptr, p.sq_off.head);
+    ring->sq_tail = ur_offset(sq_ptr, p.sq_off.tail);
+    ring->sq_array = ur_offset(sq_ptr, p.sq_off.array);
+    ring->sq_local_tail = *ring->sq_tail;
+    ring->cq_entries = p.cq_entries;
+    ring->cq_head = ur_offset(cq_ptr, p.cq_off.head);
+    ring->cq_tail = ur_offset(cq_ptr, p.cq_off.tail);
+    ring->cqes = ur_offset(cq_ptr, p.cq_off.cqes);
+
+    // The buffer ring and the buffers it points to.
+    br_size = buf_count * sizeof(struct io_uring_buf);
+    br_ptr = mmap(NULL, br_size + (size_t)buf_count * buf_size,
+                  PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (br_ptr == MAP_FAILED) return -1;
+    ring->br = br_ptr;
+    ring->bufs = (char *)br_ptr + br_size;
+    ring->buf_count = buf_count;
+    ring->buf_size = buf_size;
+
+    bzero(&reg, sizeof(reg));
+    reg.ring_addr = (uint64_t)(uintptr_t)ring->br;
+    reg.ring_entries = buf_count;
+    reg.bgid = UR_BUF_GROUP;
+    if (syscall(SYS_io_uring_register, ring->fd, IORING_REGISTER_PBUF_RING,
+                &reg, 1) < 0)
+        return -1;
+
+    for (unsigned int i = 0; i < buf_count; i++) {
+        struct io_uring_buf *buf =
+            &ring->br->bufs[ring->br_tail & (buf_count - 1)];
+
+        buf->addr = (uint64_t)(uintptr_t)(ring->bufs + (size_t)i * buf_size);
+        buf->len = buf_size;
+        buf->bid = (unsigned short)i;
+        ring->br_tail += 1;
+    }
+    __atomic_store_n(&ring->br->tail, ring->br_tail, __ATOMIC_RELEASE);
+
+    return 0;
+}
+
+/// @brief Gives the bytes of a provided buffer.
+/// @param ring The ring.
+/// @param bid Buffer id.
+/// @return The buffer.
+static char *ur_buf(const ur_ring *ring, unsigned int bid) {
+    return ring->bufs + (size_t)bid * ring->buf_size;
+}
+
+/// @brief Gives a provided buffer back to the kernel.
+/// @param ring The ring.
+/// @param bid Buffer id.
+static void ur_buf_recycle(ur_ring *ring, unsigned int bid) {
+    struct io_uring_buf *buf =
+        &ring->br->bufs[ring->br_tail & (ring->buf_count - 1)];
+
+    buf->addr = (uint64_t)(uintptr_t)ur_buf(ring, bid);
+    buf->len = ring->buf_size;
+    buf->bid = (unsigned short)bid;
+    ring->br_tail += 1;
+    __atomic_store_n(&ring->br->tail, ring->br_tail, __ATOMIC_RELEASE);
+}
+
+/// @brief Submits the queued requests, waits for at least `wait_nr`
+/// completions and lets the kernel post the completions it deferred.
+/// @param ring The ring.
+/// @param wait_nr The number of completions to wait for.
+/// @param timeout Waiting timeout in milliseconds or `-1` for none.
+/// @return The number of submitted requests or `-1` if it failed. A timeout
+/// isn't a failure.
+static int ur_submit_and_wait(ur_ring *ring, unsigned int wait_nr,
+                              int timeout) {
+    unsigned int to_submit = ring->sq_local_tail - *ring->sq_tail;
+    struct __kernel_timespec ts;
+    struct io_uring_getevents_arg arg;
+    long res;
+
+    __atomic_store_n(ring->sq_tail, ring->sq_local_tail, __ATOMIC_RELEASE);
+
+    bzero(&arg, sizeof(arg));
+    if (timeout >= 0) {
+        ts.tv_sec = timeout / 1000;
+        ts.tv_nsec = (long long)(timeout % 1000) * 1000000;
+        arg.ts = (uint64_t)(uintptr_t)&ts;
+    }
+
+    res = syscall(SYS_io_uring_enter, ring->fd, to_submit, wait_nr,
+                  IORING_ENTER_GETEVENTS | IORING_ENTER_EXT_ARG, &arg,
+                  sizeof(arg));
+    if (res < 0 && (errno == ETIME || errno == EINTR)) return 0;
+
+    return (int)res;
+}
+
+/// @brief Takes an entry of the submission queue. The queue is submitted
+/// first if it's full.
+/// @param ring The ring.
+/// @return A zeroed entry or `NULL` if submitting failed.
+static struct io_uring_sqe *ur_get_sqe(ur_ring *ring) {
+    struct io_uring_sqe *sqe;
+    unsigned int index;
+
+    if (ring->sq_local_tail -
+            __atomic_load_n(ring->sq_head, __ATOMIC_ACQUIRE) ==
+        ring->sq_entries) {
+        if (ur_submit_and_wait(ring, 0, 0) < 0) return NULL;
+    }
+
+    index = ring->sq_local_tail & (ring->sq_entries - 1);
+    sqe = &ring->sqes[index];
+    bzero(sqe, sizeof(struct io_uring_sqe));
+    ring->sq_array[index] = index;
+    ring->sq_local_tail += 1;
+
+    return sqe;
+}
+
+/// @brief Gives the next completion if there's any.
+/// @param ring The ring.
+/// @return A completion or `NULL`. It should be marked as seen with
+/// `ur_cqe_seen`.
+static struct io_uring_cqe *ur_peek_cqe(const ur_ring *ring) {
+    unsigned int head = *ring->cq_head;
+
+    if (head == __atomic_load_n(ring->cq_tail, __ATOMIC_ACQUIRE)) return NULL;
+
+    return &ring->cqes[head & (ring->cq_entries - 1)];
+}
+
+/// @brief Marks the completion that `ur_peek_cqe` gave as seen.
+/// @param ring The ring.
+static void ur_cqe_seen(ur_ring *ring) {
+    __atomic_store_n(ring->cq_head, *ring->cq_head + 1, __ATOMIC_RELEASE);
+}
+
+/// @brief Queues an accept that completes once per new connection.
+/// @param ring The ring.
+/// @param fd Listening socket.
+/// @param user_data What its completions come with.
+/// @return `0` or `-1` if it failed.
+static int ur_prep_multishot_accept(ur_ring *ring, int fd, uint64_t user_data) {
+    struct io_uring_sqe *sqe = ur_get_sqe(ring);
+
+    if (sqe == NULL) return -1;
+    sqe->opcode = IORING_OP_ACCEPT;
+    sqe->fd = fd;
+    sqe->ioprio = IORING_ACCEPT_MULTISHOT;
+    sqe->accept_flags = SOCK_NONBLOCK;
+    sqe->user_data = user_data;
+
+    return 0;
+}
+
+/// @brief Queues a poll that completes every time the file descripter becomes
+/// readable.
+/// @param ring The ring.
+/// @param fd File descripter.
+/// @param user_data What its completions come with.
+/// @return `0` or `-1` if it failed.
+static int ur_prep_multishot_poll(ur_ring *ring, int fd, uint64_t user_data) {
+    struct io_uring_sqe *sqe = ur_get_sqe(ring);
+
+    if (sqe == NULL) return -1;
+    sqe->opcode = IORING_OP_POLL_ADD;
+    sqe->fd = fd;
+    sqe->len = IORING_POLL_ADD_MULTI;
+    sqe->poll32_events = POLLIN;
+    sqe->user_data = user_data;
+
+    return 0;
+}
+
+/// @brief Queues a receive that completes once per chunk of bytes, each in a
+/// provided buffer.
+/// @param ring The ring.
+/// @param fd Socket.
+/// @param user_data What its completions come with.
+/// @return `0` or `-1` if it failed.
+static int ur_prep_multishot_recv(ur_ring *ring, int fd, uint64_t user_data) {
+    struct io_uring_sqe *sqe = ur_get_sqe(ring);
+
+    if (sqe == NULL) return -1;
+    sqe->opcode = IORING_OP_RECV;
+    sqe->fd = fd;
+    sqe->ioprio = IORING_RECV_MULTISHOT;
+    sqe->flags = IOSQE_BUFFER_SELECT;
+    sqe->buf_group = UR_BUF_GROUP;
+    sqe->user_data = user_data;
+
+    return 0;
+}
+
+/// @brief Queues a send that only completes once every byte is sent or it
+/// failed.
+/// @param ring The ring.
+/// @param fd Socket.
+/// @param buf Bytes to send. They should stay valid until it completes.
+/// @param len The number of bytes.
+/// @param user_data What its completion comes with.
+/// @return `0` or `-1` if it failed.
+static int ur_prep_send(ur_ring *ring, int fd, const char *buf, size_t len,
+                        uint64_t user_data) {
+    struct io_uring_sqe *sqe = ur_get_sqe(ring);
+
+    if (sqe == NULL) return -1;
+    sqe->opcode = IORING_OP_SEND;
+    sqe->fd = fd;
+    sqe->addr = (uint64_t)(uintptr_t)buf;
+    sqe->len = (unsigned int)len;
+    sqe->msg_flags = MSG_NOSIGNAL | MSG_WAITALL;
+    sqe->user_data = user_data;
+
+    return 0;
+}
+
+/// @brief Queues the cancellation of every request with the given user data.
+/// @param ring The ring.
+/// @param target User data of the requests.
+/// @param user_data What its completion comes with.
+/// @return `0` or `-1` if it failed.
+static int ur_prep_cancel(ur_ring *ring, uint64_t target, uint64_t user_data) {
+    struct io_uring_sqe *sqe = ur_get_sqe(ring);
+
+    if (sqe == NULL) return -1;
+    sqe->opcode = IORING_OP_ASYNC_CANCEL;
+    sqe->fd = -1;
+    sqe->addr = target;
+    sqe->cancel_flags = IORING_ASYNC_CANCEL_ALL;
+    sqe->user_data = user_data;
+
+    return 0;
+}
@@ -0,0 +1,186 @@
+#define _GNU_SOURCE
+
+#include "../src/codec.h"
+#include "../src/console.h"
+#include "../src/game.h"
+#include "../src/protocol.h"
+#include "../src/socket.h"
+#include <signal.h>
+#include <stdio.h>
+#include <sys/wait.h>
+
+// Checks that a match is called off for both players when one of them quits
+// before it joins. The test starts the server with two shards and a guesser
+// of the second one asks for a match and quits in the same write, so its shard
+// turns the game down after the chooser has been told about it. The chooser
+// has to be told to exit then instead of being left in the game.
+
+/// The password of the server.
+#define PASSWORD "password12345"
+/// The shards of the server. The shard of a user is its id minus one modulo
+/// this.
+#define SHARDS 2
+/// Milliseconds that the test waits for each message.
+#define WAIT_MS 5000
+/// Connections that are opened at most to get a user on the second shard.
+#define MAX_TRIES 16
+
+/// A connection to the server.
+typedef struct {
+    /// Storage of `in`.
+    char in_data[PL_INBUF_SIZE];
+    /// Bytes received from the server.
+    pl_inbuf in;
+    /// Messages waiting to be sent to the server.
+    pl_outbuf out;
+    /// User id.
+    size_t id;
+    /// Socket's file descripter.
+    int fd;
+    /// Wire format negotiated with the server.
+    pl_version version;
+} test_conn;
+
+/// Storage of the output buffers.
+static pl_pool pool = (pl_pool){.free = NULL, .size = PL_MSG_MAX_SIZE};
+
+/// The server's process. Zero means it hasn't been started.
+static pid_t server = 0;
+
+/// Path to the server's unix socket file.
+static char path[64];
+
+/// @brief Stops the server, also when the test fails.
+static void stop_server(void) {
+    int status;
+
+    if (server <= 0) return;
+    kill(server, SIGINT);
+    waitpid(server, &status, 0);
+    unlink(path);
+}
+
+/// @brief Connects to the server and authenticates.
+/// @param c The connection.
+static void test_connect(test_conn *c) {
+    char payload[PL_RAW_BYTES_SIZE];
+    size_t pass_len = strlen(PASSWORD);
+    pl_frame frame;
+    pl_frame *m;
+
+    c->in = pl_inbuf_init(c->in_data, PL_INBUF_SIZE);
+    c->out = pl_outbuf_init(NULL, 0);
+    c->version = pl_version_legacy;
+    c->fd = success_or_die(
+        st_client_setup(0, 0, path, true, st_profile_default),
+        "Failed to connect to the server");
+
+    m = pl_poll_msg_read(c->fd, &c->in, &c->version, &frame, WAIT_MS);
+    if (m == NULL || m->kind != mk_enter_passwd)
+        die("The server didn't ask for the password.\n");
+
+    payload[0] = (char)pl_version_compact;
+    memcpy(payload + 1, PASSWORD, pass_len);
+    c->version = pl_version_compact;
+    success_or_die(pl_poll_msg_write(c->fd, &c->out, &pool, c->version, payload,
+                                     (pl_message){
+                                         .id = 0,
+                                         .kind = mk_enter_passwd,
+                                         .raw_bytes_len = pass_len + 1,
+                                     },
+                                     WAIT_MS),
+                   "Failed to send the password");
+
+    m = pl_poll_msg_read(c->fd, &c->in, &c->version, &frame, WAIT_MS);
+    if (m == NULL || m->kind != mk_assign_uid) die("Unauthorized!\n");
+    c->id = m->id;
+}
+
+/// @brief Queues a request for a match.
+/// @param c The connection.
+static void test_queue_match(test_conn *c) {
+    ge_game request = {.id = 0, .chooser = c->id, .guesser = 0};
+
+    bzero(request.word, sizeof(request.word));
+    strcpy(request.word, "word");
+    if (pl_msg_queue(&c->out, &pool, c->version, (const char *)&request,
+                     (pl_message){
+                         .id = c->id,
+                         .kind = mk_find_match,
+                         .raw_bytes_len = sizeof(ge_game),
+                     }) < 0)
+        die("Failed to queue a request for a match.\n");
+}
+
+/// @brief Sends what's queued with a single write.
+/// @param c The connection.
+static void test_flush(test_conn *c) {
+    if (pl_outbuf_flush(&c->out, &pool, c->fd) != 0)
+        die("Failed to send in a single write.\n");
+}
+
+/// @brief Waits for a message other than an announcement of the lobby.
+/// @param c The connection.
+/// @return Its kind.
+static pl_message_kind test_expect(test_conn *c) {
+    pl_frame frame;
+    pl_frame *m;
+
+    do {
+        m = pl_poll_msg_read(c->fd, &c->in, &c->version, &frame, WAIT_MS);
+        if (m == NULL) die("The server didn't answer in time.\n");
+    } while (m->kind == mk_show_opponents || m->kind == mk_opponents_joined ||
+             m->kind == mk_opponents_left);
+
+    return m->kind;
+}
+
+int main(int argc, char *argv[]) {
+    test_conn chooser, guesser;
+    int tries = 0;
+
+    if (argc != 2) die("Pass the path of the server.\n");
+    snprintf(path, sizeof(path), "/tmp/guessing-game-test-%d", getpid());
+
+    if ((server = fork()) == 0) {
+        execl(argv[1], argv[1], PASSWORD, "unix", path, "--shards=2", NULL);
+        die("Failed to start the server.\n");
+    }
+    success_or_die(server, "Failed to start the server");
+    atexit(stop_server);
+
+    // The socket file shows up once the server listens.
+    while (access(path, F_OK) != 0) {
+        if (++tries > WAIT_MS / 10) die("The server didn't start in time.\n");
+        usleep(10000);
+    }
+
+    test_connect(&chooser);
+    test_queue_match(&chooser);
+    test_flush(&chooser);
+    // Lets the chooser's request reach the first shard, which matches, first.
+    usleep(100000);
+
+    // The guesser's request and its quit are mailed to the first shard in
+    // order, so it's matched and quits before its own shard puts it in the
+    // game. The ones that land on the first shard stay in the lobby.
+    for (tries = 0; tries < MAX_TRIES; tries++) {
+        test_connect(&guesser);
+        if ((guesser.id - 1) % SHARDS == 1) break;
+    }
+    if (tries == MAX_TRIES) die("No user landed on the second shard.\n");
+    test_queue_match(&guesser);
+    if (pl_msg_queue(&guesser.out, &pool, guesser.version, "",
+                     (pl_message){.id = guesser.id, .kind = mk_exit}) < 0)
+        die("Failed to queue the quit.\n");
+    test_flush(&guesser);
+
+    if (test_expect(&chooser) != mk_select_opponent)
+        die("The chooser wasn't put into the game.\n");
+    if (test_expect(&chooser) != mk_exit)
+        die("The chooser wasn't told that the game was called off.\n");
+
+    printf("The match was called off.\n");
+
+    return EXIT_SUCCESS;
+}
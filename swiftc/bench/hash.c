@@ -0,0 +1,84 @@
+// Measures the hashes in GB/s across input sizes.
+#define _POSIX_C_SOURCE 199309L
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+#include "swiftc/swiftc.h"
+
+/// Bytes hashed per measurement.
+#define TOTAL (256 * 1024 * 1024)
+#define MAX   (1024 * 1024)
+
+static const usize sizes[] = {8, 16, 32, 64, 128, 256, 1024, 4096, 65536, MAX};
+
+static double now_s(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (double)ts.tv_sec + (double)ts.tv_nsec / 1e9;
+}
+
+/// Only the scalar accumulators, to show what the vectorized ones buy.
+static u64 hash64_nosimd(Slice data, u64 seed) {
+    u64 acc[8], a, b;
+    u32 stripe = 0;
+
+    if (data.len <= HASH_BULK_MIN) {
+        hash_short(data.ptr, data.len, seed, &a, &b);
+        return hash_short_final64(a, b, data.len);
+    }
+
+    hash_bulk_init(acc, seed);
+    hash_stripes_nosimd(acc, data.ptr, (data.len - 1) / HASH_STRIPE, &stripe);
+    hash_accumulate_nosimd(acc, (u8 *)data.ptr + data.len - HASH_STRIPE,
+                           hash_secret + HASH_LAST_KEY);
+    return hash_bulk_final64(acc, data.len, seed);
+}
+
+static u64 hash128_lo(Slice data, u64 seed) {
+    Hash128 hash = hash128(data, seed);
+    return hash.lo ^ hash.hi;
+}
+
+/// Feeds the input in 4 chunks.
+static u64 hash_stream(Slice data, u64 seed) {
+    HashStream stream = hash_stream_init(seed);
+    usize chunk       = data.len / 4;
+
+    for (usize pos = 0; pos < data.len; pos += chunk) {
+        hash_stream_update(&stream, (Slice){.ptr = (u8 *)data.ptr + pos, .len = chunk});
+    }
+    return hash_stream_digest64(&stream);
+}
+
+/// Hashes `TOTAL` bytes in `len`-byte inputs. The seed depends on the last
+/// hash so the calls can't overlap, which is the latency a hash map sees.
+static double gbps(u64 (*hash)(Slice, u64), u8 *bytes, usize len) {
+    usize rounds = TOTAL / len;
+    u64 seed     = 0;
+    double start = now_s();
+
+    for (usize i = 0; i < rounds; i++) seed = hash((Slice){.ptr = bytes, .len = len}, seed);
+
+    if (seed == 42) printf("Unlucky!\n");
+    return (double)(rounds * len) / (now_s() - start) / 1e9;
+}
+
+int main(void) {
+    u8 *bytes = malloc(MAX);
+
+    if (bytes == NULL) return EXIT_FAILURE;
+    for (usize i = 0; i < MAX; i++) bytes[i] = (u8)(i * 131);
+
+    printf("| %-7s | %8s | %8s | %8s | %8s |\n", "bytes", "hash64", "nosimd", "hash128",
+           "stream");
+    printf("|---------|----------|----------|----------|----------|\n");
+    for (usize s = 0; s < sizeof(sizes) / sizeof(sizes[0]); s++) {
+        printf("| %7zu | %8.2f | %8.2f | %8.2f | %8.2f |\n", sizes[s], gbps(hash64, bytes, sizes[s]),
+               gbps(hash64_nosimd, bytes, sizes[s]), gbps(hash128_lo, bytes, sizes[s]),
+               gbps(hash_stream, bytes, sizes[s]));
+    }
+
+    free(bytes);
+    return EXIT_SUCCESS;
+}
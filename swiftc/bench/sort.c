@@ -0,0 +1,169 @@
+// Compares qsort against pdqsort and radix sort on 10M elements.
+#define _POSIX_C_SOURCE 200809L
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "swiftc/swiftc.h"
+
+#define SORT_NAME       sort_u64_typed
+#define SORT_TYPE       u64
+#define SORT_LESS(a, b) ((a) < (b))
+#include "swiftc/sort/pdqsort_typed.h"
+
+#define COUNT      (10 * 1000 * 1000)
+#define MAX_THREADS 64
+
+typedef enum
+{
+    pattern_random,
+    pattern_sorted,
+    pattern_sawtooth,
+    pattern_count,
+} pattern;
+
+static const char *pattern_names[pattern_count] = {"random", "sorted", "sawtooth"};
+
+typedef struct {
+    RadixParallel *sort;
+    u32 worker;
+    u32 _padding;
+} worker_args;
+
+static double now_ms(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (double)ts.tv_sec * 1e3 + (double)ts.tv_nsec / 1e6;
+}
+
+static void fill(u64 *items, usize count, pattern p) {
+    u64 state = 0x9e3779b97f4a7c15;
+
+    for (usize i = 0; i < count; i++) {
+        switch (p) {
+        case pattern_random:
+            state ^= state << 13;
+            state ^= state >> 7;
+            state ^= state << 17;
+            items[i] = state;
+            break;
+        case pattern_sorted:
+            items[i] = i;
+            break;
+        case pattern_sawtooth:
+        case pattern_count:
+            items[i] = i % (count / 64);
+            break;
+        }
+    }
+}
+
+static void check(const u64 *items, usize count, const char *name) {
+    for (usize i = 1; i < count; i++) {
+        if (items[i - 1] > items[i]) {
+            fprintf(stderr, "%s didn't sort the items!\n", name);
+            exit(EXIT_FAILURE);
+        }
+    }
+}
+
+static int cmp_u64(const void *a, const void *b) {
+    u64 x = *(const u64 *)a;
+    u64 y = *(const u64 *)b;
+    return (x > y) - (x < y);
+}
+
+static u8 less_u64(const void *a, const void *b, void *ctx) {
+    (void)ctx;
+    return *(const u64 *)a < *(const u64 *)b;
+}
+
+static void *radix_worker(void *arg) {
+    worker_args *args = arg;
+    radix_parallel_run(args->sort, args->worker);
+    return NULL;
+}
+
+/// Sorts with `threads` workers where the calling thread is the last one.
+static void radix_parallel(Slice items, u32 threads, ArenaAllocator *arena) {
+    pthread_t handles[MAX_THREADS];
+    worker_args args[MAX_THREADS];
+    RadixParallel sort;
+    usize mark = arena->pos;
+
+    if (radix_parallel_init(&sort, items, sizeof(u64), threads, arena) != 0) {
+        fprintf(stderr, "The arena is too small!\n");
+        exit(EXIT_FAILURE);
+    }
+
+    for (u32 i = 0; i < threads; i++) args[i] = (worker_args){.sort = &sort, .worker = i};
+    for (u32 i = 0; i + 1 < threads; i++) {
+        pthread_create(&handles[i], NULL, radix_worker, &args[i]);
+    }
+    radix_worker(&args[threads - 1]);
+    for (u32 i = 0; i + 1 < threads; i++) pthread_join(handles[i], NULL);
+
+    arena->pos = mark;
+}
+
+int main(void) {
+    long cpus          = sysconf(_SC_NPROCESSORS_ONLN);
+    u32 threads        = cpus < 1 ? 1 : cpus > MAX_THREADS ? MAX_THREADS : (u32)cpus;
+    usize scratch_len  = COUNT * sizeof(u64) + MAX_THREADS * RADIX_BUCKETS * sizeof(usize) + 64;
+    u64 *items         = malloc(COUNT * sizeof(u64));
+    void *scratch      = malloc(scratch_len);
+    ArenaAllocator arena = arena_init(scratch, scratch_len);
+    Slice slice        = {.ptr = items, .len = COUNT * sizeof(u64)};
+    double start;
+
+    if (items == NULL || scratch == NULL) return EXIT_FAILURE;
+
+    printf("Sorting %d u64 items (ms, %u threads for the parallel radix sort):\n", COUNT,
+           threads);
+    printf("| %-8s | %8s | %8s | %8s | %8s | %8s |\n", "input", "qsort", "pdq", "pdq typed",
+           "radix", "radix mt");
+    printf("|----------|----------|----------|-----------|----------|----------|\n");
+
+    for (pattern p = 0; p < pattern_count; p++) {
+        double qsort_ms, pdq_ms, typed_ms, radix_ms, parallel_ms;
+
+        fill(items, COUNT, p);
+        start = now_ms();
+        qsort(items, COUNT, sizeof(u64), cmp_u64);
+        qsort_ms = now_ms() - start;
+        check(items, COUNT, "qsort");
+
+        fill(items, COUNT, p);
+        start = now_ms();
+        sort_pdq(slice, sizeof(u64), less_u64, NULL);
+        pdq_ms = now_ms() - start;
+        check(items, COUNT, "sort_pdq");
+
+        fill(items, COUNT, p);
+        start = now_ms();
+        sort_u64_typed(items, COUNT);
+        typed_ms = now_ms() - start;
+        check(items, COUNT, "pdqsort_typed");
+
+        fill(items, COUNT, p);
+        start = now_ms();
+        radix_sort_u64(slice, &arena);
+        radix_ms = now_ms() - start;
+        check(items, COUNT, "radix_sort_u64");
+
+        fill(items, COUNT, p);
+        start = now_ms();
+        radix_parallel(slice, threads, &arena);
+        parallel_ms = now_ms() - start;
+        check(items, COUNT, "radix_parallel_run");
+
+        printf("| %-8s | %8.1f | %8.1f | %9.1f | %8.1f | %8.1f |\n", pattern_names[p], qsort_ms,
+               pdq_ms, typed_ms, radix_ms, parallel_ms);
+    }
+
+    free(scratch);
+    free(items);
+    return EXIT_SUCCESS;
+}
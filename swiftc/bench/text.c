@@ -0,0 +1,102 @@
+// Measures the UTF-8 validators and the ASCII case folding in GB/s.
+#define _POSIX_C_SOURCE 199309L
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+#include "swiftc/swiftc.h"
+
+#define LEN    (64 * 1024 * 1024)
+#define ROUNDS 10
+
+typedef u8 (*validate_fn)(Slice);
+typedef void (*fold_fn)(Slice);
+
+static double now_s(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (double)ts.tv_sec + (double)ts.tv_nsec / 1e9;
+}
+
+/// Fills `text` with ASCII and, when `multibyte` is set, mostly 2 to 4-byte
+/// sequences.
+static void fill(u8 *text, usize len, u8 multibyte) {
+    static const char *const glyphs[] = {"a", "\xC3\xA9", "\xE2\x82\xAC", "\xF0\x9F\x98\x80"};
+    u64 state = 0x9e3779b97f4a7c15;
+    usize i   = 0;
+
+    while (i + 4 <= len) {
+        state ^= state << 13;
+        state ^= state >> 7;
+        state ^= state << 17;
+
+        const char *glyph = multibyte ? glyphs[state % 4] : "Q";
+        for (const char *c = glyph; *c != '\0'; c++) text[i++] = (u8)*c;
+    }
+    while (i < len) text[i++] = 'x';
+}
+
+static double validate_gbps(validate_fn fn, Slice text) {
+    double start = now_s();
+    for (u32 i = 0; i < ROUNDS; i++) {
+        if (fn(text) != 1) {
+            fprintf(stderr, "The text is valid!\n");
+            exit(EXIT_FAILURE);
+        }
+    }
+    return (double)text.len * ROUNDS / (now_s() - start) / 1e9;
+}
+
+static double fold_gbps(fold_fn fn, Slice text) {
+    double start = now_s();
+    for (u32 i = 0; i < ROUNDS; i++) fn(text);
+    return (double)text.len * ROUNDS / (now_s() - start) / 1e9;
+}
+
+int main(void) {
+    u8 *bytes  = malloc(LEN);
+    Slice text = {.ptr = bytes, .len = LEN};
+
+    if (bytes == NULL) return EXIT_FAILURE;
+
+    printf("| %-18s | %8s | %8s |\n", "GB/s", "ascii", "utf-8");
+    printf("|--------------------|----------|----------|\n");
+
+    fill(bytes, LEN, 0);
+    double ascii_nosimd = validate_gbps(utf8_validate_nosimd, text);
+#if defined(__x86_64__)
+    double ascii_sse42 = validate_gbps(utf8_validate_sse42, text);
+    double ascii_avx2  = (cpu_features() & CPU_AVX2) ? validate_gbps(utf8_validate_avx2, text) : 0;
+#elif defined(__aarch64__)
+    double ascii_neon = validate_gbps(utf8_validate_neon, text);
+#endif
+
+    fill(bytes, LEN, 1);
+    printf("| %-18s | %8.2f | %8.2f |\n", "utf8 nosimd", ascii_nosimd,
+           validate_gbps(utf8_validate_nosimd, text));
+#if defined(__x86_64__)
+    printf("| %-18s | %8.2f | %8.2f |\n", "utf8 sse4.2", ascii_sse42,
+           validate_gbps(utf8_validate_sse42, text));
+    if (cpu_features() & CPU_AVX2) {
+        printf("| %-18s | %8.2f | %8.2f |\n", "utf8 avx2", ascii_avx2,
+               validate_gbps(utf8_validate_avx2, text));
+    }
+#elif defined(__aarch64__)
+    printf("| %-18s | %8.2f | %8.2f |\n", "utf8 neon", ascii_neon,
+           validate_gbps(utf8_validate_neon, text));
+#endif
+
+    fill(bytes, LEN, 0);
+    printf("| %-18s | %8.2f | %8s |\n", "to_lower nosimd", fold_gbps(ascii_lower_nosimd, text), "-");
+#if defined(__x86_64__)
+    printf("| %-18s | %8.2f | %8s |\n", "to_lower sse2", fold_gbps(ascii_lower_sse2, text), "-");
+    if (cpu_features() & CPU_AVX2) {
+        printf("| %-18s | %8.2f | %8s |\n", "to_lower avx2", fold_gbps(ascii_lower_avx2, text), "-");
+    }
+#elif defined(__aarch64__)
+    printf("| %-18s | %8.2f | %8s |\n", "to_lower neon", fold_gbps(ascii_lower_neon, text), "-");
+#endif
+
+    free(bytes);
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,61 @@
+#pragma once
+
+#include "branching.h"
+#include "numbers.h"
+
+#if defined(__x86_64__)
+    #include <cpuid.h>
+    #include <immintrin.h>
+
+    /// Compiles a function for SSE4.2 regardless of the global target.
+    #define CPU_TARGET_SSE42 __attribute__((target("sse4.2")))
+    /// Compiles a function for AVX2 regardless of the global target.
+    #define CPU_TARGET_AVX2  __attribute__((target("avx2")))
+#elif defined(__aarch64__)
+    #include <arm_neon.h>
+#endif
+
+typedef enum CpuFeature
+{
+    /// Set once the features have been detected.
+    CPU_DETECTED = 1 << 0,
+    CPU_SSE42    = 1 << 1,
+    CPU_AVX2     = 1 << 2,
+    CPU_NEON     = 1 << 3,
+} CpuFeature;
+
+/// Returns the `CpuFeature` flags of the running CPU. The detection is done
+/// once and cached.
+FNDECL_PREFIX u32 cpu_features(void) {
+    static u32 cached = 0;
+    u32 features      = __atomic_load_n(&cached, __ATOMIC_RELAXED);
+
+    if (likely(features != 0)) return features;
+    features = CPU_DETECTED;
+
+#if defined(__x86_64__)
+    {
+        u32 eax, ebx, ecx, edx, xcr0_lo, xcr0_hi;
+
+        if (__get_cpuid(1, &eax, &ebx, &ecx, &edx)) {
+            if (ecx & bit_SSE4_2) features |= CPU_SSE42;
+
+            // AVX registers are only usable if the OS saves them (OSXSAVE and
+            // the XMM and YMM bits of XCR0).
+            if ((ecx & bit_OSXSAVE) && (ecx & bit_AVX)) {
+                __asm__("xgetbv" : "=a"(xcr0_lo), "=d"(xcr0_hi) : "c"(0));
+                if ((xcr0_lo & 0x6) == 0x6 && __get_cpuid_count(7, 0, &eax, &ebx, &ecx, &edx) &&
+                    (ebx & bit_AVX2)) {
+                    features |= CPU_AVX2;
+                }
+            }
+        }
+    }
+#elif defined(__aarch64__)
+    // NEON is mandatory on aarch64.
+    features |= CPU_NEON;
+#endif
+
+    __atomic_store_n(&cached, features, __ATOMIC_RELAXED);
+    return features;
+}
@@ -0,0 +1,263 @@
+#pragma once
+
+#include "../cpu.h"
+#include "../numbers.h"
+#include "mix.h"
+
+// Every stripe adds each of its 8 words to the neighbouring accumulator and the
+// product of the two halves of the word XOR its key to its own accumulator.
+// Every `HASH_BLOCK_STRIPES` stripes the accumulators are scrambled so the
+// 32-bit products can't cancel each other out. The variants produce identical
+// results.
+
+#pragma clang diagnostic push
+#pragma clang diagnostic ignored "-Wunsafe-buffer-usage"
+
+/// Feeds a single stripe keyed with the 8 words at `key`.
+FNDECL_PREFIX void hash_accumulate_nosimd(u64 *acc, const u8 *stripe, const u64 *key) {
+    u64 data, keyed;
+
+    for (u32 i = 0; i < 8; i++) {
+        data  = hash_read64(stripe + i * 8);
+        keyed = data ^ key[i];
+        acc[i ^ 1] += data;
+        acc[i] += (keyed & 0xFFFFFFFF) * (keyed >> 32);
+    }
+}
+
+/// Feeds `count` stripes and scrambles at the end of every block. `stripe` is
+/// the position within the current block.
+FNDECL_PREFIX void hash_stripes_nosimd(u64 *acc, const u8 *ptr, usize count, u32 *stripe) {
+    for (usize n = 0; n < count; n++, ptr += HASH_STRIPE) {
+        hash_accumulate_nosimd(acc, ptr, hash_secret + *stripe);
+        if (++*stripe == HASH_BLOCK_STRIPES) {
+            for (u32 i = 0; i < 8; i++) {
+                acc[i] ^= acc[i] >> 47;
+                acc[i] ^= hash_secret[HASH_SCRAMBLE_KEY + i];
+                acc[i] *= HASH_SCRAMBLE_MUL;
+            }
+            *stripe = 0;
+        }
+    }
+}
+
+#if defined(__x86_64__)
+
+/// Feeds 16 bytes of a stripe to two accumulators.
+FNDECL_PREFIX __m128i hash_lane_sse2(__m128i acc, const u8 *data, const u64 *key) {
+    __m128i value = _mm_loadu_si128((const __m128i *)(const void *)data);
+    __m128i keyed = _mm_xor_si128(value, _mm_loadu_si128((const __m128i *)(const void *)key));
+    __m128i product = _mm_mul_epu32(keyed, _mm_srli_epi64(keyed, 32));
+    __m128i swapped = _mm_shuffle_epi32(value, _MM_SHUFFLE(1, 0, 3, 2));
+    return _mm_add_epi64(acc, _mm_add_epi64(product, swapped));
+}
+
+/// Scrambles two accumulators.
+FNDECL_PREFIX __m128i hash_scramble_sse2(__m128i acc, const u64 *key) {
+    __m128i mul = _mm_set1_epi32((i32)HASH_SCRAMBLE_MUL);
+    __m128i lo, hi;
+
+    acc = _mm_xor_si128(acc, _mm_srli_epi64(acc, 47));
+    acc = _mm_xor_si128(acc, _mm_loadu_si128((const __m128i *)(const void *)key));
+    lo  = _mm_mul_epu32(acc, mul);
+    hi  = _mm_mul_epu32(_mm_srli_epi64(acc, 32), mul);
+    return _mm_add_epi64(lo, _mm_slli_epi64(hi, 32));
+}
+
+/// Feeds a single stripe keyed with the 8 words at `key` with SSE2
+/// instructions.
+FNDECL_PREFIX void hash_accumulate_sse2(u64 *acc, const u8 *stripe, const u64 *key) {
+    __m128i *lanes = (__m128i *)(void *)acc;
+
+    for (u32 i = 0; i < 4; i++) {
+        _mm_storeu_si128(lanes + i, hash_lane_sse2(_mm_loadu_si128(lanes + i), stripe + i * 16,
+                                                   key + i * 2));
+    }
+}
+
+/// Feeds `count` stripes 16 bytes at a time with SSE2 instructions.
+FNDECL_PREFIX void hash_stripes_sse2(u64 *acc, const u8 *ptr, usize count, u32 *stripe) {
+    __m128i *lanes = (__m128i *)(void *)acc;
+    __m128i a0     = _mm_loadu_si128(lanes);
+    __m128i a1     = _mm_loadu_si128(lanes + 1);
+    __m128i a2     = _mm_loadu_si128(lanes + 2);
+    __m128i a3     = _mm_loadu_si128(lanes + 3);
+    const u64 *key;
+
+    for (usize n = 0; n < count; n++, ptr += HASH_STRIPE) {
+        key = hash_secret + *stripe;
+        a0  = hash_lane_sse2(a0, ptr, key);
+        a1  = hash_lane_sse2(a1, ptr + 16, key + 2);
+        a2  = hash_lane_sse2(a2, ptr + 32, key + 4);
+        a3  = hash_lane_sse2(a3, ptr + 48, key + 6);
+        if (++*stripe == HASH_BLOCK_STRIPES) {
+            key     = hash_secret + HASH_SCRAMBLE_KEY;
+            a0      = hash_scramble_sse2(a0, key);
+            a1      = hash_scramble_sse2(a1, key + 2);
+            a2      = hash_scramble_sse2(a2, key + 4);
+            a3      = hash_scramble_sse2(a3, key + 6);
+            *stripe = 0;
+        }
+    }
+
+    _mm_storeu_si128(lanes, a0);
+    _mm_storeu_si128(lanes + 1, a1);
+    _mm_storeu_si128(lanes + 2, a2);
+    _mm_storeu_si128(lanes + 3, a3);
+}
+
+/// Feeds 32 bytes of a stripe to four accumulators.
+FNDECL_PREFIX CPU_TARGET_AVX2 __m256i hash_lane_avx2(__m256i acc, const u8 *data,
+                                                     const u64 *key) {
+    __m256i value = _mm256_loadu_si256((const __m256i *)(const void *)data);
+    __m256i keyed =
+        _mm256_xor_si256(value, _mm256_loadu_si256((const __m256i *)(const void *)key));
+    __m256i product = _mm256_mul_epu32(keyed, _mm256_srli_epi64(keyed, 32));
+    __m256i swapped = _mm256_shuffle_epi32(value, _MM_SHUFFLE(1, 0, 3, 2));
+    return _mm256_add_epi64(acc, _mm256_add_epi64(product, swapped));
+}
+
+/// Scrambles four accumulators.
+FNDECL_PREFIX CPU_TARGET_AVX2 __m256i hash_scramble_avx2(__m256i acc, const u64 *key) {
+    __m256i mul = _mm256_set1_epi32((i32)HASH_SCRAMBLE_MUL);
+    __m256i lo, hi;
+
+    acc = _mm256_xor_si256(acc, _mm256_srli_epi64(acc, 47));
+    acc = _mm256_xor_si256(acc, _mm256_loadu_si256((const __m256i *)(const void *)key));
+    lo  = _mm256_mul_epu32(acc, mul);
+    hi  = _mm256_mul_epu32(_mm256_srli_epi64(acc, 32), mul);
+    return _mm256_add_epi64(lo, _mm256_slli_epi64(hi, 32));
+}
+
+/// Feeds a single stripe keyed with the 8 words at `key` with AVX2
+/// instructions.
+FNDECL_PREFIX CPU_TARGET_AVX2 void hash_accumulate_avx2(u64 *acc, const u8 *stripe,
+                                                        const u64 *key) {
+    __m256i *lanes = (__m256i *)(void *)acc;
+
+    _mm256_storeu_si256(lanes, hash_lane_avx2(_mm256_loadu_si256(lanes), stripe, key));
+    _mm256_storeu_si256(lanes + 1,
+                        hash_lane_avx2(_mm256_loadu_si256(lanes + 1), stripe + 32, key + 4));
+}
+
+/// Feeds `count` stripes 32 bytes at a time with AVX2 instructions.
+FNDECL_PREFIX CPU_TARGET_AVX2 void hash_stripes_avx2(u64 *acc, const u8 *ptr, usize count,
+                                                     u32 *stripe) {
+    __m256i *lanes = (__m256i *)(void *)acc;
+    __m256i a0     = _mm256_loadu_si256(lanes);
+    __m256i a1     = _mm256_loadu_si256(lanes + 1);
+    const u64 *key;
+
+    for (usize n = 0; n < count; n++, ptr += HASH_STRIPE) {
+        key = hash_secret + *stripe;
+        a0  = hash_lane_avx2(a0, ptr, key);
+        a1  = hash_lane_avx2(a1, ptr + 32, key + 4);
+        if (++*stripe == HASH_BLOCK_STRIPES) {
+            key     = hash_secret + HASH_SCRAMBLE_KEY;
+            a0      = hash_scramble_avx2(a0, key);
+            a1      = hash_scramble_avx2(a1, key + 4);
+            *stripe = 0;
+        }
+    }
+
+    _mm256_storeu_si256(lanes, a0);
+    _mm256_storeu_si256(lanes + 1, a1);
+}
+
+#elif defined(__aarch64__)
+
+/// Feeds 16 bytes of a stripe to two accumulators.
+FNDECL_PREFIX uint64x2_t hash_lane_neon(uint64x2_t acc, const u8 *data, const u64 *key) {
+    uint64x2_t value   = vreinterpretq_u64_u8(vld1q_u8(data));
+    uint64x2_t keyed   = veorq_u64(value, vld1q_u64(key));
+    uint64x2_t product = vmull_u32(vmovn_u64(keyed), vshrn_n_u64(keyed, 32));
+    return vaddq_u64(acc, vaddq_u64(product, vextq_u64(value, value, 1)));
+}
+
+/// Scrambles two accumulators.
+FNDECL_PREFIX uint64x2_t hash_scramble_neon(uint64x2_t acc, const u64 *key) {
+    uint64x2_t lo, hi;
+
+    acc = veorq_u64(acc, vshrq_n_u64(acc, 47));
+    acc = veorq_u64(acc, vld1q_u64(key));
+    lo  = vmull_n_u32(vmovn_u64(acc), HASH_SCRAMBLE_MUL);
+    hi  = vmull_n_u32(vshrn_n_u64(acc, 32), HASH_SCRAMBLE_MUL);
+    return vaddq_u64(lo, vshlq_n_u64(hi, 32));
+}
+
+/// Feeds a single stripe keyed with the 8 words at `key` with NEON
+/// instructions.
+FNDECL_PREFIX void hash_accumulate_neon(u64 *acc, const u8 *stripe, const u64 *key) {
+    for (u32 i = 0; i < 8; i += 2) {
+        vst1q_u64(acc + i, hash_lane_neon(vld1q_u64(acc + i), stripe + i * 8, key + i));
+    }
+}
+
+/// Feeds `count` stripes 16 bytes at a time with NEON instructions.
+FNDECL_PREFIX void hash_stripes_neon(u64 *acc, const u8 *ptr, usize count, u32 *stripe) {
+    uint64x2_t a0 = vld1q_u64(acc);
+    uint64x2_t a1 = vld1q_u64(acc + 2);
+    uint64x2_t a2 = vld1q_u64(acc + 4);
+    uint64x2_t a3 = vld1q_u64(acc + 6);
+    const u64 *key;
+
+    for (usize n = 0; n < count; n++, ptr += HASH_STRIPE) {
+        key = hash_secret + *stripe;
+        a0  = hash_lane_neon(a0, ptr, key);
+        a1  = hash_lane_neon(a1, ptr + 16, key + 2);
+        a2  = hash_lane_neon(a2, ptr + 32, key + 4);
+        a3  = hash_lane_neon(a3, ptr + 48, key + 6);
+        if (++*stripe == HASH_BLOCK_STRIPES) {
+            key     = hash_secret + HASH_SCRAMBLE_KEY;
+            a0      = hash_scramble_neon(a0, key);
+            a1      = hash_scramble_neon(a1, key + 2);
+            a2      = hash_scramble_neon(a2, key + 4);
+            a3      = hash_scramble_neon(a3, key + 6);
+            *stripe = 0;
+        }
+    }
+
+    vst1q_u64(acc, a0);
+    vst1q_u64(acc + 2, a1);
+    vst1q_u64(acc + 4, a2);
+    vst1q_u64(acc + 6, a3);
+}
+
+#endif
+
+/// Feeds `count` stripes with the widest instruction set the CPU supports.
+FNDECL_PREFIX void hash_stripes(u64 *acc, const u8 *ptr, usize count, u32 *stripe) {
+#if defined(__x86_64__)
+    if (cpu_features() & CPU_AVX2) hash_stripes_avx2(acc, ptr, count, stripe);
+    else hash_stripes_sse2(acc, ptr, count, stripe);
+#elif defined(__aarch64__)
+    hash_stripes_neon(acc, ptr, count, stripe);
+#else
+    hash_stripes_nosimd(acc, ptr, count, stripe);
+#endif
+}
+
+/// Feeds the last stripe of the input, which may overlap the stripe before
+/// it.
+FNDECL_PREFIX void hash_accumulate_last(u64 *acc, const u8 *stripe) {
+#if defined(__x86_64__)
+    hash_accumulate_sse2(acc, stripe, hash_secret + HASH_LAST_KEY);
+#elif defined(__aarch64__)
+    hash_accumulate_neon(acc, stripe, hash_secret + HASH_LAST_KEY);
+#else
+    hash_accumulate_nosimd(acc, stripe, hash_secret + HASH_LAST_KEY);
+#endif
+}
+
+/// Runs the bulk path over `len` bytes, where `len` is at least a stripe.
+/// Every stripe but the one with the last byte is fed in order, then the
+/// last `HASH_STRIPE` bytes are fed.
+FNDECL_PREFIX void hash_bulk(u64 *acc, const u8 *ptr, usize len, u64 seed) {
+    u32 stripe = 0;
+
+    hash_bulk_init(acc, seed);
+    hash_stripes(acc, ptr, (len - 1) / HASH_STRIPE, &stripe);
+    hash_accumulate_last(acc, ptr + len - HASH_STRIPE);
+}
+
+#pragma clang diagnostic pop
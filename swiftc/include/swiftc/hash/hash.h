@@ -0,0 +1,6 @@
+#pragma once
+
+#include "bulk.h"
+#include "mix.h"
+#include "oneshot.h"
+#include "stream.h"
@@ -0,0 +1,137 @@
+#pragma once
+
+#include "../branching.h"
+#include "../mem/Slice.h"
+#include "../numbers.h"
+
+// The short path is wyhash (final version 4.2) and the bulk path is an
+// xxh3-style set of 8 accumulators that are fed 64-byte stripes and are
+// folded together with the same multiply-mix as the short path.
+
+#pragma clang diagnostic push
+#pragma clang diagnostic ignored "-Wunsafe-buffer-usage"
+
+/// Inputs above this length take the bulk path.
+#define HASH_BULK_MIN      256
+/// Bytes consumed by the accumulators at once.
+#define HASH_STRIPE        64
+/// Stripes between two scrambles of the accumulators.
+#define HASH_BLOCK_STRIPES 16
+/// Offset in `hash_secret` of the key of the last stripe.
+#define HASH_LAST_KEY      13
+/// Offset in `hash_secret` of the scramble key.
+#define HASH_SCRAMBLE_KEY  16
+/// The scrambled accumulators are multiplied by this 32-bit prime.
+#define HASH_SCRAMBLE_MUL  0x9E3779B1
+
+/// Secrets of the short path.
+static const u64 hash_short_secret[4] = {
+    0x2d358dccaa6c78a5,
+    0x8bb84b93962eacc9,
+    0x4b33a62ed433d4a3,
+    0x4d5a2da51de1aa47,
+};
+
+/// Keys of the bulk path. Stripe `i` of a block is keyed with the 8 words at
+/// offset `i`.
+static const u64 hash_secret[24] = {
+    0x2cb0f69f4abea221, 0x9417034723148989, 0xdd555950609dfe03, 0xdbafb150deb12800,
+    0x7e789b2e6c442cb6, 0xf41e5636c7e4f8c4, 0x0959d150f8fba7e4, 0xa97316f13cdb9eea,
+    0x74cd8258f9520068, 0x55c74a62e116868b, 0xd2f4c799a2023cbd, 0xdf98cb79a37b51b9,
+    0x396f5885524f3905, 0xaf1d56386ca3b276, 0xa9ffbe6b5104e85a, 0x6bd0c51b9fd533b3,
+    0x980ce91c50ab4b56, 0x28ac395780fe62c5, 0x768912e3a6bcedc7, 0x50b3e8c9332c7c88,
+    0xce3bbfe520bd47da, 0xcba6c8e8e0bb7c4f, 0xbf194db8434a346d, 0x7d8f2a7b60416d7f,
+};
+
+/// Reads 8 unaligned little-endian bytes.
+FNDECL_PREFIX u64 hash_read64(const u8 *ptr) {
+    u64 value;
+    __builtin_memcpy(&value, ptr, sizeof(u64));
+    return value;
+}
+
+/// Reads 4 unaligned little-endian bytes.
+FNDECL_PREFIX u64 hash_read32(const u8 *ptr) {
+    u32 value;
+    __builtin_memcpy(&value, ptr, sizeof(u32));
+    return value;
+}
+
+/// Replaces `a` and `b` with the low and high halves of their product.
+FNDECL_PREFIX void hash_mum(u64 *a, u64 *b) {
+    u128 product = (u128)*a * *b;
+    *a           = (u64)product;
+    *b           = (u64)(product >> 64);
+}
+
+/// Folds the 128-bit product of `a` and `b` to 64 bits.
+FNDECL_PREFIX u64 hash_mix(u64 a, u64 b) {
+    hash_mum(&a, &b);
+    return a ^ b;
+}
+
+/// Runs the short path over `len` bytes and leaves its 128-bit state in `a`
+/// and `b`. Inputs up to 16 bytes are read with a few overlapping loads.
+FNDECL_PREFIX void hash_short(const u8 *ptr, usize len, u64 seed, u64 *a, u64 *b) {
+    const u64 *s = hash_short_secret;
+    u64 see1, see2;
+    usize i;
+
+    seed ^= hash_mix(seed ^ s[0], s[1]);
+    if (likely(len <= 16)) {
+        if (likely(len >= 4)) {
+            *a = (hash_read32(ptr) << 32) | hash_read32(ptr + ((len >> 3) << 2));
+            *b = (hash_read32(ptr + len - 4) << 32) |
+                 hash_read32(ptr + len - 4 - ((len >> 3) << 2));
+        } else if (likely(len > 0)) {
+            *a = ((u64)ptr[0] << 16) | ((u64)ptr[len >> 1] << 8) | ptr[len - 1];
+            *b = 0;
+        } else {
+            *a = 0;
+            *b = 0;
+        }
+    } else {
+        i = len;
+        if (unlikely(i > 48)) {
+            see1 = seed;
+            see2 = seed;
+            do {
+                seed = hash_mix(hash_read64(ptr) ^ s[1], hash_read64(ptr + 8) ^ seed);
+                see1 = hash_mix(hash_read64(ptr + 16) ^ s[2], hash_read64(ptr + 24) ^ see1);
+                see2 = hash_mix(hash_read64(ptr + 32) ^ s[3], hash_read64(ptr + 40) ^ see2);
+                ptr += 48;
+                i -= 48;
+            } while (likely(i > 48));
+            seed ^= see1 ^ see2;
+        }
+        while (unlikely(i > 16)) {
+            seed = hash_mix(hash_read64(ptr) ^ s[1], hash_read64(ptr + 8) ^ seed);
+            ptr += 16;
+            i -= 16;
+        }
+        *a = hash_read64(ptr + i - 16);
+        *b = hash_read64(ptr + i - 8);
+    }
+
+    *a ^= s[1];
+    *b ^= seed;
+    hash_mum(a, b);
+}
+
+/// Seeds the accumulators of the bulk path.
+FNDECL_PREFIX void hash_bulk_init(u64 *acc, u64 seed) {
+    for (u32 i = 0; i < 8; i++) acc[i] = hash_secret[HASH_SCRAMBLE_KEY + i] ^ seed;
+}
+
+/// Folds the accumulators to 64 bits with the keys at `key`.
+FNDECL_PREFIX u64 hash_bulk_merge(const u64 *acc, const u64 *key, u64 start) {
+    u64 result = start;
+
+    for (u32 i = 0; i < 8; i += 2) result += hash_mix(acc[i] ^ key[i], acc[i + 1] ^ key[i + 1]);
+
+    result ^= result >> 37;
+    result *= 0x165667919E3779F9;
+    return result ^ (result >> 32);
+}
+
+#pragma clang diagnostic pop
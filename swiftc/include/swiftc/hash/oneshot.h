@@ -0,0 +1,70 @@
+#pragma once
+
+#include "../mem/Slice.h"
+#include "../numbers.h"
+#include "bulk.h"
+#include "mix.h"
+
+/// A 128-bit hash.
+typedef struct Hash128 {
+    u64 lo;
+    u64 hi;
+} Hash128;
+
+/// Finishes the short path with 64 bits.
+FNDECL_PREFIX u64 hash_short_final64(u64 a, u64 b, usize len) {
+    return hash_mix(a ^ hash_short_secret[0] ^ len, b ^ hash_short_secret[1]);
+}
+
+/// Finishes the short path with 128 bits.
+FNDECL_PREFIX Hash128 hash_short_final128(u64 a, u64 b, usize len) {
+    return (Hash128){
+        .lo = hash_short_final64(a, b, len),
+        .hi = hash_mix(b ^ hash_short_secret[2] ^ len, a ^ hash_short_secret[3]),
+    };
+}
+
+/// Finishes the bulk path with 64 bits.
+FNDECL_PREFIX u64 hash_bulk_final64(const u64 *acc, usize len, u64 seed) {
+    return hash_bulk_merge(acc, hash_secret, len * 0x9E3779B185EBCA87 ^ seed);
+}
+
+/// Finishes the bulk path with 128 bits.
+FNDECL_PREFIX Hash128 hash_bulk_final128(const u64 *acc, usize len, u64 seed) {
+    return (Hash128){
+        .lo = hash_bulk_final64(acc, len, seed),
+        .hi = hash_bulk_merge(acc, hash_secret + 8, ~(len * 0xC2B2AE3D27D4EB4F) ^ seed),
+    };
+}
+
+/// Returns the 64-bit hash of `data`.
+FNDECL_PREFIX u64 hash64(Slice data, u64 seed) {
+    u64 acc[8], a, b;
+
+    if (likely(data.len <= HASH_BULK_MIN)) {
+        hash_short((const u8 *)data.ptr, data.len, seed, &a, &b);
+        return hash_short_final64(a, b, data.len);
+    }
+
+    hash_bulk(acc, (const u8 *)data.ptr, data.len, seed);
+    return hash_bulk_final64(acc, data.len, seed);
+}
+
+/// Returns the 128-bit hash of `data`. The low half is the same as `hash64`.
+FNDECL_PREFIX Hash128 hash128(Slice data, u64 seed) {
+    u64 acc[8], a, b;
+
+    if (likely(data.len <= HASH_BULK_MIN)) {
+        hash_short((const u8 *)data.ptr, data.len, seed, &a, &b);
+        return hash_short_final128(a, b, data.len);
+    }
+
+    hash_bulk(acc, (const u8 *)data.ptr, data.len, seed);
+    return hash_bulk_final128(acc, data.len, seed);
+}
+
+/// Returns the 64-bit hash of an integer. It's the same as hashing its 8
+/// bytes.
+FNDECL_PREFIX u64 hash_u64(u64 value, u64 seed) {
+    return hash64((Slice){.ptr = &value, .len = sizeof(u64)}, seed);
+}
@@ -0,0 +1,128 @@
+#pragma once
+
+#include "../mem/Slice.h"
+#include "../mem/utils.h"
+#include "../numbers.h"
+#include "bulk.h"
+#include "mix.h"
+#include "oneshot.h"
+
+// The stream keeps the first `HASH_BULK_MIN` bytes to itself since it can't
+// know which path the total length is going to take. After that a stripe is
+// only fed once a byte after it arrives so the stripe with the last byte is
+// left for the digest, exactly like the one-shot bulk path.
+
+#pragma clang diagnostic push
+#pragma clang diagnostic ignored "-Wunsafe-buffer-usage"
+
+/// Incremental state of `hash64` and `hash128` for data that arrives in
+/// chunks. The digests are the same as hashing the concatenated chunks.
+typedef struct HashStream {
+    u64 acc[8];
+    u64 seed;
+    /// Bytes hashed so far.
+    u64 len;
+    /// Position of the next stripe within its block.
+    u32 stripe;
+    /// Bytes in `buf`, which always starts at a stripe boundary.
+    u32 buf_len;
+    u8 buf[HASH_BULK_MIN];
+    /// The last stripe fed to the accumulators. The last stripe of the input
+    /// may overlap it.
+    u8 last[HASH_STRIPE];
+} HashStream;
+
+/// Returns an empty stream.
+FNDECL_PREFIX HashStream hash_stream_init(u64 seed) {
+    HashStream self;
+
+    hash_bulk_init(self.acc, seed);
+    self.seed    = seed;
+    self.len     = 0;
+    self.stripe  = 0;
+    self.buf_len = 0;
+    return self;
+}
+
+/// Feeds `count` stripes from `ptr` and remembers the last one.
+FNDECL_PREFIX void hash_stream_consume(HashStream *self, const u8 *ptr, usize count) {
+    hash_stripes(self->acc, ptr, count, &self->stripe);
+    __builtin_memcpy(self->last, ptr + (count - 1) * HASH_STRIPE, HASH_STRIPE);
+}
+
+/// Hashes the next chunk.
+FNDECL_PREFIX void hash_stream_update(HashStream *self, Slice data) {
+    const u8 *ptr = (const u8 *)data.ptr;
+    usize len     = data.len;
+    usize count, take;
+
+    self->len += len;
+    while (len > 0) {
+        if (self->buf_len == HASH_BULK_MIN) {
+            hash_stream_consume(self, self->buf, HASH_BULK_MIN / HASH_STRIPE);
+            self->buf_len = 0;
+        }
+
+        // Large chunks skip the buffer but the stripe with their last byte.
+        if (self->buf_len == 0 && len > HASH_BULK_MIN) {
+            count = (len - 1) / HASH_STRIPE;
+            hash_stream_consume(self, ptr, count);
+            ptr += count * HASH_STRIPE;
+            len -= count * HASH_STRIPE;
+        }
+
+        take = HASH_BULK_MIN - self->buf_len;
+        if (take > len) take = len;
+        mem_copy(self->buf + self->buf_len, ptr, take);
+        self->buf_len += (u32)take;
+        ptr += take;
+        len -= take;
+    }
+}
+
+/// Copies the accumulators to `acc` and feeds them the buffered stripes.
+FNDECL_PREFIX void hash_stream_finish(const HashStream *self, u64 *acc) {
+    u32 stripe  = self->stripe;
+    usize count = (self->buf_len - 1) / HASH_STRIPE;
+    usize rest  = self->buf_len - count * HASH_STRIPE;
+    u8 tail[HASH_STRIPE];
+
+    __builtin_memcpy(acc, self->acc, sizeof(self->acc));
+    hash_stripes(acc, self->buf, count, &stripe);
+
+    if (self->buf_len >= HASH_STRIPE) {
+        hash_accumulate_last(acc, self->buf + self->buf_len - HASH_STRIPE);
+    } else {
+        mem_copy(tail, self->last + rest, HASH_STRIPE - rest);
+        mem_copy(tail + HASH_STRIPE - rest, self->buf, rest);
+        hash_accumulate_last(acc, tail);
+    }
+}
+
+/// Returns the 64-bit hash of everything fed so far. The stream can still
+/// be updated afterwards.
+FNDECL_PREFIX u64 hash_stream_digest64(HashStream *self) {
+    u64 acc[8];
+
+    if (self->len <= HASH_BULK_MIN) {
+        return hash64((Slice){.ptr = self->buf, .len = self->len}, self->seed);
+    }
+
+    hash_stream_finish(self, acc);
+    return hash_bulk_final64(acc, self->len, self->seed);
+}
+
+/// Returns the 128-bit hash of everything fed so far. The stream can still
+/// be updated afterwards.
+FNDECL_PREFIX Hash128 hash_stream_digest128(HashStream *self) {
+    u64 acc[8];
+
+    if (self->len <= HASH_BULK_MIN) {
+        return hash128((Slice){.ptr = self->buf, .len = self->len}, self->seed);
+    }
+
+    hash_stream_finish(self, acc);
+    return hash_bulk_final128(acc, self->len, self->seed);
+}
+
+#pragma clang diagnostic pop
@@ -0,0 +1,186 @@
+#pragma once
+
+#include "../numbers.h"
+#include "../os/linux/linux.h"
+#include "../os/page_size.h"
+#include "Slice.h"
+#include "utils.h"
+
+// The same memfd is mapped twice back to back so the byte after the end of
+// the ring is its first byte again. Any span of up to `capacity` bytes
+// starting anywhere in the first mapping is contiguous and can be handed to
+// `read`, `write` or `memcpy` as is.
+//
+// The cursors count every byte ever written and read, and the offset of a
+// cursor is its value modulo the capacity, which is a power of two. The
+// `mirror_ring_spsc_` functions can be used by one producer thread and one
+// consumer thread at the same time, the others are for a single thread.
+
+#pragma clang diagnostic push
+#pragma clang diagnostic ignored "-Wunsafe-buffer-usage"
+
+/// The cursors are on their own cache lines so the producer and the consumer
+/// don't invalidate each other's.
+typedef struct __attribute__((aligned(64))) MirrorRing {
+    /// The two mappings, `2 * capacity` bytes.
+    u8 *mem;
+    usize capacity;
+    u8 _padding0[48];
+    /// Bytes written so far. Only advanced by the producer.
+    usize head;
+    /// The producer's last view of `tail`.
+    usize tail_cache;
+    u8 _padding1[48];
+    /// Bytes read so far. Only advanced by the consumer.
+    usize tail;
+    /// The consumer's last view of `head`.
+    usize head_cache;
+    u8 _padding2[48];
+} MirrorRing;
+
+/// Creates a ring of at least `min_capacity` bytes, rounded up to a power of
+/// two that's a multiple of `granularity`. The granularity has to be a power
+/// of two multiple of the page size. `mem` is `nullptr` on failure.
+FNDECL_PREFIX MirrorRing mirror_ring_init_granular(usize min_capacity, usize granularity) {
+    MirrorRing self = {0};
+    usize capacity  = granularity;
+    usize fd, reserved, first, second;
+
+    if (granularity == 0 || granularity % os_page_size() != 0 ||
+        (granularity & (granularity - 1)) != 0) {
+        return self;
+    }
+    while (capacity < min_capacity) capacity <<= 1;
+
+    fd = SYSCALL(SYS_memfd_create, 2, (usize) "swiftc-mirror-ring", MFD_CLOEXEC);
+    if (linux_get_syserrno(fd) != SE_SUCCESS) return self;
+
+    // Reserve the address range of both halves first so nothing else can be
+    // mapped in between.
+    reserved = SYSCALL(SYS_mmap, 6, 0, capacity * 2, PROT_NONE, MAP_PRIVATE | MAP_ANONYMOUS,
+                       (usize)-1, 0);
+    if (linux_get_syserrno(SYSCALL(SYS_ftruncate, 2, fd, capacity)) != SE_SUCCESS ||
+        linux_get_syserrno(reserved) != SE_SUCCESS) {
+        goto fail;
+    }
+
+    first  = SYSCALL(SYS_mmap, 6, reserved, capacity, PROT_READ | PROT_WRITE,
+                     MAP_SHARED | MAP_FIXED, fd, 0);
+    second = SYSCALL(SYS_mmap, 6, reserved + capacity, capacity, PROT_READ | PROT_WRITE,
+                     MAP_SHARED | MAP_FIXED, fd, 0);
+    if (first != reserved || second != reserved + capacity) goto fail;
+
+    // The mappings keep the memfd alive.
+    SYSCALL(SYS_close, 1, fd);
+    self.mem      = (u8 *)reserved;
+    self.capacity = capacity;
+    return self;
+
+fail:
+    if (linux_get_syserrno(reserved) == SE_SUCCESS) {
+        SYSCALL(SYS_munmap, 2, reserved, capacity * 2);
+    }
+    SYSCALL(SYS_close, 1, fd);
+    return self;
+}
+
+/// Creates a ring of at least `min_capacity` bytes, rounded up to a power of
+/// two number of pages. `mem` is `nullptr` on failure.
+FNDECL_PREFIX MirrorRing mirror_ring_init(usize min_capacity) {
+    return mirror_ring_init_granular(min_capacity, os_page_size());
+}
+
+/// Unmaps the ring.
+FNDECL_PREFIX void mirror_ring_deinit(MirrorRing *self) {
+    if (self->mem != nullptr) SYSCALL(SYS_munmap, 2, (usize)self->mem, self->capacity * 2);
+    self->mem = nullptr;
+}
+
+/// Bytes that can be read.
+FNDECL_PREFIX usize mirror_ring_len(const MirrorRing *self) {
+    return self->head - self->tail;
+}
+
+/// Returns the readable bytes as one contiguous span.
+FNDECL_PREFIX Slice mirror_ring_read_span(const MirrorRing *self) {
+    return (Slice){.ptr = self->mem + (self->tail & (self->capacity - 1)),
+                   .len = self->head - self->tail};
+}
+
+/// Marks `n` bytes of the read span as read.
+FNDECL_PREFIX void mirror_ring_consume(MirrorRing *self, usize n) {
+    self->tail += n;
+}
+
+/// Returns the writable bytes as one contiguous span.
+FNDECL_PREFIX Slice mirror_ring_write_span(const MirrorRing *self) {
+    return (Slice){.ptr = self->mem + (self->head & (self->capacity - 1)),
+                   .len = self->capacity - (self->head - self->tail)};
+}
+
+/// Marks `n` bytes of the write span as written.
+FNDECL_PREFIX void mirror_ring_commit(MirrorRing *self, usize n) {
+    self->head += n;
+}
+
+/// Copies `data` into the ring. Returns 1 if it doesn't fit.
+FNDECL_PREFIX u8 mirror_ring_push(MirrorRing *self, Slice data) {
+    Slice span = mirror_ring_write_span(self);
+
+    if (data.len > span.len) return 1;
+    mem_copy(span.ptr, data.ptr, data.len);
+    mirror_ring_commit(self, data.len);
+    return 0;
+}
+
+/// Moves up to `dest.len` bytes out of the ring. Returns the number of bytes
+/// moved.
+FNDECL_PREFIX usize mirror_ring_pop(MirrorRing *self, Slice dest) {
+    Slice span = mirror_ring_read_span(self);
+    usize n    = dest.len < span.len ? dest.len : span.len;
+
+    mem_copy(dest.ptr, span.ptr, n);
+    mirror_ring_consume(self, n);
+    return n;
+}
+
+/// Returns the writable bytes as one contiguous span. The consumer's cursor is
+/// only loaded again when fewer than `want` bytes are known to be free, so a
+/// producer that needs `want` contiguous bytes sees every byte freed so far.
+/// Only called by the producer.
+FNDECL_PREFIX Slice mirror_ring_spsc_write_span(MirrorRing *self, usize want) {
+    usize space = self->capacity - (self->head - self->tail_cache);
+
+    if (space < want) {
+        self->tail_cache = __atomic_load_n(&self->tail, __ATOMIC_ACQUIRE);
+        space            = self->capacity - (self->head - self->tail_cache);
+    }
+    return (Slice){.ptr = self->mem + (self->head & (self->capacity - 1)), .len = space};
+}
+
+/// Publishes `n` bytes of the write span to the consumer. Only called by the
+/// producer.
+FNDECL_PREFIX void mirror_ring_spsc_commit(MirrorRing *self, usize n) {
+    __atomic_store_n(&self->head, self->head + n, __ATOMIC_RELEASE);
+}
+
+/// Returns the readable bytes as one contiguous span. The producer's cursor is
+/// only loaded again when fewer than `want` bytes are known to be readable.
+/// Only called by the consumer.
+FNDECL_PREFIX Slice mirror_ring_spsc_read_span(MirrorRing *self, usize want) {
+    usize len = self->head_cache - self->tail;
+
+    if (len < want) {
+        self->head_cache = __atomic_load_n(&self->head, __ATOMIC_ACQUIRE);
+        len              = self->head_cache - self->tail;
+    }
+    return (Slice){.ptr = self->mem + (self->tail & (self->capacity - 1)), .len = len};
+}
+
+/// Hands `n` bytes of the read span back to the producer. Only called by
+/// the consumer.
+FNDECL_PREFIX void mirror_ring_spsc_consume(MirrorRing *self, usize n) {
+    __atomic_store_n(&self->tail, self->tail + n, __ATOMIC_RELEASE);
+}
+
+#pragma clang diagnostic pop
@@ -15,14 +15,14 @@ FNDECL_PREFIX PageAllocator page_init(usize n) {
     usize len = n * PAGE_SIZE;
 
 #ifdef __unix__
-    SyscallError res = linux_get_syserrno(
-        SYSCALL(SYS_mmap, 6, 0, len, PROT_READ | PROT_WRITE, MAP_ANONYMOUS | MAP_PRIVATE, 0, 0));
+    usize mem =
+        SYSCALL(SYS_mmap, 6, 0, len, PROT_READ | PROT_WRITE, MAP_ANONYMOUS | MAP_PRIVATE, 0, 0);
 
-    if (res != SE_SUCCESS) {
+    if (linux_get_syserrno(mem) != SE_SUCCESS) {
         return (PageAllocator){.mem = nullptr, .len = 0};
     }
 
-    return (PageAllocator){.mem = (void *)res, .len = len};
+    return (PageAllocator){.mem = (void *)mem, .len = len};
 #else
     #error "PageAllocator is not implemented for the target OS!"
 #endif
@@ -3,6 +3,7 @@
 #include "Allocator.h"
 #include "ArenaAllocator.h"
 #include "ArrayList.h"
+#include "MirrorRing.h"
 #include "PageAllocator.h"
 #include "Slice.h"
 #include "utils.h"
@@ -37,3 +37,8 @@ typedef unsigned long long int u64;
 
 typedef i64 isize;
 typedef u64 usize;
+
+#ifdef __SIZEOF_INT128__
+__extension__ typedef signed __int128 i128;
+__extension__ typedef unsigned __int128 u128;
+#endif
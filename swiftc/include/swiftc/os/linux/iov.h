@@ -0,0 +1,177 @@
+#pragma once
+
+#include "../../mem/Slice.h"
+#include "../../numbers.h"
+#include "linux.h"
+
+// `Slice` has the layout of `struct iovec` so arrays of slices are passed to
+// the kernel as they are. Every wrapper returns the raw syscall result which
+// is decoded with `linux_get_syserrno`.
+
+#pragma clang diagnostic push
+#pragma clang diagnostic ignored "-Wunsafe-buffer-usage"
+
+_Static_assert(sizeof(Slice) == 16 && __builtin_offsetof(Slice, ptr) == 0 &&
+                   __builtin_offsetof(Slice, len) == 8,
+               "`Slice` should have the layout of `struct iovec`.");
+
+/// The most entries a single vectored syscall accepts.
+#define IOV_MAX 1024
+
+/// `struct msghdr`.
+typedef struct MsgHdr {
+    /// Optional address of the peer.
+    void *name;
+    u32 name_len;
+    u32 _padding0;
+    Slice *iov;
+    usize iov_len;
+    /// Ancillary data.
+    void *control;
+    usize control_len;
+    /// `MSG_` flags of the received message.
+    i32 flags;
+    u32 _padding1;
+} MsgHdr;
+
+/// `struct mmsghdr`.
+typedef struct MMsgHdr {
+    MsgHdr hdr;
+    /// Bytes sent or received for this message.
+    u32 len;
+    u32 _padding;
+} MMsgHdr;
+
+/// Reads into the slices in order.
+FNDECL_PREFIX usize linux_readv(i32 fd, const Slice *iov, usize count) {
+    return SYSCALL(SYS_readv, 3, (usize)fd, (usize)iov, count);
+}
+
+/// Writes the slices in order.
+FNDECL_PREFIX usize linux_writev(i32 fd, const Slice *iov, usize count) {
+    return SYSCALL(SYS_writev, 3, (usize)fd, (usize)iov, count);
+}
+
+/// Sends a message from the slices of `msg`.
+FNDECL_PREFIX usize linux_sendmsg(i32 fd, const MsgHdr *msg, i32 flags) {
+    return SYSCALL(SYS_sendmsg, 3, (usize)fd, (usize)msg, (usize)flags);
+}
+
+/// Receives a message into the slices of `msg`.
+FNDECL_PREFIX usize linux_recvmsg(i32 fd, MsgHdr *msg, i32 flags) {
+    return SYSCALL(SYS_recvmsg, 3, (usize)fd, (usize)msg, (usize)flags);
+}
+
+/// Sends up to `count` messages. Returns the number of messages sent and
+/// sets their `len`.
+FNDECL_PREFIX usize linux_sendmmsg(i32 fd, MMsgHdr *msgs, u32 count, i32 flags) {
+    return SYSCALL(SYS_sendmmsg, 4, (usize)fd, (usize)msgs, count, (usize)flags);
+}
+
+/// Receives up to `count` messages without a timeout. Returns the number of
+/// messages received and sets their `len`.
+FNDECL_PREFIX usize linux_recvmmsg(i32 fd, MMsgHdr *msgs, u32 count, i32 flags) {
+    return SYSCALL(SYS_recvmmsg, 5, (usize)fd, (usize)msgs, count, (usize)flags, 0);
+}
+
+/// A list of slices that is written with as few syscalls as possible.
+typedef struct IovBuilder {
+    Slice *iov;
+    /// Entries in use.
+    u32 len;
+    u32 cap;
+    /// The first entry that hasn't been completely written yet.
+    u32 head;
+    u32 _padding;
+    /// Bytes that haven't been written yet.
+    usize pending;
+} IovBuilder;
+
+/// Creates a builder on top of `cap` slices of storage.
+FNDECL_PREFIX IovBuilder iov_init(Slice *storage, u32 cap) {
+    return (IovBuilder){.iov = storage, .len = 0, .cap = cap, .head = 0, .pending = 0};
+}
+
+/// Appends `data`. It's merged into the last entry if it starts where that
+/// entry ends. Returns 1 if there's no room left.
+FNDECL_PREFIX u8 iov_push(IovBuilder *self, Slice data) {
+    Slice *last = self->len > self->head ? &self->iov[self->len - 1] : nullptr;
+
+    if (data.len == 0) return 0;
+    if (last != nullptr && (u8 *)last->ptr + last->len == data.ptr) {
+        last->len += data.len;
+    } else {
+        // Written entries at the front make room when the storage is full.
+        if (self->len == self->cap && self->head > 0) {
+            for (u32 i = self->head; i < self->len; i++) self->iov[i - self->head] = self->iov[i];
+            self->len -= self->head;
+            self->head = 0;
+        }
+        if (self->len == self->cap) return 1;
+        self->iov[self->len++] = data;
+    }
+    self->pending += data.len;
+    return 0;
+}
+
+/// Drops `n` written bytes from the front. A partially written entry is
+/// trimmed in place.
+FNDECL_PREFIX void iov_advance(IovBuilder *self, usize n) {
+    Slice *entry;
+
+    self->pending -= n;
+    while (n > 0) {
+        entry = &self->iov[self->head];
+        if (n < entry->len) {
+            entry->ptr = (u8 *)entry->ptr + n;
+            entry->len -= n;
+            break;
+        }
+        n -= entry->len;
+        self->head++;
+    }
+
+    // Skip entries that were emptied exactly and recycle the storage once
+    // everything is written.
+    while (self->head < self->len && self->iov[self->head].len == 0) self->head++;
+    if (self->head == self->len) {
+        self->head = 0;
+        self->len  = 0;
+    }
+}
+
+/// Writes the pending bytes in chunks of `IOV_MAX` entries until they're all
+/// written or `fd` stops accepting them. Sockets are written with `sendmsg`
+/// and `flags` (e.g. `MSG_NOSIGNAL`) if `is_socket` is set, anything else with
+/// `writev`. What's left can be written with another call once `fd` is
+/// writable again. Returns the bytes written, or the error if nothing was.
+FNDECL_PREFIX usize iov_flush(IovBuilder *self, i32 fd, u8 is_socket, i32 flags) {
+    usize total = 0;
+    usize count, written;
+    MsgHdr msg;
+    SyscallError err;
+
+    while (self->pending > 0) {
+        count = self->len - self->head;
+        if (count > IOV_MAX) count = IOV_MAX;
+
+        if (is_socket) {
+            msg = (MsgHdr){.iov = self->iov + self->head, .iov_len = count};
+            written = linux_sendmsg(fd, &msg, flags);
+        } else {
+            written = linux_writev(fd, self->iov + self->head, count);
+        }
+
+        err = linux_get_syserrno(written);
+        if (err == SE_INTR) continue;
+        if (err != SE_SUCCESS) return total > 0 ? total : written;
+        if (written == 0) break;
+
+        iov_advance(self, written);
+        total += written;
+    }
+
+    return total;
+}
+
+#pragma clang diagnostic pop
@@ -371,6 +371,50 @@ typedef enum SyscallError
 /// For anonymous mmap, memory could be uninitialized
 #define MAP_UNINITIALIZED   0x4000000
 
+/// MFD: close the file on exec
+#define MFD_CLOEXEC         0x0001
+/// MFD: allow sealing operations on the file
+#define MFD_ALLOW_SEALING   0x0002
+
+/// MADV: no further special treatment
+#define MADV_NORMAL         0
+
+/// AF: local sockets
+#define AF_UNIX             1
+/// AF: IPv4
+#define AF_INET             2
+/// AF: IPv6
+#define AF_INET6            10
+
+/// SOCK: sequenced, reliable, connection-based byte streams
+#define SOCK_STREAM         1
+/// SOCK: connectionless, unreliable datagrams
+#define SOCK_DGRAM          2
+/// SOCK: set O_NONBLOCK on the new socket
+#define SOCK_NONBLOCK       04000
+/// SOCK: set FD_CLOEXEC on the new socket
+#define SOCK_CLOEXEC        02000000
+
+/// SOL: socket level options
+#define SOL_SOCKET          1
+/// SO: send buffer size
+#define SO_SNDBUF           7
+/// SO: receive buffer size
+#define SO_RCVBUF           8
+
+/// MSG: peek at incoming data
+#define MSG_PEEK            0x2
+/// MSG: return the real length of a truncated datagram
+#define MSG_TRUNC           0x20
+/// MSG: nonblocking operation
+#define MSG_DONTWAIT        0x40
+/// MSG: don't raise SIGPIPE when the peer has closed the connection
+#define MSG_NOSIGNAL        0x4000
+/// MSG: more data is coming, hold back a partial frame
+#define MSG_MORE            0x8000
+/// MSG: recvmmsg: block only until the first message arrives
+#define MSG_WAITFORONE      0x10000
+
 struct stat {
     unsigned short st_dev;
     unsigned short st_ino;
@@ -1,4 +1,5 @@
 #pragma once
 
+#include "linux/iov.h"
 #include "linux/linux.h"
 #include "page_size.h"
@@ -1,7 +1,36 @@
 #pragma once
 
+#include "../numbers.h"
+#include "linux/linux.h"
+
 #ifdef __APPLE__
     #define PAGE_SIZE (16 * 1024)
 #else
     #define PAGE_SIZE (4 * 1024)
 #endif
+
+/// Returns the page size of the running kernel, which can be larger than
+/// `PAGE_SIZE` (16K or 64K on some aarch64 kernels). The result is cached.
+FNDECL_PREFIX usize os_page_size(void) {
+    static usize cached = 0;
+    usize size          = __atomic_load_n(&cached, __ATOMIC_RELAXED);
+    usize probe;
+
+    if (size != 0) return size;
+
+    // `madvise` only accepts page aligned addresses so the first power of two
+    // offset into a fresh mapping that it accepts is the page size.
+    probe = SYSCALL(SYS_mmap, 6, 0, 1 << 16, PROT_READ, MAP_ANONYMOUS | MAP_PRIVATE, (usize)-1, 0);
+    if (linux_get_syserrno(probe) != SE_SUCCESS) return PAGE_SIZE;
+
+    for (size = PAGE_SIZE; size < (1 << 16); size <<= 1) {
+        if (linux_get_syserrno(SYSCALL(SYS_madvise, 3, probe + size, 1, MADV_NORMAL)) ==
+            SE_SUCCESS) {
+            break;
+        }
+    }
+    SYSCALL(SYS_munmap, 2, probe, 1 << 16);
+
+    __atomic_store_n(&cached, size, __ATOMIC_RELAXED);
+    return size;
+}
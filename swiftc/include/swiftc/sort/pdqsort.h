@@ -0,0 +1,47 @@
+#pragma once
+
+#include "../mem/Slice.h"
+#include "../numbers.h"
+
+/// Returns non-zero if the element at `a` should be ordered before the one at
+/// `b`. `ctx` is passed through untouched.
+typedef u8 (*SortLessFn)(const void *a, const void *b, void *ctx);
+
+/// Swaps two elements of `size` bytes, 8 bytes at a time where possible.
+FNDECL_PREFIX void sort_swap(u8 *a, u8 *b, usize size) {
+    u64 wa, wb;
+    u8 ta;
+
+#pragma clang diagnostic push
+#pragma clang diagnostic ignored "-Wunsafe-buffer-usage"
+    for (; size >= sizeof(u64); size -= sizeof(u64), a += sizeof(u64), b += sizeof(u64)) {
+        __builtin_memcpy(&wa, a, sizeof(u64));
+        __builtin_memcpy(&wb, b, sizeof(u64));
+        __builtin_memcpy(a, &wb, sizeof(u64));
+        __builtin_memcpy(b, &wa, sizeof(u64));
+    }
+    for (; size > 0; size--, a++, b++) {
+        ta = *a;
+        *a = *b;
+        *b = ta;
+    }
+#pragma clang diagnostic pop
+}
+
+#define PDQ_NAME         sort_pdq_erased
+#define PDQ_PARAMS       , usize size, SortLessFn less, void *ctx
+#define PDQ_ARGS         , size, less, ctx
+#define PDQ_SIZE         size
+#define PDQ_LESS(a, b)   less((a), (b), ctx)
+#define PDQ_SWAP(a, b)   sort_swap((a), (b), size)
+#define PDQ_UNUSED       (void)less, (void)ctx
+#include "pdqsort_impl.h"
+
+/// Sorts the elements of `items` in place with pattern-defeating quicksort.
+/// It's not stable. `items.len` is in bytes, like every `Slice`, and should be
+/// a multiple of `size`. The comparator is called through a pointer, see
+/// `pdqsort_typed.h` for a variant that inlines it.
+FNDECL_PREFIX void sort_pdq(Slice items, usize size, SortLessFn less, void *ctx) {
+    if (size == 0) return;
+    sort_pdq_erased_run((u8 *)items.ptr, items.len / size, size, less, ctx);
+}
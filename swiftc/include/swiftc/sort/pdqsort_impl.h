@@ -0,0 +1,287 @@
+// This header is a template and is intentionally not guarded by `#pragma once`.
+// It's included once per instantiation by `pdqsort.h` and `pdqsort_typed.h`
+// and expects these macros to be defined beforehand (they're undefined at the
+// end of this file):
+//
+// - `PDQ_NAME`: Prefix of every generated function.
+// - `PDQ_PARAMS`: Extra parameters of the generated functions (may be empty).
+// - `PDQ_ARGS`: The arguments that forward `PDQ_PARAMS` (may be empty).
+// - `PDQ_SIZE`: Element size in bytes.
+// - `PDQ_LESS(a, b)`: Whether the element at `a` is less than the one at `b`.
+// - `PDQ_SWAP(a, b)`: Swaps the elements at `a` and `b`.
+// - `PDQ_UNUSED`: Optional statement that marks `PDQ_PARAMS` as used in the
+//   functions which only swap.
+//
+// Elements are always addressed by `u8` pointers so the same algorithm serves
+// the type-erased and the typed variants. With a constant `PDQ_SIZE` the
+// compiler strength-reduces all of the pointer math.
+
+#include "../numbers.h"
+
+#pragma clang diagnostic push
+#pragma clang diagnostic ignored "-Wunsafe-buffer-usage"
+
+#define PDQ_CAT2(a, b) a##_##b
+#define PDQ_CAT(a, b)  PDQ_CAT2(a, b)
+#define PDQ_FN(name)   PDQ_CAT(PDQ_NAME, name)
+
+#ifndef PDQ_UNUSED
+    #define PDQ_UNUSED
+#endif
+
+/// Below this many elements insertion sort is used.
+#define PDQ_INSERTION_SORT_THRESHOLD 24
+/// Above this many elements the pivot is the pseudo-median of nine.
+#define PDQ_NINTHER_THRESHOLD        128
+/// Maximum number of moves `partial_insertion_sort` may do before giving up.
+#define PDQ_PARTIAL_INSERTION_LIMIT  8
+
+/// Sorts [begin, end) with insertion sort.
+FNDECL_PREFIX void PDQ_FN(insertion_sort)(u8 *begin, u8 *end PDQ_PARAMS) {
+    u8 *cur, *sift;
+
+    if (begin == end) return;
+    for (cur = begin + PDQ_SIZE; cur < end; cur += PDQ_SIZE) {
+        for (sift = cur; sift != begin && PDQ_LESS(sift, sift - PDQ_SIZE); sift -= PDQ_SIZE) {
+            PDQ_SWAP(sift, sift - PDQ_SIZE);
+        }
+    }
+}
+
+/// Attempts insertion sort on [begin, end). Gives up and returns 0 as soon as
+/// more than `PDQ_PARTIAL_INSERTION_LIMIT` elements had to be moved.
+FNDECL_PREFIX u8 PDQ_FN(partial_insertion_sort)(u8 *begin, u8 *end PDQ_PARAMS) {
+    u8 *cur, *sift;
+    usize moves = 0;
+
+    if (begin == end) return 1;
+    for (cur = begin + PDQ_SIZE; cur < end; cur += PDQ_SIZE) {
+        for (sift = cur; sift != begin && PDQ_LESS(sift, sift - PDQ_SIZE); sift -= PDQ_SIZE) {
+            PDQ_SWAP(sift, sift - PDQ_SIZE);
+            moves += 1;
+        }
+        if (moves > PDQ_PARTIAL_INSERTION_LIMIT) return 0;
+    }
+
+    return 1;
+}
+
+/// Sorts the two elements at `a` and `b`.
+FNDECL_PREFIX void PDQ_FN(sort2)(u8 *a, u8 *b PDQ_PARAMS) {
+    if (PDQ_LESS(b, a)) PDQ_SWAP(a, b);
+}
+
+/// Sorts the three elements at `a`, `b` and `c`.
+FNDECL_PREFIX void PDQ_FN(sort3)(u8 *a, u8 *b, u8 *c PDQ_PARAMS) {
+    PDQ_FN(sort2)(a, b PDQ_ARGS);
+    PDQ_FN(sort2)(b, c PDQ_ARGS);
+    PDQ_FN(sort2)(a, b PDQ_ARGS);
+}
+
+/// Restores the max-heap property of `len` elements starting at `base` below
+/// the element with index `root`.
+FNDECL_PREFIX void PDQ_FN(sift_down)(u8 *base, usize len, usize root PDQ_PARAMS) {
+    usize child;
+
+    for (;;) {
+        child = 2 * root + 1;
+        if (child >= len) return;
+        if (child + 1 < len && PDQ_LESS(base + child * PDQ_SIZE, base + (child + 1) * PDQ_SIZE))
+            child += 1;
+        if (!PDQ_LESS(base + root * PDQ_SIZE, base + child * PDQ_SIZE)) return;
+
+        PDQ_SWAP(base + root * PDQ_SIZE, base + child * PDQ_SIZE);
+        root = child;
+    }
+}
+
+/// Heapsort which is the worst-case fallback of pdqsort.
+FNDECL_PREFIX void PDQ_FN(heapsort)(u8 *begin, u8 *end PDQ_PARAMS) {
+    usize len = (usize)(end - begin) / PDQ_SIZE;
+    usize i;
+
+    for (i = len / 2; i > 0; i--) PDQ_FN(sift_down)(begin, len, i - 1 PDQ_ARGS);
+    for (i = len; i > 1; i--) {
+        PDQ_SWAP(begin, begin + (i - 1) * PDQ_SIZE);
+        PDQ_FN(sift_down)(begin, i - 1, 0 PDQ_ARGS);
+    }
+}
+
+/// Partitions [begin, end) around the pivot at `begin`. Elements equal to the
+/// pivot go to the right. Stores whether no swap was needed in
+/// `already_partitioned` and returns the final position of the pivot.
+///
+/// Requires an element that's not less than the pivot in (begin, end), which
+/// the median selection guarantees.
+FNDECL_PREFIX u8 *PDQ_FN(partition_right)(u8 *begin, u8 *end, u8 *already_partitioned PDQ_PARAMS) {
+    u8 *first = begin;
+    u8 *last  = end;
+
+    // Finds the first element that's not less than the pivot.
+    do first += PDQ_SIZE;
+    while (PDQ_LESS(first, begin));
+
+    // Finds the last element that's less than the pivot. It's only guarded
+    // when there was no such element on the left side.
+    if (first - PDQ_SIZE == begin) {
+        do last -= PDQ_SIZE;
+        while (first < last && !PDQ_LESS(last, begin));
+    } else {
+        do last -= PDQ_SIZE;
+        while (!PDQ_LESS(last, begin));
+    }
+
+    *already_partitioned = first >= last;
+
+    // Every misplaced pair is swapped. The previous swap guards both loops.
+    while (first < last) {
+        PDQ_SWAP(first, last);
+        do first += PDQ_SIZE;
+        while (PDQ_LESS(first, begin));
+        do last -= PDQ_SIZE;
+        while (!PDQ_LESS(last, begin));
+    }
+
+    first -= PDQ_SIZE;
+    if (first != begin) PDQ_SWAP(begin, first);
+    return first;
+}
+
+/// Partitions [begin, end) around the pivot at `begin` putting the elements
+/// equal to the pivot to the left. It's used when the range is full of
+/// duplicates of its predecessor so they're never touched again.
+FNDECL_PREFIX u8 *PDQ_FN(partition_left)(u8 *begin, u8 *end PDQ_PARAMS) {
+    u8 *first = begin;
+    u8 *last  = end;
+
+    do last -= PDQ_SIZE;
+    while (PDQ_LESS(begin, last));
+
+    if (last + PDQ_SIZE == end) {
+        do first += PDQ_SIZE;
+        while (first < last && !PDQ_LESS(begin, first));
+    } else {
+        do first += PDQ_SIZE;
+        while (!PDQ_LESS(begin, first));
+    }
+
+    while (first < last) {
+        PDQ_SWAP(first, last);
+        do last -= PDQ_SIZE;
+        while (PDQ_LESS(begin, last));
+        do first += PDQ_SIZE;
+        while (!PDQ_LESS(begin, first));
+    }
+
+    if (last != begin) PDQ_SWAP(begin, last);
+    return last;
+}
+
+/// Swaps a few elements of an unbalanced partition of `len` elements in order
+/// to break patterns that keep producing bad pivots.
+FNDECL_PREFIX void PDQ_FN(break_patterns)(u8 *begin, u8 *end, usize len PDQ_PARAMS) {
+    usize quarter = len / 4;
+
+    PDQ_UNUSED;
+    if (len < PDQ_INSERTION_SORT_THRESHOLD) return;
+
+    PDQ_SWAP(begin, begin + quarter * PDQ_SIZE);
+    PDQ_SWAP(end - PDQ_SIZE, end - quarter * PDQ_SIZE);
+
+    if (len > PDQ_NINTHER_THRESHOLD) {
+        PDQ_SWAP(begin + PDQ_SIZE, begin + (quarter + 1) * PDQ_SIZE);
+        PDQ_SWAP(begin + 2 * PDQ_SIZE, begin + (quarter + 2) * PDQ_SIZE);
+        PDQ_SWAP(end - 2 * PDQ_SIZE, end - (quarter + 1) * PDQ_SIZE);
+        PDQ_SWAP(end - 3 * PDQ_SIZE, end - (quarter + 2) * PDQ_SIZE);
+    }
+}
+
+/// The pdqsort main loop. Recurses into the left partition and loops on the
+/// right one. `bad_allowed` is the number of unbalanced partitions tolerated
+/// before falling back to heapsort.
+FNDECL_PREFIX void PDQ_FN(loop)(u8 *begin, u8 *end, usize bad_allowed, u8 leftmost PDQ_PARAMS) {
+    usize len, half, left_len, right_len;
+    u8 *pivot;
+    u8 already_partitioned;
+
+    for (;;) {
+        len = (usize)(end - begin) / PDQ_SIZE;
+        if (len < PDQ_INSERTION_SORT_THRESHOLD) {
+            PDQ_FN(insertion_sort)(begin, end PDQ_ARGS);
+            return;
+        }
+
+        // Moves the pivot to `begin`.
+        half = len / 2;
+        if (len > PDQ_NINTHER_THRESHOLD) {
+            PDQ_FN(sort3)(begin, begin + half * PDQ_SIZE, end - PDQ_SIZE PDQ_ARGS);
+            PDQ_FN(sort3)
+            (begin + PDQ_SIZE, begin + (half - 1) * PDQ_SIZE, end - 2 * PDQ_SIZE PDQ_ARGS);
+            PDQ_FN(sort3)
+            (begin + 2 * PDQ_SIZE, begin + (half + 1) * PDQ_SIZE, end - 3 * PDQ_SIZE PDQ_ARGS);
+            PDQ_FN(sort3)
+            (begin + (half - 1) * PDQ_SIZE, begin + half * PDQ_SIZE,
+             begin + (half + 1) * PDQ_SIZE PDQ_ARGS);
+            PDQ_SWAP(begin, begin + half * PDQ_SIZE);
+        } else {
+            PDQ_FN(sort3)(begin + half * PDQ_SIZE, begin, end - PDQ_SIZE PDQ_ARGS);
+        }
+
+        // The predecessor is equal to the pivot so everything equal to it is
+        // already in place.
+        if (!leftmost && !PDQ_LESS(begin - PDQ_SIZE, begin)) {
+            begin = PDQ_FN(partition_left)(begin, end PDQ_ARGS) + PDQ_SIZE;
+            continue;
+        }
+
+        pivot     = PDQ_FN(partition_right)(begin, end, &already_partitioned PDQ_ARGS);
+        left_len  = (usize)(pivot - begin) / PDQ_SIZE;
+        right_len = (usize)(end - (pivot + PDQ_SIZE)) / PDQ_SIZE;
+
+        if (left_len < len / 8 || right_len < len / 8) {
+            bad_allowed -= 1;
+            if (bad_allowed == 0) {
+                PDQ_FN(heapsort)(begin, end PDQ_ARGS);
+                return;
+            }
+
+            PDQ_FN(break_patterns)(begin, pivot, left_len PDQ_ARGS);
+            PDQ_FN(break_patterns)(pivot + PDQ_SIZE, end, right_len PDQ_ARGS);
+        } else if (already_partitioned &&
+                   PDQ_FN(partial_insertion_sort)(begin, pivot PDQ_ARGS) &&
+                   PDQ_FN(partial_insertion_sort)(pivot + PDQ_SIZE, end PDQ_ARGS)) {
+            return;
+        }
+
+        PDQ_FN(loop)(begin, pivot, bad_allowed, leftmost PDQ_ARGS);
+        begin    = pivot + PDQ_SIZE;
+        leftmost = 0;
+    }
+}
+
+/// Sorts `len` elements starting at `base`.
+FNDECL_PREFIX void PDQ_FN(run)(u8 *base, usize len PDQ_PARAMS) {
+    usize bad_allowed = 1;
+
+    if (len < 2) return;
+    while ((len >> bad_allowed) != 0) bad_allowed += 1;
+
+    PDQ_FN(loop)(base, base + len * PDQ_SIZE, bad_allowed, 1 PDQ_ARGS);
+}
+
+#undef PDQ_INSERTION_SORT_THRESHOLD
+#undef PDQ_NINTHER_THRESHOLD
+#undef PDQ_PARTIAL_INSERTION_LIMIT
+#undef PDQ_FN
+#undef PDQ_CAT
+#undef PDQ_CAT2
+
+#undef PDQ_NAME
+#undef PDQ_PARAMS
+#undef PDQ_ARGS
+#undef PDQ_SIZE
+#undef PDQ_LESS
+#undef PDQ_SWAP
+#undef PDQ_UNUSED
+
+#pragma clang diagnostic pop
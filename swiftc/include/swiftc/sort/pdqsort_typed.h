@@ -0,0 +1,49 @@
+// This header is a template and is intentionally not guarded by `#pragma once`.
+// It instantiates pdqsort for a single element type with the comparator
+// inlined. Define these macros and include it (they're undefined afterwards):
+//
+// - `SORT_NAME`: Name of the generated function.
+// - `SORT_TYPE`: Element type.
+// - `SORT_LESS(a, b)`: Expression over two `SORT_TYPE` values which is true
+//   if `a` should be ordered before `b`.
+//
+// ```c
+// #define SORT_NAME sort_u32_desc
+// #define SORT_TYPE u32
+// #define SORT_LESS(a, b) ((a) > (b))
+// #include "swiftc/sort/pdqsort_typed.h"
+//
+// sort_u32_desc(items, count);
+// ```
+
+#include "../numbers.h"
+
+#define SORT_TYPED_CAT2(a, b) a##_##b
+#define SORT_TYPED_CAT(a, b)  SORT_TYPED_CAT2(a, b)
+#define SORT_TYPED_AT(p)      (*(SORT_TYPE *)(void *)(p))
+
+#define PDQ_NAME              SORT_TYPED_CAT(SORT_NAME, pdq)
+#define PDQ_PARAMS
+#define PDQ_ARGS
+#define PDQ_SIZE              sizeof(SORT_TYPE)
+#define PDQ_LESS(a, b)        (SORT_LESS(SORT_TYPED_AT(a), SORT_TYPED_AT(b)))
+#define PDQ_SWAP(a, b)                                                                             \
+    do {                                                                                           \
+        SORT_TYPE sort_typed_tmp = SORT_TYPED_AT(a);                                               \
+        SORT_TYPED_AT(a)         = SORT_TYPED_AT(b);                                               \
+        SORT_TYPED_AT(b)         = sort_typed_tmp;                                                 \
+    } while (0)
+#include "pdqsort_impl.h"
+
+/// Sorts `len` elements starting at `items` in place. It's not stable.
+FNDECL_PREFIX void SORT_NAME(SORT_TYPE *items, usize len) {
+    SORT_TYPED_CAT(SORT_NAME, pdq_run)((u8 *)(void *)items, len);
+}
+
+#undef SORT_TYPED_AT
+#undef SORT_TYPED_CAT
+#undef SORT_TYPED_CAT2
+
+#undef SORT_NAME
+#undef SORT_TYPE
+#undef SORT_LESS
@@ -0,0 +1,138 @@
+#pragma once
+
+#include "../mem/ArenaAllocator.h"
+#include "../mem/Slice.h"
+#include "../numbers.h"
+
+/// Bits sorted per pass.
+#define RADIX_BITS    8
+/// Buckets per pass.
+#define RADIX_BUCKETS (1 << RADIX_BITS)
+
+/// A key-value pair which is sorted by `key` with `radix_sort_kv`.
+typedef struct SortKV {
+    u64 key;
+    u64 value;
+} SortKV;
+
+/// Shared state of a parallel radix sort. Every worker runs
+/// `radix_parallel_run` on its own thread, swiftC doesn't spawn threads.
+typedef struct RadixParallel {
+    u8 *items;
+    u8 *scratch;
+    usize count;
+    /// Per-worker histograms of the current pass: `workers * RADIX_BUCKETS`.
+    usize *hist;
+    /// Per-worker number of passes that moved the items, whose parity tells
+    /// which buffer they're in.
+    u8 *moves;
+    u32 workers;
+    /// Element size in bytes: 4 (`u32`), 8 (`u64`) or 16 (`SortKV`).
+    u32 size;
+    /// Barrier state.
+    u32 arrived;
+    u32 generation;
+} RadixParallel;
+
+/// Hints the CPU that we're spinning.
+FNDECL_PREFIX void radix_relax(void) {
+#if defined(__x86_64__)
+    __builtin_ia32_pause();
+#elif defined(__aarch64__)
+    __asm__ __volatile__("yield");
+#endif
+}
+
+/// Waits until every worker has reached the barrier.
+FNDECL_PREFIX void radix_barrier(RadixParallel *self) {
+    u32 generation = __atomic_load_n(&self->generation, __ATOMIC_ACQUIRE);
+
+    if (__atomic_add_fetch(&self->arrived, 1, __ATOMIC_ACQ_REL) == self->workers) {
+        __atomic_store_n(&self->arrived, 0, __ATOMIC_RELAXED);
+        __atomic_store_n(&self->generation, generation + 1, __ATOMIC_RELEASE);
+        return;
+    }
+
+    while (__atomic_load_n(&self->generation, __ATOMIC_ACQUIRE) == generation) radix_relax();
+}
+
+#define RADIX_NAME      radix_sort_u32
+#define RADIX_TYPE      u32
+#define RADIX_KEY(x)    (x)
+#define RADIX_KEY_BYTES 4
+#include "radix_impl.h"
+
+#define RADIX_NAME      radix_sort_u64
+#define RADIX_TYPE      u64
+#define RADIX_KEY(x)    (x)
+#define RADIX_KEY_BYTES 8
+#include "radix_impl.h"
+
+#define RADIX_NAME      radix_sort_kv
+#define RADIX_TYPE      SortKV
+#define RADIX_KEY(x)    ((x).key)
+#define RADIX_KEY_BYTES 8
+#include "radix_impl.h"
+
+/// Prepares a parallel sort of `items` whose elements are `size` bytes: 4
+/// (`u32`), 8 (`u64`) or 16 (`SortKV`). The scratch buffer and histograms are
+/// taken from `scratch` and stay allocated until the caller resets the arena.
+/// Returns 1 if the size is unsupported or the arena is too small.
+FNDECL_PREFIX u8 radix_parallel_init(RadixParallel *self, Slice items, usize size, u32 workers,
+                                     ArenaAllocator *scratch) {
+    Allocator allocator = arena_allocator(scratch);
+
+    if ((size != sizeof(u32) && size != sizeof(u64) && size != sizeof(SortKV)) || workers == 0)
+        return 1;
+
+    self->items      = (u8 *)items.ptr;
+    self->count      = items.len / size;
+    self->workers    = workers;
+    self->size       = (u32)size;
+    self->arrived    = 0;
+    self->generation = 0;
+
+    self->scratch = (u8 *)mem_alloc(allocator, self->count * size);
+    self->hist    = (usize *)mem_alloc(allocator, (usize)workers * RADIX_BUCKETS * sizeof(usize));
+    self->moves   = (u8 *)mem_alloc(allocator, workers);
+    if (self->scratch == nullptr || self->hist == nullptr || self->moves == nullptr) return 1;
+    for (u32 i = 0; i < workers; i++) self->moves[i] = 0;
+
+    return 0;
+}
+
+/// The number of phases of a parallel sort: a histogram and a scatter phase
+/// per key byte and a last one that copies the items back where needed.
+FNDECL_PREFIX u32 radix_parallel_phases(const RadixParallel *self) {
+    return (self->size == sizeof(u32) ? 4 : 8) * 2 + 1;
+}
+
+/// Runs phase `phase` of the share of `worker`. A phase may only start once
+/// every worker has finished the previous one, which `radix_parallel_run`
+/// waits for with a barrier. Calling the workers' phases in turn on a single
+/// thread sorts the same way.
+FNDECL_PREFIX void radix_parallel_step(RadixParallel *self, u32 worker, u32 phase) {
+    switch (self->size) {
+    case sizeof(u32):
+        radix_sort_u32_step(self, worker, phase);
+        break;
+    case sizeof(u64):
+        radix_sort_u64_step(self, worker, phase);
+        break;
+    default:
+        radix_sort_kv_step(self, worker, phase);
+        break;
+    }
+}
+
+/// Sorts the share of `worker` which is in the [0, workers) range. Every worker
+/// has to call it exactly once, each on its own thread. It returns once the
+/// whole slice is sorted. With a single worker it's a plain stable LSD sort.
+FNDECL_PREFIX void radix_parallel_run(RadixParallel *self, u32 worker) {
+    u32 phases = radix_parallel_phases(self);
+
+    for (u32 phase = 0; phase < phases; phase++) {
+        radix_parallel_step(self, worker, phase);
+        radix_barrier(self);
+    }
+}
@@ -0,0 +1,132 @@
+// This header is a template and is intentionally not guarded by `#pragma once`.
+// It's included once per key type by `radix.h` and expects these macros to be
+// defined beforehand (they're undefined at the end of this file):
+//
+// - `RADIX_NAME`: Name of the generated single-threaded sort function.
+// - `RADIX_TYPE`: Element type.
+// - `RADIX_KEY(x)`: The unsigned integer key of the element `x`.
+// - `RADIX_KEY_BYTES`: Size of the key in bytes which is the number of passes.
+
+#include "../mem/ArenaAllocator.h"
+#include "../mem/Slice.h"
+#include "../numbers.h"
+
+#pragma clang diagnostic push
+#pragma clang diagnostic ignored "-Wunsafe-buffer-usage"
+
+#define RADIX_CAT2(a, b) a##_##b
+#define RADIX_CAT(a, b)  RADIX_CAT2(a, b)
+#define RADIX_FN(name)   RADIX_CAT(RADIX_NAME, name)
+#define RADIX_DIGIT(x, pass)                                                                       \
+    ((usize)((RADIX_KEY(x) >> ((pass) * RADIX_BITS)) & (RADIX_BUCKETS - 1)))
+
+/// Sorts `items` (a slice of `RADIX_TYPE`, `len` in bytes) with LSD radix sort
+/// using a buffer of the same size taken from `scratch`. The buffer is given
+/// back to the arena before returning. Returns 1 if the arena is too small.
+FNDECL_PREFIX u8 RADIX_NAME(Slice items, ArenaAllocator *scratch) {
+    usize counts[RADIX_KEY_BYTES][RADIX_BUCKETS];
+    usize count = items.len / sizeof(RADIX_TYPE);
+    usize mark  = scratch->pos;
+    usize i, pass, sum, tmp;
+    RADIX_TYPE *src = (RADIX_TYPE *)items.ptr;
+    RADIX_TYPE *dst, *swap;
+
+    if (count < 2) return 0;
+
+    dst = (RADIX_TYPE *)mem_alloc(arena_allocator(scratch), count * sizeof(RADIX_TYPE));
+    if (dst == nullptr) return 1;
+
+    // Every histogram is built in a single read of the input.
+    for (pass = 0; pass < RADIX_KEY_BYTES; pass++) {
+        for (i = 0; i < RADIX_BUCKETS; i++) counts[pass][i] = 0;
+    }
+    for (i = 0; i < count; i++) {
+        for (pass = 0; pass < RADIX_KEY_BYTES; pass++) counts[pass][RADIX_DIGIT(src[i], pass)] += 1;
+    }
+
+    for (pass = 0; pass < RADIX_KEY_BYTES; pass++) {
+        // All of the keys share this digit so the pass wouldn't move anything.
+        if (counts[pass][RADIX_DIGIT(src[0], pass)] == count) continue;
+
+        for (i = 0, sum = 0; i < RADIX_BUCKETS; i++) {
+            tmp              = counts[pass][i];
+            counts[pass][i]  = sum;
+            sum             += tmp;
+        }
+        for (i = 0; i < count; i++) dst[counts[pass][RADIX_DIGIT(src[i], pass)]++] = src[i];
+
+        swap = src;
+        src  = dst;
+        dst  = swap;
+    }
+
+    // An odd number of passes leaves the result in the scratch buffer.
+    if (src != (RADIX_TYPE *)items.ptr) {
+        for (i = 0; i < count; i++) dst[i] = src[i];
+    }
+
+    scratch->pos = mark;
+    return 0;
+}
+
+/// Phase `phase` of the share of `worker` in a parallel sort. See
+/// `radix_parallel_step`.
+FNDECL_PREFIX void RADIX_FN(step)(RadixParallel *self, u32 worker, u32 phase) {
+    usize offsets[RADIX_BUCKETS];
+    usize lo    = self->count * worker / self->workers;
+    usize hi    = self->count * (worker + 1) / self->workers;
+    usize *hist = self->hist + (usize)worker * RADIX_BUCKETS;
+    usize pass  = phase / 2;
+    usize i, d, w, base, before, total, h;
+    RADIX_TYPE *items   = (RADIX_TYPE *)(void *)self->items;
+    RADIX_TYPE *scratch = (RADIX_TYPE *)(void *)self->scratch;
+    // Every worker moves its chunk in the same passes so they all agree on
+    // which buffer holds the items.
+    RADIX_TYPE *src = self->moves[worker] % 2 == 0 ? items : scratch;
+    RADIX_TYPE *dst = src == items ? scratch : items;
+
+    if (pass == RADIX_KEY_BYTES) {
+        if (src != items) {
+            for (i = lo; i < hi; i++) items[i] = src[i];
+        }
+        return;
+    }
+
+    if (phase % 2 == 0) {
+        for (d = 0; d < RADIX_BUCKETS; d++) hist[d] = 0;
+        for (i = lo; i < hi; i++) hist[RADIX_DIGIT(src[i], pass)] += 1;
+        return;
+    }
+
+    // Each worker scatters its chunk right after the chunks of the lower
+    // workers within every bucket, which keeps the sort stable.
+    for (d = 0, base = 0; d < RADIX_BUCKETS; d++) {
+        total  = 0;
+        before = 0;
+        for (w = 0; w < self->workers; w++) {
+            h      = self->hist[w * RADIX_BUCKETS + d];
+            total += h;
+            if (w < worker) before += h;
+        }
+        // All of the keys share this digit so the pass wouldn't move anything.
+        if (total == self->count) return;
+
+        offsets[d]  = base + before;
+        base       += total;
+    }
+
+    for (i = lo; i < hi; i++) dst[offsets[RADIX_DIGIT(src[i], pass)]++] = src[i];
+    self->moves[worker] += 1;
+}
+
+#undef RADIX_DIGIT
+#undef RADIX_FN
+#undef RADIX_CAT
+#undef RADIX_CAT2
+
+#undef RADIX_NAME
+#undef RADIX_TYPE
+#undef RADIX_KEY
+#undef RADIX_KEY_BYTES
+
+#pragma clang diagnostic pop
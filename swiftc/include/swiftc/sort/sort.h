@@ -0,0 +1,4 @@
+#pragma once
+
+#include "pdqsort.h"
+#include "radix.h"
@@ -11,7 +11,10 @@
 #pragma clang diagnostic push
 #pragma clang diagnostic ignored "-Wunused-function"
 #include "branching.h"
+#include "hash/hash.h"
 #include "mem/mem.h"
 #include "numbers.h"
 #include "os/os.h"
+#include "sort/sort.h"
+#include "text/text.h"
 #pragma clang diagnostic pop
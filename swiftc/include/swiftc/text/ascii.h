@@ -0,0 +1,249 @@
+#pragma once
+
+#include "../cpu.h"
+#include "../mem/Slice.h"
+#include "../numbers.h"
+
+// Case folding only touches the 'A'-'Z' and 'a'-'z' ranges so it's safe on
+// UTF-8, every byte of a multi-byte sequence is above 0x7F.
+
+#pragma clang diagnostic push
+#pragma clang diagnostic ignored "-Wunsafe-buffer-usage"
+
+/// Lowercases a single ASCII byte.
+FNDECL_PREFIX u8 ascii_lower_byte(u8 c) {
+    return (u8)(c - 'A') < 26 ? (u8)(c | 0x20) : c;
+}
+
+/// Uppercases a single ASCII byte.
+FNDECL_PREFIX u8 ascii_upper_byte(u8 c) {
+    return (u8)(c - 'a') < 26 ? (u8)(c & ~0x20) : c;
+}
+
+/// Lowercases `text` in place one byte at a time.
+FNDECL_PREFIX void ascii_lower_nosimd(Slice text) {
+    u8 *ptr = (u8 *)text.ptr;
+    for (usize i = 0; i < text.len; i++) ptr[i] = ascii_lower_byte(ptr[i]);
+}
+
+/// Uppercases `text` in place one byte at a time.
+FNDECL_PREFIX void ascii_upper_nosimd(Slice text) {
+    u8 *ptr = (u8 *)text.ptr;
+    for (usize i = 0; i < text.len; i++) ptr[i] = ascii_upper_byte(ptr[i]);
+}
+
+/// Compares `a` and `b` ignoring the case of ASCII letters one byte at a time.
+FNDECL_PREFIX u8 ascii_eql_ignore_case_nosimd(Slice a, Slice b) {
+    const u8 *pa = (const u8 *)a.ptr;
+    const u8 *pb = (const u8 *)b.ptr;
+
+    if (a.len != b.len) return 0;
+    for (usize i = 0; i < a.len; i++) {
+        if (ascii_lower_byte(pa[i]) != ascii_lower_byte(pb[i])) return 0;
+    }
+    return 1;
+}
+
+#if defined(__x86_64__)
+
+// SSE2 is part of x86_64 so it doesn't need a target attribute. The range
+// check is a signed comparison after moving the first letter to -128.
+
+/// Flips the case bit of the bytes of `v` within [first, first + 26).
+FNDECL_PREFIX __m128i ascii_flip_sse2(__m128i v, char first) {
+    __m128i shifted = _mm_add_epi8(v, _mm_set1_epi8((char)(-128 - first)));
+    __m128i in_range = _mm_cmplt_epi8(shifted, _mm_set1_epi8(-128 + 26));
+    return _mm_xor_si128(v, _mm_and_si128(in_range, _mm_set1_epi8(0x20)));
+}
+
+/// Flips the case of the ASCII letters starting with `first` 16 bytes at a
+/// time.
+FNDECL_PREFIX void ascii_fold_sse2(Slice text, char first) {
+    u8 *ptr = (u8 *)text.ptr;
+    usize i;
+
+    for (i = 0; i + 16 <= text.len; i += 16) {
+        __m128i *block = (__m128i *)(void *)(ptr + i);
+        _mm_storeu_si128(block, ascii_flip_sse2(_mm_loadu_si128(block), first));
+    }
+    for (; i < text.len; i++) {
+        if ((u8)(ptr[i] - first) < 26) ptr[i] ^= 0x20;
+    }
+}
+
+/// Lowercases `text` in place 16 bytes at a time with SSE2 instructions.
+FNDECL_PREFIX void ascii_lower_sse2(Slice text) {
+    ascii_fold_sse2(text, 'A');
+}
+
+/// Uppercases `text` in place 16 bytes at a time with SSE2 instructions.
+FNDECL_PREFIX void ascii_upper_sse2(Slice text) {
+    ascii_fold_sse2(text, 'a');
+}
+
+/// Compares `a` and `b` ignoring the case of ASCII letters 16 bytes at a time
+/// with SSE2 instructions.
+FNDECL_PREFIX u8 ascii_eql_ignore_case_sse2(Slice a, Slice b) {
+    const u8 *pa = (const u8 *)a.ptr;
+    const u8 *pb = (const u8 *)b.ptr;
+    __m128i va, vb;
+    usize i;
+
+    if (a.len != b.len) return 0;
+    for (i = 0; i + 16 <= a.len; i += 16) {
+        va = ascii_flip_sse2(_mm_loadu_si128((const __m128i *)(const void *)(pa + i)), 'A');
+        vb = ascii_flip_sse2(_mm_loadu_si128((const __m128i *)(const void *)(pb + i)), 'A');
+        if (_mm_movemask_epi8(_mm_cmpeq_epi8(va, vb)) != 0xFFFF) return 0;
+    }
+
+    for (; i < a.len; i++) {
+        if (ascii_lower_byte(pa[i]) != ascii_lower_byte(pb[i])) return 0;
+    }
+    return 1;
+}
+
+/// Flips the case bit of the bytes of `v` within [first, first + 26).
+FNDECL_PREFIX CPU_TARGET_AVX2 __m256i ascii_flip_avx2(__m256i v, char first) {
+    __m256i shifted  = _mm256_add_epi8(v, _mm256_set1_epi8((char)(-128 - first)));
+    __m256i in_range = _mm256_cmpgt_epi8(_mm256_set1_epi8(-128 + 26), shifted);
+    return _mm256_xor_si256(v, _mm256_and_si256(in_range, _mm256_set1_epi8(0x20)));
+}
+
+/// Flips the case of the ASCII letters starting with `first` 32 bytes at a
+/// time.
+FNDECL_PREFIX CPU_TARGET_AVX2 void ascii_fold_avx2(Slice text, char first) {
+    u8 *ptr = (u8 *)text.ptr;
+    usize i;
+
+    for (i = 0; i + 32 <= text.len; i += 32) {
+        __m256i *block = (__m256i *)(void *)(ptr + i);
+        _mm256_storeu_si256(block, ascii_flip_avx2(_mm256_loadu_si256(block), first));
+    }
+    ascii_fold_sse2((Slice){.ptr = ptr + i, .len = text.len - i}, first);
+}
+
+/// Lowercases `text` in place 32 bytes at a time with AVX2 instructions.
+FNDECL_PREFIX CPU_TARGET_AVX2 void ascii_lower_avx2(Slice text) {
+    ascii_fold_avx2(text, 'A');
+}
+
+/// Uppercases `text` in place 32 bytes at a time with AVX2 instructions.
+FNDECL_PREFIX CPU_TARGET_AVX2 void ascii_upper_avx2(Slice text) {
+    ascii_fold_avx2(text, 'a');
+}
+
+/// Compares `a` and `b` ignoring the case of ASCII letters 32 bytes at a time
+/// with AVX2 instructions.
+FNDECL_PREFIX CPU_TARGET_AVX2 u8 ascii_eql_ignore_case_avx2(Slice a, Slice b) {
+    const u8 *pa = (const u8 *)a.ptr;
+    const u8 *pb = (const u8 *)b.ptr;
+    __m256i va, vb;
+    usize i;
+
+    if (a.len != b.len) return 0;
+    for (i = 0; i + 32 <= a.len; i += 32) {
+        va = ascii_flip_avx2(_mm256_loadu_si256((const __m256i *)(const void *)(pa + i)), 'A');
+        vb = ascii_flip_avx2(_mm256_loadu_si256((const __m256i *)(const void *)(pb + i)), 'A');
+        if ((u32)_mm256_movemask_epi8(_mm256_cmpeq_epi8(va, vb)) != 0xFFFFFFFF) return 0;
+    }
+
+    for (; i < a.len; i++) {
+        if (ascii_lower_byte(pa[i]) != ascii_lower_byte(pb[i])) return 0;
+    }
+    return 1;
+}
+
+#elif defined(__aarch64__)
+
+/// Flips the case bit of the bytes of `v` within [first, first + 26).
+FNDECL_PREFIX uint8x16_t ascii_flip_neon(uint8x16_t v, u8 first) {
+    uint8x16_t in_range = vcltq_u8(vsubq_u8(v, vdupq_n_u8(first)), vdupq_n_u8(26));
+    return veorq_u8(v, vandq_u8(in_range, vdupq_n_u8(0x20)));
+}
+
+/// Flips the case of the ASCII letters starting with `first` 16 bytes at a
+/// time.
+FNDECL_PREFIX void ascii_fold_neon(Slice text, u8 first) {
+    u8 *ptr = (u8 *)text.ptr;
+    usize i;
+
+    for (i = 0; i + 16 <= text.len; i += 16) {
+        vst1q_u8(ptr + i, ascii_flip_neon(vld1q_u8(ptr + i), first));
+    }
+    for (; i < text.len; i++) {
+        if ((u8)(ptr[i] - first) < 26) ptr[i] ^= 0x20;
+    }
+}
+
+/// Lowercases `text` in place 16 bytes at a time with NEON instructions.
+FNDECL_PREFIX void ascii_lower_neon(Slice text) {
+    ascii_fold_neon(text, 'A');
+}
+
+/// Uppercases `text` in place 16 bytes at a time with NEON instructions.
+FNDECL_PREFIX void ascii_upper_neon(Slice text) {
+    ascii_fold_neon(text, 'a');
+}
+
+/// Compares `a` and `b` ignoring the case of ASCII letters 16 bytes at a time
+/// with NEON instructions.
+FNDECL_PREFIX u8 ascii_eql_ignore_case_neon(Slice a, Slice b) {
+    const u8 *pa = (const u8 *)a.ptr;
+    const u8 *pb = (const u8 *)b.ptr;
+    usize i;
+
+    if (a.len != b.len) return 0;
+    for (i = 0; i + 16 <= a.len; i += 16) {
+        uint8x16_t eq = vceqq_u8(ascii_flip_neon(vld1q_u8(pa + i), 'A'),
+                                 ascii_flip_neon(vld1q_u8(pb + i), 'A'));
+        if (vminvq_u8(eq) != 0xFF) return 0;
+    }
+
+    for (; i < a.len; i++) {
+        if (ascii_lower_byte(pa[i]) != ascii_lower_byte(pb[i])) return 0;
+    }
+    return 1;
+}
+
+#endif
+
+/// Lowercases the ASCII letters of `text` in place with the widest
+/// instruction set the CPU supports.
+FNDECL_PREFIX void ascii_to_lower(Slice text) {
+#if defined(__x86_64__)
+    if (cpu_features() & CPU_AVX2) ascii_lower_avx2(text);
+    else ascii_lower_sse2(text);
+#elif defined(__aarch64__)
+    ascii_lower_neon(text);
+#else
+    ascii_lower_nosimd(text);
+#endif
+}
+
+/// Uppercases the ASCII letters of `text` in place with the widest
+/// instruction set the CPU supports.
+FNDECL_PREFIX void ascii_to_upper(Slice text) {
+#if defined(__x86_64__)
+    if (cpu_features() & CPU_AVX2) ascii_upper_avx2(text);
+    else ascii_upper_sse2(text);
+#elif defined(__aarch64__)
+    ascii_upper_neon(text);
+#else
+    ascii_upper_nosimd(text);
+#endif
+}
+
+/// Compares `a` and `b` ignoring the case of ASCII letters with the widest
+/// instruction set the CPU supports.
+FNDECL_PREFIX u8 ascii_eql_ignore_case(Slice a, Slice b) {
+#if defined(__x86_64__)
+    if (cpu_features() & CPU_AVX2) return ascii_eql_ignore_case_avx2(a, b);
+    return ascii_eql_ignore_case_sse2(a, b);
+#elif defined(__aarch64__)
+    return ascii_eql_ignore_case_neon(a, b);
+#else
+    return ascii_eql_ignore_case_nosimd(a, b);
+#endif
+}
+
+#pragma clang diagnostic pop
@@ -0,0 +1,4 @@
+#pragma once
+
+#include "ascii.h"
+#include "utf8.h"
@@ -0,0 +1,365 @@
+#pragma once
+
+#include "../cpu.h"
+#include "../mem/Slice.h"
+#include "../numbers.h"
+
+// The SIMD validators implement the lookup algorithm from "Validating UTF-8 In
+// Less Than One Instruction Per Byte" (Keiser, Lemire). Every byte is
+// classified by three 16-entry tables indexed by the high nibble of the
+// previous byte, the low nibble of the previous byte and the high nibble of
+// the current byte. A non-zero AND of the three lookups is an error unless
+// it's the expected continuation of a 3 or 4-byte sequence.
+
+#pragma clang diagnostic push
+#pragma clang diagnostic ignored "-Wunsafe-buffer-usage"
+
+/// A lead byte or ASCII followed by a lead byte or ASCII.
+#define UTF8_TOO_SHORT  (1 << 0)
+/// ASCII followed by a continuation byte.
+#define UTF8_TOO_LONG   (1 << 1)
+/// 0xE0 followed by a byte below 0xA0.
+#define UTF8_OVERLONG_3 (1 << 2)
+/// 0xF4 followed by a byte above 0x8F, or 0xF5 and above.
+#define UTF8_TOO_LARGE  (1 << 3)
+/// 0xED followed by a byte above 0x9F.
+#define UTF8_SURROGATE  (1 << 4)
+/// 0xC0 or 0xC1.
+#define UTF8_OVERLONG_2 (1 << 5)
+/// 0xF0 followed by a byte below 0x90, or above 0xF4 followed by 0x8_.
+#define UTF8_OVERLONG_4 (1 << 6)
+/// A continuation byte followed by a continuation byte.
+#define UTF8_TWO_CONTS  (1 << 7)
+#define UTF8_CARRY      (UTF8_TOO_SHORT | UTF8_TOO_LONG | UTF8_TWO_CONTS)
+
+/// Classes by the high nibble of the previous byte.
+static const u8 utf8_prev_high[16] = {
+    UTF8_TOO_LONG,
+    UTF8_TOO_LONG,
+    UTF8_TOO_LONG,
+    UTF8_TOO_LONG,
+    UTF8_TOO_LONG,
+    UTF8_TOO_LONG,
+    UTF8_TOO_LONG,
+    UTF8_TOO_LONG,
+    UTF8_TWO_CONTS,
+    UTF8_TWO_CONTS,
+    UTF8_TWO_CONTS,
+    UTF8_TWO_CONTS,
+    UTF8_TOO_SHORT | UTF8_OVERLONG_2,
+    UTF8_TOO_SHORT,
+    UTF8_TOO_SHORT | UTF8_OVERLONG_3 | UTF8_SURROGATE,
+    UTF8_TOO_SHORT | UTF8_TOO_LARGE | UTF8_OVERLONG_4,
+};
+
+/// Classes by the low nibble of the previous byte.
+static const u8 utf8_prev_low[16] = {
+    UTF8_CARRY | UTF8_OVERLONG_3 | UTF8_OVERLONG_2 | UTF8_OVERLONG_4,
+    UTF8_CARRY | UTF8_OVERLONG_2,
+    UTF8_CARRY,
+    UTF8_CARRY,
+    UTF8_CARRY | UTF8_TOO_LARGE,
+    UTF8_CARRY | UTF8_TOO_LARGE | UTF8_OVERLONG_4,
+    UTF8_CARRY | UTF8_TOO_LARGE | UTF8_OVERLONG_4,
+    UTF8_CARRY | UTF8_TOO_LARGE | UTF8_OVERLONG_4,
+    UTF8_CARRY | UTF8_TOO_LARGE | UTF8_OVERLONG_4,
+    UTF8_CARRY | UTF8_TOO_LARGE | UTF8_OVERLONG_4,
+    UTF8_CARRY | UTF8_TOO_LARGE | UTF8_OVERLONG_4,
+    UTF8_CARRY | UTF8_TOO_LARGE | UTF8_OVERLONG_4,
+    UTF8_CARRY | UTF8_TOO_LARGE | UTF8_OVERLONG_4,
+    UTF8_CARRY | UTF8_TOO_LARGE | UTF8_OVERLONG_4 | UTF8_SURROGATE,
+    UTF8_CARRY | UTF8_TOO_LARGE | UTF8_OVERLONG_4,
+    UTF8_CARRY | UTF8_TOO_LARGE | UTF8_OVERLONG_4,
+};
+
+/// Classes by the high nibble of the current byte.
+static const u8 utf8_cur_high[16] = {
+    UTF8_TOO_SHORT,
+    UTF8_TOO_SHORT,
+    UTF8_TOO_SHORT,
+    UTF8_TOO_SHORT,
+    UTF8_TOO_SHORT,
+    UTF8_TOO_SHORT,
+    UTF8_TOO_SHORT,
+    UTF8_TOO_SHORT,
+    UTF8_TOO_LONG | UTF8_OVERLONG_2 | UTF8_TWO_CONTS | UTF8_OVERLONG_3 | UTF8_OVERLONG_4,
+    UTF8_TOO_LONG | UTF8_OVERLONG_2 | UTF8_TWO_CONTS | UTF8_OVERLONG_3 | UTF8_TOO_LARGE,
+    UTF8_TOO_LONG | UTF8_OVERLONG_2 | UTF8_TWO_CONTS | UTF8_SURROGATE | UTF8_TOO_LARGE,
+    UTF8_TOO_LONG | UTF8_OVERLONG_2 | UTF8_TWO_CONTS | UTF8_SURROGATE | UTF8_TOO_LARGE,
+    UTF8_TOO_SHORT,
+    UTF8_TOO_SHORT,
+    UTF8_TOO_SHORT,
+    UTF8_TOO_SHORT,
+};
+
+/// A block ending with a byte above these expects continuation bytes in the
+/// next block. The last 16 bytes are used for 16-byte registers.
+static const u8 utf8_incomplete_max[32] = {
+    0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+    0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+    0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xF0 - 1, 0xE0 - 1, 0xC0 - 1,
+};
+
+/// Validates UTF-8 one code point at a time with an 8-byte ASCII fast path.
+/// Returns 1 if `text` is valid.
+FNDECL_PREFIX u8 utf8_validate_nosimd(Slice text) {
+    const u8 *ptr = (const u8 *)text.ptr;
+    usize len     = text.len;
+    usize i       = 0;
+    u64 word;
+    u8 lead, second;
+
+    while (i < len) {
+        if (i + 8 <= len) {
+            __builtin_memcpy(&word, ptr + i, sizeof(u64));
+            if ((word & 0x8080808080808080) == 0) {
+                i += 8;
+                continue;
+            }
+        }
+
+        lead = ptr[i];
+        if (lead < 0x80) {
+            i += 1;
+            continue;
+        }
+
+        // Continuation bytes can't lead and 0xC0, 0xC1 are always overlong.
+        if (lead < 0xC2 || lead > 0xF4) return 0;
+
+        if (lead < 0xE0) {
+            if (i + 1 >= len || (ptr[i + 1] & 0xC0) != 0x80) return 0;
+            i += 2;
+        } else if (lead < 0xF0) {
+            if (i + 2 >= len) return 0;
+            second = ptr[i + 1];
+            if ((second & 0xC0) != 0x80 || (ptr[i + 2] & 0xC0) != 0x80) return 0;
+            if (lead == 0xE0 && second < 0xA0) return 0;
+            if (lead == 0xED && second > 0x9F) return 0;
+            i += 3;
+        } else {
+            if (i + 3 >= len) return 0;
+            second = ptr[i + 1];
+            if ((second & 0xC0) != 0x80 || (ptr[i + 2] & 0xC0) != 0x80 ||
+                (ptr[i + 3] & 0xC0) != 0x80)
+                return 0;
+            if (lead == 0xF0 && second < 0x90) return 0;
+            if (lead == 0xF4 && second > 0x8F) return 0;
+            i += 4;
+        }
+    }
+
+    return 1;
+}
+
+#if defined(__x86_64__)
+
+/// Error bits of the 16 bytes of `input` given the 16 bytes before them.
+FNDECL_PREFIX CPU_TARGET_SSE42 __m128i utf8_check_sse42(__m128i input, __m128i prev_input) {
+    __m128i nibble = _mm_set1_epi8(0x0F);
+    __m128i prev1  = _mm_alignr_epi8(input, prev_input, 15);
+    __m128i prev2  = _mm_alignr_epi8(input, prev_input, 14);
+    __m128i prev3  = _mm_alignr_epi8(input, prev_input, 13);
+    __m128i special, third, fourth;
+
+    special = _mm_and_si128(
+        _mm_and_si128(
+            _mm_shuffle_epi8(_mm_loadu_si128((const __m128i *)(const void *)utf8_prev_high),
+                             _mm_and_si128(_mm_srli_epi16(prev1, 4), nibble)),
+            _mm_shuffle_epi8(_mm_loadu_si128((const __m128i *)(const void *)utf8_prev_low),
+                             _mm_and_si128(prev1, nibble))),
+        _mm_shuffle_epi8(_mm_loadu_si128((const __m128i *)(const void *)utf8_cur_high),
+                         _mm_and_si128(_mm_srli_epi16(input, 4), nibble)));
+
+    // Only 0b111_____ and 0b1111____ are left with the high bit set.
+    third  = _mm_subs_epu8(prev2, _mm_set1_epi8(0xE0 - 0x80));
+    fourth = _mm_subs_epu8(prev3, _mm_set1_epi8(0xF0 - 0x80));
+
+    return _mm_xor_si128(_mm_and_si128(_mm_or_si128(third, fourth), _mm_set1_epi8(-0x80)),
+                         special);
+}
+
+/// Validates a 16-byte block and updates the running state.
+FNDECL_PREFIX CPU_TARGET_SSE42 void utf8_step_sse42(__m128i input, __m128i *prev_input,
+                                                    __m128i *prev_incomplete, __m128i *error) {
+    if (_mm_movemask_epi8(input) == 0) {
+        *error           = _mm_or_si128(*error, *prev_incomplete);
+        *prev_incomplete = _mm_setzero_si128();
+    } else {
+        *error = _mm_or_si128(*error, utf8_check_sse42(input, *prev_input));
+        *prev_incomplete = _mm_subs_epu8(
+            input, _mm_loadu_si128((const __m128i *)(const void *)(utf8_incomplete_max + 16)));
+    }
+    *prev_input = input;
+}
+
+/// Validates UTF-8 16 bytes at a time with SSE4.2 instructions. Returns 1 if
+/// `text` is valid.
+FNDECL_PREFIX CPU_TARGET_SSE42 u8 utf8_validate_sse42(Slice text) {
+    const u8 *ptr           = (const u8 *)text.ptr;
+    __m128i prev_input      = _mm_setzero_si128();
+    __m128i prev_incomplete = _mm_setzero_si128();
+    __m128i error           = _mm_setzero_si128();
+    u8 tail[16];
+    usize i, j;
+
+    for (i = 0; i + 16 <= text.len; i += 16) {
+        utf8_step_sse42(_mm_loadu_si128((const __m128i *)(const void *)(ptr + i)), &prev_input,
+                        &prev_incomplete, &error);
+    }
+
+    // The tail is padded with zeroes which are ASCII.
+    if (i < text.len) {
+        for (j = 0; j < 16; j++) tail[j] = i + j < text.len ? ptr[i + j] : 0;
+        utf8_step_sse42(_mm_loadu_si128((const __m128i *)(const void *)tail), &prev_input,
+                        &prev_incomplete, &error);
+    }
+
+    error = _mm_or_si128(error, prev_incomplete);
+    return (u8)_mm_testz_si128(error, error);
+}
+
+/// Loads a 16-byte table into both lanes.
+FNDECL_PREFIX CPU_TARGET_AVX2 __m256i utf8_table_avx2(const u8 *table) {
+    return _mm256_broadcastsi128_si256(_mm_loadu_si128((const __m128i *)(const void *)table));
+}
+
+/// Error bits of the 32 bytes of `input` given the 32 bytes before them.
+FNDECL_PREFIX CPU_TARGET_AVX2 __m256i utf8_check_avx2(__m256i input, __m256i prev_input) {
+    __m256i nibble = _mm256_set1_epi8(0x0F);
+    // The upper half of `prev_input` followed by the lower half of `input` so
+    // `alignr` can shift across the two 128-bit lanes.
+    __m256i shifted = _mm256_permute2x128_si256(prev_input, input, 0x21);
+    __m256i prev1   = _mm256_alignr_epi8(input, shifted, 15);
+    __m256i prev2   = _mm256_alignr_epi8(input, shifted, 14);
+    __m256i prev3   = _mm256_alignr_epi8(input, shifted, 13);
+    __m256i special, third, fourth;
+
+    special = _mm256_and_si256(
+        _mm256_and_si256(_mm256_shuffle_epi8(utf8_table_avx2(utf8_prev_high),
+                                             _mm256_and_si256(_mm256_srli_epi16(prev1, 4), nibble)),
+                         _mm256_shuffle_epi8(utf8_table_avx2(utf8_prev_low),
+                                             _mm256_and_si256(prev1, nibble))),
+        _mm256_shuffle_epi8(utf8_table_avx2(utf8_cur_high),
+                            _mm256_and_si256(_mm256_srli_epi16(input, 4), nibble)));
+
+    third  = _mm256_subs_epu8(prev2, _mm256_set1_epi8(0xE0 - 0x80));
+    fourth = _mm256_subs_epu8(prev3, _mm256_set1_epi8(0xF0 - 0x80));
+
+    return _mm256_xor_si256(
+        _mm256_and_si256(_mm256_or_si256(third, fourth), _mm256_set1_epi8(-0x80)), special);
+}
+
+/// Validates a 32-byte block and updates the running state.
+FNDECL_PREFIX CPU_TARGET_AVX2 void utf8_step_avx2(__m256i input, __m256i *prev_input,
+                                                  __m256i *prev_incomplete, __m256i *error) {
+    if (_mm256_movemask_epi8(input) == 0) {
+        *error           = _mm256_or_si256(*error, *prev_incomplete);
+        *prev_incomplete = _mm256_setzero_si256();
+    } else {
+        *error = _mm256_or_si256(*error, utf8_check_avx2(input, *prev_input));
+        *prev_incomplete = _mm256_subs_epu8(
+            input, _mm256_loadu_si256((const __m256i *)(const void *)utf8_incomplete_max));
+    }
+    *prev_input = input;
+}
+
+/// Validates UTF-8 32 bytes at a time with AVX2 instructions. Returns 1 if
+/// `text` is valid.
+FNDECL_PREFIX CPU_TARGET_AVX2 u8 utf8_validate_avx2(Slice text) {
+    const u8 *ptr           = (const u8 *)text.ptr;
+    __m256i prev_input      = _mm256_setzero_si256();
+    __m256i prev_incomplete = _mm256_setzero_si256();
+    __m256i error           = _mm256_setzero_si256();
+    u8 tail[32];
+    usize i, j;
+
+    for (i = 0; i + 32 <= text.len; i += 32) {
+        utf8_step_avx2(_mm256_loadu_si256((const __m256i *)(const void *)(ptr + i)), &prev_input,
+                       &prev_incomplete, &error);
+    }
+
+    if (i < text.len) {
+        for (j = 0; j < 32; j++) tail[j] = i + j < text.len ? ptr[i + j] : 0;
+        utf8_step_avx2(_mm256_loadu_si256((const __m256i *)(const void *)tail), &prev_input,
+                       &prev_incomplete, &error);
+    }
+
+    error = _mm256_or_si256(error, prev_incomplete);
+    return (u8)_mm256_testz_si256(error, error);
+}
+
+#elif defined(__aarch64__)
+
+/// Error bits of the 16 bytes of `input` given the 16 bytes before them.
+FNDECL_PREFIX uint8x16_t utf8_check_neon(uint8x16_t input, uint8x16_t prev_input) {
+    uint8x16_t prev1 = vextq_u8(prev_input, input, 15);
+    uint8x16_t prev2 = vextq_u8(prev_input, input, 14);
+    uint8x16_t prev3 = vextq_u8(prev_input, input, 13);
+    uint8x16_t special, third, fourth;
+
+    special = vandq_u8(
+        vandq_u8(vqtbl1q_u8(vld1q_u8(utf8_prev_high), vshrq_n_u8(prev1, 4)),
+                 vqtbl1q_u8(vld1q_u8(utf8_prev_low), vandq_u8(prev1, vdupq_n_u8(0x0F)))),
+        vqtbl1q_u8(vld1q_u8(utf8_cur_high), vshrq_n_u8(input, 4)));
+
+    third  = vqsubq_u8(prev2, vdupq_n_u8(0xE0 - 0x80));
+    fourth = vqsubq_u8(prev3, vdupq_n_u8(0xF0 - 0x80));
+
+    return veorq_u8(vandq_u8(vorrq_u8(third, fourth), vdupq_n_u8(0x80)), special);
+}
+
+/// Validates a 16-byte block and updates the running state.
+FNDECL_PREFIX void utf8_step_neon(uint8x16_t input, uint8x16_t *prev_input,
+                                  uint8x16_t *prev_incomplete, uint8x16_t *error) {
+    if (vmaxvq_u8(input) < 0x80) {
+        *error           = vorrq_u8(*error, *prev_incomplete);
+        *prev_incomplete = vdupq_n_u8(0);
+    } else {
+        *error           = vorrq_u8(*error, utf8_check_neon(input, *prev_input));
+        *prev_incomplete = vqsubq_u8(input, vld1q_u8(utf8_incomplete_max + 16));
+    }
+    *prev_input = input;
+}
+
+/// Validates UTF-8 16 bytes at a time with NEON instructions. Returns 1 if
+/// `text` is valid.
+FNDECL_PREFIX u8 utf8_validate_neon(Slice text) {
+    const u8 *ptr              = (const u8 *)text.ptr;
+    uint8x16_t prev_input      = vdupq_n_u8(0);
+    uint8x16_t prev_incomplete = vdupq_n_u8(0);
+    uint8x16_t error           = vdupq_n_u8(0);
+    u8 tail[16];
+    usize i, j;
+
+    for (i = 0; i + 16 <= text.len; i += 16) {
+        utf8_step_neon(vld1q_u8(ptr + i), &prev_input, &prev_incomplete, &error);
+    }
+
+    if (i < text.len) {
+        for (j = 0; j < 16; j++) tail[j] = i + j < text.len ? ptr[i + j] : 0;
+        utf8_step_neon(vld1q_u8(tail), &prev_input, &prev_incomplete, &error);
+    }
+
+    error = vorrq_u8(error, prev_incomplete);
+    return vmaxvq_u8(error) == 0;
+}
+
+#endif
+
+/// Returns 1 if `text` is valid UTF-8. Picks the widest instruction set the
+/// CPU supports.
+FNDECL_PREFIX u8 utf8_validate(Slice text) {
+#if defined(__x86_64__)
+    u32 features = cpu_features();
+    if (features & CPU_AVX2) return utf8_validate_avx2(text);
+    if (features & CPU_SSE42) return utf8_validate_sse42(text);
+    return utf8_validate_nosimd(text);
+#elif defined(__aarch64__)
+    return utf8_validate_neon(text);
+#else
+    return utf8_validate_nosimd(text);
+#endif
+}
+
+#pragma clang diagnostic pop
@@ -3,3 +3,5 @@
 // Allow `_start`.
 #pragma clang diagnostic ignored "-Wmissing-prototypes"
 #pragma clang diagnostic ignored "-Wreserved-identifier"
+// The tests index raw buffers.
+#pragma clang diagnostic ignored "-Wunsafe-buffer-usage"
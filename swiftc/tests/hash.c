@@ -0,0 +1,220 @@
+#include "clang-ignore.h"
+#include "swiftc/swiftc.h"
+#include "testing.h"
+
+#define DATA_LEN   4096
+#define KEYS       (1 << 18)
+#define AVALANCHE  256
+#define MAX_STREAM 1300
+/// Input bits flipped per key size at most.
+#define MAX_BITS   512
+
+static u8 data[DATA_LEN];
+static u8 key[DATA_LEN];
+static u32 flips[MAX_BITS][128];
+static u64 rng_state = 0x9e3779b97f4a7c15;
+
+static u64 rng_next(void) {
+    rng_state ^= rng_state << 13;
+    rng_state ^= rng_state >> 7;
+    rng_state ^= rng_state << 17;
+    return rng_state;
+}
+
+static void fill_random(u8 *bytes, usize len) {
+    for (usize i = 0; i < len; i++) bytes[i] = (u8)rng_next();
+}
+
+/// Expects `hashes` to be distinct after sorting them.
+static void expect_distinct(u64 *hashes, usize count, ArenaAllocator *arena) {
+    expect(radix_sort_u64((Slice){.ptr = hashes, .len = count * sizeof(u64)}, arena) == 0);
+    for (usize i = 1; i < count; i++) expect(hashes[i - 1] != hashes[i]);
+}
+
+/// The SIMD accumulators must match the scalar ones stripe for stripe.
+static void test_variants(void) {
+    u64 expected[8], actual[8];
+    u32 expected_stripe, actual_stripe;
+
+    fill_random(data, DATA_LEN);
+    for (usize count = 0; count <= DATA_LEN / HASH_STRIPE; count++) {
+        hash_bulk_init(expected, count);
+        expected_stripe = (u32)(count % HASH_BLOCK_STRIPES);
+        actual_stripe   = expected_stripe;
+        hash_stripes_nosimd(expected, data, count, &expected_stripe);
+        hash_accumulate_nosimd(expected, data, hash_secret + HASH_LAST_KEY);
+
+#if defined(__x86_64__)
+        hash_bulk_init(actual, count);
+        actual_stripe = (u32)(count % HASH_BLOCK_STRIPES);
+        hash_stripes_sse2(actual, data, count, &actual_stripe);
+        hash_accumulate_sse2(actual, data, hash_secret + HASH_LAST_KEY);
+        expect(actual_stripe == expected_stripe);
+        for (u32 i = 0; i < 8; i++) expect(actual[i] == expected[i]);
+
+        if (cpu_features() & CPU_AVX2) {
+            hash_bulk_init(actual, count);
+            actual_stripe = (u32)(count % HASH_BLOCK_STRIPES);
+            hash_stripes_avx2(actual, data, count, &actual_stripe);
+            hash_accumulate_avx2(actual, data, hash_secret + HASH_LAST_KEY);
+            expect(actual_stripe == expected_stripe);
+            for (u32 i = 0; i < 8; i++) expect(actual[i] == expected[i]);
+        }
+#elif defined(__aarch64__)
+        hash_bulk_init(actual, count);
+        actual_stripe = (u32)(count % HASH_BLOCK_STRIPES);
+        hash_stripes_neon(actual, data, count, &actual_stripe);
+        hash_accumulate_neon(actual, data, hash_secret + HASH_LAST_KEY);
+        expect(actual_stripe == expected_stripe);
+        for (u32 i = 0; i < 8; i++) expect(actual[i] == expected[i]);
+#endif
+    }
+}
+
+/// Feeding random chunks must give the same digests as the one-shot hashes.
+static void test_stream(void) {
+    HashStream stream;
+    Hash128 expected, actual;
+    usize pos, chunk;
+
+    fill_random(data, DATA_LEN);
+    for (usize len = 0; len <= MAX_STREAM; len++) {
+        for (u32 round = 0; round < 3; round++) {
+            stream = hash_stream_init(len);
+            for (pos = 0; pos < len; pos += chunk) {
+                // Single bytes, small chunks and chunks that skip the buffer.
+                chunk = round == 0 ? 1 : (usize)(rng_next() % (round == 1 ? 80 : 700));
+                if (chunk > len - pos) chunk = len - pos;
+                hash_stream_update(&stream, (Slice){.ptr = data + pos, .len = chunk});
+            }
+
+            expected = hash128((Slice){.ptr = data, .len = len}, len);
+            actual   = hash_stream_digest128(&stream);
+            expect(actual.lo == expected.lo && actual.hi == expected.hi);
+            expect(hash_stream_digest64(&stream) == expected.lo);
+        }
+    }
+
+    // Digests don't end the stream.
+    stream = hash_stream_init(0);
+    hash_stream_update(&stream, (Slice){.ptr = data, .len = 1000});
+    expect(hash_stream_digest64(&stream) == hash64((Slice){.ptr = data, .len = 1000}, 0));
+    hash_stream_update(&stream, (Slice){.ptr = data + 1000, .len = 1000});
+    expect(hash_stream_digest64(&stream) == hash64((Slice){.ptr = data, .len = 2000}, 0));
+}
+
+/// Flipping any input bit must flip every output bit about half of the time.
+static void test_avalanche(void) {
+    static const usize sizes[] = {1, 3, 4, 8, 12, 16, 17, 40, 49, 100, 256, 257, 300, 1024, 4096};
+    Hash128 base, flipped;
+    usize bits, step;
+    u64 diff;
+
+    for (usize s = 0; s < sizeof(sizes) / sizeof(sizes[0]); s++) {
+        bits = sizes[s] * 8;
+        // Long keys only have a sample of their bits flipped.
+        step = (bits + MAX_BITS - 1) / MAX_BITS;
+        for (usize bit = 0; bit < bits; bit += step) {
+            for (u32 out = 0; out < 128; out++) flips[bit / step][out] = 0;
+        }
+
+        for (u32 sample = 0; sample < AVALANCHE; sample++) {
+            fill_random(key, sizes[s]);
+            base = hash128((Slice){.ptr = key, .len = sizes[s]}, sample);
+
+            for (usize bit = 0; bit < bits; bit += step) {
+                key[bit / 8] ^= (u8)(1 << (bit % 8));
+                flipped = hash128((Slice){.ptr = key, .len = sizes[s]}, sample);
+                key[bit / 8] ^= (u8)(1 << (bit % 8));
+
+                for (u32 out = 0; out < 64; out++) {
+                    diff = base.lo ^ flipped.lo;
+                    flips[bit / step][out] += (diff >> out) & 1;
+                    diff = base.hi ^ flipped.hi;
+                    flips[bit / step][out + 64] += (diff >> out) & 1;
+                }
+            }
+        }
+
+        // The expected count is 128 with a standard deviation of 8.
+        for (usize bit = 0; bit < bits; bit += step) {
+            for (u32 out = 0; out < 128; out++) {
+                expect(flips[bit / step][out] > 128 - 48 && flips[bit / step][out] < 128 + 48);
+            }
+        }
+    }
+}
+
+/// Sequential, sparse and zero keys, and different seeds.
+static void test_collisions(u64 *hashes, u64 *his, ArenaAllocator *arena) {
+    Hash128 hash;
+    usize top;
+
+    // Sequential integers. The top 32 bits are expected to collide 8 times.
+    for (u64 i = 0; i < KEYS; i++) {
+        hash      = hash128((Slice){.ptr = &i, .len = sizeof(u64)}, 0);
+        hashes[i] = hash.lo;
+        his[i]    = hash.hi;
+        expect(hash_u64(i, 0) == hash.lo);
+    }
+    expect_distinct(his, KEYS, arena);
+    expect_distinct(hashes, KEYS, arena);
+    top = 0;
+    for (usize i = 1; i < KEYS; i++) top += (hashes[i - 1] >> 32) == (hashes[i] >> 32);
+    expect(top < 32);
+
+    // Keys of 64 zero bytes with two bits set.
+    for (usize i = 0; i < 64; i++) key[i] = 0;
+    top = 0;
+    for (usize a = 0; a < 512; a++) {
+        for (usize b = a + 1; b < 512; b += 4) {
+            key[a / 8] ^= (u8)(1 << (a % 8));
+            key[b / 8] ^= (u8)(1 << (b % 8));
+            hashes[top++] = hash64((Slice){.ptr = key, .len = 64}, 0);
+            key[a / 8] ^= (u8)(1 << (a % 8));
+            key[b / 8] ^= (u8)(1 << (b % 8));
+        }
+    }
+    expect_distinct(hashes, top, arena);
+
+    // Every length of zeroes.
+    for (usize i = 0; i < DATA_LEN; i++) data[i] = 0;
+    for (usize len = 0; len <= DATA_LEN; len++) {
+        hashes[len] = hash64((Slice){.ptr = data, .len = len}, 0);
+    }
+    expect_distinct(hashes, DATA_LEN + 1, arena);
+
+    // The same key with different seeds.
+    for (u64 seed = 0; seed < KEYS; seed++) {
+        hashes[seed] = hash64((Slice){.ptr = data, .len = 300}, seed);
+    }
+    expect_distinct(hashes, KEYS, arena);
+}
+
+TEST_ENTRY extern void _start(void) {
+    PageAllocator pages  = page_init((KEYS * sizeof(u64) * 4) / PAGE_SIZE + 4);
+    ArenaAllocator arena = arena_init(pages.mem, pages.len);
+    Allocator allocator  = arena_allocator(&arena);
+    u64 *hashes          = mem_alloc(allocator, KEYS * sizeof(u64));
+    u64 *his             = mem_alloc(allocator, KEYS * sizeof(u64));
+
+    expect(pages.mem != nullptr);
+
+    test_variants();
+    test_stream();
+    test_avalanche();
+    test_collisions(hashes, his, &arena);
+
+    // The hashes are stable so they can be stored.
+    for (usize i = 0; i < DATA_LEN; i++) data[i] = (u8)i;
+    expect(hash64((Slice){.ptr = data, .len = 0}, 0) == 0x93228a4de0eec5a2);
+    expect(hash64((Slice){.ptr = data, .len = 7}, 0) == 0x094e98feb6055cc6);
+    expect(hash64((Slice){.ptr = data, .len = 100}, 0) == 0x77ed9a7dfb9ac9b7);
+    expect(hash64((Slice){.ptr = data, .len = 4000}, 42) == 0x10b90b365884e200);
+    expect(hash128((Slice){.ptr = data, .len = 4000}, 42).hi == 0x374fdf5368706af4);
+
+    page_deinit(&pages);
+    SYSCALL(SYS_exit, 1, 0);
+
+    __builtin_unreachable();
+}
@@ -0,0 +1,177 @@
+#include "clang-ignore.h"
+#include "swiftc/swiftc.h"
+#include "testing.h"
+
+#define ENTRIES 3000
+#define STRIDE  64
+#define BATCH   8
+
+static u8 data[ENTRIES * STRIDE];
+static u8 received[ENTRIES * STRIDE];
+static Slice storage[ENTRIES];
+
+/// Opens a pair of connected local sockets.
+static void open_pair(i32 *fds, u32 type) {
+    expect(linux_get_syserrno(SYSCALL(SYS_socketpair, 4, AF_UNIX, type, 0, (usize)fds)) ==
+           SE_SUCCESS);
+}
+
+static void close_pair(const i32 *fds) {
+    SYSCALL(SYS_close, 1, (usize)fds[0]);
+    SYSCALL(SYS_close, 1, (usize)fds[1]);
+}
+
+static void test_builder(void) {
+    IovBuilder iov = iov_init(storage, 4);
+
+    // Adjacent slices of the same buffer end up in one entry.
+    expect(iov_push(&iov, (Slice){.ptr = data, .len = 10}) == 0);
+    expect(iov_push(&iov, (Slice){.ptr = data + 10, .len = 5}) == 0);
+    expect(iov_push(&iov, (Slice){.ptr = data + 15, .len = 0}) == 0);
+    expect(iov.len == 1 && storage[0].len == 15 && iov.pending == 15);
+
+    expect(iov_push(&iov, (Slice){.ptr = data + 20, .len = 1}) == 0);
+    expect(iov_push(&iov, (Slice){.ptr = data + 30, .len = 1}) == 0);
+    expect(iov_push(&iov, (Slice){.ptr = data + 40, .len = 1}) == 0);
+    expect(iov_push(&iov, (Slice){.ptr = data + 50, .len = 1}) == 1);
+    // The last entry can still grow.
+    expect(iov_push(&iov, (Slice){.ptr = data + 41, .len = 2}) == 0);
+    expect(iov.len == 4 && iov.pending == 20);
+
+    // Partially written entries are trimmed and written ones make room.
+    iov_advance(&iov, 16);
+    expect(iov.head == 2 && iov.pending == 4);
+    iov_advance(&iov, 0);
+    expect(iov.head == 2);
+    expect(iov_push(&iov, (Slice){.ptr = data + 60, .len = 1}) == 0);
+    expect(iov.head == 0 && iov.len == 3 && storage[2].ptr == data + 60);
+
+    iov_advance(&iov, 1);
+    expect(iov.head == 1 && storage[1].ptr == data + 40 && storage[1].len == 3);
+    iov_advance(&iov, 4);
+    expect(iov.head == 0 && iov.len == 0 && iov.pending == 0);
+}
+
+/// Scattered reads and gathered writes of a stream socket.
+static void test_vectored(void) {
+    Slice out[3], in[2];
+    i32 fds[2];
+
+    open_pair(fds, SOCK_STREAM);
+    for (usize i = 0; i < 64; i++) data[i] = (u8)i;
+
+    out[0] = (Slice){.ptr = data + 32, .len = 32};
+    out[1] = (Slice){.ptr = data, .len = 16};
+    out[2] = (Slice){.ptr = data + 16, .len = 16};
+    expect(linux_writev(fds[0], out, 3) == 64);
+
+    in[0] = (Slice){.ptr = received, .len = 40};
+    in[1] = (Slice){.ptr = received + 100, .len = 100};
+    expect(linux_readv(fds[1], in, 2) == 64);
+    for (usize i = 0; i < 32; i++) expect(received[i] == i + 32);
+    for (usize i = 32; i < 40; i++) expect(received[i] == i - 32);
+    for (usize i = 0; i < 24; i++) expect(received[100 + i] == i + 8);
+
+    close_pair(fds);
+}
+
+/// Batches of datagrams made of two slices each.
+static void test_batched(void) {
+    MMsgHdr msgs[BATCH];
+    Slice out[BATCH][2], in[BATCH];
+    MsgHdr msg;
+    i32 fds[2];
+
+    open_pair(fds, SOCK_DGRAM);
+    for (usize i = 0; i < 256; i++) data[i] = (u8)i;
+
+    for (u32 m = 0; m < BATCH; m++) {
+        out[m][0] = (Slice){.ptr = data + m, .len = 1};
+        out[m][1] = (Slice){.ptr = data + 100, .len = m};
+        msgs[m]   = (MMsgHdr){.hdr = {.iov = out[m], .iov_len = 2}};
+    }
+    expect(linux_sendmmsg(fds[0], msgs, BATCH, MSG_NOSIGNAL) == BATCH);
+    for (u32 m = 0; m < BATCH; m++) expect(msgs[m].len == m + 1);
+
+    for (u32 m = 0; m < BATCH; m++) {
+        in[m]   = (Slice){.ptr = received + m * 16, .len = 16};
+        msgs[m] = (MMsgHdr){.hdr = {.iov = &in[m], .iov_len = 1}};
+    }
+    expect(linux_recvmmsg(fds[1], msgs, BATCH, MSG_DONTWAIT) == BATCH);
+    for (u32 m = 0; m < BATCH; m++) {
+        expect(msgs[m].len == m + 1 && received[m * 16] == m);
+        for (u32 i = 0; i < m; i++) expect(received[m * 16 + 1 + i] == 100 + i);
+    }
+
+    // A single message with sendmsg/recvmsg, truncated on the way in.
+    msg = (MsgHdr){.iov = out[5], .iov_len = 2};
+    expect(linux_sendmsg(fds[0], &msg, MSG_NOSIGNAL) == 6);
+    in[0] = (Slice){.ptr = received, .len = 4};
+    msg   = (MsgHdr){.iov = in, .iov_len = 1};
+    expect(linux_recvmsg(fds[1], &msg, 0) == 4);
+    expect((msg.flags & MSG_TRUNC) != 0 && received[0] == 5 && received[3] == 102);
+
+    close_pair(fds);
+}
+
+/// More entries than `IOV_MAX` through a nonblocking socket with a small
+/// buffer, so the flush stops early again and again.
+static void test_partial(void) {
+    IovBuilder iov  = iov_init(storage, ENTRIES);
+    i32 bufsize     = 4096;
+    usize read_pos  = 0;
+    usize written   = 0;
+    usize total     = 0;
+    u32 flushes     = 0;
+    usize r, pos;
+    i32 fds[2];
+
+    open_pair(fds, SOCK_STREAM | SOCK_NONBLOCK);
+    SYSCALL(SYS_setsockopt, 5, (usize)fds[0], SOL_SOCKET, SO_SNDBUF, (usize)&bufsize,
+            sizeof(bufsize));
+    for (usize i = 0; i < sizeof(data); i++) data[i] = (u8)(i * 13);
+
+    // Gaps between the slices so nothing is coalesced.
+    for (usize i = 0; i < ENTRIES; i++) {
+        expect(iov_push(&iov, (Slice){.ptr = data + i * STRIDE, .len = 1 + i % 48}) == 0);
+        total += 1 + i % 48;
+    }
+    expect(iov.len == ENTRIES && iov.pending == total);
+
+    while (iov.pending > 0) {
+        r = iov_flush(&iov, fds[0], 1, MSG_NOSIGNAL);
+        if (linux_get_syserrno(r) == SE_AGAIN) r = 0;
+        expect(linux_get_syserrno(r) == SE_SUCCESS);
+        written += r;
+        flushes++;
+
+        r = SYSCALL(SYS_read, 3, (usize)fds[1], (usize)(received + read_pos),
+                    sizeof(received) - read_pos);
+        if (linux_get_syserrno(r) != SE_AGAIN) read_pos += r;
+    }
+    while (read_pos < written) {
+        r = SYSCALL(SYS_read, 3, (usize)fds[1], (usize)(received + read_pos),
+                    sizeof(received) - read_pos);
+        expect(linux_get_syserrno(r) == SE_SUCCESS);
+        read_pos += r;
+    }
+
+    expect(written == total && read_pos == total && flushes > 1);
+    pos = 0;
+    for (usize i = 0; i < ENTRIES; i++) {
+        for (usize j = 0; j <= i % 48; j++) expect(received[pos++] == (u8)((i * STRIDE + j) * 13));
+    }
+
+    close_pair(fds);
+}
+
+TEST_ENTRY extern void _start(void) {
+    test_builder();
+    test_vectored();
+    test_batched();
+    test_partial();
+
+    SYSCALL(SYS_exit, 1, 0);
+
+    __builtin_unreachable();
+}
@@ -0,0 +1,157 @@
+#include "clang-ignore.h"
+#include "swiftc/swiftc.h"
+#include "testing.h"
+
+#define ROUNDS 20000
+
+static u8 chunk[3 * 16384];
+static u8 out[3 * 16384];
+static u64 rng_state = 0x9e3779b97f4a7c15;
+
+static u64 rng_next(void) {
+    rng_state ^= rng_state << 13;
+    rng_state ^= rng_state >> 7;
+    rng_state ^= rng_state << 17;
+    return rng_state;
+}
+
+/// Both halves must be views of the same memory.
+static void test_mirror(MirrorRing *ring) {
+    usize cap = ring->capacity;
+
+    for (usize i = 0; i < cap; i += 509) {
+        ring->mem[i] = (u8)i;
+        expect(ring->mem[cap + i] == (u8)i);
+        ring->mem[cap + i] = (u8)~i;
+        expect(ring->mem[i] == (u8)~i);
+    }
+}
+
+/// Pushes and pops random chunks, which wrap around again and again, and
+/// checks that every byte comes out in order.
+static void test_stream(MirrorRing *ring, u8 spsc) {
+    u64 written = ring->head, read = ring->tail;
+    usize max   = ring->capacity / 3 < sizeof(chunk) ? ring->capacity / 3 : sizeof(chunk);
+    usize len, n;
+    Slice span;
+
+    for (u32 round = 0; round < ROUNDS; round++) {
+        len = (usize)(rng_next() % (max + 1));
+        for (usize i = 0; i < len; i++) chunk[i] = (u8)((written + i) * 7);
+
+        span = spsc ? mirror_ring_spsc_write_span(ring, len) : mirror_ring_write_span(ring);
+        // A span too short for the chunk is all the space there is.
+        if (len > span.len) expect(span.len == ring->capacity - (written - read));
+        if (len <= span.len) {
+            // A single copy even when the span crosses the end of the ring.
+            mem_copy(span.ptr, chunk, len);
+            if (spsc) mirror_ring_spsc_commit(ring, len);
+            else mirror_ring_commit(ring, len);
+            written += len;
+            // The consumer sees a commit as soon as it wants more. Only every
+            // fourth round, so the other rounds run on stale cursors.
+            if (spsc && round % 4 == 0) {
+                expect(mirror_ring_spsc_read_span(ring, ring->capacity).len == written - read);
+            }
+        } else if (!spsc) {
+            expect(mirror_ring_push(ring, (Slice){.ptr = chunk, .len = len}) == 1);
+        }
+
+        len  = (usize)(rng_next() % (max + 1));
+        span = spsc ? mirror_ring_spsc_read_span(ring, len) : mirror_ring_read_span(ring);
+        if (len > span.len) expect(span.len == written - read);
+        n = len < span.len ? len : span.len;
+        for (usize i = 0; i < n; i++) expect(((u8 *)span.ptr)[i] == (u8)((read + i) * 7));
+        if (spsc) mirror_ring_spsc_consume(ring, n);
+        else mirror_ring_consume(ring, n);
+        read += n;
+
+        // The producer sees a consume as soon as it wants more.
+        if (spsc && round % 4 == 2) {
+            expect(mirror_ring_spsc_write_span(ring, ring->capacity).len ==
+                   ring->capacity - (written - read));
+        }
+        expect(ring->head == written && ring->tail == read);
+        expect(mirror_ring_len(ring) == written - read);
+    }
+
+    // Drain what's left with `pop`.
+    while ((n = mirror_ring_pop(ring, (Slice){.ptr = out, .len = sizeof(out)})) > 0) {
+        for (usize i = 0; i < n; i++) expect(out[i] == (u8)((read + i) * 7));
+        read += n;
+    }
+    expect(read == written && mirror_ring_len(ring) == 0);
+    expect(mirror_ring_write_span(ring).len == ring->capacity);
+}
+
+/// A span across the end of the ring goes through `write` and `read` in a
+/// single syscall.
+static void test_syscalls(MirrorRing *ring) {
+    i32 fds[2];
+    usize cap = ring->capacity;
+    Slice span;
+
+    expect(linux_get_syserrno(SYSCALL(SYS_pipe2, 2, (usize)fds, 0)) == SE_SUCCESS);
+
+    ring->head = ring->tail = cap * 5 - 100;
+    for (usize i = 0; i < 200; i++) chunk[i] = (u8)(i + 1);
+    expect(mirror_ring_push(ring, (Slice){.ptr = chunk, .len = 200}) == 0);
+    expect(ring->mem[cap - 100] == 1 && ring->mem[99] == 200);
+
+    span = mirror_ring_read_span(ring);
+    expect(SYSCALL(SYS_write, 3, (usize)fds[1], (usize)span.ptr, span.len) == 200);
+    mirror_ring_consume(ring, 200);
+
+    ring->head = ring->tail = cap * 7 - 50;
+    span       = mirror_ring_write_span(ring);
+    expect(SYSCALL(SYS_read, 3, (usize)fds[0], (usize)span.ptr, 200) == 200);
+    mirror_ring_commit(ring, 200);
+    expect(ring->mem[cap - 50] == 1 && ring->mem[149] == 200);
+    expect(mirror_ring_pop(ring, (Slice){.ptr = out, .len = 300}) == 200);
+    for (usize i = 0; i < 200; i++) expect(out[i] == (u8)(i + 1));
+
+    SYSCALL(SYS_close, 1, (usize)fds[0]);
+    SYSCALL(SYS_close, 1, (usize)fds[1]);
+}
+
+static void test_ring(usize min_capacity, usize granularity) {
+    MirrorRing ring = mirror_ring_init_granular(min_capacity, granularity);
+
+    expect(ring.mem != nullptr);
+    expect(ring.capacity >= min_capacity && ring.capacity % granularity == 0);
+    expect((ring.capacity & (ring.capacity - 1)) == 0);
+
+    test_mirror(&ring);
+    test_stream(&ring, 0);
+    test_syscalls(&ring);
+
+    mirror_ring_deinit(&ring);
+    expect(ring.mem == nullptr);
+
+    // The SPSC cursor caches assume the ring was only used through them.
+    ring = mirror_ring_init_granular(min_capacity, granularity);
+    expect(ring.mem != nullptr);
+    test_stream(&ring, 1);
+    mirror_ring_deinit(&ring);
+}
+
+TEST_ENTRY extern void _start(void) {
+    usize page = os_page_size();
+
+    expect(page >= 4096 && (page & (page - 1)) == 0);
+
+    // Rings on 16K boundaries work the same on 4K and 16K page kernels.
+    test_ring(1, page);
+    test_ring(page + 1, page);
+    test_ring(1, 16384 > page ? 16384 : page);
+    test_ring(40000, 16384 > page ? 16384 : page);
+    test_ring(1 << 20, page);
+
+    // A granularity that isn't a multiple of the page size.
+    expect(mirror_ring_init_granular(1, page / 2).mem == nullptr);
+    expect(mirror_ring_init_granular(1, page * 3).mem == nullptr);
+
+    SYSCALL(SYS_exit, 1, 0);
+
+    __builtin_unreachable();
+}
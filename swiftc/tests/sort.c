@@ -0,0 +1,150 @@
+#include "clang-ignore.h"
+#include "swiftc/swiftc.h"
+#include "testing.h"
+
+#define SORT_NAME      sort_u64_asc
+#define SORT_TYPE      u64
+#define SORT_LESS(a, b) ((a) < (b))
+#include "swiftc/sort/pdqsort_typed.h"
+
+#define COUNT 100000
+
+static u64 rng_state;
+
+static u64 rng_next(void) {
+    rng_state ^= rng_state << 13;
+    rng_state ^= rng_state >> 7;
+    rng_state ^= rng_state << 17;
+    return rng_state;
+}
+
+static u8 less_u64(const void *a, const void *b, void *ctx) {
+    (void)ctx;
+    return *(const u64 *)a < *(const u64 *)b;
+}
+
+/// Fills `items` with the pattern with the given index. The same pattern always
+/// produces the same items.
+static void fill(u64 *items, usize count, u32 pattern) {
+    rng_state = 0x9e3779b97f4a7c15;
+    for (usize i = 0; i < count; i++) {
+        switch (pattern) {
+        case 0: items[i] = rng_next(); break;
+        case 1: items[i] = i; break;
+        case 2: items[i] = count - i; break;
+        case 3: items[i] = i % 1000; break;
+        case 4: items[i] = rng_next() % 16; break;
+        default: items[i] = 42; break;
+        }
+    }
+}
+
+static u64 checksum(const u64 *items, usize count) {
+    u64 sum = 0;
+    for (usize i = 0; i < count; i++) sum += items[i] * 0x100000001b3 + (items[i] >> 7);
+    return sum;
+}
+
+static void expect_sorted(const u64 *items, usize count, u64 sum) {
+    for (usize i = 1; i < count; i++) expect(items[i - 1] <= items[i]);
+    expect(checksum(items, count) == sum);
+}
+
+/// Runs a parallel sort with `workers` workers on this thread, calling the
+/// phase of every worker in turn before the next phase.
+static void radix_interleaved(Slice items, usize size, u32 workers, ArenaAllocator *arena) {
+    RadixParallel parallel;
+    usize mark = arena->pos;
+
+    expect(radix_parallel_init(&parallel, items, size, workers, arena) == 0);
+    for (u32 phase = 0; phase < radix_parallel_phases(&parallel); phase++) {
+        for (u32 worker = 0; worker < workers; worker++) {
+            radix_parallel_step(&parallel, worker, phase);
+        }
+    }
+    arena->pos = mark;
+}
+
+TEST_ENTRY extern void _start(void) {
+    PageAllocator pages  = page_init((COUNT * sizeof(SortKV) * 5) / PAGE_SIZE + 4);
+    ArenaAllocator arena = arena_init(pages.mem, pages.len);
+    Allocator allocator  = arena_allocator(&arena);
+    u64 *items           = mem_alloc(allocator, COUNT * sizeof(u64));
+    SortKV *pairs        = mem_alloc(allocator, COUNT * sizeof(SortKV));
+    SortKV *kv_sorted    = mem_alloc(allocator, COUNT * sizeof(SortKV));
+    u32 *halves          = mem_alloc(allocator, COUNT * sizeof(u32));
+    Slice slice          = {.ptr = items, .len = COUNT * sizeof(u64)};
+    RadixParallel parallel;
+    usize mark;
+    u64 sum;
+
+    expect(pages.mem != nullptr);
+
+    for (u32 pattern = 0; pattern < 6; pattern++) {
+        fill(items, COUNT, pattern);
+        sum = checksum(items, COUNT);
+        sort_pdq(slice, sizeof(u64), less_u64, nullptr);
+        expect_sorted(items, COUNT, sum);
+
+        fill(items, COUNT, pattern);
+        sort_u64_asc(items, COUNT);
+        expect_sorted(items, COUNT, sum);
+
+        fill(items, COUNT, pattern);
+        expect(radix_sort_u64(slice, &arena) == 0);
+        expect_sorted(items, COUNT, sum);
+
+        fill(items, COUNT, pattern);
+        mark = arena.pos;
+        expect(radix_parallel_init(&parallel, slice, sizeof(u64), 1, &arena) == 0);
+        radix_parallel_run(&parallel, 0);
+        expect_sorted(items, COUNT, sum);
+        arena.pos = mark;
+
+        // The offsets of several workers, including ones with uneven chunks.
+        for (u32 workers = 2; workers <= 4; workers++) {
+            fill(items, COUNT, pattern);
+            radix_interleaved(slice, sizeof(u64), workers, &arena);
+            expect_sorted(items, COUNT, sum);
+        }
+
+        // Stability: equal keys keep the order of their values.
+        fill(items, COUNT, pattern);
+        for (usize i = 0; i < COUNT; i++) pairs[i] = (SortKV){.key = items[i], .value = i};
+        expect(radix_sort_kv((Slice){.ptr = pairs, .len = COUNT * sizeof(SortKV)}, &arena) == 0);
+        for (usize i = 1; i < COUNT; i++) {
+            expect(pairs[i - 1].key <= pairs[i].key);
+            if (pairs[i - 1].key == pairs[i].key) expect(pairs[i - 1].value < pairs[i].value);
+        }
+
+        // The same order from three workers.
+        for (usize i = 0; i < COUNT; i++) {
+            kv_sorted[i] = pairs[i];
+            pairs[i]     = (SortKV){.key = items[i], .value = i};
+        }
+        radix_interleaved((Slice){.ptr = pairs, .len = COUNT * sizeof(SortKV)}, sizeof(SortKV), 3,
+                          &arena);
+        for (usize i = 0; i < COUNT; i++) {
+            expect(pairs[i].key == kv_sorted[i].key && pairs[i].value == kv_sorted[i].value);
+        }
+
+        fill(items, COUNT, pattern);
+        for (usize i = 0; i < COUNT; i++) halves[i] = (u32)items[i];
+        expect(radix_sort_u32((Slice){.ptr = halves, .len = COUNT * sizeof(u32)}, &arena) == 0);
+        for (usize i = 1; i < COUNT; i++) expect(halves[i - 1] <= halves[i]);
+
+        for (usize i = 0; i < COUNT; i++) kv_sorted[i].key = halves[i];
+        for (usize i = 0; i < COUNT; i++) halves[i] = (u32)items[i];
+        radix_interleaved((Slice){.ptr = halves, .len = COUNT * sizeof(u32)}, sizeof(u32), 4,
+                          &arena);
+        for (usize i = 0; i < COUNT; i++) expect(halves[i] == kv_sorted[i].key);
+    }
+
+    // The scratch buffer doesn't fit.
+    expect(radix_sort_u64(slice, &(ArenaAllocator){.mem = nullptr, .len = 0, .pos = 0}) == 1);
+
+    page_deinit(&pages);
+    SYSCALL(SYS_exit, 1, 0);
+
+    __builtin_unreachable();
+}
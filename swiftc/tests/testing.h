@@ -0,0 +1,16 @@
+#pragma once
+
+#include "swiftc/swiftc.h"
+
+#if defined(__x86_64__)
+    // `_start` is entered with a 16-byte aligned stack instead of the one a
+    // `call` leaves behind, so it's realigned for the vectorized code.
+    #define TEST_ENTRY __attribute__((noreturn, force_align_arg_pointer))
+#else
+    #define TEST_ENTRY __attribute__((noreturn))
+#endif
+
+/// Exits the test with a failure status unless `cond` holds.
+static void expect(i32 cond) {
+    if (!cond) SYSCALL(SYS_exit, 1, 1);
+}
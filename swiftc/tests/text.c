@@ -0,0 +1,214 @@
+#include "clang-ignore.h"
+#include "swiftc/swiftc.h"
+#include "testing.h"
+
+#define FUZZ_LEN    1024
+#define FUZZ_ROUNDS 2000
+
+typedef struct {
+    const char *bytes;
+    usize len;
+    u8 valid;
+    u8 _padding[7];
+} Sample;
+
+#define SAMPLE(str, valid) {str, sizeof(str) - 1, valid, {0}}
+
+static const Sample samples[] = {
+    SAMPLE("", 1),
+    SAMPLE("a", 1),
+    SAMPLE("\xC2\xA9", 1),
+    SAMPLE("\xE2\x82\xAC", 1),
+    SAMPLE("\xF0\x9F\x98\x80", 1),
+    SAMPLE("\xEF\xBF\xBF", 1),
+    SAMPLE("\xF4\x8F\xBF\xBF", 1),
+    SAMPLE("\xED\x9F\xBF", 1),
+    SAMPLE("\xE0\xA0\x80", 1),
+    SAMPLE("\xF0\x90\x80\x80", 1),
+    // Truncated sequences.
+    SAMPLE("\xC2", 0),
+    SAMPLE("\xE2\x82", 0),
+    SAMPLE("\xF0\x9F\x98", 0),
+    // Stray continuation bytes.
+    SAMPLE("\x80", 0),
+    SAMPLE("\xC2\xA9\xA9", 0),
+    // Overlong encodings.
+    SAMPLE("\xC0\x80", 0),
+    SAMPLE("\xC1\xBF", 0),
+    SAMPLE("\xE0\x9F\xBF", 0),
+    SAMPLE("\xF0\x8F\xBF\xBF", 0),
+    // Surrogates and code points above U+10FFFF.
+    SAMPLE("\xED\xA0\x80", 0),
+    SAMPLE("\xF4\x90\x80\x80", 0),
+    SAMPLE("\xF5\x80\x80\x80", 0),
+    SAMPLE("\xFF", 0),
+    // A lead byte interrupted by ASCII or another lead byte.
+    SAMPLE("\xE2\x82" "a", 0),
+    SAMPLE("\xC2\xC2\xA9", 0),
+};
+
+static u8 buffer[FUZZ_LEN];
+static u8 lower[256];
+static u8 upper[256];
+static u64 rng_state = 0x9e3779b97f4a7c15;
+
+static u64 rng_next(void) {
+    rng_state ^= rng_state << 13;
+    rng_state ^= rng_state >> 7;
+    rng_state ^= rng_state << 17;
+    return rng_state;
+}
+
+/// Runs every validator the CPU supports and expects all of them to agree with
+/// `valid`.
+static void expect_utf8(Slice text, u8 valid) {
+    expect(utf8_validate_nosimd(text) == valid);
+    expect(utf8_validate(text) == valid);
+#if defined(__x86_64__)
+    if (cpu_features() & CPU_SSE42) expect(utf8_validate_sse42(text) == valid);
+    if (cpu_features() & CPU_AVX2) expect(utf8_validate_avx2(text) == valid);
+#elif defined(__aarch64__)
+    expect(utf8_validate_neon(text) == valid);
+#endif
+}
+
+/// Places every sample at every offset around the 16 and 32-byte block
+/// boundaries of an ASCII buffer.
+static void test_samples(void) {
+    for (usize s = 0; s < sizeof(samples) / sizeof(samples[0]); s++) {
+        for (usize offset = 0; offset < 70; offset++) {
+            for (usize i = 0; i < sizeof(buffer); i++) buffer[i] = 'x';
+            for (usize i = 0; i < samples[s].len; i++) buffer[offset + i] = (u8)samples[s].bytes[i];
+
+            // The sample in the middle of the text and at its very end.
+            expect_utf8((Slice){.ptr = buffer, .len = 128}, samples[s].valid);
+            expect_utf8((Slice){.ptr = buffer, .len = offset + samples[s].len}, samples[s].valid);
+        }
+    }
+}
+
+/// Writes random code points of every length to `buffer`.
+static void fill_utf8(void) {
+    usize i = 0;
+    u32 cp;
+
+    while (i + 4 <= sizeof(buffer)) {
+        switch (rng_next() % 4) {
+        case 0: buffer[i++] = (u8)(rng_next() % 0x80); break;
+        case 1:
+            cp            = 0x80 + (u32)(rng_next() % (0x800 - 0x80));
+            buffer[i++] = (u8)(0xC0 | (cp >> 6));
+            buffer[i++] = (u8)(0x80 | (cp & 0x3F));
+            break;
+        case 2:
+            cp = 0x800 + (u32)(rng_next() % (0x10000 - 0x800));
+            if (cp >= 0xD800 && cp <= 0xDFFF) cp -= 0x800;
+            buffer[i++] = (u8)(0xE0 | (cp >> 12));
+            buffer[i++] = (u8)(0x80 | ((cp >> 6) & 0x3F));
+            buffer[i++] = (u8)(0x80 | (cp & 0x3F));
+            break;
+        default:
+            cp          = 0x10000 + (u32)(rng_next() % (0x110000 - 0x10000));
+            buffer[i++] = (u8)(0xF0 | (cp >> 18));
+            buffer[i++] = (u8)(0x80 | ((cp >> 12) & 0x3F));
+            buffer[i++] = (u8)(0x80 | ((cp >> 6) & 0x3F));
+            buffer[i++] = (u8)(0x80 | (cp & 0x3F));
+            break;
+        }
+    }
+    for (; i < sizeof(buffer); i++) buffer[i] = 'x';
+}
+
+/// Cross-checks the SIMD validators against the scalar one on random text
+/// with a few random bytes flipped.
+static void test_fuzz(void) {
+    Slice text = {.ptr = buffer, .len = sizeof(buffer)};
+    u8 valid;
+
+    for (u32 round = 0; round < FUZZ_ROUNDS; round++) {
+        fill_utf8();
+        expect_utf8(text, 1);
+
+        for (u64 flips = rng_next() % 3 + 1; flips > 0; flips--) {
+            buffer[rng_next() % sizeof(buffer)] = (u8)rng_next();
+        }
+        valid = utf8_validate_nosimd(text);
+        expect_utf8(text, valid);
+
+        // A random prefix can cut a sequence short.
+        text.len = rng_next() % sizeof(buffer);
+        expect_utf8(text, utf8_validate_nosimd(text));
+        text.len = sizeof(buffer);
+    }
+}
+
+/// Folds all 256 byte values with every variant at every tail length.
+static void test_ascii(void) {
+    Slice text;
+
+    for (u32 c = 0; c < 256; c++) {
+        lower[c] = (c >= 'A' && c <= 'Z') ? (u8)(c + 32) : (u8)c;
+        upper[c] = (c >= 'a' && c <= 'z') ? (u8)(c - 32) : (u8)c;
+    }
+
+    for (usize len = 0; len <= 256; len += 1) {
+        text = (Slice){.ptr = buffer, .len = len};
+
+        for (usize i = 0; i < len; i++) buffer[i] = (u8)(i * 7 + len);
+        ascii_to_lower(text);
+        for (usize i = 0; i < len; i++) expect(buffer[i] == lower[(u8)(i * 7 + len)]);
+        ascii_to_upper(text);
+        for (usize i = 0; i < len; i++) expect(buffer[i] == upper[(u8)(i * 7 + len)]);
+
+        for (usize i = 0; i < len; i++) buffer[i] = (u8)(i * 7 + len);
+        ascii_lower_nosimd(text);
+        for (usize i = 0; i < len; i++) expect(buffer[i] == lower[(u8)(i * 7 + len)]);
+        ascii_upper_nosimd(text);
+        for (usize i = 0; i < len; i++) expect(buffer[i] == upper[(u8)(i * 7 + len)]);
+
+#if defined(__x86_64__)
+        for (usize i = 0; i < len; i++) buffer[i] = (u8)(i * 7 + len);
+        ascii_lower_sse2(text);
+        for (usize i = 0; i < len; i++) expect(buffer[i] == lower[(u8)(i * 7 + len)]);
+        ascii_upper_sse2(text);
+        for (usize i = 0; i < len; i++) expect(buffer[i] == upper[(u8)(i * 7 + len)]);
+#endif
+
+        // The upper half of the buffer is the same text with the case flipped.
+        for (usize i = 0; i < len; i++) {
+            buffer[i]       = (u8)(i * 7 + len);
+            buffer[i + 512] = lower[buffer[i]] == buffer[i] ? upper[buffer[i]] : lower[buffer[i]];
+        }
+        expect(ascii_eql_ignore_case(text, (Slice){.ptr = buffer + 512, .len = len}));
+        expect(ascii_eql_ignore_case_nosimd(text, (Slice){.ptr = buffer + 512, .len = len}));
+        if (len > 0) {
+            // Any other byte must be a mismatch, including the case bit of a
+            // non-letter.
+            buffer[len - 1 + 512] ^= 0x01;
+            expect(!ascii_eql_ignore_case(text, (Slice){.ptr = buffer + 512, .len = len}));
+            buffer[len - 1 + 512] ^= 0x01;
+            if (lower[buffer[len - 1]] == upper[buffer[len - 1]]) {
+                buffer[len - 1 + 512] ^= 0x20;
+                expect(!ascii_eql_ignore_case(text, (Slice){.ptr = buffer + 512, .len = len}));
+            }
+        }
+        expect(!ascii_eql_ignore_case(text, (Slice){.ptr = buffer + 512, .len = len + 1}));
+    }
+
+    // Multi-byte sequences are left alone.
+    buffer[0] = 0xC3;
+    buffer[1] = 0x84;
+    buffer[2] = 'Q';
+    ascii_to_lower((Slice){.ptr = buffer, .len = 3});
+    expect(buffer[0] == 0xC3 && buffer[1] == 0x84 && buffer[2] == 'q');
+}
+
+TEST_ENTRY extern void _start(void) {
+    test_samples();
+    test_fuzz();
+    test_ascii();
+
+    SYSCALL(SYS_exit, 1, 0);
+
+    __builtin_unreachable();
+}